@@ -0,0 +1,269 @@
+#include "asmemitter.h"
+#include "builtins.h"
+
+AsmEmitter::AsmEmitter(std::ostream& _out, const Library& library) : out(_out)
+{
+    for (auto it = library.functions.begin(); it != library.functions.end(); ++it)
+        functions.push_back("b_" + it->name);
+    line(".intel_syntax noprefix");
+    line(".text");
+}
+
+void AsmEmitter::line(const std::string& text)
+{
+    out<<"\t"<<text<<"\n";
+}
+
+std::string AsmEmitter::local(unsigned slot)
+{
+    return "qword ptr [rbp - " + std::to_string(8 * (slot + 1)) + "]";
+}
+
+std::string AsmEmitter::name(X64REG reg)
+{
+    static const char* names[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11"};
+    return names[static_cast<int>(reg)];
+}
+
+std::string AsmEmitter::name(X64OP op)
+{
+    static const char* names[] = {"add", "sub", "cmp", "mov"};
+    return names[static_cast<int>(op)];
+}
+
+std::string AsmEmitter::name(X64COND cond)
+{
+    static const char* names[] = {"e", "ne"};
+    return names[static_cast<int>(cond)];
+}
+
+void AsmEmitter::bind(unsigned label)
+{
+    out<<".L"<<label<<":\n";
+}
+
+void AsmEmitter::begin_function(unsigned index)
+{
+    out<<"\n";
+    line(".p2align 4");
+    line(".globl " + functions[index]);
+    line(".type " + functions[index] + ", @function");
+    out<<functions[index]<<":\n";
+}
+
+void AsmEmitter::end_function(unsigned index)
+{
+    out<<".Lend_"<<functions[index]<<":\n";
+    line(".size " + functions[index] + ", .-" + functions[index]);
+}
+
+void AsmEmitter::finish(const std::vector<Word>& statics)
+{
+    for (auto it = builtin_values.begin(); it != builtin_values.end(); ++it)
+    {
+        out<<"\n";
+        line(".p2align 3");
+        out<<".Lbuiltin_"<<builtins[*it].name<<":\n";
+        line("jmp brt_" + builtins[*it].name + "@PLT");
+    }
+
+    // where each function's code is, for the runtime to name the one a fault is in
+    out<<"\n";
+    line(".section .data.rel.ro");
+    line(".p2align 3");
+    line(".globl b_functions");
+    out<<"b_functions:\n";
+    for (auto it = functions.begin(); it != functions.end(); ++it)
+        line(".quad " + *it + ", .Lend_" + *it + ", .Lname_" + *it);
+    line(".quad 0, 0, 0");
+    line(".section .rodata");
+    for (auto it = functions.begin(); it != functions.end(); ++it)
+    {
+        out<<".Lname_"<<*it<<":\n";
+        line(".asciz \"" + it->substr(2) + "\"");
+    }
+
+    if (!statics.empty())
+    {
+        out<<"\n";
+        line(".data");
+        line(".p2align 3");
+        out<<".Lstatics:\n";
+        for (auto it = statics.begin(); it != statics.end(); ++it)
+            line(".quad " + std::to_string(*it));
+    }
+    line(".section .note.GNU-stack,\"\",@progbits");
+}
+
+void AsmEmitter::push(X64REG reg)
+{
+    line("push " + name(reg));
+}
+
+void AsmEmitter::pop(X64REG reg)
+{
+    line("pop " + name(reg));
+}
+
+void AsmEmitter::mov_imm(X64REG reg, Word value)
+{
+    if (value == 0)
+        line("xor " + name(reg) + ", " + name(reg));
+    else if (value >= INT32_MIN && value <= INT32_MAX)
+        line("mov " + name(reg) + ", " + std::to_string(value));
+    else
+        line("movabs " + name(reg) + ", " + std::to_string(value));
+}
+
+void AsmEmitter::alu(X64OP op, X64REG dst, X64REG src)
+{
+    line(name(op) + " " + name(dst) + ", " + name(src));
+}
+
+void AsmEmitter::alu_imm(X64OP op, X64REG dst, std::int32_t value)
+{
+    line(name(op) + " " + name(dst) + ", " + std::to_string(value));
+}
+
+void AsmEmitter::alu_local(X64OP op, X64REG dst, unsigned slot)
+{
+    line(name(op) + " " + name(dst) + ", " + local(slot));
+}
+
+void AsmEmitter::alu_to_local(X64OP op, unsigned slot, X64REG src)
+{
+    line(name(op) + " " + local(slot) + ", " + name(src));
+}
+
+void AsmEmitter::alu_local_imm(X64OP op, unsigned slot, std::int32_t value)
+{
+    line(name(op) + " " + local(slot) + ", " + std::to_string(value));
+}
+
+void AsmEmitter::lea_local(X64REG dst, unsigned slot)
+{
+    line("lea " + name(dst) + ", [rbp - " + std::to_string(8 * (slot + 1)) + "]");
+}
+
+void AsmEmitter::load_param(X64REG dst, unsigned index)
+{
+    line("mov " + name(dst) + ", qword ptr [rbp + " + std::to_string(16 + 8 * index) + "]");
+}
+
+void AsmEmitter::store_param(unsigned index, X64REG src)
+{
+    line("mov qword ptr [rbp + " + std::to_string(16 + 8 * index) + "], " + name(src));
+}
+
+void AsmEmitter::load(X64REG dst, X64REG base)
+{
+    line("mov " + name(dst) + ", qword ptr [" + name(base) + "]");
+}
+
+void AsmEmitter::store(X64REG base, X64REG src)
+{
+    line("mov qword ptr [" + name(base) + "], " + name(src));
+}
+
+void AsmEmitter::load_stack(X64REG dst, std::int32_t offset)
+{
+    line("mov " + name(dst) + ", qword ptr [rsp + " + std::to_string(offset) + "]");
+}
+
+void AsmEmitter::push_stack(std::int32_t offset)
+{
+    line("push qword ptr [rsp + " + std::to_string(offset) + "]");
+}
+
+void AsmEmitter::shl(X64REG reg, unsigned bits)
+{
+    line("shl " + name(reg) + ", " + std::to_string(bits));
+}
+
+void AsmEmitter::shr(X64REG reg, unsigned bits)
+{
+    line("shr " + name(reg) + ", " + std::to_string(bits));
+}
+
+void AsmEmitter::neg(X64REG reg)
+{
+    line("neg " + name(reg));
+}
+
+void AsmEmitter::test(X64REG reg)
+{
+    line("test " + name(reg) + ", " + name(reg));
+}
+
+void AsmEmitter::setcc(X64COND cond, X64REG reg)
+{
+    static const char* low_bytes[] = {"al", "cl", "dl"};
+    std::string low = low_bytes[static_cast<int>(reg)];
+    line("set" + name(cond) + " " + low);
+    line("movzx " + name(reg) + ", " + low);
+}
+
+void AsmEmitter::jmp(unsigned label)
+{
+    line("jmp .L" + std::to_string(label));
+}
+
+void AsmEmitter::jcc(X64COND cond, unsigned label)
+{
+    line("j" + name(cond) + " .L" + std::to_string(label));
+}
+
+void AsmEmitter::call_function(unsigned index)
+{
+    line("call " + functions[index]);
+}
+
+void AsmEmitter::call_builtin(unsigned index)
+{
+    line("call brt_" + builtins[index].name + "@PLT");
+}
+
+void AsmEmitter::jump_function(unsigned index)
+{
+    line("jmp " + functions[index]);
+}
+
+void AsmEmitter::function_value(X64REG dst, unsigned index)
+{
+    line("lea " + name(dst) + ", [rip + " + functions[index] + "]");
+    shr(dst, 3);
+}
+
+void AsmEmitter::builtin_value(X64REG dst, unsigned index)
+{
+    builtin_values.insert(index);
+    line("lea " + name(dst) + ", [rip + .Lbuiltin_" + builtins[index].name + "]");
+    shr(dst, 3);
+}
+
+void AsmEmitter::call_value(X64REG reg)
+{
+    shl(reg, 3);
+    line("call " + name(reg));
+}
+
+void AsmEmitter::jump_value(X64REG reg)
+{
+    shl(reg, 3);
+    line("jmp " + name(reg));
+}
+
+void AsmEmitter::lea_string(X64REG dst, Word offset)
+{
+    line("lea " + name(dst) + ", [rip + .Lstatics + " + std::to_string(8 * offset) + "]");
+}
+
+void AsmEmitter::leave()
+{
+    line("leave");
+}
+
+void AsmEmitter::ret()
+{
+    line("ret");
+}
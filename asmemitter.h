@@ -0,0 +1,72 @@
+#ifndef H_ASMEMITTER
+#define H_ASMEMITTER
+
+#include <ostream>
+#include <set>
+#include <string>
+
+#include "x64emitter.h"
+#include "function.h"
+#include "library.h"
+
+/* Writes GNU assembler source (Intel syntax) for the System V ABI. Library
+ * functions become global symbols b_<name>, builtins are called through
+ * brt_<name> from the native runtime, see nativeruntime.cpp. The value of a
+ * function is its address shifted right by 3 like any other B address.
+ * b_functions lists where the code of each function begins and ends and
+ * its name, up to an entry of nulls. */
+class AsmEmitter : public X64Emitter
+{
+    std::ostream& out;
+    std::vector<std::string> functions;
+    std::set<unsigned> builtin_values;      // builtins whose address is taken get an aligned thunk
+
+    void line(const std::string& text);
+    std::string local(unsigned slot);
+    static std::string name(X64REG reg);
+    static std::string name(X64OP op);
+    static std::string name(X64COND cond);
+
+public:
+    AsmEmitter(std::ostream& _out, const Library& library);
+
+    void bind(unsigned label) override;
+    void begin_function(unsigned index) override;
+    void end_function(unsigned index) override;
+    void finish(const std::vector<Word>& statics) override;
+
+    void push(X64REG reg) override;
+    void pop(X64REG reg) override;
+    void mov_imm(X64REG reg, Word value) override;
+    void alu(X64OP op, X64REG dst, X64REG src) override;
+    void alu_imm(X64OP op, X64REG dst, std::int32_t value) override;
+    void alu_local(X64OP op, X64REG dst, unsigned slot) override;
+    void alu_to_local(X64OP op, unsigned slot, X64REG src) override;
+    void alu_local_imm(X64OP op, unsigned slot, std::int32_t value) override;
+    void lea_local(X64REG dst, unsigned slot) override;
+    void load_param(X64REG dst, unsigned index) override;
+    void store_param(unsigned index, X64REG src) override;
+    void load(X64REG dst, X64REG base) override;
+    void store(X64REG base, X64REG src) override;
+    void load_stack(X64REG dst, std::int32_t offset) override;
+    void push_stack(std::int32_t offset) override;
+    void shl(X64REG reg, unsigned bits) override;
+    void shr(X64REG reg, unsigned bits) override;
+    void neg(X64REG reg) override;
+    void test(X64REG reg) override;
+    void setcc(X64COND cond, X64REG reg) override;
+    void jmp(unsigned label) override;
+    void jcc(X64COND cond, unsigned label) override;
+    void call_function(unsigned index) override;
+    void call_builtin(unsigned index) override;
+    void jump_function(unsigned index) override;
+    void function_value(X64REG dst, unsigned index) override;
+    void builtin_value(X64REG dst, unsigned index) override;
+    void call_value(X64REG reg) override;
+    void jump_value(X64REG reg) override;
+    void lea_string(X64REG dst, Word offset) override;
+    void leave() override;
+    void ret() override;
+};
+
+#endif // H_ASMEMITTER
@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <system_error>
+#include <vector>
+
+#include "astcache.h"
+#include "lazyparser.h"
+#include "lang_syntax.h"
+
+namespace fs = std::filesystem;
+
+// bumped whenever the layout of an entry changes
+static const std::uint64_t format_version = 2;
+static const char magic[8] = {'B', 'A', 'S', 'T', 'C', 'A', 'C', 'H'};
+static const std::uint32_t absent = 0xffffffff;
+
+static const std::uint64_t multiplier = 0xc6a4a7935bd1e995ULL;
+
+static std::uint64_t read64(const char* p)
+{
+    std::uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static std::uint64_t scramble(std::uint64_t k)
+{
+    k *= multiplier;
+    k ^= k >> 47;
+    return k * multiplier;
+}
+
+// four independent lanes over 32-byte blocks, so that the multiplications overlap
+std::uint64_t AstCache::hash(const char* data, std::size_t size, std::uint64_t seed)
+{
+    std::uint64_t h = seed ^ (size * multiplier);
+    std::uint64_t lanes[4] = {h, h + 1, h + 2, h + 3};
+    const char* p = data;
+    for (const char* end = data + size / 32 * 32; p != end; p += 32)
+        for (int i = 0; i < 4; ++i)
+            lanes[i] = (lanes[i] ^ scramble(read64(p + 8 * i))) * multiplier;
+    for (int i = 0; i < 4; ++i)
+        h = (h ^ scramble(lanes[i])) * multiplier;
+    for (const char* end = data + size / 8 * 8; p != end; p += 8)
+        h = (h ^ scramble(read64(p))) * multiplier;
+
+    std::uint64_t tail = 0;
+    for (std::size_t i = 0; p + i != data + size; ++i)
+        tail |= std::uint64_t(static_cast<unsigned char>(p[i])) << (8 * i);
+    h = (h ^ scramble(tail)) * multiplier;
+
+    h ^= h >> 47;
+    h *= multiplier;
+    return h ^ (h >> 47);
+}
+
+// every table is hashed entry by entry and the hashes summed, the order of an unordered_map isn't fixed
+std::uint64_t AstCache::grammar_stamp()
+{
+    static const std::uint64_t stamp = []()
+    {
+        std::uint64_t sum = hash(reinterpret_cast<const char*>(&format_version), sizeof(format_version));
+        auto add = [&](std::vector<std::int64_t> fields)
+        {
+            sum += hash(reinterpret_cast<const char*>(fields.data()), fields.size() * sizeof(std::int64_t), fields.size());
+        };
+        for (auto it = grammar.begin(); it != grammar.end(); ++it)
+        {
+            const Goal& goal = it->second.next_goal;
+            std::int64_t detail = goal.goal == GOAL::STATEMENT ? static_cast<std::int64_t>(goal.statement)
+                                : goal.goal == GOAL::EXPRESSION ? static_cast<std::int64_t>(goal.expr) : 0;
+            add({it->first.current_state, it->first.lookahead_token, static_cast<std::int64_t>(it->second.next_action),
+                 it->second.next_state, it->second.return_state, static_cast<std::int64_t>(goal.goal), detail});
+        }
+        for (auto it = op_prec.begin(); it != op_prec.end(); ++it)
+            add({1, static_cast<std::int64_t>(it->first), it->second});
+        for (auto it = op_assoc.begin(); it != op_assoc.end(); ++it)
+            add({2, static_cast<std::int64_t>(it->first), static_cast<std::int64_t>(it->second)});
+        for (auto it = op_opcount.begin(); it != op_opcount.end(); ++it)
+            add({3, static_cast<std::int64_t>(it->first), static_cast<std::int64_t>(it->second)});
+        return sum;
+    }();
+    return stamp;
+}
+
+/* Entries are a header (magic, grammar stamp, source size) and the source
+ * itself, followed by the functions. Counts and lengths are 32-bit, absent marking a null pointer
+ * in the tree; everything is in the byte order of the machine. */
+class AstWriter
+{
+    std::string& out;
+
+    void number(std::uint32_t value) {out.append(reinterpret_cast<const char*>(&value), sizeof(value));}
+    void string(const std::string& value)
+    {
+        number(value.size());
+        out.append(value);
+    }
+
+public:
+    AstWriter(std::string& _out) : out(_out) {}
+
+    void function(Function& function)
+    {
+        string(function.name);
+        number(function.params.size());
+        for (auto it = function.params.begin(); it != function.params.end(); ++it)
+            string(*it);
+        statement(function.getbody());
+    }
+
+    void statement(const Statement& stmt)
+    {
+        out.push_back(static_cast<char>(stmt.type));
+        if (stmt.body)
+        {
+            number(stmt.body->size());
+            for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+                statement(*it);
+        }
+        else number(absent);
+        out.push_back(stmt.expr != nullptr);
+        if (stmt.expr)
+            expression(*stmt.expr);
+        if (stmt.vars)
+        {
+            number(stmt.vars->size());
+            for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            {
+                string(it->name);
+                out.push_back(it->is_initialized);
+                if (it->is_initialized)
+                    expression(*it->expr);
+            }
+        }
+        else number(absent);
+    }
+
+    void expression(const Expression& expr)
+    {
+        out.push_back(static_cast<char>(expr.type));
+        out.push_back(static_cast<char>(expr.gentype));
+        out.push_back(expr.int_val != nullptr);
+        if (expr.int_val)
+            number(static_cast<std::uint32_t>(*expr.int_val));
+        out.push_back(expr.str_val != nullptr);
+        if (expr.str_val)
+            string(*expr.str_val);
+        if (expr.expressions)
+        {
+            number(expr.expressions->size());
+            for (auto it = expr.expressions->begin(); it != expr.expressions->end(); ++it)
+                expression(*it);
+        }
+        else number(absent);
+    }
+};
+
+// reads what AstWriter wrote, throwing on a truncated entry
+class AstReader
+{
+    const char* p;
+    const char* end;
+
+    void need(std::size_t bytes)
+    {
+        if (static_cast<std::size_t>(end - p) < bytes)
+            throw std::runtime_error("Truncated AST cache entry");
+    }
+    std::uint32_t number()
+    {
+        need(sizeof(std::uint32_t));
+        std::uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return value;
+    }
+    std::uint8_t byte()
+    {
+        need(1);
+        return static_cast<std::uint8_t>(*p++);
+    }
+    // a number of items that follow, each at least a byte long
+    std::uint32_t count()
+    {
+        std::uint32_t value = number();
+        if (value != absent)
+            need(value);
+        return value;
+    }
+    std::string string()
+    {
+        std::uint32_t size = number();
+        need(size);
+        std::string value(p, size);
+        p += size;
+        return value;
+    }
+
+public:
+    AstReader(const char* _p, const char* _end) : p(_p), end(_end) {}
+
+    bool finished() const {return p == end;}
+
+    Function function()
+    {
+        Identifier name = string();
+        std::uint32_t params_size = count();
+        if (params_size == absent)
+            throw std::runtime_error("Malformed AST cache entry");
+        std::vector<Identifier> params(params_size);
+        for (auto it = params.begin(); it != params.end(); ++it)
+            *it = string();
+        return Function(name, params, statement());
+    }
+
+    Statement statement()
+    {
+        Statement stmt;
+        stmt.type = static_cast<STATEMENT_TYPE>(byte());
+        std::uint32_t statements = count();
+        if (statements != absent)
+        {
+            stmt.body = std::make_shared<std::vector<Statement>>();
+            stmt.body->reserve(statements);
+            for (std::uint32_t i = 0; i < statements; ++i)
+                stmt.body->push_back(statement());
+        }
+        if (byte())
+            stmt.expr = std::make_shared<Expression>(expression());
+        std::uint32_t vars = count();
+        if (vars != absent)
+        {
+            stmt.vars = std::make_shared<std::vector<Variable>>();
+            stmt.vars->reserve(vars);
+            for (std::uint32_t i = 0; i < vars; ++i)
+            {
+                Identifier name = string();
+                if (byte())
+                    stmt.vars->push_back(Variable(name, expression()));
+                else
+                    stmt.vars->push_back(Variable(name));
+            }
+        }
+        return stmt;
+    }
+
+    Expression expression()
+    {
+        Expression expr;
+        expr.type = static_cast<EXPR_TYPE>(byte());
+        expr.gentype = static_cast<EXPR_OPCOUNT>(byte());
+        if (byte())
+            expr.int_val = std::make_shared<int>(static_cast<int>(number()));
+        if (byte())
+            expr.str_val = std::make_shared<std::string>(string());
+        std::uint32_t operands = count();
+        if (operands != absent)
+        {
+            expr.expressions = std::make_shared<std::vector<Expression>>();
+            expr.expressions->reserve(operands);
+            for (std::uint32_t i = 0; i < operands; ++i)
+                expr.expressions->push_back(expression());
+        }
+        return expr;
+    }
+};
+
+AstCache::AstCache(const std::string& _directory, std::uintmax_t _max_bytes)
+    : directory(_directory), max_bytes(_max_bytes), hits(0), misses(0)
+{
+    std::error_code error;
+    fs::create_directories(directory, error);
+}
+
+std::string AstCache::entry_path(std::uint64_t key) const
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string name(16, '0');
+    for (int i = 15; i >= 0; --i, key >>= 4)
+        name[i] = digits[key & 15];
+    return (fs::path(directory) / (name + ".ast")).string();
+}
+
+Library AstCache::parse(std::shared_ptr<std::string> source)
+{
+    std::string path = entry_path(hash(source->data(), source->size()));
+    Library library;
+    if (load(path, *source, library))
+    {
+        hits++;
+        return library;
+    }
+    misses++;
+    library = LazyParser::parse(source);
+    store(path, *source, library);
+    return library;
+}
+
+bool AstCache::load(const std::string& path, const std::string& source, Library& library) const
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    std::string entry(static_cast<std::size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    if (!file.read(&entry[0], entry.size()))
+        return false;
+
+    const std::size_t header = sizeof(magic) + 2 * sizeof(std::uint64_t);
+    std::uint64_t stamp, size;
+    if (entry.size() < header || std::memcmp(entry.data(), magic, sizeof(magic)))
+        return false;
+    std::memcpy(&stamp, entry.data() + sizeof(magic), sizeof(stamp));
+    std::memcpy(&size, entry.data() + sizeof(magic) + sizeof(stamp), sizeof(size));
+    // the hash only picks the entry, a different source with the same one is a miss
+    if (stamp != grammar_stamp() || size != source.size() || entry.size() - header < size ||
+        entry.compare(header, size, source) != 0)
+        return false;
+
+    try
+    {
+        AstReader reader(entry.data() + header + size, entry.data() + entry.size());
+        std::vector<Function> functions;
+        while (!reader.finished())
+            functions.push_back(reader.function());
+        library = Library(functions);
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+
+    std::error_code error;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+    return true;
+}
+
+void AstCache::store(const std::string& path, const std::string& source, Library& library) const
+{
+    std::string entry(magic, sizeof(magic));
+    std::uint64_t stamp = grammar_stamp(), size = source.size();
+    entry.append(reinterpret_cast<const char*>(&stamp), sizeof(stamp));
+    entry.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    entry.append(source);
+    AstWriter writer(entry);
+    for (auto it = library.functions.begin(); it != library.functions.end(); ++it)
+        writer.function(*it);
+
+    // a name no other compiler writing the same entry uses
+    std::random_device random;
+    std::string temporary = path + "." + std::to_string(random()) + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        file.write(entry.data(), entry.size());
+        if (!file.flush())
+        {
+            file.close();
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    std::error_code error;
+    fs::rename(temporary, path, error);
+    if (error)
+        fs::remove(temporary, error);
+    else
+        evict();
+}
+
+void AstCache::evict() const
+{
+    struct Entry
+    {
+        fs::file_time_type used;
+        std::uintmax_t bytes;
+        fs::path path;
+    };
+    std::vector<Entry> entries;
+    std::uintmax_t total = 0;
+    std::error_code error;
+    for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+    {
+        if (it->path().extension() != ".ast")
+            continue;
+        std::error_code entry_error;
+        Entry entry{it->last_write_time(entry_error), it->file_size(entry_error), it->path()};
+        if (entry_error)
+            continue;
+        total += entry.bytes;
+        entries.push_back(entry);
+    }
+    if (total <= max_bytes)
+        return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {return a.used < b.used;});
+    for (auto it = entries.begin(); it != entries.end() && total > max_bytes; ++it)
+        if (fs::remove(it->path, error))
+            total -= it->bytes;
+}
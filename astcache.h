@@ -0,0 +1,47 @@
+#ifndef H_ASTCACHE
+#define H_ASTCACHE
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "function.h"
+#include "library.h"
+
+/* Parsed programs kept on disk, keyed by a hash of their source. An entry
+ * is the Library as the parser built it, before name resolution, stamped
+ * with a hash of the grammar and operator tables so that an entry written
+ * by a compiler with a different grammar is never loaded. It holds the
+ * source as well, and is only loaded for the very same source, so sources
+ * whose hashes collide just take turns in the entry. Entries are
+ * written to a temporary file and renamed into place, so concurrent
+ * compilers sharing a directory see a whole entry or none. Loading an
+ * entry touches its modification time; when the directory grows past its
+ * size, the least recently used entries are removed. */
+class AstCache
+{
+    std::string directory;
+    std::uintmax_t max_bytes;
+
+    std::string entry_path(std::uint64_t key) const;
+    bool load(const std::string& path, const std::string& source, Library& library) const;
+    void store(const std::string& path, const std::string& source, Library& library) const;
+    // removes the oldest entries until the directory fits in max_bytes
+    void evict() const;
+
+public:
+    unsigned hits;
+    unsigned misses;
+
+    AstCache(const std::string& _directory, std::uintmax_t _max_bytes = std::uintmax_t(1) << 28);
+
+    // the Library of source, loaded from the cache or parsed and stored
+    Library parse(std::shared_ptr<std::string> source);
+
+    // 64-bit hash of size bytes, not meant to resist collisions made on purpose
+    static std::uint64_t hash(const char* data, std::size_t size, std::uint64_t seed = 0);
+    // hash of the grammar and operator precedence tables, changes with the language
+    static std::uint64_t grammar_stamp();
+};
+
+#endif // H_ASTCACHE
@@ -0,0 +1,252 @@
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AST_IMAGE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "astimage.h"
+#include "astcache.h"
+
+static const char magic[8] = {'B', 'A', 'S', 'T', 'I', 'M', 'G', '1'};
+
+/* Lays out the records in one buffer. A node's record is reserved by its
+ * parent, together with those of its siblings, and filled in once the
+ * arrays of its own children have been reserved after it. Strings go to a
+ * table of their own, appended at the end, each stored once. */
+class AstImageWriter
+{
+    std::vector<char> image;
+    std::string strings;
+    std::unordered_map<std::string, std::uint32_t> string_offsets;
+
+    // space for count records at the end, returns its offset
+    template <typename Record>
+    std::size_t reserve(std::size_t count)
+    {
+        std::size_t offset = image.size();
+        image.resize(offset + count * sizeof(Record));
+        return offset;
+    }
+    template <typename Record>
+    void put(std::size_t offset, const Record& record)
+    {
+        std::memcpy(image.data() + offset, &record, sizeof(record));
+    }
+    static std::int32_t relative(std::size_t from, std::size_t to)
+    {
+        std::int64_t offset = static_cast<std::int64_t>(to) - static_cast<std::int64_t>(from);
+        if (offset != static_cast<std::int32_t>(offset))
+            throw std::runtime_error("AST too large for an image");
+        return static_cast<std::int32_t>(offset);
+    }
+    std::uint32_t string(const std::string& value)
+    {
+        auto found = string_offsets.find(value);
+        if (found != string_offsets.end())
+            return found->second;
+        std::uint32_t offset = strings.size();
+        std::uint32_t length = value.size();
+        strings.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        strings.append(value);
+        string_offsets.emplace(value, offset);
+        return offset;
+    }
+
+    void fill(std::size_t at, const Statement& stmt)
+    {
+        AstImage::StatementRecord record = {};
+        record.type = static_cast<std::uint8_t>(stmt.type);
+        if (stmt.body)
+        {
+            record.has_body = 1;
+            record.body_count = stmt.body->size();
+            if (!stmt.body->empty())
+            {
+                std::size_t body = reserve<AstImage::StatementRecord>(stmt.body->size());
+                record.body = relative(at, body);
+                for (std::size_t i = 0; i < stmt.body->size(); ++i)
+                    fill(body + i * sizeof(AstImage::StatementRecord), (*stmt.body)[i]);
+            }
+        }
+        if (stmt.expr)
+        {
+            std::size_t expr = reserve<AstImage::ExpressionRecord>(1);
+            record.expr = relative(at, expr);
+            fill(expr, *stmt.expr);
+        }
+        if (stmt.vars)
+        {
+            record.has_vars = 1;
+            record.var_count = stmt.vars->size();
+            if (!stmt.vars->empty())
+            {
+                std::size_t vars = reserve<AstImage::VariableRecord>(stmt.vars->size());
+                record.vars = relative(at, vars);
+                for (std::size_t i = 0; i < stmt.vars->size(); ++i)
+                {
+                    const Variable& var = (*stmt.vars)[i];
+                    std::size_t var_at = vars + i * sizeof(AstImage::VariableRecord);
+                    AstImage::VariableRecord var_record = {string(var.name), 0};
+                    if (var.is_initialized)
+                    {
+                        std::size_t expr = reserve<AstImage::ExpressionRecord>(1);
+                        var_record.expr = relative(var_at, expr);
+                        fill(expr, *var.expr);
+                    }
+                    put(var_at, var_record);
+                }
+            }
+        }
+        put(at, record);
+    }
+
+    void fill(std::size_t at, const Expression& expr)
+    {
+        AstImage::ExpressionRecord record = {};
+        record.type = static_cast<std::uint8_t>(expr.type);
+        record.gentype = static_cast<std::uint8_t>(expr.gentype);
+        if (expr.int_val)
+        {
+            record.has_int = 1;
+            record.int_val = *expr.int_val;
+        }
+        if (expr.str_val)
+        {
+            record.has_str = 1;
+            record.str_val = string(*expr.str_val);
+        }
+        if (expr.expressions && !expr.expressions->empty())
+        {
+            record.operand_count = expr.expressions->size();
+            std::size_t operands = reserve<AstImage::ExpressionRecord>(expr.expressions->size());
+            record.operands = relative(at, operands);
+            for (std::size_t i = 0; i < expr.expressions->size(); ++i)
+                fill(operands + i * sizeof(AstImage::ExpressionRecord), (*expr.expressions)[i]);
+        }
+        put(at, record);
+    }
+
+public:
+    std::vector<char> write(Library& library)
+    {
+        std::size_t header = reserve<AstImage::Header>(1);
+        std::size_t functions = reserve<AstImage::FunctionRecord>(library.functions.size());
+        for (std::size_t i = 0; i < library.functions.size(); ++i)
+        {
+            Function& function = library.functions[i];
+            std::size_t at = functions + i * sizeof(AstImage::FunctionRecord);
+            AstImage::FunctionRecord record = {string(function.name), static_cast<std::uint32_t>(function.params.size()), 0, 0};
+            if (!function.params.empty())
+            {
+                std::size_t params = reserve<std::uint32_t>(function.params.size());
+                record.params = relative(at, params);
+                for (std::size_t j = 0; j < function.params.size(); ++j)
+                    put(params + j * sizeof(std::uint32_t), string(function.params[j]));
+            }
+            std::size_t body = reserve<AstImage::StatementRecord>(1);
+            record.body = relative(at, body);
+            fill(body, function.getbody());
+            put(at, record);
+        }
+
+        // the string table starts aligned for its lengths
+        image.resize((image.size() + 7) / 8 * 8);
+        if (image.size() + strings.size() > 0xffffffffu)
+            throw std::runtime_error("AST too large for an image");
+        AstImage::Header record;
+        std::memcpy(record.magic, magic, sizeof(magic));
+        record.stamp = AstCache::grammar_stamp();
+        record.size = image.size() + strings.size();
+        record.functions = library.functions.size();
+        record.strings = image.size();
+        put(header, record);
+        image.insert(image.end(), strings.begin(), strings.end());
+        return std::move(image);
+    }
+};
+
+void AstImage::write(Library& library, const std::string& path)
+{
+    std::vector<char> image = AstImageWriter().write(library);
+    std::ofstream file(path, std::ios::binary);
+    if (!file.write(image.data(), image.size()))
+        throw std::runtime_error("Cannot write AST image " + path);
+}
+
+AstImage::AstImage(const std::string& path) : data(nullptr), size(0), mapped(false)
+{
+#ifdef AST_IMAGE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open AST image " + path);
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0)
+    {
+        size = status.st_size;
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            data = static_cast<const char*>(mapping);
+            mapped = true;
+        }
+    }
+    close(fd);
+    if (!mapped)
+        throw std::runtime_error("Cannot map AST image " + path);
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        throw std::runtime_error("Cannot open AST image " + path);
+    size = file.tellg();
+    char* buffer = new char[size];
+    file.seekg(0);
+    file.read(buffer, size);
+    data = buffer;
+#endif
+
+    const Header* header = reinterpret_cast<const Header*>(data);
+    const char* problem = nullptr;
+    if (size < sizeof(Header) || std::memcmp(header->magic, magic, sizeof(magic)))
+        problem = " isn't an AST image";
+    else if (header->stamp != AstCache::grammar_stamp())
+        problem = " was written for another grammar";
+    else if (header->size != size || header->strings > size ||
+             (size - sizeof(Header)) / sizeof(FunctionRecord) < header->functions)
+        problem = " is truncated or damaged";
+    if (problem)
+    {
+        unmap();
+        throw std::runtime_error("AST image " + path + problem);
+    }
+}
+
+void AstImage::unmap()
+{
+#ifdef AST_IMAGE_MMAP
+    if (mapped)
+        munmap(const_cast<char*>(data), size);
+#else
+    delete[] data;
+#endif
+    data = nullptr;
+    mapped = false;
+}
+
+std::string_view AstImage::string(std::uint32_t offset) const
+{
+    std::size_t table = reinterpret_cast<const Header*>(data)->strings;
+    std::uint32_t length;
+    if (size - table < sizeof(length) || size - table - sizeof(length) < offset)
+        throw std::runtime_error("String outside of the AST image");
+    std::memcpy(&length, data + table + offset, sizeof(length));
+    if (size - table - sizeof(length) - offset < length)
+        throw std::runtime_error("String outside of the AST image");
+    return std::string_view(data + table + offset + sizeof(length), length);
+}
@@ -0,0 +1,196 @@
+#ifndef H_ASTIMAGE
+#define H_ASTIMAGE
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "function.h"
+#include "library.h"
+
+/* A Library in a file that's mapped and read in place. Every node is a
+ * fixed-size record; the children of a node are an array of records and a
+ * node refers to that array by its offset in bytes from the node itself, 0
+ * when there is none. Names and string literals are offsets into a string
+ * table at the end of the file, each a length followed by the characters.
+ * Everything is in the byte order of the machine that wrote it, and the
+ * header carries the grammar stamp of AstCache since the records store the
+ * parser's node types.
+ *
+ * Opening an image only checks the header; the views below read the
+ * records as they're walked and allocate nothing. Every offset is checked
+ * against the mapping when it's followed, so a damaged image throws instead
+ * of reading outside of it. */
+class AstImage
+{
+public:
+    struct Header
+    {
+        char magic[8];
+        std::uint64_t stamp;
+        std::uint64_t size;         // of the whole file
+        std::uint32_t functions;    // records right after the header
+        std::uint32_t strings;      // offset of the string table
+    };
+    struct FunctionRecord
+    {
+        std::uint32_t name;
+        std::uint32_t param_count;
+        std::int32_t params;        // array of param_count names
+        std::int32_t body;
+    };
+    struct StatementRecord
+    {
+        std::uint8_t type;
+        std::uint8_t has_body;
+        std::uint8_t has_vars;
+        std::uint8_t reserved;
+        std::uint32_t body_count;
+        std::int32_t body;
+        std::int32_t expr;
+        std::uint32_t var_count;
+        std::int32_t vars;
+    };
+    struct VariableRecord
+    {
+        std::uint32_t name;
+        std::int32_t expr;          // initializer
+    };
+    struct ExpressionRecord
+    {
+        std::uint8_t type;
+        std::uint8_t gentype;
+        std::uint8_t has_int;
+        std::uint8_t has_str;
+        std::int32_t int_val;
+        std::uint32_t str_val;
+        std::uint32_t operand_count;
+        std::int32_t operands;
+    };
+
+private:
+    const char* data;
+    std::size_t size;
+    bool mapped;
+
+    // count records at offset from a record in the image; the position is worked out as a number,
+    // a pointer outside of the image can't even be compared
+    template <typename Record>
+    const Record* follow(const void* from, std::int32_t offset, std::size_t count = 1) const
+    {
+        std::int64_t position = (static_cast<const char*>(from) - data) + static_cast<std::int64_t>(offset);
+        std::size_t at = static_cast<std::size_t>(position);
+        if (!offset || position < 0 || at > size || count > (size - at) / sizeof(Record) || at % alignof(Record))
+            throw std::runtime_error("Offset outside of the AST image");
+        return reinterpret_cast<const Record*>(data + at);
+    }
+    std::string_view string(std::uint32_t offset) const;
+    void unmap();
+
+public:
+    class ExpressionView
+    {
+        const AstImage* image;
+        const ExpressionRecord* record;
+
+    public:
+        ExpressionView(const AstImage* _image, const ExpressionRecord* _record) : image(_image), record(_record) {}
+
+        EXPR_TYPE type() const {return static_cast<EXPR_TYPE>(record->type);}
+        EXPR_OPCOUNT gentype() const {return static_cast<EXPR_OPCOUNT>(record->gentype);}
+        bool has_int() const {return record->has_int;}
+        int int_val() const {return record->int_val;}
+        bool has_str() const {return record->has_str;}
+        std::string_view str_val() const {return image->string(record->str_val);}
+        // operands, or the called expression followed by the arguments of a call
+        std::size_t size() const {return record->operand_count;}
+        ExpressionView operator[](std::size_t i) const
+        {
+            return ExpressionView(image, image->follow<ExpressionRecord>(record, record->operands, size()) + i);
+        }
+    };
+
+    class VariableView
+    {
+        const AstImage* image;
+        const VariableRecord* record;
+
+    public:
+        VariableView(const AstImage* _image, const VariableRecord* _record) : image(_image), record(_record) {}
+
+        std::string_view name() const {return image->string(record->name);}
+        bool is_initialized() const {return record->expr;}
+        ExpressionView expr() const
+        {
+            return ExpressionView(image, image->follow<ExpressionRecord>(record, record->expr));
+        }
+    };
+
+    class StatementView
+    {
+        const AstImage* image;
+        const StatementRecord* record;
+
+    public:
+        StatementView(const AstImage* _image, const StatementRecord* _record) : image(_image), record(_record) {}
+
+        STATEMENT_TYPE type() const {return static_cast<STATEMENT_TYPE>(record->type);}
+        // statements of a compound statement, the one controlled by a conditional or loop
+        bool has_body() const {return record->has_body;}
+        std::size_t size() const {return record->body_count;}
+        StatementView operator[](std::size_t i) const
+        {
+            return StatementView(image, image->follow<StatementRecord>(record, record->body, size()) + i);
+        }
+        bool has_expr() const {return record->expr;}
+        ExpressionView expr() const
+        {
+            return ExpressionView(image, image->follow<ExpressionRecord>(record, record->expr));
+        }
+        bool has_vars() const {return record->has_vars;}
+        std::size_t var_count() const {return record->var_count;}
+        VariableView var(std::size_t i) const
+        {
+            return VariableView(image, image->follow<VariableRecord>(record, record->vars, var_count()) + i);
+        }
+    };
+
+    class FunctionView
+    {
+        const AstImage* image;
+        const FunctionRecord* record;
+
+    public:
+        FunctionView(const AstImage* _image, const FunctionRecord* _record) : image(_image), record(_record) {}
+
+        std::string_view name() const {return image->string(record->name);}
+        std::size_t param_count() const {return record->param_count;}
+        std::string_view param(std::size_t i) const
+        {
+            return image->string(image->follow<std::uint32_t>(record, record->params, param_count())[i]);
+        }
+        StatementView body() const
+        {
+            return StatementView(image, image->follow<StatementRecord>(record, record->body));
+        }
+    };
+
+    // maps the image at path, throws if it isn't one written for this grammar
+    AstImage(const std::string& path);
+    ~AstImage() {unmap();}
+    AstImage(const AstImage&) = delete;
+    AstImage& operator=(const AstImage&) = delete;
+
+    std::size_t functions() const {return reinterpret_cast<const Header*>(data)->functions;}
+    FunctionView function(std::size_t i) const
+    {
+        return FunctionView(this, reinterpret_cast<const FunctionRecord*>(data + sizeof(Header)) + i);
+    }
+    std::size_t bytes() const {return size;}
+
+    // writes library, parsing the bodies that haven't been yet
+    static void write(Library& library, const std::string& path);
+};
+
+#endif // H_ASTIMAGE
@@ -0,0 +1,110 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "serverprotocol.h"
+
+using namespace std;
+
+// Sends one source to a server started with compiler --serve and writes what it answers.
+// Usage: bclient [--stats] [--repeat N] SOCKET signatures|check|compile SOURCE [IMAGE]
+int main(int argc, char* argv[])
+{
+#ifdef SERVER_PROTOCOL_SUPPORTED
+    bool stats = false;
+    unsigned long repeat = 1;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if (arg == "--stats")               // report the time a request takes
+            stats = true;
+        else if (arg == "--repeat" && i + 1 < argc)     // send the request as many times over the connection
+            repeat = std::stoul(argv[++i]);
+        else args.push_back(arg);
+    }
+    if (args.size() < 3 || repeat == 0)
+    {
+        cerr<<"Usage: bclient [--stats] [--repeat N] SOCKET signatures|check|compile SOURCE [IMAGE]"<<endl;
+        return 2;
+    }
+
+    SERVER_COMMAND command;
+    if (args[1] == "signatures")
+        command = SERVER_COMMAND::SIGNATURES;
+    else if (args[1] == "check")
+        command = SERVER_COMMAND::CHECK;
+    else if (args[1] == "compile")
+        command = SERVER_COMMAND::COMPILE;
+    else
+    {
+        cerr<<"Unknown command "<<args[1]<<endl;
+        return 2;
+    }
+
+    ifstream src(args[2]);
+    if (!src.good())
+    {
+        cerr<<"Cannot read "<<args[2]<<endl;
+        return 2;
+    }
+    std::stringstream buffer;
+    buffer<<src.rdbuf();
+    std::string source = buffer.str();
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (args[0].size() >= sizeof(address.sun_path) || server < 0)
+    {
+        cerr<<"Cannot connect to "<<args[0]<<endl;
+        return 2;
+    }
+    args[0].copy(address.sun_path, args[0].size());
+    if (connect(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        cerr<<"Cannot connect to "<<args[0]<<endl;
+        return 2;
+    }
+
+    std::uint8_t status = 0;
+    std::string response;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < repeat; ++i)
+    {
+        if (!send_frame(server, static_cast<std::uint8_t>(command), source.data(), source.size()) ||
+            !receive_frame(server, status, response))
+        {
+            cerr<<"Connection to "<<args[0]<<" lost"<<endl;
+            return 2;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    close(server);
+    if (stats)
+        cerr<<repeat<<" requests in "<<elapsed.count()<<" s, "<<elapsed.count() / repeat * 1e6<<" us each"<<endl;
+
+    if (static_cast<SERVER_STATUS>(status) != SERVER_STATUS::OK)
+    {
+        cerr<<response;
+        return 1;
+    }
+    if (command == SERVER_COMMAND::COMPILE && args.size() > 3 && args[3] != "-")
+    {
+        ofstream image(args[3], std::ios::binary);
+        if (!image.write(response.data(), response.size()))
+        {
+            cerr<<"Cannot write "<<args[3]<<endl;
+            return 2;
+        }
+    }
+    else cout<<response;
+    return 0;
+#else
+    cerr<<"bclient needs a POSIX system"<<endl;
+    return 2;
+#endif
+}
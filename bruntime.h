@@ -0,0 +1,44 @@
+#ifndef H_BRUNTIME
+#define H_BRUNTIME
+
+/* Helpers for the C that CCodegen writes (--emit-c). Compile it with this
+ * directory on the include path and link with the bruntime library, which
+ * provides the builtins and main. B words are intptr_t; a B address is the
+ * machine address of a word divided by the word size, as everywhere else.
+ * Arithmetic wraps around like in the interpreters. */
+
+#include <stdint.h>
+
+typedef intptr_t bword;
+typedef bword (*bfunction)(void);   // cast to the right number of arguments before calling
+
+#define B_ADDRESS(lvalue) ((bword)((uintptr_t)&(lvalue) / sizeof(bword)))
+#define B_WORD(address) (*(bword*)((uintptr_t)(address) * sizeof(bword)))
+
+bword brt_putchar(bword c);
+bword brt_getchar(void);
+bword brt_printf(bword format, ...);
+bword brt_char(bword string, bword index);
+bword brt_lchar(bword string, bword index, bword c);
+bword brt_exit(void);
+bword brt_getvec(bword size);
+bword brt_flush(void);
+
+// function values are indices into brt_functions, builtins are -(index + 1)
+extern const bfunction brt_functions[];
+static const bfunction brt_builtins[] = {(bfunction)brt_putchar, (bfunction)brt_getchar, (bfunction)brt_printf,
+                                         (bfunction)brt_char, (bfunction)brt_lchar, (bfunction)brt_exit,
+                                         (bfunction)brt_getvec, (bfunction)brt_flush};
+
+#define B_FUNCTION(value) ((value) < 0 ? brt_builtins[-(value) - 1] : brt_functions[value])
+
+static inline bword brt_add(bword a, bword b) {return (bword)((uintptr_t)a + (uintptr_t)b);}
+static inline bword brt_sub(bword a, bword b) {return (bword)((uintptr_t)a - (uintptr_t)b);}
+static inline bword brt_neg(bword a) {return (bword)(0 - (uintptr_t)a);}
+
+// compound assignment and increments of any lvalue, the value is read after the operand is evaluated
+static inline bword brt_addto(bword* lvalue, bword delta) {return *lvalue = brt_add(*lvalue, delta);}
+static inline bword brt_subfrom(bword* lvalue, bword delta) {return *lvalue = brt_sub(*lvalue, delta);}
+static inline bword brt_postadd(bword* lvalue, bword delta) {bword old = *lvalue; *lvalue = brt_add(old, delta); return old;}
+
+#endif // H_BRUNTIME
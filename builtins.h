@@ -0,0 +1,18 @@
+#ifndef H_BUILTINS
+#define H_BUILTINS
+
+#include <vector>
+
+#include "identifier.h"
+
+// Functions provided by the B runtime library, visible from every program
+struct Builtin
+{
+    Identifier name;
+    int arity;      // -1 for functions taking a variable number of arguments
+};
+
+const std::vector<Builtin> builtins = {{"putchar", 1}, {"getchar", 0}, {"printf", -1}, {"char", 2},
+                                       {"lchar", 3}, {"exit", 0}, {"getvec", 1}, {"flush", 0}};
+
+#endif // H_BUILTINS
@@ -0,0 +1,123 @@
+#ifndef H_BYTECODE
+#define H_BYTECODE
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "identifier.h"
+#include "memory.h"
+
+/* Stack machine instructions: name, number of operand words following the
+ * opcode and effect on the operand stack (calls additionally pop their
+ * arguments). The VM's dispatch table is generated from the same list, so
+ * the order here is the opcode numbering. */
+#define BYTECODE_OPCODES(X) \
+    X(HALT, 0, 0)       /* stop the machine */ \
+    X(PUSH, 1, 1)       /* push immediate */ \
+    X(PUSHSTR, 1, 1)    /* push address of string literal at statics offset */ \
+    X(POP, 0, -1) \
+    X(DUP, 0, 1) \
+    X(LOADL, 1, 1)      /* push frame slot */ \
+    X(STOREL, 1, 0)     /* frame slot = top, value stays on the stack */ \
+    X(ADDRL, 1, 1)      /* push address of frame slot */ \
+    X(LOAD, 0, 0)       /* address -> word at address */ \
+    X(STORE, 0, -1)     /* address value -> value, stores value at address */ \
+    X(INCL, 2, 1)       /* frame slot += delta, push new value */ \
+    X(POSTINCL, 2, 1)   /* push frame slot, then slot += delta */ \
+    X(INC, 1, 0)        /* address -> new value, word at address += delta */ \
+    X(POSTINC, 1, 0)    /* address -> old value, word at address += delta */ \
+    X(ADD, 0, -1) \
+    X(SUB, 0, -1) \
+    X(EQ, 0, -1) \
+    X(NE, 0, -1) \
+    X(NEG, 0, 0) \
+    X(NOT, 0, 0) \
+    X(JMP, 1, 0)        /* jump to absolute code position */ \
+    X(JZ, 1, -1)        /* pop, jump if zero */ \
+    X(JNZ, 1, -1)       /* pop, jump if not zero */ \
+    X(CALL, 2, 1)       /* function index, argument count */ \
+    X(CALLB, 2, 1)      /* builtin index, argument count */ \
+    X(CALLI, 1, 0)      /* argument count, calls the function value on top of the arguments */ \
+    X(TAILCALL, 2, 1)   /* like CALL but in the caller's frame, returning to its caller; followed by RET */ \
+    X(TAILCALLI, 1, 0)  /* like CALLI but in the caller's frame; followed by RET, which returns what a builtin pushed */ \
+    X(RET, 0, -1)
+
+/* Superinstructions, sequences of the instructions above executed by a
+ * single dispatch, follow them in the numbering. Each has the operands of
+ * its parts in order. The list is generated by superinstgen from opcode
+ * sequence profiles, see CMakeLists.txt. */
+#ifdef SUPERINSTRUCTIONS_HEADER
+#include SUPERINSTRUCTIONS_HEADER
+#else
+#include "superinstructions.h"
+#endif
+
+#define BYTECODE_ENUM(name, operands, effect, ...) name,
+enum class OPCODE {BYTECODE_OPCODES(BYTECODE_ENUM) SUPERINSTRUCTIONS(BYTECODE_ENUM, ) OPCODE_COUNT};
+#undef BYTECODE_ENUM
+
+#define BYTECODE_COUNT(...) + 1
+const int base_opcode_count = 0 BYTECODE_OPCODES(BYTECODE_COUNT);
+#undef BYTECODE_COUNT
+
+struct OpcodeInfo
+{
+    const char* name;
+    int operands;
+    int stack_effect;
+};
+
+#define BYTECODE_INFO(name, operands, effect, ...) {#name, operands, effect},
+constexpr OpcodeInfo opcode_info[] = {BYTECODE_OPCODES(BYTECODE_INFO) SUPERINSTRUCTIONS(BYTECODE_INFO, )};
+#undef BYTECODE_INFO
+
+constexpr const OpcodeInfo& getinfo(OPCODE op)
+{
+    return opcode_info[static_cast<int>(op)];
+}
+
+struct CompiledFunction
+{
+    Identifier name;
+    unsigned params;
+    unsigned frame_size;
+    unsigned max_stack;     // operand stack words used by the function itself
+    std::size_t entry;      // position of the first instruction in Program::code
+};
+
+/* Compiled library, for either the stack or the register instruction set.
+ * Function values are indices into functions, builtins used as values are
+ * encoded as -(index + 1). String literals are stored one character per
+ * word, zero terminated, in statics, which the VM copies to the start of
+ * B memory. */
+struct Program
+{
+    std::vector<Word> code;
+    std::vector<CompiledFunction> functions;
+    std::vector<Word> statics;
+    std::map<std::string, Word> strings;    // statics offset of each literal, equal literals are shared
+
+    Word intern(const std::string& literal)
+    {
+        auto it = strings.find(literal);
+        if (it != strings.end())
+            return it->second;
+
+        Word offset = statics.size();
+        std::vector<Word> words = string_literal_words(literal);
+        statics.insert(statics.end(), words.begin(), words.end());
+        strings[literal] = offset;
+        return offset;
+    }
+
+    int find(const Identifier& name) const
+    {
+        for (std::size_t i = 0; i < functions.size(); ++i)
+            if (functions[i].name == name)
+                return i;
+        return -1;
+    }
+};
+
+#endif // H_BYTECODE
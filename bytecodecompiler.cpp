@@ -0,0 +1,413 @@
+#include <algorithm>
+
+#include "bytecodecompiler.h"
+
+Program BytecodeCompiler::compile(Library& library)
+{
+    Program program;
+    for (auto it = library.functions.begin(); it != library.functions.end(); ++it)
+        program.functions.push_back(CompiledFunction{it->name, static_cast<unsigned>(it->params.size()),
+                                                     std::max<unsigned>(it->frame_size, it->params.size()), 0, 0});
+
+    BytecodeCompiler compiler(program);
+    for (std::size_t i = 0; i < library.functions.size(); ++i)
+    {
+        program.functions[i].entry = compiler.here();
+        compiler.compile_function(library.functions[i]);
+        program.functions[i].max_stack = compiler.max_depth;
+    }
+    return program;
+}
+
+void BytecodeCompiler::emit(OPCODE op)
+{
+    program.code.push_back(static_cast<Word>(op));
+    adjust(getinfo(op).stack_effect);
+}
+
+void BytecodeCompiler::emit(OPCODE op, Word operand)
+{
+    emit(op);
+    program.code.push_back(operand);
+}
+
+void BytecodeCompiler::emit(OPCODE op, Word operand1, Word operand2)
+{
+    emit(op, operand1);
+    program.code.push_back(operand2);
+}
+
+void BytecodeCompiler::adjust(int effect)
+{
+    depth += effect;
+    max_depth = std::max(max_depth, depth);
+}
+
+void BytecodeCompiler::patch(std::size_t jump, std::size_t target)
+{
+    program.code[jump + 1] = target;
+}
+
+bool BytecodeCompiler::islocal(const Expression& expr)
+{
+    return expr.type == EXPR_TYPE::IDENTIFIER &&
+           (expr.binding.type == IDTYPE::VARIABLE || expr.binding.type == IDTYPE::PARAMETER);
+}
+
+void BytecodeCompiler::compile_function(Function& function)
+{
+    depth = max_depth = 0;
+    tail_calls = TailCalls::allowed(function);
+    compile_statement(function.getbody());
+
+    // falling off the end returns zero
+    emit(OPCODE::PUSH, 0);
+    emit(OPCODE::RET);
+}
+
+void BytecodeCompiler::compile_statement(const Statement& stmt)
+{
+    switch (stmt.type)
+    {
+        case STATEMENT_TYPE::COMPOUND:
+            for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+                compile_statement(*it);
+            break;
+        case STATEMENT_TYPE::CONDITIONAL:
+        {
+            compile_expr(*stmt.expr);
+            std::size_t skip = here();
+            emit(OPCODE::JZ, 0);
+            compile_statement(stmt.body->back());
+            patch(skip, here());
+            break;
+        }
+        case STATEMENT_TYPE::LOOP:
+        {
+            // condition is placed after the body, so each iteration dispatches one jump
+            std::size_t enter = here();
+            emit(OPCODE::JMP, 0);
+            std::size_t body = here();
+            compile_statement(stmt.body->back());
+            patch(enter, here());
+            compile_expr(*stmt.expr);
+            emit(OPCODE::JNZ, body);
+            break;
+        }
+        case STATEMENT_TYPE::RETURN:
+        {
+            const Expression* call = tail_calls ? TailCalls::call(stmt) : nullptr;
+            if (call)
+                compile_call(*call, true);
+            else
+                compile_expr(*stmt.expr);
+            emit(OPCODE::RET);
+            break;
+        }
+        case STATEMENT_TYPE::VAR_DEF:
+            // frames are zeroed on entry, only initializers need code
+            for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            {
+                if (it->is_initialized)
+                {
+                    compile_expr(*it->expr);
+                    emit(OPCODE::STOREL, it->binding.index);
+                    emit(OPCODE::POP);
+                }
+            }
+            break;
+        case STATEMENT_TYPE::EXPRESSION:
+            compile_expr(*stmt.expr);
+            emit(OPCODE::POP);
+            break;
+        case STATEMENT_TYPE::NOP:
+            break;
+    }
+}
+
+void BytecodeCompiler::compile_expr(const Expression& expr)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::INT_LITERAL:
+            emit(OPCODE::PUSH, *expr.int_val);
+            break;
+        case EXPR_TYPE::STR_LITERAL:
+            emit(OPCODE::PUSHSTR, program.intern(*expr.str_val));
+            break;
+        case EXPR_TYPE::IDENTIFIER:
+            switch (expr.binding.type)
+            {
+                case IDTYPE::VARIABLE:
+                case IDTYPE::PARAMETER:
+                    emit(OPCODE::LOADL, expr.binding.index);
+                    break;
+                case IDTYPE::FUNCTION:
+                    emit(OPCODE::PUSH, expr.binding.index);
+                    break;
+                case IDTYPE::BUILTIN:
+                    emit(OPCODE::PUSH, -(expr.binding.index + 1));
+                    break;
+            }
+            break;
+        case EXPR_TYPE::PARENTHESIS:
+            compile_expr(expr.expressions->front());
+            break;
+        case EXPR_TYPE::INDEXING:
+        case EXPR_TYPE::UNARY_STAR:
+            compile_address(expr);
+            emit(OPCODE::LOAD);
+            break;
+        case EXPR_TYPE::UNARY_AMP:
+            compile_address(expr.expressions->front());
+            break;
+        case EXPR_TYPE::FUNC_CALL:
+            compile_call(expr);
+            break;
+        case EXPR_TYPE::BIN_EQUALS:
+        {
+            const Expression& lhs = expr.expressions->front();
+            if (islocal(lhs))
+            {
+                compile_expr(expr.expressions->back());
+                emit(OPCODE::STOREL, lhs.binding.index);
+            }
+            else
+            {
+                compile_address(lhs);
+                compile_expr(expr.expressions->back());
+                emit(OPCODE::STORE);
+            }
+            break;
+        }
+        case EXPR_TYPE::BIN_PLUSEQUALS:
+            compile_compound_assignment(expr, OPCODE::ADD);
+            break;
+        case EXPR_TYPE::BIN_MINUSEQUALS:
+            compile_compound_assignment(expr, OPCODE::SUB);
+            break;
+        case EXPR_TYPE::BIN_PLUS:
+        case EXPR_TYPE::BIN_MINUS:
+        case EXPR_TYPE::BIN_COMPARE:
+        case EXPR_TYPE::BIN_NEGATEEQUALS:
+        {
+            static const std::map<EXPR_TYPE, OPCODE> binary_ops = {{EXPR_TYPE::BIN_PLUS, OPCODE::ADD}, {EXPR_TYPE::BIN_MINUS, OPCODE::SUB},
+                                                                   {EXPR_TYPE::BIN_COMPARE, OPCODE::EQ}, {EXPR_TYPE::BIN_NEGATEEQUALS, OPCODE::NE}};
+            compile_expr(expr.expressions->front());
+            compile_expr(expr.expressions->back());
+            emit(binary_ops.at(expr.type));
+            break;
+        }
+        case EXPR_TYPE::BIN_AND:
+        case EXPR_TYPE::BIN_OR:
+        {
+            // a && b: if a is zero, skip b and yield 0, otherwise yield b != 0
+            OPCODE shortcut = expr.type == EXPR_TYPE::BIN_AND ? OPCODE::JZ : OPCODE::JNZ;
+            Word shortcut_value = expr.type == EXPR_TYPE::BIN_AND ? 0 : 1;
+
+            compile_expr(expr.expressions->front());
+            std::size_t first = here();
+            emit(shortcut, 0);
+            compile_expr(expr.expressions->back());
+            std::size_t second = here();
+            emit(shortcut, 0);
+            emit(OPCODE::PUSH, !shortcut_value);
+            std::size_t done = here();
+            emit(OPCODE::JMP, 0);
+            adjust(-1);
+            patch(first, here());
+            patch(second, here());
+            emit(OPCODE::PUSH, shortcut_value);
+            patch(done, here());
+            break;
+        }
+        case EXPR_TYPE::BIN_COMMA:
+            compile_expr(expr.expressions->front());
+            emit(OPCODE::POP);
+            compile_expr(expr.expressions->back());
+            break;
+        case EXPR_TYPE::UNARY_MINUS:
+            compile_expr(expr.expressions->front());
+            emit(OPCODE::NEG);
+            break;
+        case EXPR_TYPE::UNARY_NEGATE:
+            compile_expr(expr.expressions->front());
+            emit(OPCODE::NOT);
+            break;
+        case EXPR_TYPE::UNARY_PREINCR:
+            compile_increment(expr.expressions->front(), 1, false);
+            break;
+        case EXPR_TYPE::UNARY_PREDECR:
+            compile_increment(expr.expressions->front(), -1, false);
+            break;
+        case EXPR_TYPE::UNARY_POSTINCR:
+            compile_increment(expr.expressions->front(), 1, true);
+            break;
+        case EXPR_TYPE::UNARY_POSTDECR:
+            compile_increment(expr.expressions->front(), -1, true);
+            break;
+        case EXPR_TYPE::TERNARY:
+        {
+            compile_expr(expr.expressions->at(0));
+            std::size_t to_false = here();
+            emit(OPCODE::JZ, 0);
+            compile_expr(expr.expressions->at(1));
+            std::size_t done = here();
+            emit(OPCODE::JMP, 0);
+            adjust(-1);     // only one of the branches leaves a value
+            patch(to_false, here());
+            compile_expr(expr.expressions->at(2));
+            patch(done, here());
+            break;
+        }
+        case EXPR_TYPE::NONE:
+            emit(OPCODE::PUSH, 0);
+            break;
+    }
+}
+
+void BytecodeCompiler::compile_address(const Expression& expr)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::IDENTIFIER:
+            if (!islocal(expr))
+                throw std::logic_error("Address of '" + *expr.str_val + "' which isn't a variable");
+            emit(OPCODE::ADDRL, expr.binding.index);
+            break;
+        case EXPR_TYPE::UNARY_STAR:
+            compile_expr(expr.expressions->front());
+            break;
+        case EXPR_TYPE::INDEXING:
+            compile_expr(expr.expressions->front());
+            compile_expr(expr.expressions->back());
+            emit(OPCODE::ADD);
+            break;
+        case EXPR_TYPE::PARENTHESIS:
+            compile_address(expr.expressions->front());
+            break;
+        default:
+            throw std::logic_error("Expression is not an lvalue");
+    }
+}
+
+void BytecodeCompiler::compile_call(const Expression& expr, bool tail)
+{
+    const Expression& callee = expr.expressions->front();
+    Word argc = expr.expressions->size() - 1;
+    for (auto it = expr.expressions->begin() + 1; it != expr.expressions->end(); ++it)
+        compile_expr(*it);
+
+    if (callee.type == EXPR_TYPE::IDENTIFIER && callee.binding.type == IDTYPE::FUNCTION)
+        emit(tail ? OPCODE::TAILCALL : OPCODE::CALL, callee.binding.index, argc);
+    else if (callee.type == EXPR_TYPE::IDENTIFIER && callee.binding.type == IDTYPE::BUILTIN)
+        emit(OPCODE::CALLB, callee.binding.index, argc);
+    else
+    {
+        compile_expr(callee);
+        emit(tail ? OPCODE::TAILCALLI : OPCODE::CALLI, argc);
+    }
+    adjust(-argc);
+}
+
+void BytecodeCompiler::compile_increment(const Expression& operand, Word delta, bool postfix)
+{
+    if (islocal(operand))
+        emit(postfix ? OPCODE::POSTINCL : OPCODE::INCL, operand.binding.index, delta);
+    else
+    {
+        compile_address(operand);
+        emit(postfix ? OPCODE::POSTINC : OPCODE::INC, delta);
+    }
+}
+
+void BytecodeCompiler::compile_compound_assignment(const Expression& expr, OPCODE op)
+{
+    const Expression& lhs = expr.expressions->front();
+    if (islocal(lhs))
+    {
+        emit(OPCODE::LOADL, lhs.binding.index);
+        compile_expr(expr.expressions->back());
+        emit(op);
+        emit(OPCODE::STOREL, lhs.binding.index);
+    }
+    else
+    {
+        compile_address(lhs);
+        emit(OPCODE::DUP);
+        emit(OPCODE::LOAD);
+        compile_expr(expr.expressions->back());
+        emit(op);
+        emit(OPCODE::STORE);
+    }
+}
+
+std::size_t BytecodeCompiler::fuse(Program& program)
+{
+#define FUSE_PART(op, offset) OPCODE::op,
+#define FUSE_SEQUENCE(name, operands, effect, ...) {OPCODE::name, {__VA_ARGS__}},
+    std::vector<std::pair<OPCODE, std::vector<OPCODE>>> sequences = {SUPERINSTRUCTIONS(FUSE_SEQUENCE, FUSE_PART)};
+#undef FUSE_SEQUENCE
+#undef FUSE_PART
+    std::stable_sort(sequences.begin(), sequences.end(), [](const std::pair<OPCODE, std::vector<OPCODE>>& a,
+                                                            const std::pair<OPCODE, std::vector<OPCODE>>& b)
+    {
+        return a.second.size() > b.second.size();
+    });
+
+    auto isjump = [](OPCODE op) {return op == OPCODE::JMP || op == OPCODE::JZ || op == OPCODE::JNZ;};
+    const std::vector<Word>& code = program.code;
+    std::vector<std::size_t> starts;
+    std::vector<bool> target(code.size() + 1, false);
+    for (std::size_t pc = 0; pc < code.size(); pc += 1 + getinfo(static_cast<OPCODE>(code[pc])).operands)
+    {
+        starts.push_back(pc);
+        if (isjump(static_cast<OPCODE>(code[pc])))
+            target[code[pc + 1]] = true;
+    }
+    for (auto it = program.functions.begin(); it != program.functions.end(); ++it)
+        target[it->entry] = true;
+
+    std::vector<Word> fused;
+    std::vector<std::size_t> moved(code.size() + 1, 0);     // new position of each instruction that starts one
+    std::vector<std::size_t> jumps;                         // positions of jump targets in fused
+    std::size_t removed = 0;
+    for (std::size_t i = 0; i < starts.size(); )
+    {
+        std::size_t length = 1;
+        OPCODE op = static_cast<OPCODE>(code[starts[i]]);
+        for (auto sequence = sequences.begin(); sequence != sequences.end(); ++sequence)
+        {
+            const std::vector<OPCODE>& parts = sequence->second;
+            bool matches = i + parts.size() <= starts.size();
+            for (std::size_t j = 0; matches && j < parts.size(); ++j)
+                matches = static_cast<OPCODE>(code[starts[i + j]]) == parts[j] && (j == 0 || !target[starts[i + j]]);
+            if (matches)
+            {
+                length = parts.size();
+                op = sequence->first;
+                break;
+            }
+        }
+
+        moved[starts[i]] = fused.size();
+        fused.push_back(static_cast<Word>(op));
+        for (std::size_t j = i; j < i + length; ++j)
+        {
+            OPCODE part = static_cast<OPCODE>(code[starts[j]]);
+            if (isjump(part))
+                jumps.push_back(fused.size());
+            fused.insert(fused.end(), code.begin() + starts[j] + 1, code.begin() + starts[j] + 1 + getinfo(part).operands);
+        }
+        removed += length - 1;
+        i += length;
+    }
+    moved[code.size()] = fused.size();
+
+    for (auto it = jumps.begin(); it != jumps.end(); ++it)
+        fused[*it] = moved[fused[*it]];
+    for (auto it = program.functions.begin(); it != program.functions.end(); ++it)
+        it->entry = moved[it->entry];
+    program.code = fused;
+    return removed;
+}
@@ -0,0 +1,53 @@
+#ifndef H_BYTECODECOMPILER
+#define H_BYTECODECOMPILER
+
+#include <map>
+#include <string>
+
+#include "bytecode.h"
+#include "expression.h"
+#include "statement.h"
+#include "function.h"
+#include "library.h"
+#include "tailcalls.h"
+
+/* Lowers an analysed library (identifiers bound, frame sizes known, see
+ * Context) to stack machine code. Function bodies are compiled one after
+ * another into a single code vector; jumps use absolute positions. */
+class BytecodeCompiler
+{
+    Program& program;
+    int depth;
+    int max_depth;
+    bool tail_calls;    // allowed in the function being compiled, see TailCalls
+
+    void emit(OPCODE op);
+    void emit(OPCODE op, Word operand);
+    void emit(OPCODE op, Word operand1, Word operand2);
+    void adjust(int effect);
+    std::size_t here() const {return program.code.size();}
+    void patch(std::size_t jump, std::size_t target);   // sets the target of the jump emitted at position jump
+
+    void compile_function(Function& function);
+    void compile_statement(const Statement& stmt);
+    void compile_expr(const Expression& expr);
+    void compile_address(const Expression& expr);
+    void compile_call(const Expression& expr, bool tail = false);
+    void compile_increment(const Expression& operand, Word delta, bool postfix);
+    void compile_compound_assignment(const Expression& expr, OPCODE op);
+
+    static bool islocal(const Expression& expr);
+
+    BytecodeCompiler(Program& _program) : program(_program), depth(0), max_depth(0), tail_calls(false) {}
+
+public:
+    static Program compile(Library& library);
+
+    /* Peephole pass replacing sequences of instructions by superinstructions,
+     * longest first, except where a jump lands inside of a sequence. Returns
+     * the number of instructions removed, each one dispatch fewer when the
+     * sequence runs. Only VM runs superinstructions. */
+    static std::size_t fuse(Program& program);
+};
+
+#endif // H_BYTECODECOMPILER
@@ -0,0 +1,211 @@
+#include <algorithm>
+
+#include "callgraph.h"
+
+CallGraph::CallGraph(Library& library)
+{
+    offsets.push_back(0);
+    std::vector<unsigned> callees;
+    for (auto it = library.functions.begin(); it != library.functions.end(); ++it)
+    {
+        callees.clear();
+        collect_statement(it->getbody(), callees);
+        std::sort(callees.begin(), callees.end());
+        callees.erase(std::unique(callees.begin(), callees.end()), callees.end());
+
+        targets.insert(targets.end(), callees.begin(), callees.end());
+        offsets.push_back(targets.size());
+    }
+    find_components();
+}
+
+void CallGraph::collect_statement(const Statement& stmt, std::vector<unsigned>& callees)
+{
+    if (stmt.expr)
+        collect_expr(*stmt.expr, callees);
+    if (stmt.vars)
+    {
+        for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            if (it->is_initialized)
+                collect_expr(*it->expr, callees);
+    }
+    if (stmt.body)
+    {
+        for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+            collect_statement(*it, callees);
+    }
+}
+
+void CallGraph::collect_expr(const Expression& expr, std::vector<unsigned>& callees)
+{
+    if (expr.type == EXPR_TYPE::IDENTIFIER && expr.binding.isresolved() && expr.binding.type == IDTYPE::FUNCTION)
+        callees.push_back(expr.binding.index);
+    if (expr.expressions)
+    {
+        for (auto it = expr.expressions->begin(); it != expr.expressions->end(); ++it)
+            collect_expr(*it, callees);
+    }
+}
+
+// Tarjan's algorithm with an explicit stack, call chains in generated code can be very long
+void CallGraph::find_components()
+{
+    const unsigned unvisited = static_cast<unsigned>(-1);
+    unsigned n = size();
+    std::vector<unsigned> index(n, unvisited), lowlink(n, 0);
+    std::vector<bool> on_stack(n, false);
+    std::vector<unsigned> scc_stack, members;
+    std::vector<std::pair<unsigned, unsigned>> call_stack;  // function and position in its callee list
+    unsigned next_index = 0, next_component = 0;
+
+    component.assign(n, 0);
+    recursive.assign(n, false);
+
+    for (unsigned root = 0; root < n; ++root)
+    {
+        if (index[root] != unvisited)
+            continue;
+
+        call_stack.push_back(std::make_pair(root, offsets[root]));
+        index[root] = lowlink[root] = next_index++;
+        scc_stack.push_back(root);
+        on_stack[root] = true;
+
+        while (!call_stack.empty())
+        {
+            unsigned v = call_stack.back().first;
+            unsigned& edge = call_stack.back().second;
+            if (edge < offsets[v + 1])
+            {
+                unsigned w = targets[edge++];
+                if (index[w] == unvisited)
+                {
+                    index[w] = lowlink[w] = next_index++;
+                    scc_stack.push_back(w);
+                    on_stack[w] = true;
+                    call_stack.push_back(std::make_pair(w, offsets[w]));
+                }
+                else if (on_stack[w])
+                    lowlink[v] = std::min(lowlink[v], index[w]);
+                continue;
+            }
+
+            call_stack.pop_back();
+            if (!call_stack.empty())
+            {
+                unsigned parent = call_stack.back().first;
+                lowlink[parent] = std::min(lowlink[parent], lowlink[v]);
+            }
+
+            if (lowlink[v] == index[v])
+            {
+                members.clear();
+                unsigned w;
+                do
+                {
+                    w = scc_stack.back();
+                    scc_stack.pop_back();
+                    on_stack[w] = false;
+                    component[w] = next_component;
+                    members.push_back(w);
+                } while (w != v);
+
+                if (members.size() > 1 || std::binary_search(callees_begin(v), callees_end(v), v))
+                {
+                    for (auto it = members.begin(); it != members.end(); ++it)
+                        recursive[*it] = true;
+                }
+                next_component++;
+            }
+        }
+    }
+}
+
+std::vector<bool> CallGraph::reachable(const std::vector<unsigned>& entry_points) const
+{
+    std::vector<bool> seen(size(), false);
+    std::vector<unsigned> worklist;
+    for (auto it = entry_points.begin(); it != entry_points.end(); ++it)
+    {
+        if (!seen[*it])
+        {
+            seen[*it] = true;
+            worklist.push_back(*it);
+        }
+    }
+
+    while (!worklist.empty())
+    {
+        unsigned f = worklist.back();
+        worklist.pop_back();
+        for (const unsigned* callee = callees_begin(f); callee != callees_end(f); ++callee)
+        {
+            if (!seen[*callee])
+            {
+                seen[*callee] = true;
+                worklist.push_back(*callee);
+            }
+        }
+    }
+    return seen;
+}
+
+std::vector<bool> CallGraph::reachable(const Library& library, const std::vector<Identifier>& entry_points) const
+{
+    std::vector<unsigned> entries;
+    for (unsigned i = 0; i < library.functions.size(); ++i)
+        if (std::find(entry_points.begin(), entry_points.end(), library.functions[i].name) != entry_points.end())
+            entries.push_back(i);
+    return reachable(entries);
+}
+
+unsigned CallGraph::prune(Library& library, const std::vector<Identifier>& entry_points)
+{
+    std::vector<bool> live = CallGraph(library).reachable(library, entry_points);
+
+    std::vector<int> new_index(library.functions.size(), -1);
+    std::vector<Function> kept;
+    for (unsigned i = 0; i < library.functions.size(); ++i)
+    {
+        if (live[i])
+        {
+            new_index[i] = kept.size();
+            kept.push_back(library.functions[i]);
+        }
+    }
+
+    unsigned removed = library.functions.size() - kept.size();
+    library.functions.swap(kept);
+    for (auto it = library.functions.begin(); it != library.functions.end(); ++it)
+        remap_statement(it->getbody(), new_index);
+    return removed;
+}
+
+void CallGraph::remap_statement(Statement& stmt, const std::vector<int>& new_index)
+{
+    if (stmt.expr)
+        remap_expr(*stmt.expr, new_index);
+    if (stmt.vars)
+    {
+        for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            if (it->is_initialized)
+                remap_expr(*it->expr, new_index);
+    }
+    if (stmt.body)
+    {
+        for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+            remap_statement(*it, new_index);
+    }
+}
+
+void CallGraph::remap_expr(Expression& expr, const std::vector<int>& new_index)
+{
+    // functions referenced from a kept function are reachable, so they're always kept too
+    if (expr.type == EXPR_TYPE::IDENTIFIER && expr.binding.isresolved() && expr.binding.type == IDTYPE::FUNCTION)
+        expr.binding.index = new_index[expr.binding.index];
+    if (expr.expressions)
+    {
+        for (auto it = expr.expressions->begin(); it != expr.expressions->end(); ++it)
+            remap_expr(*it, new_index);
+    }
+}
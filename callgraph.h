@@ -0,0 +1,50 @@
+#ifndef H_CALLGRAPH
+#define H_CALLGRAPH
+
+#include <vector>
+
+#include "identifier.h"
+#include "expression.h"
+#include "statement.h"
+#include "function.h"
+#include "library.h"
+
+/* Call graph over Library::functions in compressed sparse row form: the
+ * callees of function i are targets[offsets[i]] .. targets[offsets[i+1]-1].
+ * Any resolved reference to a function counts as an edge, not only direct
+ * calls, since a function whose address is taken may be called through it.
+ * Built from identifier bindings, so names must be resolved first. */
+class CallGraph
+{
+    private:
+        std::vector<unsigned> offsets;
+        std::vector<unsigned> targets;
+        std::vector<unsigned> component;    // strongly connected component of each function
+        std::vector<bool> recursive;
+
+        static void collect_statement(const Statement& stmt, std::vector<unsigned>& callees);
+        static void collect_expr(const Expression& expr, std::vector<unsigned>& callees);
+        static void remap_statement(Statement& stmt, const std::vector<int>& new_index);
+        static void remap_expr(Expression& expr, const std::vector<int>& new_index);
+
+        void find_components();
+
+    public:
+        CallGraph(Library& library);
+
+        unsigned size() const {return offsets.size() - 1;}
+        const unsigned* callees_begin(unsigned function) const {return targets.data() + offsets[function];}
+        const unsigned* callees_end(unsigned function) const {return targets.data() + offsets[function + 1];}
+
+        // components are numbered in reverse topological order: callees before callers
+        unsigned getcomponent(unsigned function) const {return component[function];}
+        bool isrecursive(unsigned function) const {return recursive[function];}
+
+        std::vector<bool> reachable(const std::vector<unsigned>& entry_points) const;
+        std::vector<bool> reachable(const Library& library, const std::vector<Identifier>& entry_points) const;
+
+        // removes unreachable functions and renumbers function bindings in the remaining ones
+        static unsigned prune(Library& library, const std::vector<Identifier>& entry_points);
+};
+
+#endif // H_CALLGRAPH
@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "ccodegen.h"
+#include "builtins.h"
+
+void CCodegen::generate(Library& library, std::ostream& out)
+{
+    CCodegen codegen(library);
+    for (auto it = library.functions.begin(); it != library.functions.end(); ++it)
+        codegen.generate_function(*it);
+
+    out<<"/* Generated from B, compile with bruntime.h on the include path and link with the bruntime library */\n";
+    out<<"#include \"bruntime.h\"\n\n";
+    for (auto it = library.functions.begin(); it != library.functions.end(); ++it)
+        out<<signature(*it)<<";\n";
+
+    out<<"\nconst bfunction brt_functions[] = {";
+    for (auto it = library.functions.begin(); it != library.functions.end(); ++it)
+        out<<"(bfunction)b_"<<it->name<<", ";
+    out<<"0};\n";
+
+    if (!codegen.data.statics.empty())
+    {
+        out<<"\nstatic bword brt_statics[] = {";
+        for (std::size_t i = 0; i < codegen.data.statics.size(); ++i)
+            out<<(i ? ", " : "")<<codegen.data.statics[i];
+        out<<"};\n";
+    }
+    out<<codegen.definitions.str();
+}
+
+std::string CCodegen::local_name(const Identifier& name, unsigned slot)
+{
+    return name + "_" + std::to_string(slot);
+}
+
+// main is called by the runtime library, everything else can be static
+std::string CCodegen::signature(const Function& function)
+{
+    std::string text = (function.name == "main" ? "bword b_" : "static bword b_") + function.name + "(";
+    for (std::size_t i = 0; i < function.params.size(); ++i)
+        text += (i ? ", bword " : "bword ") + local_name(function.params[i], i);
+    return text + (function.params.empty() ? "void)" : ")");
+}
+
+void CCodegen::collect_names(const Statement& stmt, std::vector<std::string>& names)
+{
+    if (stmt.type == STATEMENT_TYPE::VAR_DEF)
+    {
+        for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            if (names[it->binding.index].empty())
+                names[it->binding.index] = local_name(it->name, it->binding.index);
+    }
+    else if (stmt.body)
+    {
+        for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+            collect_names(*it, names);
+    }
+}
+
+void CCodegen::generate_function(Function& function)
+{
+    unsigned params = function.params.size();
+    unsigned frame = std::max(function.frame_size, params);
+    locals.assign(frame, std::string());
+    for (unsigned i = 0; i < params; ++i)
+        locals[i] = local_name(function.params[i], i);
+    collect_names(function.getbody(), locals);
+    for (unsigned slot = params; slot < frame; ++slot)
+        if (locals[slot].empty())
+            locals[slot] = local_name("slot", slot);
+
+    temporaries = 0;
+    depth = 1;
+    std::stringstream body;
+    generate_statement(function.getbody(), body);
+
+    definitions<<"\n"<<signature(function)<<"\n{\n";
+    for (unsigned slot = params; slot < frame; ++slot)
+        definitions<<"    bword "<<locals[slot]<<" = 0;\n";
+    for (unsigned i = 0; i < temporaries; ++i)
+        definitions<<(i ? ", t" : "    bword t")<<i<<(i + 1 == temporaries ? ";\n" : "");
+    definitions<<body.str();
+    definitions<<"    return 0;\n}\n";
+}
+
+void CCodegen::generate_statement(const Statement& stmt, std::ostream& body)
+{
+    switch (stmt.type)
+    {
+        case STATEMENT_TYPE::COMPOUND:
+            for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+                generate_statement(*it, body);
+            break;
+        case STATEMENT_TYPE::CONDITIONAL:
+        case STATEMENT_TYPE::LOOP:
+            body<<indent()<<(stmt.type == STATEMENT_TYPE::LOOP ? "while (" : "if (")<<expr(*stmt.expr)<<")\n";
+            body<<indent()<<"{\n";
+            depth++;
+            generate_statement(stmt.body->back(), body);
+            depth--;
+            body<<indent()<<"}\n";
+            break;
+        case STATEMENT_TYPE::RETURN:
+            body<<indent()<<"return "<<expr(*stmt.expr)<<";\n";
+            break;
+        case STATEMENT_TYPE::VAR_DEF:
+            for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+                if (it->is_initialized)
+                    body<<indent()<<locals[it->binding.index]<<" = "<<expr(*it->expr)<<";\n";
+            break;
+        case STATEMENT_TYPE::EXPRESSION:
+            body<<indent()<<expr(*stmt.expr)<<";\n";
+            break;
+        case STATEMENT_TYPE::NOP:
+            break;
+    }
+}
+
+bool CCodegen::islocal(const Expression& expr)
+{
+    return expr.type == EXPR_TYPE::IDENTIFIER &&
+           (expr.binding.type == IDTYPE::VARIABLE || expr.binding.type == IDTYPE::PARAMETER);
+}
+
+// values that don't depend on when they're evaluated
+bool CCodegen::isconstant(const Expression& expr)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::INT_LITERAL:
+        case EXPR_TYPE::STR_LITERAL:
+        case EXPR_TYPE::NONE:
+            return true;
+        case EXPR_TYPE::IDENTIFIER:
+            return !islocal(expr);
+        case EXPR_TYPE::PARENTHESIS:
+            return isconstant(expr.expressions->front());
+        default:
+            return false;
+    }
+}
+
+std::string CCodegen::wrap(const std::string& prefix, const std::string& value)
+{
+    return prefix.empty() ? value : "(" + prefix + value + ")";
+}
+
+/* C of each operand, in values. If one has side effects and another one
+ * could see them (or force is set), the operands are assigned to
+ * temporaries in order and values name the temporaries; the returned
+ * prefix is the comma separated assignments, see wrap(). */
+std::string CCodegen::sequence(const std::vector<const Expression*>& operands, std::vector<std::string>& values, bool force)
+{
+    unsigned varying = 0;
+    bool effects = false;
+    for (auto it = operands.begin(); it != operands.end(); ++it)
+    {
+        varying += !isconstant(**it);
+        effects = effects || (*it)->haseffects();
+    }
+
+    std::string prefix;
+    values.clear();
+    for (auto it = operands.begin(); it != operands.end(); ++it)
+    {
+        std::string value = expr(**it);
+        if ((force || (effects && varying > 1)) && !isconstant(**it))
+        {
+            std::string temporary = "t" + std::to_string(temporaries++);
+            prefix += temporary + " = " + value + ", ";
+            value = temporary;
+        }
+        values.push_back(value);
+    }
+    return prefix;
+}
+
+// B address of an lvalue, locals are addressed with B_ADDRESS
+std::string CCodegen::address(const Expression& expr)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::IDENTIFIER:
+            if (!islocal(expr))
+                throw std::logic_error("Address of '" + *expr.str_val + "' which isn't a variable");
+            return "B_ADDRESS(" + locals[expr.binding.index] + ")";
+        case EXPR_TYPE::UNARY_STAR:
+            return this->expr(expr.expressions->front());
+        case EXPR_TYPE::INDEXING:
+        {
+            std::vector<std::string> values;
+            std::string prefix = sequence({&expr.expressions->front(), &expr.expressions->back()}, values);
+            return wrap(prefix, "brt_add(" + values[0] + ", " + values[1] + ")");
+        }
+        case EXPR_TYPE::PARENTHESIS:
+            return address(expr.expressions->front());
+        default:
+            throw std::logic_error("Expression is not an lvalue");
+    }
+}
+
+std::string CCodegen::lvalue(const Expression& expr)
+{
+    if (expr.type == EXPR_TYPE::PARENTHESIS)
+        return lvalue(expr.expressions->front());
+    if (islocal(expr))
+        return locals[expr.binding.index];
+    return "B_WORD(" + address(expr) + ")";
+}
+
+std::string CCodegen::expr(const Expression& expr)
+{
+    const std::vector<Expression>* operands = expr.expressions.get();
+    std::vector<std::string> values;
+    switch (expr.type)
+    {
+        case EXPR_TYPE::NONE:
+            return "((bword)0)";
+        case EXPR_TYPE::INT_LITERAL:
+            // bword, not int, also where they're passed to printf and read back with va_arg
+            return "((bword)" + std::to_string(*expr.int_val) + ")";
+        case EXPR_TYPE::STR_LITERAL:
+            return "B_ADDRESS(brt_statics[" + std::to_string(data.intern(*expr.str_val)) + "])";
+        case EXPR_TYPE::IDENTIFIER:
+            switch (expr.binding.type)
+            {
+                case IDTYPE::VARIABLE:
+                case IDTYPE::PARAMETER:
+                    return locals[expr.binding.index];
+                case IDTYPE::FUNCTION:
+                    return "((bword)" + std::to_string(expr.binding.index) + ")";
+                case IDTYPE::BUILTIN:
+                    return "((bword)" + std::to_string(-expr.binding.index - 1) + ")";
+            }
+            break;
+        case EXPR_TYPE::PARENTHESIS:
+            return this->expr(operands->front());
+        case EXPR_TYPE::INDEXING:
+        case EXPR_TYPE::UNARY_STAR:
+            return "B_WORD(" + address(expr) + ")";
+        case EXPR_TYPE::UNARY_AMP:
+            return address(operands->front());
+        case EXPR_TYPE::FUNC_CALL:
+            return call(expr);
+        case EXPR_TYPE::BIN_EQUALS:
+        case EXPR_TYPE::BIN_PLUSEQUALS:
+        case EXPR_TYPE::BIN_MINUSEQUALS:
+        {
+            // the lvalue's address is evaluated before the value, like in the interpreters
+            const Expression& target = operands->front();
+            const Expression& value = operands->back();
+            std::string prefix, place;
+            if (islocal(target) || !(target.haseffects() || value.haseffects()))
+                place = lvalue(target);
+            else
+            {
+                std::string temporary = "t" + std::to_string(temporaries++);
+                prefix = temporary + " = " + address(target) + ", ";
+                place = "B_WORD(" + temporary + ")";
+            }
+            std::string assigned = this->expr(value);
+            bool sequenced = islocal(target) ? value.haseffects() : !prefix.empty();
+            std::string current;
+            if (sequenced && !isconstant(value))
+            {
+                // and the old value of a compound assignment before a value that may change it
+                if (expr.type != EXPR_TYPE::BIN_EQUALS && value.haseffects())
+                {
+                    current = "t" + std::to_string(temporaries++);
+                    prefix += current + " = " + place + ", ";
+                }
+                std::string temporary = "t" + std::to_string(temporaries++);
+                prefix += temporary + " = " + assigned + ", ";
+                assigned = temporary;
+            }
+            if (expr.type == EXPR_TYPE::BIN_EQUALS)
+                return wrap(prefix, "(" + place + " = " + assigned + ")");
+            if (!current.empty())
+            {
+                std::string op = expr.type == EXPR_TYPE::BIN_PLUSEQUALS ? "brt_add(" : "brt_sub(";
+                return wrap(prefix, "(" + place + " = " + op + current + ", " + assigned + "))");
+            }
+            std::string helper = expr.type == EXPR_TYPE::BIN_PLUSEQUALS ? "brt_addto(&" : "brt_subfrom(&";
+            return wrap(prefix, helper + place + ", " + assigned + ")");
+        }
+        case EXPR_TYPE::BIN_PLUS:
+        case EXPR_TYPE::BIN_MINUS:
+        case EXPR_TYPE::BIN_COMPARE:
+        case EXPR_TYPE::BIN_NEGATEEQUALS:
+        {
+            std::string prefix = sequence({&operands->front(), &operands->back()}, values);
+            if (expr.type == EXPR_TYPE::BIN_PLUS)
+                return wrap(prefix, "brt_add(" + values[0] + ", " + values[1] + ")");
+            if (expr.type == EXPR_TYPE::BIN_MINUS)
+                return wrap(prefix, "brt_sub(" + values[0] + ", " + values[1] + ")");
+            std::string op = expr.type == EXPR_TYPE::BIN_COMPARE ? " == " : " != ";
+            return wrap(prefix, "(bword)(" + values[0] + op + values[1] + ")");
+        }
+        case EXPR_TYPE::BIN_AND:
+            return "(bword)(" + this->expr(operands->front()) + " && " + this->expr(operands->back()) + ")";
+        case EXPR_TYPE::BIN_OR:
+            return "(bword)(" + this->expr(operands->front()) + " || " + this->expr(operands->back()) + ")";
+        case EXPR_TYPE::TERNARY:
+            return "(" + this->expr(operands->at(0)) + " ? " + this->expr(operands->at(1)) + " : " + this->expr(operands->at(2)) + ")";
+        case EXPR_TYPE::BIN_COMMA:
+            return "(" + this->expr(operands->front()) + ", " + this->expr(operands->back()) + ")";
+        case EXPR_TYPE::UNARY_MINUS:
+            return "brt_neg(" + this->expr(operands->front()) + ")";
+        case EXPR_TYPE::UNARY_NEGATE:
+            return "(bword)!" + this->expr(operands->front());
+        case EXPR_TYPE::UNARY_PREINCR:
+        case EXPR_TYPE::UNARY_PREDECR:
+        case EXPR_TYPE::UNARY_POSTINCR:
+        case EXPR_TYPE::UNARY_POSTDECR:
+        {
+            bool postfix = expr.type == EXPR_TYPE::UNARY_POSTINCR || expr.type == EXPR_TYPE::UNARY_POSTDECR;
+            bool increment = expr.type == EXPR_TYPE::UNARY_PREINCR || expr.type == EXPR_TYPE::UNARY_POSTINCR;
+            return std::string(postfix ? "brt_postadd(&" : "brt_addto(&") + lvalue(operands->front()) + (increment ? ", 1)" : ", -1)");
+        }
+    }
+    throw std::logic_error("Unknown expression type");
+}
+
+/* Direct calls get exactly the parameters of the callee (missing ones are
+ * zero, extra ones are evaluated and dropped), calls through a value cast
+ * it to a function taking the number of arguments given. */
+std::string CCodegen::call(const Expression& expr)
+{
+    const Expression& callee = expr.expressions->front();
+    std::vector<const Expression*> operands;
+    bool direct = callee.type == EXPR_TYPE::IDENTIFIER &&
+                  (callee.binding.type == IDTYPE::FUNCTION || callee.binding.type == IDTYPE::BUILTIN);
+    if (!direct)
+        operands.push_back(&callee);
+    for (auto it = expr.expressions->begin() + 1; it != expr.expressions->end(); ++it)
+        operands.push_back(&*it);
+
+    std::size_t argc = expr.expressions->size() - 1;
+    std::string name;
+    int params = argc;
+    if (direct && callee.binding.type == IDTYPE::FUNCTION)
+    {
+        name = "b_" + library.functions[callee.binding.index].name;
+        params = library.functions[callee.binding.index].params.size();
+    }
+    else if (direct)
+    {
+        name = "brt_" + builtins[callee.binding.index].name;
+        params = builtins[callee.binding.index].arity < 0 ? argc : builtins[callee.binding.index].arity;
+    }
+
+    bool dropped_effects = false;
+    for (std::size_t arg = params; arg < argc; ++arg)
+        dropped_effects = dropped_effects || expr.expressions->at(arg + 1).haseffects();
+
+    std::vector<std::string> values;
+    std::string prefix = sequence(operands, values, dropped_effects);
+    std::size_t first = direct ? 0 : 1;
+
+    std::string function = name;
+    if (!direct)
+    {
+        function = "((bword (*)(";
+        for (std::size_t arg = 0; arg < argc; ++arg)
+            function += arg ? ", bword" : "bword";
+        function += argc ? "))B_FUNCTION(" : "void))B_FUNCTION(";
+        function += values[0] + "))";
+    }
+
+    std::string text = function + "(";
+    for (int arg = 0; arg < params; ++arg)
+    {
+        text += arg ? ", " : "";
+        text += arg < static_cast<int>(argc) ? values[first + arg] : "0";
+    }
+    return wrap(prefix, text + ")");
+}
@@ -0,0 +1,53 @@
+#ifndef H_CCODEGEN
+#define H_CCODEGEN
+
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "expression.h"
+#include "statement.h"
+#include "function.h"
+#include "library.h"
+
+/* Translates an analysed library to C using the helpers in bruntime.h.
+ * Every function becomes b_<name> with its frame slots as local variables,
+ * all declared (and zeroed) at the top so that B's function wide lifetime
+ * of variables is kept. Lvalues are locals or B_WORD(address). C leaves the
+ * order of evaluation of most operands unspecified, so whenever it could
+ * matter the operands are first assigned, left to right, to temporaries. */
+class CCodegen
+{
+    const Library& library;
+    std::stringstream definitions;
+    Program data;           // only its string literals are used
+    std::vector<std::string> locals;
+    unsigned temporaries;
+    unsigned depth;
+
+    void generate_function(Function& function);
+    void generate_statement(const Statement& stmt, std::ostream& body);
+    std::string expr(const Expression& expr);
+    std::string lvalue(const Expression& expr);
+    std::string address(const Expression& expr);
+    std::string call(const Expression& expr);
+    std::string sequence(const std::vector<const Expression*>& operands, std::vector<std::string>& values,
+                         bool force = false);
+    static std::string signature(const Function& function);
+    static std::string local_name(const Identifier& name, unsigned slot);
+    std::string indent() const {return std::string(4 * depth, ' ');}
+
+    static bool isconstant(const Expression& expr);
+    static bool islocal(const Expression& expr);
+    static std::string wrap(const std::string& prefix, const std::string& value);
+    static void collect_names(const Statement& stmt, std::vector<std::string>& names);
+
+    CCodegen(const Library& _library) : library(_library), temporaries(0), depth(0) {}
+
+public:
+    static void generate(Library& library, std::ostream& out);
+};
+
+#endif // H_CCODEGEN
@@ -0,0 +1,298 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "compileserver.h"
+#include "serverprotocol.h"
+#include "lazyparser.h"
+#include "context.h"
+#include "constantfolder.h"
+#include "inliner.h"
+#include "bytecodecompiler.h"
+#include "programimage.h"
+
+#ifdef SERVER_PROTOCOL_SUPPORTED
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/time.h>
+#endif
+
+CompileServer::CompileServer(const std::string& _path, unsigned _threads, std::size_t _cache_bytes,
+                             const std::string& _cache_directory, std::uintmax_t _cache_directory_bytes)
+    : path(_path), threads(_threads ? _threads : 1), cache_directory(_cache_directory),
+      cache_directory_bytes(_cache_directory_bytes), listener(-1), wake{-1, -1}, stopping(false),
+      cache_bytes(_cache_bytes), cached_bytes(0)
+{
+#ifdef SERVER_PROTOCOL_SUPPORTED
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Socket path " + path + " is too long");
+    path.copy(address.sun_path, path.size());
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        throw std::runtime_error("Cannot create a socket");
+    // a socket left behind by a server that was killed
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+    {
+        close(listener);
+        throw std::runtime_error("Cannot listen on " + path);
+    }
+    // neither end blocks: the poll drains it, and a full pipe already wakes it
+    if (pipe(wake) != 0 || fcntl(wake[0], F_SETFL, O_NONBLOCK) != 0 || fcntl(wake[1], F_SETFL, O_NONBLOCK) != 0)
+    {
+        close(listener);
+        throw std::runtime_error("Cannot create a pipe");
+    }
+#else
+    throw std::runtime_error("The compile server needs a POSIX system");
+#endif
+}
+
+CompileServer::~CompileServer()
+{
+#ifdef SERVER_PROTOCOL_SUPPORTED
+    if (listener >= 0)
+    {
+        close(listener);
+        unlink(path.c_str());
+    }
+    for (int end : wake)
+        if (end >= 0)
+            close(end);
+#endif
+}
+
+void CompileServer::serve()
+{
+    std::vector<std::thread> handlers;
+    for (unsigned i = 0; i < threads; ++i)
+        handlers.push_back(std::thread(&CompileServer::handle_requests, this));
+    watch_connections();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    request_ready.notify_all();
+    for (auto it = handlers.begin(); it != handlers.end(); ++it)
+        it->join();
+#ifdef SERVER_PROTOCOL_SUPPORTED
+    for (auto it = returned.begin(); it != returned.end(); ++it)
+        close(*it);
+    returned.clear();
+#endif
+}
+
+void CompileServer::watch_connections()
+{
+#ifdef SERVER_PROTOCOL_SUPPORTED
+    std::vector<int> idle;      // connections waiting for their next request
+    std::vector<pollfd> polled;
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            idle.insert(idle.end(), returned.begin(), returned.end());
+            returned.clear();
+        }
+        polled.assign({{listener, POLLIN, 0}, {wake[0], POLLIN, 0}});
+        for (auto it = idle.begin(); it != idle.end(); ++it)
+            polled.push_back({*it, POLLIN, 0});
+        if (poll(polled.data(), polled.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr<<"Cannot poll connections on "<<path<<": "<<std::strerror(errno)<<std::endl;
+            break;
+        }
+
+        char drained[64];
+        if (polled[1].revents)
+            while (read(wake[0], drained, sizeof(drained)) > 0)
+                ;
+        // a request, or the client hanging up, is for a handler to find out
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < idle.size(); ++i)
+        {
+            if (polled[i + 2].revents)
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                ready.push_back(idle[i]);
+                request_ready.notify_one();
+            }
+            else
+                idle[kept++] = idle[i];
+        }
+        idle.resize(kept);
+
+        if (!(polled[0].revents & POLLIN))
+            continue;
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN)
+                continue;
+            std::cerr<<"Cannot accept connections on "<<path<<": "<<std::strerror(errno)<<std::endl;
+            break;
+        }
+        timeval stall = {stall_seconds, 0};
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &stall, sizeof(stall));
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &stall, sizeof(stall));
+        idle.push_back(connection);
+    }
+    for (auto it = idle.begin(); it != idle.end(); ++it)
+        close(*it);
+#endif
+}
+
+void CompileServer::handle_requests()
+{
+#ifdef SERVER_PROTOCOL_SUPPORTED
+    // requests are already spread over the handlers
+    ThreadPool pool(1);
+    while (true)
+    {
+        int connection;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            request_ready.wait(lock, [this]() {return stopping || !ready.empty();});
+            if (ready.empty())
+                return;
+            connection = ready.front();
+            ready.pop_front();
+        }
+
+        std::uint8_t command;
+        std::string source;
+        if (receive_frame(connection, command, source))
+        {
+            std::string request = static_cast<char>(command) + source;
+            std::string response = respond(request, pool);
+            if (send_frame(connection, response[0], response.data() + 1, response.size() - 1))
+            {
+                hand_back(connection);
+                continue;
+            }
+        }
+        close(connection);
+    }
+#endif
+}
+
+void CompileServer::hand_back(int connection)
+{
+#ifdef SERVER_PROTOCOL_SUPPORTED
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        returned.push_back(connection);
+    }
+    // when the pipe is full the poll wakes up anyway
+    char wakeup = 0;
+    ssize_t written = write(wake[1], &wakeup, 1);
+    static_cast<void>(written);
+#endif
+}
+
+// the status byte followed by the body of the response
+std::string CompileServer::respond(const std::string& request, ThreadPool& pool)
+{
+    std::uint64_t key = AstCache::hash(request.data(), request.size());
+    std::string response;
+    if (lookup(key, request, response))
+        return response;
+    // lexer needs a trailing separator after the last token
+    std::shared_ptr<std::string> source = std::make_shared<std::string>(request.substr(1) + "\n");
+    response = compile(static_cast<std::uint8_t>(request[0]), source, pool);
+    remember(key, request, response);
+    return response;
+}
+
+std::string CompileServer::compile(std::uint8_t command, std::shared_ptr<std::string> source, ThreadPool& pool)
+{
+    const char ok = static_cast<char>(SERVER_STATUS::OK), failed = static_cast<char>(SERVER_STATUS::FAILED);
+    try
+    {
+        Library lib = cache_directory.empty() ? LazyParser::parse(source)
+                                              : AstCache(cache_directory, cache_directory_bytes).parse(source);
+        switch (static_cast<SERVER_COMMAND>(command))
+        {
+            case SERVER_COMMAND::SIGNATURES:
+            {
+                std::string text(1, ok);
+                for (auto it = lib.functions.begin(); it != lib.functions.end(); ++it)
+                {
+                    text += it->name + "(";
+                    for (auto param = it->params.begin(); param != it->params.end(); ++param)
+                        text += (param != it->params.begin() ? ", " : "") + *param;
+                    text += ")\n";
+                }
+                return text;
+            }
+            case SERVER_COMMAND::CHECK:
+            case SERVER_COMMAND::COMPILE:
+            {
+                std::vector<Diagnostic> diagnostics = Context::analyse(lib, pool);
+                std::string text(1, diagnostics.empty() ? ok : failed);
+                for (auto it = diagnostics.begin(); it != diagnostics.end(); ++it)
+                    text += it->function + ": " + it->message + "\n";
+                if (!diagnostics.empty() || static_cast<SERVER_COMMAND>(command) == SERVER_COMMAND::CHECK)
+                    return text;
+
+                ConstantFolder::fold(lib, pool);
+                InlineOptions options;
+                if (Inliner::inline_calls(lib, options))
+                    ConstantFolder::fold(lib, pool);
+                Program program = BytecodeCompiler::compile(lib);
+                BytecodeCompiler::fuse(program);
+                std::vector<char> image = ProgramImage::serialize(program);
+                return std::string(1, ok) + std::string(image.begin(), image.end());
+            }
+        }
+        return std::string(1, failed) + "Unknown command " + std::to_string(command) + "\n";
+    }
+    catch (const std::exception& e)
+    {
+        return std::string(1, failed) + e.what() + "\n";
+    }
+}
+
+bool CompileServer::lookup(std::uint64_t key, const std::string& request, std::string& response)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto found = cached.find(key);
+    if (found == cached.end() || found->second->second.request != request)
+        return false;
+    recent.splice(recent.begin(), recent, found->second);
+    response = found->second->second.response;
+    return true;
+}
+
+void CompileServer::remember(std::uint64_t key, const std::string& request, const std::string& response)
+{
+    std::size_t bytes = request.size() + response.size();
+    if (bytes > cache_bytes)
+        return;
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto found = cached.find(key);
+    if (found != cached.end())
+    {
+        cached_bytes -= found->second->second.request.size() + found->second->second.response.size();
+        recent.erase(found->second);
+        cached.erase(found);
+    }
+    while (cached_bytes + bytes > cache_bytes)
+    {
+        const CachedResponse& oldest = recent.back().second;
+        cached_bytes -= oldest.request.size() + oldest.response.size();
+        cached.erase(recent.back().first);
+        recent.pop_back();
+    }
+    recent.emplace_front(key, CachedResponse{request, response});
+    cached[key] = recent.begin();
+    cached_bytes += bytes;
+}
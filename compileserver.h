@@ -0,0 +1,79 @@
+#ifndef H_COMPILESERVER
+#define H_COMPILESERVER
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "astcache.h"
+#include "threadpool.h"
+
+/* Compiles sources sent over a Unix domain socket, in frames described in
+ * serverprotocol.h. The point is to pay for process startup and for
+ * building the lexer and parser tables once instead of for every small
+ * file. The thread running serve() accepts connections and polls the idle
+ * ones; a connection with a request waiting is queued for the handler
+ * threads, one of which receives that request, answers it and hands the
+ * connection back. Each request is a unit of work of its own, so as many
+ * run at once as there are handlers however many clients stay connected,
+ * and a client stalling halfway through a frame is dropped after
+ * stall_seconds. Handlers analyse with a single-threaded pool of their
+ * own. Responses are kept in memory, keyed by command and source, until
+ * they take more than cache_bytes; with a cache directory, parsed sources
+ * are also kept in an AstCache. */
+class CompileServer
+{
+    struct CachedResponse
+    {
+        std::string request;    // command and source, compared on a hash match
+        std::string response;
+    };
+
+    static const int stall_seconds = 10;
+
+    std::string path;
+    unsigned threads;
+    std::string cache_directory;
+    std::uintmax_t cache_directory_bytes;
+    int listener;
+    int wake[2];    // a pipe, written to when a connection is handed back to the poll
+
+    std::mutex queue_mutex;
+    std::condition_variable request_ready;
+    std::deque<int> ready;      // connections with a request waiting, for the handlers
+    std::vector<int> returned;  // connections whose request was answered, for the poll
+    bool stopping;
+
+    std::mutex cache_mutex;
+    std::list<std::pair<std::uint64_t, CachedResponse>> recent;    // most recently used first
+    std::unordered_map<std::uint64_t, decltype(recent)::iterator> cached;
+    std::size_t cache_bytes;
+    std::size_t cached_bytes;
+
+    // accepts connections and queues those with a request, until accepting fails for good
+    void watch_connections();
+    void handle_requests();
+    void hand_back(int connection);
+    std::string respond(const std::string& request, ThreadPool& pool);
+    std::string compile(std::uint8_t command, std::shared_ptr<std::string> source, ThreadPool& pool);
+    bool lookup(std::uint64_t key, const std::string& request, std::string& response);
+    void remember(std::uint64_t key, const std::string& request, const std::string& response);
+
+public:
+    CompileServer(const std::string& _path, unsigned _threads, std::size_t _cache_bytes = std::size_t(1) << 26,
+                  const std::string& _cache_directory = std::string(), std::uintmax_t _cache_directory_bytes = std::uintmax_t(1) << 28);
+    ~CompileServer();
+    CompileServer(const CompileServer&) = delete;
+    CompileServer& operator=(const CompileServer&) = delete;
+
+    // listens on path until the process ends or accepting connections fails
+    void serve();
+};
+
+#endif // H_COMPILESERVER
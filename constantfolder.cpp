@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <climits>
+
+#include "constantfolder.h"
+
+static Word add(Word a, Word b)
+{
+    return static_cast<Word>(static_cast<std::uint64_t>(a) + static_cast<std::uint64_t>(b));
+}
+
+static Word negate(Word a)
+{
+    return static_cast<Word>(0 - static_cast<std::uint64_t>(a));
+}
+
+static bool fits(Word value)
+{
+    return value >= INT_MIN && value <= INT_MAX;
+}
+
+void ConstantFolder::fold(Library& library, ThreadPool& pool)
+{
+    pool.parallel_for(library.functions.size(), [&](std::size_t i)
+    {
+        fold(library.functions[i]);
+    });
+}
+
+void ConstantFolder::fold(Function& function)
+{
+    fold_statement(function.getbody());
+}
+
+void ConstantFolder::fold_statement(Statement& stmt)
+{
+    bool branching = stmt.type == STATEMENT_TYPE::CONDITIONAL || stmt.type == STATEMENT_TYPE::LOOP;
+    if (stmt.expr)
+        fold_expr(*stmt.expr, branching || stmt.type == STATEMENT_TYPE::EXPRESSION);
+    if (stmt.vars)
+    {
+        for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            if (it->is_initialized)
+                fold_expr(*it->expr, false);
+    }
+    if (stmt.body)
+    {
+        for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+            fold_statement(*it);
+        if (stmt.type == STATEMENT_TYPE::COMPOUND)
+            stmt.body->erase(std::remove_if(stmt.body->begin(), stmt.body->end(),
+                                            [](const Statement& s) {return s.type == STATEMENT_TYPE::NOP;}),
+                             stmt.body->end());
+    }
+
+    Word condition;
+    if (branching && isliteral(*stmt.expr, condition))
+    {
+        if (condition == 0)
+            stmt = Statement();
+        else if (stmt.type == STATEMENT_TYPE::CONDITIONAL)
+        {
+            Statement body = stmt.body->back();
+            stmt = body;
+        }
+    }
+}
+
+/* Folds expr and its operands bottom up. With truth_only set only whether
+ * the value is zero matters, so any non-zero value may stand for 1. */
+void ConstantFolder::fold_expr(Expression& expr, bool truth_only)
+{
+    if (!expr.expressions)
+        return;
+
+    std::vector<Expression>& operands = *expr.expressions;
+    Word a, b;
+    switch (expr.type)
+    {
+        case EXPR_TYPE::PARENTHESIS:
+            fold_expr(operands[0], truth_only);
+            replace(expr, operands[0]);
+            break;
+        case EXPR_TYPE::UNARY_NEGATE:
+            fold_expr(operands[0], true);
+            if (isliteral(operands[0], a))
+                expr = Expression(a == 0 ? 1 : 0);
+            else if (operands[0].type == EXPR_TYPE::UNARY_NEGATE)
+                fold_truth(expr, operands[0].expressions->front(), truth_only);
+            else if (operands[0].type == EXPR_TYPE::BIN_COMPARE || operands[0].type == EXPR_TYPE::BIN_NEGATEEQUALS)
+            {
+                Expression comparison = operands[0];
+                expr = Expression(comparison.type == EXPR_TYPE::BIN_COMPARE ? EXPR_TYPE::BIN_NEGATEEQUALS : EXPR_TYPE::BIN_COMPARE,
+                                  comparison.expressions->at(0), comparison.expressions->at(1));
+            }
+            break;
+        case EXPR_TYPE::UNARY_MINUS:
+            fold_expr(operands[0], false);
+            if (isliteral(operands[0], a))
+            {
+                if (fits(negate(a)))
+                    expr = Expression(static_cast<int>(negate(a)));
+            }
+            else if (operands[0].type == EXPR_TYPE::UNARY_MINUS)
+                replace(expr, operands[0].expressions->front());
+            break;
+        case EXPR_TYPE::BIN_PLUS:
+        case EXPR_TYPE::BIN_MINUS:
+            fold_expr(operands[0], false);
+            fold_expr(operands[1], false);
+            fold_sum(expr);
+            break;
+        case EXPR_TYPE::BIN_COMPARE:
+        case EXPR_TYPE::BIN_NEGATEEQUALS:
+            fold_expr(operands[0], false);
+            fold_expr(operands[1], false);
+            if (isliteral(operands[0], a) && isliteral(operands[1], b))
+                expr = Expression((a == b) == (expr.type == EXPR_TYPE::BIN_COMPARE) ? 1 : 0);
+            else if (expr.type == EXPR_TYPE::BIN_NEGATEEQUALS && isliteral(operands[1], b) && b == 0)
+                fold_truth(expr, operands[0], truth_only);
+            else if (expr.type == EXPR_TYPE::BIN_NEGATEEQUALS && isliteral(operands[0], a) && a == 0)
+                fold_truth(expr, operands[1], truth_only);
+            break;
+        case EXPR_TYPE::BIN_AND:
+        case EXPR_TYPE::BIN_OR:
+        {
+            bool conjunction = expr.type == EXPR_TYPE::BIN_AND;
+            fold_expr(operands[0], true);
+            fold_expr(operands[1], true);
+            if (isliteral(operands[0], a))
+            {
+                if ((a != 0) == conjunction)    // 1 && x, 0 || x
+                    fold_truth(expr, operands[1], truth_only);
+                else                            // 0 && x, 1 || x, x is never evaluated
+                    expr = Expression(conjunction ? 0 : 1);
+            }
+            else if (isliteral(operands[1], b))
+            {
+                if ((b != 0) == conjunction)
+                    fold_truth(expr, operands[0], truth_only);
+                else if (!operands[0].haseffects())
+                    expr = Expression(conjunction ? 0 : 1);
+            }
+            break;
+        }
+        case EXPR_TYPE::TERNARY:
+            fold_expr(operands[0], true);
+            fold_expr(operands[1], truth_only);
+            fold_expr(operands[2], truth_only);
+            if (isliteral(operands[0], a))
+                replace(expr, operands[a != 0 ? 1 : 2]);
+            else if (isliteral(operands[1], a) && isliteral(operands[2], b))
+            {
+                if (a == b && operands[0].haseffects())
+                    expr = Expression(EXPR_TYPE::BIN_COMMA, operands[0], operands[1]);
+                else if (a == b)
+                    replace(expr, operands[1]);
+                else if (b == 0 && (truth_only || a == 1))     // c ? 1 : 0
+                    fold_truth(expr, operands[0], truth_only);
+            }
+            break;
+        case EXPR_TYPE::BIN_COMMA:
+            fold_expr(operands[0], true);   // the value is discarded
+            fold_expr(operands[1], truth_only);
+            if (!operands[0].haseffects())
+                replace(expr, operands[1]);
+            break;
+        default:    // indexing, calls, assignments, & and *; their lvalue operands stay lvalues
+            for (auto it = operands.begin(); it != operands.end(); ++it)
+                fold_expr(*it, false);
+            break;
+    }
+}
+
+// x + c, x - c, 0 + x, 0 - x and (x + c1) - c2 with literal c's, operands already folded
+void ConstantFolder::fold_sum(Expression& expr)
+{
+    Expression left = expr.expressions->at(0);
+    Expression right = expr.expressions->at(1);
+    bool minus = expr.type == EXPR_TYPE::BIN_MINUS;
+    Word a, b;
+    if (isliteral(left, a) && isliteral(right, b))
+    {
+        Word sum = add(a, minus ? negate(b) : b);
+        if (fits(sum))
+            expr = Expression(static_cast<int>(sum));
+    }
+    else if (isliteral(left, a) && a == 0)
+    {
+        if (!minus)
+            replace(expr, right);
+        else if (right.type == EXPR_TYPE::UNARY_MINUS)
+            replace(expr, right.expressions->front());
+        else
+            expr = Expression(EXPR_TYPE::UNARY_MINUS, right);
+    }
+    else if (isliteral(right, b))
+    {
+        Word offset = minus ? negate(b) : b;
+        Word inner;
+        if ((left.type == EXPR_TYPE::BIN_PLUS || left.type == EXPR_TYPE::BIN_MINUS) && isliteral(left.expressions->at(1), inner))
+        {
+            Word combined = add(offset, left.type == EXPR_TYPE::BIN_MINUS ? negate(inner) : inner);
+            if (fits(combined) && fits(negate(combined)))
+            {
+                offset = combined;
+                left = left.expressions->at(0);
+            }
+        }
+
+        if (offset == 0)
+            replace(expr, left);
+        else if (fits(offset) && fits(negate(offset)))
+            expr = offset < 0 ? Expression(EXPR_TYPE::BIN_MINUS, left, Expression(static_cast<int>(negate(offset))))
+                              : Expression(EXPR_TYPE::BIN_PLUS, left, Expression(static_cast<int>(offset)));
+    }
+}
+
+// expr becomes the truth value (0 or 1) of operand, or operand itself if that's as good
+void ConstantFolder::fold_truth(Expression& expr, Expression operand, bool truth_only)
+{
+    Word value;
+    if (isliteral(operand, value))
+        expr = Expression(value != 0 ? 1 : 0);
+    else if (truth_only || istruthvalue(operand))
+        replace(expr, operand);
+    else
+        expr = Expression(EXPR_TYPE::BIN_NEGATEEQUALS, operand, Expression(0));
+}
+
+bool ConstantFolder::isliteral(const Expression& expr, Word& value)
+{
+    if (expr.type != EXPR_TYPE::INT_LITERAL)
+        return false;
+    value = *expr.int_val;
+    return true;
+}
+
+// operators whose value is always 0 or 1
+bool ConstantFolder::istruthvalue(const Expression& expr)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::BIN_COMPARE:
+        case EXPR_TYPE::BIN_NEGATEEQUALS:
+        case EXPR_TYPE::BIN_AND:
+        case EXPR_TYPE::BIN_OR:
+        case EXPR_TYPE::UNARY_NEGATE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// with is a copy, so it may be one of expr's own operands
+void ConstantFolder::replace(Expression& expr, Expression with)
+{
+    expr = with;
+}
@@ -0,0 +1,38 @@
+#ifndef H_CONSTANTFOLDER
+#define H_CONSTANTFOLDER
+
+#include "memory.h"
+#include "expression.h"
+#include "statement.h"
+#include "function.h"
+#include "library.h"
+#include "threadpool.h"
+
+/* Simplifies analysed function bodies in place: constant subexpressions of
+ * arithmetic, comparison, logical and ternary operators become literals,
+ * x+0, x-0, -(-x) and chains of additions of constants are reduced, and
+ * where only the truth of a value matters (conditions, operands of !, &&
+ * and ||) !!x and x!=0 become x. An operand is only dropped if it's
+ * never evaluated anyway or has no side effects, see haseffects(). Ifs and
+ * loops whose condition folds to 0 are removed, ifs whose condition folds to
+ * anything else are replaced by their body. Folding wraps around like B
+ * words do at run time; a result which doesn't fit an integer literal is
+ * left unfolded. */
+class ConstantFolder
+{
+    private:
+        static void fold_statement(Statement& stmt);
+        static void fold_expr(Expression& expr, bool truth_only);
+        static void fold_sum(Expression& expr);
+        static void fold_truth(Expression& expr, Expression operand, bool truth_only);
+
+        static bool isliteral(const Expression& expr, Word& value);
+        static bool istruthvalue(const Expression& expr);
+        static void replace(Expression& expr, Expression with);
+
+    public:
+        static void fold(Function& function);
+        static void fold(Library& library, ThreadPool& pool);
+};
+
+#endif // H_CONSTANTFOLDER
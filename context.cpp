@@ -0,0 +1,314 @@
+#include <functional>
+
+#include "context.h"
+#include "builtins.h"
+
+SymbolTable::SymbolTable() : table(64, -1)
+{
+    scope_marks.push_back(0);
+}
+
+int SymbolTable::find(const Identifier& name, std::size_t hash) const
+{
+    std::size_t mask = table.size() - 1;
+    for (std::size_t i = hash & mask; table[i] != -1; i = (i + 1) & mask)
+    {
+        const Entry& entry = entries[table[i]];
+        if (entry.hash == hash && entry.name == name)
+            return table[i];
+    }
+    return -1;
+}
+
+int SymbolTable::insert(const Identifier& name, std::size_t hash)
+{
+    if (2 * (entries.size() + 1) > table.size())
+        grow();
+
+    std::size_t mask = table.size() - 1;
+    std::size_t i = hash & mask;
+    while (table[i] != -1)
+        i = (i + 1) & mask;
+
+    table[i] = entries.size();
+    entries.push_back(Entry{name, hash, -1});
+    return table[i];
+}
+
+void SymbolTable::grow()
+{
+    std::vector<int> new_table(table.size() * 2, -1);
+    std::size_t mask = new_table.size() - 1;
+    for (std::size_t e = 0; e < entries.size(); ++e)
+    {
+        std::size_t i = entries[e].hash & mask;
+        while (new_table[i] != -1)
+            i = (i + 1) & mask;
+        new_table[i] = e;
+    }
+    table.swap(new_table);
+}
+
+void SymbolTable::push_scope()
+{
+    scope_marks.push_back(decls.size());
+}
+
+void SymbolTable::pop_scope()
+{
+    if (scope_marks.size() <= 1)
+        throw std::logic_error("Popping the outermost scope");
+
+    while (decls.size() > scope_marks.back())
+    {
+        entries[decls.back().entry].innermost = decls.back().shadowed;
+        decls.pop_back();
+    }
+    scope_marks.pop_back();
+}
+
+bool SymbolTable::declare(const Identifier& name, Binding binding)
+{
+    std::size_t hash = std::hash<Identifier>()(name);
+    int entry = find(name, hash);
+    if (entry == -1)
+        entry = insert(name, hash);
+
+    int shadowed = entries[entry].innermost;
+    if (shadowed != -1 && decls[shadowed].scope == scope_marks.size())
+        return false;
+
+    decls.push_back(Decl{binding, entry, shadowed, scope_marks.size()});
+    entries[entry].innermost = decls.size() - 1;
+    return true;
+}
+
+const Binding* SymbolTable::lookup(const Identifier& name) const
+{
+    int entry = find(name, std::hash<Identifier>()(name));
+    if (entry == -1 || entries[entry].innermost == -1)
+        return nullptr;
+    return &decls[entries[entry].innermost].binding;
+}
+
+FunctionTable::FunctionTable(Library& library, std::vector<Diagnostic>& diagnostics) : table(64, -1)
+{
+    while (table.size() < 2 * (library.functions.size() + builtins.size()))
+        table.resize(table.size() * 2, -1);
+
+    for (std::size_t i = 0; i < library.functions.size(); ++i)
+    {
+        const Function& function = library.functions[i];
+        if (find(function.name, std::hash<Identifier>()(function.name)) != -1)
+            diagnostics.push_back(Diagnostic(function.name, "duplicate definition of function '" + function.name + "'"));
+        else insert(function.name, FunctionInfo{Binding(IDTYPE::FUNCTION, i), static_cast<int>(function.params.size())});
+    }
+    for (std::size_t i = 0; i < builtins.size(); ++i)
+    {
+        if (find(builtins[i].name, std::hash<Identifier>()(builtins[i].name)) == -1)
+            insert(builtins[i].name, FunctionInfo{Binding(IDTYPE::BUILTIN, i), builtins[i].arity});
+    }
+}
+
+int FunctionTable::find(const Identifier& name, std::size_t hash) const
+{
+    std::size_t mask = table.size() - 1;
+    for (std::size_t i = hash & mask; table[i] != -1; i = (i + 1) & mask)
+    {
+        const Entry& entry = entries[table[i]];
+        if (entry.hash == hash && entry.name == name)
+            return table[i];
+    }
+    return -1;
+}
+
+void FunctionTable::insert(const Identifier& name, FunctionInfo info)
+{
+    std::size_t hash = std::hash<Identifier>()(name);
+    std::size_t mask = table.size() - 1;
+    std::size_t i = hash & mask;
+    while (table[i] != -1)
+        i = (i + 1) & mask;
+
+    table[i] = entries.size();
+    entries.push_back(Entry{name, hash, info});
+}
+
+const FunctionInfo* FunctionTable::lookup(const Identifier& name) const
+{
+    int entry = find(name, std::hash<Identifier>()(name));
+    return entry == -1 ? nullptr : &entries[entry].info;
+}
+
+void Context::error(std::string message)
+{
+    diagnostics.push_back(Diagnostic(current_function, message));
+}
+
+void Context::declare_local(const Identifier& name, IDTYPE type, Binding& binding)
+{
+    binding = Binding(type, next_slot++);
+    if (!symbols.declare(name, binding))
+        error("duplicate definition of '" + name + "'");
+}
+
+std::vector<Diagnostic> Context::analyse(Library& library, ThreadPool& pool)
+{
+    std::vector<Diagnostic> diagnostics;
+    FunctionTable functions(library, diagnostics);
+
+    std::vector<std::vector<Diagnostic>> per_function(library.functions.size());
+    pool.parallel_for(library.functions.size(), [&](std::size_t i)
+    {
+        per_function[i] = Context(functions).analyse(library.functions[i]);
+    });
+
+    for (auto it = per_function.begin(); it != per_function.end(); ++it)
+        diagnostics.insert(diagnostics.end(), it->begin(), it->end());
+    return diagnostics;
+}
+
+std::vector<Diagnostic> Context::analyse(Function& function)
+{
+    current_function = function.name;
+    next_slot = 0;
+
+    symbols.push_scope();
+    Binding binding;
+    for (auto it = function.params.begin(); it != function.params.end(); ++it)
+        declare_local(*it, IDTYPE::PARAMETER, binding);
+
+    // outermost block of the body shares the scope with parameters
+    resolve_statement(function.getbody(), false);
+    symbols.pop_scope();
+
+    function.frame_size = next_slot;
+    return diagnostics;
+}
+
+void Context::resolve_statement(Statement& stmt, bool new_scope)
+{
+    switch (stmt.type)
+    {
+        case STATEMENT_TYPE::COMPOUND:
+            if (new_scope)
+                symbols.push_scope();
+            for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+                resolve_statement(*it);
+            if (new_scope)
+                symbols.pop_scope();
+            break;
+        case STATEMENT_TYPE::CONDITIONAL:
+        case STATEMENT_TYPE::LOOP:
+            resolve_expr(*stmt.expr);
+            resolve_statement(stmt.body->back());
+            break;
+        case STATEMENT_TYPE::RETURN:
+        case STATEMENT_TYPE::EXPRESSION:
+            resolve_expr(*stmt.expr);
+            break;
+        case STATEMENT_TYPE::VAR_DEF:
+            for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            {
+                // the initializer can't refer to the variable it initializes
+                if (it->is_initialized)
+                    resolve_expr(*it->expr);
+                declare_local(it->name, IDTYPE::VARIABLE, it->binding);
+            }
+            break;
+        case STATEMENT_TYPE::NOP:
+            break;
+    }
+}
+
+void Context::resolve_expr(Expression& expr)
+{
+    if (expr.type == EXPR_TYPE::IDENTIFIER)
+    {
+        const Binding* binding = symbols.lookup(*expr.str_val);
+        const FunctionInfo* function = binding ? nullptr : functions.lookup(*expr.str_val);
+        if (binding)
+            expr.binding = *binding;
+        else if (function)
+            expr.binding = function->binding;
+        else
+        {
+            expr.binding = Binding();
+            error("undefined identifier '" + *expr.str_val + "'");
+        }
+        return;
+    }
+
+    if (expr.expressions)
+    {
+        for (auto it = expr.expressions->begin(); it != expr.expressions->end(); ++it)
+            resolve_expr(*it);
+    }
+
+    switch (expr.type)
+    {
+        case EXPR_TYPE::FUNC_CALL:
+            check_call(expr);
+            break;
+        case EXPR_TYPE::BIN_EQUALS:
+            check_lvalue(expr.expressions->front(), "=");
+            break;
+        case EXPR_TYPE::BIN_PLUSEQUALS:
+            check_lvalue(expr.expressions->front(), "+=");
+            break;
+        case EXPR_TYPE::BIN_MINUSEQUALS:
+            check_lvalue(expr.expressions->front(), "-=");
+            break;
+        case EXPR_TYPE::UNARY_PREINCR:
+        case EXPR_TYPE::UNARY_POSTINCR:
+            check_lvalue(expr.expressions->front(), "++");
+            break;
+        case EXPR_TYPE::UNARY_PREDECR:
+        case EXPR_TYPE::UNARY_POSTDECR:
+            check_lvalue(expr.expressions->front(), "--");
+            break;
+        case EXPR_TYPE::UNARY_AMP:
+            check_lvalue(expr.expressions->front(), "&");
+            break;
+        default:
+            break;
+    }
+}
+
+void Context::check_call(const Expression& expr)
+{
+    const Expression& callee = expr.expressions->front();
+    if (callee.type != EXPR_TYPE::IDENTIFIER || !callee.binding.isresolved() ||
+        (callee.binding.type != IDTYPE::FUNCTION && callee.binding.type != IDTYPE::BUILTIN))
+        return;     // calls through variables can't be checked
+
+    int arity = functions.lookup(*callee.str_val)->arity;
+    int args = expr.expressions->size() - 1;
+    if (arity >= 0 && args != arity)
+        error("call to '" + *callee.str_val + "' with " + std::to_string(args) + " arguments, expected " + std::to_string(arity));
+}
+
+void Context::check_lvalue(const Expression& expr, const std::string& op)
+{
+    // unresolved names were already reported
+    if (expr.type == EXPR_TYPE::IDENTIFIER && !expr.binding.isresolved())
+        return;
+    if (!islvalue(expr))
+        error("operand of '" + op + "' is not an lvalue");
+}
+
+bool Context::islvalue(const Expression& expr)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::IDENTIFIER:
+            return expr.binding.type == IDTYPE::VARIABLE || expr.binding.type == IDTYPE::PARAMETER;
+        case EXPR_TYPE::UNARY_STAR:
+        case EXPR_TYPE::INDEXING:
+            return true;
+        case EXPR_TYPE::PARENTHESIS:
+            return islvalue(expr.expressions->front());
+        default:
+            return false;
+    }
+}
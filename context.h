@@ -1,20 +1,130 @@
 #ifndef CONTEXT_H
 #define CONTEXT_H
 
-#include <map>
 #include <vector>
 #include <string>
 
 #include "identifier.h"
+#include "expression.h"
+#include "statement.h"
 #include "function.h"
+#include "library.h"
+#include "threadpool.h"
 
+struct Diagnostic
+{
+    Identifier function;
+    std::string message;
+
+    Diagnostic(Identifier _function, std::string _message) : function(_function), message(_message) {}
+};
+
+/* Scoped symbol table in a single open-addressing hash table.
+ * Every distinct name gets one entry which is never removed and points to
+ * the innermost visible declaration of that name. Declarations are kept on
+ * a stack, each one remembering the declaration it shadows, so pushing a
+ * scope only records the stack height and popping it unwinds the
+ * declarations made since, restoring shadowed ones. Lookups are a single
+ * probe sequence regardless of scope depth. */
+class SymbolTable
+{
+    private:
+        struct Entry
+        {
+            Identifier name;
+            std::size_t hash;
+            int innermost;      // visible declaration, -1 if none
+        };
+        struct Decl
+        {
+            Binding binding;
+            int entry;
+            int shadowed;       // declaration of the same name this one hides, -1 if none
+            std::size_t scope;
+        };
+
+        std::vector<int> table;     // indices into entries, -1 for empty buckets
+        std::vector<Entry> entries;
+        std::vector<Decl> decls;
+        std::vector<std::size_t> scope_marks;
+
+        int find(const Identifier& name, std::size_t hash) const;
+        int insert(const Identifier& name, std::size_t hash);
+        void grow();
+
+    public:
+        SymbolTable();
+
+        void push_scope();
+        void pop_scope();
+        bool declare(const Identifier& name, Binding binding);     // false if already declared in the current scope
+        const Binding* lookup(const Identifier& name) const;
+};
+
+struct FunctionInfo
+{
+    Binding binding;
+    int arity;      // -1 for variadic builtins
+};
+
+/* Global names (functions and builtins) with their arity, built once per
+ * library before any function is analysed. It's never modified after
+ * construction, so any number of threads can look names up without
+ * locking. Library functions take precedence over builtins. */
+class FunctionTable
+{
+    private:
+        struct Entry
+        {
+            Identifier name;
+            std::size_t hash;
+            FunctionInfo info;
+        };
+
+        std::vector<int> table;
+        std::vector<Entry> entries;
+
+        int find(const Identifier& name, std::size_t hash) const;
+        void insert(const Identifier& name, FunctionInfo info);
+
+    public:
+        FunctionTable(Library& library, std::vector<Diagnostic>& diagnostics);
+
+        const FunctionInfo* lookup(const Identifier& name) const;
+};
+
+/* Semantic analysis of a single function: binds every identifier
+ * expression to the function, builtin, parameter or variable it refers
+ * to, gives each parameter and variable a frame slot, and reports
+ * duplicate and undefined names, calls with the wrong number of arguments
+ * and assignments, increments or address-of applied to non-lvalues.
+ * Functions don't depend on each other apart from the shared function
+ * table, so a library is analysed one function per task. */
 class Context
 {
     private:
-        std::vector<std::map<std::string,Identifier>> scopes;
-        std::vector<Function> func_list;
+        const FunctionTable& functions;
+        SymbolTable symbols;
+        std::vector<Diagnostic> diagnostics;
+        Identifier current_function;
+        int next_slot;
+
+        void error(std::string message);
+        void declare_local(const Identifier& name, IDTYPE type, Binding& binding);
+
+        void resolve_statement(Statement& stmt, bool new_scope = true);
+        void resolve_expr(Expression& expr);
+        void check_call(const Expression& expr);
+        void check_lvalue(const Expression& expr, const std::string& op);
+        static bool islvalue(const Expression& expr);
+
+    public:
+        Context(const FunctionTable& _functions) : functions(_functions), next_slot(0) {}
 
+        std::vector<Diagnostic> analyse(Function& function);
 
+        // diagnostics are ordered by function, the same for any number of threads
+        static std::vector<Diagnostic> analyse(Library& library, ThreadPool& pool);
 };
 
 #endif // CONTEXT_H
@@ -4,7 +4,12 @@
 #include <iostream>
 #include <map>
 #include <string>
+#ifdef _WIN32
 #include <windows.h>
+#else
+typedef short SHORT;
+struct COORD {SHORT X; SHORT Y;};
+#endif
 #include <stack>
 
 #include "token.h"
@@ -13,15 +18,17 @@
 #include "function.h"
 #include "library.h"
 #include "parsertoken.h"
+#include "bytecode.h"
+#include "regbytecode.h"
 
 using namespace std;
 
-std::map<std::string, unsigned char> l = {{"vend", static_cast<unsigned char>(192)},
+static std::map<std::string, unsigned char> l = {{"vend", static_cast<unsigned char>(192)},
                                           {"vbranch", static_cast<unsigned char>(195)},
                                           {"hline", static_cast<unsigned char>(196)},
                                           {"vline", static_cast<unsigned char>(179)}};
 
-std::map<EXPR_TYPE, std::string> expr_debug_names =
+static std::map<EXPR_TYPE, std::string> expr_debug_names =
 {{EXPR_TYPE::BIN_COMMA, ","},
 {EXPR_TYPE::TERNARY, "?:"},
 {EXPR_TYPE::BIN_EQUALS, "="},
@@ -49,7 +56,7 @@ std::map<EXPR_TYPE, std::string> expr_debug_names =
 {EXPR_TYPE::FUNC_CALL, "fcall"},
 {EXPR_TYPE::NONE, "none"}};
 
-std::map<STATEMENT_TYPE, std::string> stmt_debug_names =
+static std::map<STATEMENT_TYPE, std::string> stmt_debug_names =
 {{STATEMENT_TYPE::COMPOUND, "compound"},
  {STATEMENT_TYPE::CONDITIONAL, "if"},
  {STATEMENT_TYPE::LOOP, "while"},
@@ -130,11 +137,11 @@ public:
         cout<<(compact ? "\n" : "");
 
         if (compact)
-            print_debug_statement(function.body, compact, ident+1, true);
+            print_debug_statement(function.getbody(), compact, ident+1, true);
         else
         {
             cout<<tabs(compact, ident+1, true)<<"body "<<endl;
-            print_debug_statement(function.body, compact, ident+2, true);
+            print_debug_statement(function.getbody(), compact, ident+2, true);
         }
     }
 
@@ -352,6 +359,9 @@ public:
         return;
     }
 
+    // cursor positioning is only available on the Windows console, elsewhere
+    // the tree is printed without vertical connector lines
+#ifdef _WIN32
     static void gotoxy(int x, int y)
     {
         COORD coord;
@@ -429,6 +439,62 @@ public:
 
        SetConsoleCursorPosition( hConsole, coordScreen );
     }
+#else
+    static void gotoxy(int, int) {}
+    static void gotoxy(COORD) {}
+    static COORD getxy() {return COORD{0, 0};}
+    static COORD getsize() {return COORD{0, 0};}
+    static void cls() {}
+#endif
+
+    static void print_debug_program(const Program& program)
+    {
+        for (auto it = program.functions.begin(); it != program.functions.end(); ++it)
+        {
+            std::size_t end = it + 1 != program.functions.end() ? (it + 1)->entry : program.code.size();
+            cout<<"func \""<<it->name<<"\" params "<<it->params<<" frame "<<it->frame_size<<" stack "<<it->max_stack<<endl;
+            for (std::size_t pc = it->entry; pc < end; )
+            {
+                const OpcodeInfo& info = getinfo(static_cast<OPCODE>(program.code[pc]));
+                cout<<"\t"<<pc<<"\t"<<info.name;
+                for (int i = 1; i <= info.operands; ++i)
+                    cout<<(i == 1 ? " " : ", ")<<program.code[pc + i];
+                cout<<endl;
+                pc += 1 + info.operands;
+            }
+        }
+    }
+
+    static void print_debug_register_program(const Program& program)
+    {
+        for (auto it = program.functions.begin(); it != program.functions.end(); ++it)
+        {
+            std::size_t end = it + 1 != program.functions.end() ? (it + 1)->entry : program.code.size();
+            cout<<"func \""<<it->name<<"\" params "<<it->params<<" registers "<<it->frame_size<<endl;
+            for (std::size_t pc = it->entry; pc < end; )
+            {
+                REGOP op = static_cast<REGOP>(program.code[pc]);
+                const char* kinds = getinfo(op).operands;
+                cout<<"\t"<<pc<<"\t"<<getinfo(op).name;
+                for (std::size_t i = 0; kinds[i]; ++i)
+                {
+                    Word operand = program.code[pc + 1 + i];
+                    cout<<(i ? ", " : " ");
+                    if (kinds[i] == 'd' || kinds[i] == 'r')
+                        cout<<"r"<<operand;
+                    else if (kinds[i] == 'c')
+                    {
+                        cout<<"("<<operand<<")";
+                        for (Word arg = 0; arg < operand; ++arg)
+                            cout<<" r"<<program.code[pc + 2 + i + arg];
+                    }
+                    else cout<<operand;
+                }
+                cout<<endl;
+                pc += instruction_length(op, &program.code[pc]);
+            }
+        }
+    }
 
     static void print_debug_token(Token token, bool compact, int ident = 0)
     {
@@ -0,0 +1,28 @@
+#ifndef H_DISPATCH
+#define H_DISPATCH
+
+/* Instruction dispatch shared by the interpreters. Handlers are written
+ * once; with GCC and Clang they're threaded together with computed gotos
+ * (each handler jumps straight to the next one through dispatch_table),
+ * elsewhere they become cases of a switch that DISPATCH() jumps back to.
+ * Both expect locals named pc, executed and, for gotos, dispatch_table;
+ * the switch needs VM_OPCODE_ENUM defined to the interpreter's opcode enum. */
+#if defined(__GNUC__) && !defined(VM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO
+#endif
+
+// an interpreter may define VM_TRACE(opcode) to see every instruction before it runs
+#ifndef VM_TRACE
+#define VM_TRACE(opcode)
+#endif
+
+#ifdef VM_COMPUTED_GOTO
+#define VM_LABEL_ADDRESS(name, ...) &&L_##name,
+#define VM_TARGET(name) L_##name:
+#define VM_DISPATCH() do {++executed; VM_TRACE(*pc); goto *dispatch_table[*pc++];} while (0)
+#else
+#define VM_TARGET(name) case VM_OPCODE_ENUM::name:
+#define VM_DISPATCH() goto dispatch
+#endif
+
+#endif // H_DISPATCH
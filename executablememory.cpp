@@ -0,0 +1,43 @@
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "executablememory.h"
+
+ExecutableMemory::ExecutableMemory(const JitEmitter& emitter, Word* statics) : pages(nullptr), mapped(0)
+{
+#ifdef JIT_SUPPORTED
+    std::size_t page = sysconf(_SC_PAGESIZE);
+    const std::vector<std::uint8_t>& code = emitter.getcode();
+    mapped = (code.size() + page - 1) / page * page;
+    if (!mapped)
+        return;
+
+    void* memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        throw std::runtime_error("Cannot allocate memory for compiled code");
+    pages = static_cast<std::uint8_t*>(memory);
+    std::memcpy(pages, code.data(), code.size());
+    emitter.patch_strings(pages, statics);
+    if (mprotect(pages, mapped, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(pages, mapped);
+        throw std::runtime_error("Cannot make compiled code executable");
+    }
+#else
+    throw std::runtime_error("The JIT needs x86-64 and a POSIX system");
+#endif
+}
+
+ExecutableMemory::~ExecutableMemory()
+{
+#ifdef JIT_SUPPORTED
+    if (pages)
+        munmap(pages, mapped);
+#endif
+}
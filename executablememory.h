@@ -0,0 +1,29 @@
+#ifndef H_EXECUTABLEMEMORY
+#define H_EXECUTABLEMEMORY
+
+#include <cstdint>
+
+#include "jitemitter.h"
+
+/* Pages holding the code of a JitEmitter: mapped writable, filled and
+ * patched, then switched to read and execute. Needs x86-64 and mmap. */
+class ExecutableMemory
+{
+    std::uint8_t* pages;
+    std::size_t mapped;
+
+public:
+    ExecutableMemory(const JitEmitter& emitter, Word* statics);
+    ~ExecutableMemory();
+    ExecutableMemory(const ExecutableMemory&) = delete;
+    ExecutableMemory& operator=(const ExecutableMemory&) = delete;
+
+    const void* at(std::size_t offset) const {return pages + offset;}
+    bool contains(const void* address) const
+    {
+        const std::uint8_t* byte = static_cast<const std::uint8_t*>(address);
+        return byte >= pages && byte < pages + mapped;
+    }
+};
+
+#endif // H_EXECUTABLEMEMORY
@@ -199,3 +199,25 @@ Expression::Expression(EXPR_TYPE _type, std::vector<Expression> _operands)
             throw std::logic_error("Wrong number of expression arguments supplied to unary/binary/ternary expression");
     }
 }
+
+bool Expression::haseffects() const
+{
+    switch (type)
+    {
+        case EXPR_TYPE::FUNC_CALL:
+        case EXPR_TYPE::BIN_EQUALS:
+        case EXPR_TYPE::BIN_PLUSEQUALS:
+        case EXPR_TYPE::BIN_MINUSEQUALS:
+        case EXPR_TYPE::UNARY_PREINCR:
+        case EXPR_TYPE::UNARY_PREDECR:
+        case EXPR_TYPE::UNARY_POSTINCR:
+        case EXPR_TYPE::UNARY_POSTDECR:
+            return true;
+        default:
+            if (expressions)
+                for (auto it = expressions->begin(); it != expressions->end(); ++it)
+                    if (it->haseffects())
+                        return true;
+            return false;
+    }
+}
@@ -4,9 +4,13 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include <stdexcept>
 #include <map>
 #include <vector>
 
+#include "identifier.h"
+
 enum class EXPR_TYPE {NONE, INT_LITERAL, STR_LITERAL, IDENTIFIER, PARENTHESIS, INDEXING, FUNC_CALL,
                     BIN_EQUALS, BIN_PLUS, BIN_MINUS, BIN_PLUSEQUALS, BIN_MINUSEQUALS,
                     BIN_OR, BIN_AND, BIN_COMPARE, BIN_NEGATEEQUALS, BIN_COMMA,
@@ -32,6 +36,7 @@ struct Expression
     std::shared_ptr<int> int_val;
     std::shared_ptr<std::string> str_val;
     std::shared_ptr<std::vector<Expression>> expressions;
+    Binding binding;    // identifiers only, filled in by name resolution
 
     Expression();
 
@@ -58,6 +63,9 @@ struct Expression
 
     // all-in-one for unary, binary and ternary expressions
     Expression(EXPR_TYPE _type, std::vector<Expression> _operands);
+
+    // assignments, increments and calls; a call may change any variable whose address was taken
+    bool haseffects() const;
 };
 
 #endif // H_EXPRESSION
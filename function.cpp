@@ -1 +1,38 @@
+#include "function.h"
+#include "lexer.h"
+#include "parser.h"
 
+void LazyBody::parse()
+{
+    // lexer needs a trailing separator after the last token
+    std::string text = source->substr(begin, end - begin) + "\n";
+    Lexer lexer(&text);
+    Parser parser;
+
+    Token t;
+    do
+    {
+        t = lexer.next();
+        parser.feed(t);
+    } while (t.type != TOKEN_EOF);
+
+    Library library = parser.finish();
+    if (library.functions.size() != 1)
+        throw std::logic_error("Pre-scanned function range doesn't contain exactly one function");
+    parsed = std::make_shared<Statement>(library.functions.front().body);
+}
+
+Statement& Function::getbody()
+{
+    if (lazy_body)
+    {
+        std::call_once(lazy_body->parse_once, &LazyBody::parse, lazy_body.get());
+        return *lazy_body->parsed;
+    }
+    return body;
+}
+
+bool Function::isparsed() const
+{
+    return !lazy_body || lazy_body->parsed;
+}
@@ -1,9 +1,30 @@
 #ifndef H_FUNCTION
 #define H_FUNCTION
 
+#include <memory>
+#include <mutex>
+#include <string>
+
 #include "statement.h"
 #include "identifier.h"
 
+// Source range of a function whose body hasn't been parsed yet. The range
+// covers the whole function (header and body), so that it can be fed to a
+// regular parser on its own. Shared between copies of the same function,
+// so the body is parsed at most once.
+struct LazyBody
+{
+    std::shared_ptr<std::string> source;
+    std::size_t begin;
+    std::size_t end;
+    std::shared_ptr<Statement> parsed;
+    std::once_flag parse_once;
+
+    LazyBody(std::shared_ptr<std::string> _source, std::size_t _begin, std::size_t _end) : source(_source), begin(_begin), end(_end) {}
+
+    void parse();
+};
+
 struct Function
 {
     friend class DebugPrinter;
@@ -11,9 +32,16 @@ struct Function
     Identifier name;
     std::vector<Identifier> params;
     Statement body;
+    std::shared_ptr<LazyBody> lazy_body;
+    unsigned frame_size;    // parameter and variable slots, filled in by name resolution
+
+    Function(Identifier _name, Statement _body) : name(_name), body(_body), frame_size(0) {}
+    Function(Identifier _name, std::vector<Identifier> _params, Statement _body) : name(_name), params(_params), body(_body), frame_size(0) {}
+    Function(Identifier _name, std::vector<Identifier> _params, std::shared_ptr<LazyBody> _lazy_body) : name(_name), params(_params), lazy_body(_lazy_body), frame_size(0) {}
 
-    Function(Identifier _name, Statement _body) : name(_name), body(_body) {}
-    Function(Identifier _name, std::vector<Identifier> _params, Statement _body) : name(_name), params(_params), body(_body) {}
+    // body of the function, parsed on first access if the function was pre-scanned
+    Statement& getbody();
+    bool isparsed() const;
 };
 
 #endif // H_FUNCTION
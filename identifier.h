@@ -3,8 +3,23 @@
 
 #include <string>
 
-enum class IDTYPE {FUNCTION, VARIABLE, PARAMETER};
+enum class IDTYPE {FUNCTION, VARIABLE, PARAMETER, BUILTIN};
 
 typedef std::string Identifier;
 
+// Declaration an identifier was resolved to. For variables and parameters
+// index is the slot in the function's frame (parameters come first), for
+// functions the position in Library::functions and for builtins the
+// position in the builtins table.
+struct Binding
+{
+    IDTYPE type;
+    int index;
+
+    Binding() : type(IDTYPE::VARIABLE), index(-1) {}
+    Binding(IDTYPE _type, int _index) : type(_type), index(_index) {}
+
+    bool isresolved() const {return index >= 0;}
+};
+
 #endif // H_IDENTIFIER
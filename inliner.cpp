@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <numeric>
+
+#include "inliner.h"
+#include "callgraph.h"
+
+unsigned Inliner::inline_calls(Library& library, const InlineOptions& options)
+{
+    std::size_t n = library.functions.size();
+    if (!options.profile.empty() && options.profile.size() != n)
+        throw std::logic_error("Profile doesn't cover every function");
+
+    Inliner inliner(library, options);
+    inliner.bodies.assign(n, nullptr);
+    inliner.sizes.assign(n, 0);
+    inliner.written.resize(n);
+
+    CallGraph graph(library);
+    std::vector<unsigned> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b)
+    {
+        return graph.getcomponent(a) < graph.getcomponent(b);
+    });
+
+    for (auto it = order.begin(); it != order.end(); ++it)
+    {
+        Function& function = library.functions[*it];
+        function.frame_size = std::max<unsigned>(function.frame_size, function.params.size());
+        inliner.caller = &function;
+        inliner.address_taken.assign(function.frame_size, false);
+        find_address_taken(function.getbody(), inliner.address_taken);
+        inliner.inline_statement(function.getbody());
+
+        const Expression* body = expression_body(function.getbody());
+        if (body && !graph.isrecursive(*it))
+        {
+            inliner.bodies[*it] = body;
+            inliner.sizes[*it] = size(*body);
+            inliner.written[*it].assign(function.frame_size, false);
+            mark_locals(*body, inliner.written[*it], true);
+        }
+    }
+    return inliner.inlined;
+}
+
+// the returned expression if the function consists of a return statement alone
+const Expression* Inliner::expression_body(const Statement& stmt)
+{
+    if (stmt.type == STATEMENT_TYPE::COMPOUND && stmt.body->size() == 1)
+        return expression_body(stmt.body->front());
+    if (stmt.type == STATEMENT_TYPE::RETURN && stmt.expr)
+        return stmt.expr.get();
+    return nullptr;
+}
+
+unsigned Inliner::size(const Expression& expr)
+{
+    unsigned nodes = 1;
+    if (expr.expressions)
+        for (auto it = expr.expressions->begin(); it != expr.expressions->end(); ++it)
+            nodes += size(*it);
+    return nodes;
+}
+
+void Inliner::find_address_taken(const Statement& stmt, std::vector<bool>& locals)
+{
+    if (stmt.expr)
+        mark_locals(*stmt.expr, locals, false);
+    if (stmt.vars)
+    {
+        for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            if (it->is_initialized)
+                mark_locals(*it->expr, locals, false);
+    }
+    if (stmt.body)
+    {
+        for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+            find_address_taken(*it, locals);
+    }
+}
+
+// marks locals whose address is taken and, if assigned is set, those assigned or incremented
+void Inliner::mark_locals(const Expression& expr, std::vector<bool>& locals, bool assigned)
+{
+    if (!expr.expressions)
+        return;
+
+    const Expression& operand = expr.expressions->front();
+    switch (expr.type)
+    {
+        case EXPR_TYPE::BIN_EQUALS:
+        case EXPR_TYPE::BIN_PLUSEQUALS:
+        case EXPR_TYPE::BIN_MINUSEQUALS:
+        case EXPR_TYPE::UNARY_PREINCR:
+        case EXPR_TYPE::UNARY_PREDECR:
+        case EXPR_TYPE::UNARY_POSTINCR:
+        case EXPR_TYPE::UNARY_POSTDECR:
+            if (assigned && islocal(operand))
+                locals[operand.binding.index] = true;
+            break;
+        case EXPR_TYPE::UNARY_AMP:
+            if (islocal(operand))
+                locals[operand.binding.index] = true;
+            break;
+        default:
+            break;
+    }
+    for (auto it = expr.expressions->begin(); it != expr.expressions->end(); ++it)
+        mark_locals(*it, locals, assigned);
+}
+
+bool Inliner::islocal(const Expression& expr)
+{
+    return expr.type == EXPR_TYPE::IDENTIFIER && expr.binding.isresolved() &&
+           (expr.binding.type == IDTYPE::VARIABLE || expr.binding.type == IDTYPE::PARAMETER);
+}
+
+bool Inliner::worth(unsigned callee) const
+{
+    if (!bodies[callee])
+        return false;
+    unsigned limit = options.size;
+    if (!options.profile.empty())
+    {
+        if (options.profile[callee] == 0)
+            return false;
+        if (options.profile[callee] >= options.hot_calls)
+            limit = options.hot_size;
+    }
+    return sizes[callee] <= limit;
+}
+
+void Inliner::inline_statement(Statement& stmt)
+{
+    if (stmt.expr)
+        inline_expr(*stmt.expr);
+    if (stmt.vars)
+    {
+        for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            if (it->is_initialized)
+                inline_expr(*it->expr);
+    }
+    if (stmt.body)
+    {
+        for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+            inline_statement(*it);
+    }
+}
+
+/* Inlines calls in the operands first, then the call itself, whose
+ * arguments are evaluated in order before the callee's expression as they
+ * would be before the call. */
+void Inliner::inline_expr(Expression& expr)
+{
+    if (!expr.expressions)
+        return;
+    for (auto it = expr.expressions->begin(); it != expr.expressions->end(); ++it)
+        inline_expr(*it);
+
+    if (expr.type != EXPR_TYPE::FUNC_CALL)
+        return;
+    const Expression& callee = expr.expressions->front();
+    if (callee.type != EXPR_TYPE::IDENTIFIER || callee.binding.type != IDTYPE::FUNCTION || !worth(callee.binding.index))
+        return;
+
+    unsigned index = callee.binding.index;
+    const Function& function = library.functions[index];
+    std::vector<Expression> args(expr.expressions->begin() + 1, expr.expressions->end());
+    bool effects = std::any_of(args.begin(), args.end(), [](const Expression& arg) {return arg.haseffects();});
+
+    // what each slot of the callee becomes, and the assignments and extra arguments evaluated first
+    std::vector<Expression> slots(written[index].size());
+    std::vector<Expression> sequence;
+    for (unsigned slot = 0; slot < slots.size(); ++slot)
+    {
+        bool param = slot < function.params.size();
+        Expression arg = param && slot < args.size() ? args[slot] : Expression(0);
+        bool fixed = param && !written[index][slot];
+        if (fixed && arg.type == EXPR_TYPE::INT_LITERAL)
+            slots[slot] = arg;
+        else if (fixed && !effects && islocal(arg) && !address_taken[arg.binding.index])
+            slots[slot] = arg;
+        else
+        {
+            slots[slot] = Expression(EXPR_TYPE::IDENTIFIER, param ? function.params[slot] : std::string("slot"));
+            slots[slot].binding = Binding(IDTYPE::VARIABLE, caller->frame_size++);
+            address_taken.push_back(false);
+            if (param)
+                sequence.push_back(Expression(EXPR_TYPE::BIN_EQUALS, slots[slot], arg));
+        }
+    }
+    for (std::size_t i = function.params.size(); i < args.size(); ++i)
+        if (args[i].haseffects())
+            sequence.push_back(args[i]);
+
+    Expression result = substitute(*bodies[index], slots);
+    for (auto it = sequence.rbegin(); it != sequence.rend(); ++it)
+        result = Expression(EXPR_TYPE::BIN_COMMA, *it, result);
+    expr = result;
+    inlined++;
+}
+
+// copy of the callee's expression with its locals replaced, sharing nothing that may be changed in place
+Expression Inliner::substitute(const Expression& expr, const std::vector<Expression>& slots) const
+{
+    if (islocal(expr))
+        return slots[expr.binding.index];
+    Expression copy = expr;
+    if (expr.expressions)
+    {
+        copy.expressions = std::make_shared<std::vector<Expression>>();
+        for (auto it = expr.expressions->begin(); it != expr.expressions->end(); ++it)
+            copy.expressions->push_back(substitute(*it, slots));
+    }
+    return copy;
+}
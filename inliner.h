@@ -0,0 +1,63 @@
+#ifndef H_INLINER
+#define H_INLINER
+
+#include <vector>
+
+#include "expression.h"
+#include "statement.h"
+#include "function.h"
+#include "library.h"
+
+struct InlineOptions
+{
+    unsigned size = 12;                     // largest callee inlined, in expression nodes
+    unsigned hot_size = 40;                 // largest callee inlined if the profile shows it's hot
+    unsigned long long hot_calls = 1000;    // calls in the profile that make a function hot
+    std::vector<unsigned long long> profile;    // calls of every function in a training run, empty if there's none
+};
+
+/* Replaces calls of small functions whose body is a single return of an
+ * expression with that expression, in every backend's input. The
+ * arguments are assigned to new locals of the caller in evaluation order
+ * (missing ones are 0, extra ones are still evaluated) and the callee's
+ * parameters renamed to them, all joined with the comma operator; a
+ * literal argument, or a local of the caller while no argument has side
+ * effects, is substituted directly for a parameter the callee never
+ * assigns or takes the address of.
+ *
+ * Functions are processed callees first, following the components of the
+ * call graph, so a callee is inlined with its own calls already inlined.
+ * Functions in recursive components are never inlined. A callee is inlined
+ * if it's at most options.size nodes; with a profile, functions that were
+ * never called aren't inlined and hot ones may be up to options.hot_size
+ * nodes. Names must be resolved first. */
+class Inliner
+{
+    Library& library;
+    const InlineOptions& options;
+    std::vector<const Expression*> bodies;  // returned expression of every function that can be inlined
+    std::vector<unsigned> sizes;
+    std::vector<std::vector<bool>> written;     // parameters assigned or whose address is taken, by function
+    Function* caller;
+    std::vector<bool> address_taken;        // locals of the caller
+    unsigned inlined;
+
+    static const Expression* expression_body(const Statement& stmt);
+    static unsigned size(const Expression& expr);
+    static void find_address_taken(const Statement& stmt, std::vector<bool>& locals);
+    static void mark_locals(const Expression& expr, std::vector<bool>& locals, bool assigned);
+    static bool islocal(const Expression& expr);
+    bool worth(unsigned callee) const;
+
+    void inline_statement(Statement& stmt);
+    void inline_expr(Expression& expr);
+    Expression substitute(const Expression& expr, const std::vector<Expression>& slots) const;
+
+    Inliner(Library& _library, const InlineOptions& _options) : library(_library), options(_options), caller(nullptr), inlined(0) {}
+
+public:
+    // returns the number of calls inlined
+    static unsigned inline_calls(Library& library, const InlineOptions& options);
+};
+
+#endif // H_INLINER
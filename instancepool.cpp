@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "instancepool.h"
+
+std::size_t InstancePool::spawn(const Identifier& entry, const std::string& input)
+{
+    std::unique_ptr<Instance> instance(new Instance{std::unique_ptr<VM>(new VM(program, options.heap_words, options.stack_words)),
+                                                    Outcome{false, 0, std::string(), std::string(), 0}});
+    instance->vm->redirect(input);
+    instance->vm->start(entry);
+    instances.push_back(std::move(instance));
+    return instances.size() - 1;
+}
+
+void InstancePool::run()
+{
+    for (; scheduled < instances.size(); ++scheduled)
+    {
+        Instance* instance = instances[scheduled].get();
+        workers.submit([this, instance]() {run_slice(instance);});
+    }
+    workers.wait();
+}
+
+// runs on a worker, queues the instance again if its slice ends before the program does
+void InstancePool::run_slice(Instance* instance)
+{
+    VM& vm = *instance->vm;
+    try
+    {
+        unsigned long long slice = options.slice;
+        if (options.budget)
+            slice = std::min(slice, options.budget - std::min(options.budget, vm.instructions()));
+        if (!vm.resume(slice))
+        {
+            if (!options.budget || vm.instructions() < options.budget)
+            {
+                workers.submit([this, instance]() {run_slice(instance);});
+                return;
+            }
+            throw std::runtime_error("Instruction budget of " + std::to_string(options.budget) + " exhausted");
+        }
+        instance->outcome.result = vm.result();
+    }
+    catch (const std::exception& e)
+    {
+        instance->outcome.error = e.what();
+    }
+    instance->outcome.output = vm.output();
+    instance->outcome.instructions = vm.instructions();
+    instance->outcome.finished = true;
+    instance->vm.reset();
+}
@@ -0,0 +1,72 @@
+#ifndef H_INSTANCEPOOL
+#define H_INSTANCEPOOL
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "vm.h"
+#include "threadpool.h"
+
+struct InstanceOptions
+{
+    std::size_t heap_words = 1 << 16;       // B memory of every instance, reserved but only used pages take memory
+    std::size_t stack_words = 1 << 12;      // frames, and the operand stack as many words
+    unsigned long long slice = 10000;       // instructions an instance runs before the others get a turn
+    unsigned long long budget = 0;          // instructions before an instance is stopped, 0 for no limit
+};
+
+/* Runs many isolated instances of one program compiled to the stack
+ * instruction set on a fixed number of worker threads. The Program is
+ * shared and only read; every instance is a VM of its own, with its own B
+ * memory, operand and call stacks and runtime, reading its input from a
+ * string and keeping its output. Workers take runnable instances in turn
+ * and run each for a slice of instructions before queueing it again, so an
+ * endless program can't hold a worker; one running past its budget is
+ * stopped. Faults and other errors end only the instance they happen in.
+ * An instance's VM is freed as soon as it finishes. Instances are spawned
+ * and their outcomes read by one thread. Every instance alive takes about
+ * six memory mappings for its guard pages, so vm.max_map_count (65530 by
+ * default on Linux) allows some ten thousand at once. */
+class InstancePool
+{
+public:
+    struct Outcome
+    {
+        bool finished;
+        Word result;
+        std::string output;
+        std::string error;      // why it was stopped, empty if it returned or called exit()
+        unsigned long long instructions;
+    };
+
+private:
+    struct Instance
+    {
+        std::unique_ptr<VM> vm;
+        Outcome outcome;
+    };
+
+    const Program& program;
+    InstanceOptions options;
+    std::vector<std::unique_ptr<Instance>> instances;
+    std::size_t scheduled;      // instances handed to the workers
+    ThreadPool workers;         // last, so that it's joined before the instances go away
+
+    void run_slice(Instance* instance);
+
+public:
+    InstancePool(const Program& _program, unsigned threads, InstanceOptions _options = InstanceOptions())
+        : program(_program), options(_options), scheduled(0), workers(threads) {}
+
+    // creates an instance ready to run entry with input as its stdin, returns its index
+    std::size_t spawn(const Identifier& entry, const std::string& input = std::string());
+    // runs every instance spawned so far to the end
+    void run();
+
+    std::size_t size() const {return instances.size();}
+    const Outcome& outcome(std::size_t instance) const {return instances[instance]->outcome;}
+};
+
+#endif // H_INSTANCEPOOL
@@ -0,0 +1,443 @@
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#include "ir.h"
+
+unsigned IRFunction::newblock()
+{
+    blocks.emplace_back();
+    return blocks.size() - 1;
+}
+
+void IRFunction::link(unsigned from, unsigned to)
+{
+    blocks[from].succs.push_back(to);
+    blocks[to].preds.push_back(from);
+}
+
+IRValue IRFunction::append(unsigned block, IROP op, std::vector<IRValue> operands, Word imm)
+{
+    return insert(block, blocks[block].code.size(), op, operands, imm);
+}
+
+IRValue IRFunction::insert(unsigned block, std::size_t position, IROP op, std::vector<IRValue> operands, Word imm)
+{
+    values.push_back(IRInstruction{op, imm, operands, block});
+    blocks[block].code.insert(blocks[block].code.begin() + position, values.size() - 1);
+    return values.size() - 1;
+}
+
+void IRFunction::move(IRValue value, unsigned block, std::size_t position)
+{
+    std::vector<IRValue>& from = blocks[values[value].block].code;
+    from.erase(std::find(from.begin(), from.end(), value));
+    blocks[block].code.insert(blocks[block].code.begin() + position, value);
+    values[value].block = block;
+}
+
+void IRFunction::sweep()
+{
+    for (unsigned b = 0; b < blocks.size(); ++b)
+    {
+        std::vector<IRValue>& code = blocks[b].code;
+        code.erase(std::remove_if(code.begin(), code.end(), [&](IRValue v) {return values[v].block != b;}), code.end());
+    }
+}
+
+void IRFunction::replace_uses(std::vector<IRValue> replacement)
+{
+    auto find = [&](IRValue v)
+    {
+        IRValue root = v;
+        while (replacement[root] != root)
+            root = replacement[root];
+        while (replacement[v] != root)
+        {
+            IRValue next = replacement[v];
+            replacement[v] = root;
+            v = next;
+        }
+        return root;
+    };
+    for (auto it = values.begin(); it != values.end(); ++it)
+        if (it->block != NOBLOCK)
+            for (auto operand = it->operands.begin(); operand != it->operands.end(); ++operand)
+                *operand = find(*operand);
+}
+
+std::vector<unsigned> IRFunction::usecounts() const
+{
+    std::vector<unsigned> uses(values.size(), 0);
+    for (auto it = values.begin(); it != values.end(); ++it)
+        if (it->block != NOBLOCK)
+            for (auto operand = it->operands.begin(); operand != it->operands.end(); ++operand)
+                ++uses[*operand];
+    return uses;
+}
+
+std::vector<unsigned> IRFunction::reverse_postorder() const
+{
+    std::vector<unsigned> order;
+    std::vector<bool> visited(blocks.size(), false);
+    std::vector<std::pair<unsigned, unsigned>> stack;   // block and next successor to visit
+    stack.push_back(std::make_pair(0, 0));
+    visited[0] = true;
+    while (!stack.empty())
+    {
+        unsigned block = stack.back().first;
+        unsigned& next = stack.back().second;
+        if (next < blocks[block].succs.size())
+        {
+            unsigned succ = blocks[block].succs[next++];
+            if (!visited[succ])
+            {
+                visited[succ] = true;
+                stack.push_back(std::make_pair(succ, 0));
+            }
+        }
+        else
+        {
+            order.push_back(block);
+            stack.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+std::vector<unsigned> IRFunction::dominators() const
+{
+    std::vector<unsigned> order = reverse_postorder();
+    std::vector<unsigned> position(blocks.size(), 0);
+    for (unsigned i = 0; i < order.size(); ++i)
+        position[order[i]] = i;
+
+    std::vector<unsigned> idom(blocks.size(), NOBLOCK);
+    idom[0] = 0;
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+        for (auto it = order.begin() + 1; it != order.end(); ++it)
+        {
+            unsigned dominator = NOBLOCK;
+            for (auto pred = blocks[*it].preds.begin(); pred != blocks[*it].preds.end(); ++pred)
+            {
+                if (idom[*pred] == NOBLOCK)
+                    continue;
+                if (dominator == NOBLOCK)
+                {
+                    dominator = *pred;
+                    continue;
+                }
+                unsigned a = *pred, b = dominator;
+                while (a != b)
+                {
+                    while (position[a] > position[b])
+                        a = idom[a];
+                    while (position[b] > position[a])
+                        b = idom[b];
+                }
+                dominator = a;
+            }
+            if (idom[*it] != dominator)
+            {
+                idom[*it] = dominator;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+bool IRFunction::dominates(const std::vector<unsigned>& idom, unsigned a, unsigned b)
+{
+    if (idom[b] == NOBLOCK)
+        return false;
+    while (b != a)
+    {
+        if (idom[b] == b)
+            return false;
+        b = idom[b];
+    }
+    return true;
+}
+
+void IRFunction::remove_unreachable()
+{
+    std::vector<unsigned> order = reverse_postorder();
+    if (order.size() == blocks.size())
+        return;
+
+    std::vector<unsigned> renumbered(blocks.size(), NOBLOCK);
+    std::sort(order.begin(), order.end());      // keep the blocks in their order
+    for (unsigned i = 0; i < order.size(); ++i)
+        renumbered[order[i]] = i;
+
+    for (unsigned b = 0; b < blocks.size(); ++b)
+    {
+        IRBlock& block = blocks[b];
+        if (renumbered[b] == NOBLOCK)
+        {
+            for (auto it = block.code.begin(); it != block.code.end(); ++it)
+                remove(*it);
+            continue;
+        }
+
+        std::vector<unsigned> kept;
+        for (unsigned i = 0; i < block.preds.size(); ++i)
+            if (renumbered[block.preds[i]] != NOBLOCK)
+                kept.push_back(i);
+        for (auto it = block.code.begin(); it != block.code.end() && values[*it].op == IROP::PHI; ++it)
+        {
+            std::vector<IRValue> operands;
+            for (auto i = kept.begin(); i != kept.end(); ++i)
+                operands.push_back(values[*it].operands[*i]);
+            values[*it].operands = operands;
+        }
+        std::vector<unsigned> preds;
+        for (auto i = kept.begin(); i != kept.end(); ++i)
+            preds.push_back(renumbered[block.preds[*i]]);
+        block.preds = preds;
+        for (auto succ = block.succs.begin(); succ != block.succs.end(); ++succ)
+            *succ = renumbered[*succ];
+        for (auto it = block.code.begin(); it != block.code.end(); ++it)
+            values[*it].block = renumbered[b];
+    }
+
+    std::vector<IRBlock> reachable;
+    for (auto it = order.begin(); it != order.end(); ++it)
+        reachable.push_back(blocks[*it]);
+    blocks.swap(reachable);
+
+    // phis left with a single distinct operand are replaced by it
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+        std::vector<IRValue> replacement(values.size());
+        for (IRValue v = 0; v < values.size(); ++v)
+            replacement[v] = v;
+        for (IRValue v = 0; v < values.size(); ++v)
+        {
+            if (values[v].block == NOBLOCK || values[v].op != IROP::PHI)
+                continue;
+            IRValue same = v;
+            bool trivial = true;
+            for (auto operand = values[v].operands.begin(); operand != values[v].operands.end() && trivial; ++operand)
+            {
+                if (*operand == v || *operand == same)
+                    continue;
+                trivial = same == v;
+                same = *operand;
+            }
+            if (trivial && same != v)
+            {
+                replacement[v] = same;
+                remove(v);
+                changed = true;
+            }
+        }
+        if (changed)
+            replace_uses(replacement);
+    }
+    sweep();
+}
+
+void IRFunction::split_critical_edges()
+{
+    unsigned count = blocks.size();
+    for (unsigned b = 0; b < count; ++b)
+    {
+        for (unsigned k = 0; k < blocks[b].succs.size() && blocks[b].succs.size() > 1; ++k)
+        {
+            unsigned succ = blocks[b].succs[k];
+            if (blocks[succ].preds.size() < 2 || blocks[succ].code.empty() || values[blocks[succ].code.front()].op != IROP::PHI)
+                continue;
+
+            unsigned edge = newblock();
+            append(edge, IROP::JMP);
+            blocks[b].succs[k] = edge;
+            *std::find(blocks[succ].preds.begin(), blocks[succ].preds.end(), b) = edge;
+            blocks[edge].preds.push_back(b);
+            blocks[edge].succs.push_back(succ);
+        }
+    }
+}
+
+void IRFunction::verify() const
+{
+    auto fail = [&](const std::string& message)
+    {
+        throw std::logic_error("IR of " + name + ": " + message);
+    };
+    auto block_name = [](unsigned b) {return "b" + std::to_string(b);};
+    auto value_name = [](IRValue v) {return "v" + std::to_string(v);};
+
+    if (blocks.empty())
+        fail("no blocks");
+    if (!blocks[0].preds.empty())
+        fail("the entry block has predecessors");
+
+    // dominance is checked with preorder numbers and subtree sizes in the dominator tree
+    std::vector<unsigned> idom = dominators();
+    std::vector<std::vector<unsigned>> children(blocks.size());
+    for (unsigned b = 1; b < blocks.size(); ++b)
+        if (idom[b] != NOBLOCK)
+            children[idom[b]].push_back(b);
+    std::vector<unsigned> preorder(blocks.size(), 0), subtree_end(blocks.size(), 0);
+    std::vector<std::pair<unsigned, unsigned>> stack(1, std::make_pair(0, 0));
+    unsigned counter = 0;
+    preorder[0] = counter++;
+    while (!stack.empty())
+    {
+        unsigned block = stack.back().first;
+        unsigned& next = stack.back().second;
+        if (next < children[block].size())
+        {
+            unsigned child = children[block][next++];
+            preorder[child] = counter++;
+            stack.push_back(std::make_pair(child, 0));
+        }
+        else
+        {
+            subtree_end[block] = counter;
+            stack.pop_back();
+        }
+    }
+    auto dominates = [&](unsigned a, unsigned b)
+    {
+        return preorder[a] <= preorder[b] && preorder[b] < subtree_end[a];
+    };
+
+    const std::size_t none = static_cast<std::size_t>(-1);
+    std::vector<std::size_t> position(values.size(), none);
+    for (unsigned b = 0; b < blocks.size(); ++b)
+    {
+        const IRBlock& block = blocks[b];
+        if (idom[b] == NOBLOCK)
+            fail(block_name(b) + " is unreachable");
+        if (block.code.empty() || !values[block.code.back()].isterminator())
+            fail(block_name(b) + " doesn't end with a terminator");
+
+        bool phis = true;
+        for (std::size_t i = 0; i < block.code.size(); ++i)
+        {
+            IRValue v = block.code[i];
+            if (v >= values.size() || values[v].block != b || position[v] != none)
+                fail(value_name(v) + " is listed in " + block_name(b) + " but doesn't belong there");
+            position[v] = i;
+            if (values[v].isterminator() && i + 1 != block.code.size())
+                fail(block_name(b) + " has a terminator before its end");
+            if (values[v].op == IROP::PHI && !phis)
+                fail(value_name(v) + " is a phi after other instructions");
+            phis = values[v].op == IROP::PHI;
+        }
+
+        IROP terminator = values[block.code.back()].op;
+        std::size_t successors = terminator == IROP::JMP ? 1 : terminator == IROP::BRANCH ? 2 : 0;
+        if (block.succs.size() != successors)
+            fail(block_name(b) + " has " + std::to_string(block.succs.size()) + " successors for its terminator");
+        for (auto succ = block.succs.begin(); succ != block.succs.end(); ++succ)
+        {
+            const std::vector<unsigned>& preds = blocks[*succ].preds;
+            if (std::count(preds.begin(), preds.end(), b) != std::count(block.succs.begin(), block.succs.end(), *succ))
+                fail("edge " + block_name(b) + " -> " + block_name(*succ) + " isn't in the predecessors of its target");
+        }
+        for (auto pred = block.preds.begin(); pred != block.preds.end(); ++pred)
+        {
+            const std::vector<unsigned>& succs = blocks[*pred].succs;
+            if (std::count(succs.begin(), succs.end(), b) != std::count(block.preds.begin(), block.preds.end(), *pred))
+                fail("edge " + block_name(*pred) + " -> " + block_name(b) + " isn't in the successors of its source");
+        }
+    }
+
+    for (IRValue v = 0; v < values.size(); ++v)
+    {
+        const IRInstruction& instruction = values[v];
+        if (instruction.block == NOBLOCK)
+            continue;
+        if (position[v] == none)
+            fail(value_name(v) + " isn't listed in its block");
+
+        const IRBlock& block = blocks[instruction.block];
+        int expected = getinfo(instruction.op).operands;
+        if (instruction.op == IROP::PHI)
+            expected = block.preds.size();
+        if ((expected >= 0 && instruction.operands.size() != static_cast<std::size_t>(expected)) ||
+            (instruction.op == IROP::CALLI && instruction.operands.empty()))
+            fail(value_name(v) + " has a wrong number of operands");
+        if ((instruction.op == IROP::PARAM && (instruction.block != 0 || instruction.imm < 0 || instruction.imm >= params)) ||
+            (instruction.op == IROP::SLOT && (instruction.imm < 0 || instruction.imm >= frame_size)) ||
+            (instruction.op == IROP::STRING && (instruction.imm < 0 || static_cast<std::size_t>(instruction.imm) >= strings.size())))
+            fail(value_name(v) + " has an invalid immediate");
+
+        for (std::size_t i = 0; i < instruction.operands.size(); ++i)
+        {
+            IRValue operand = instruction.operands[i];
+            if (operand >= values.size() || values[operand].block == NOBLOCK)
+                fail(value_name(v) + " uses a removed value");
+            const IRInstruction& definition = values[operand];
+            if (definition.op == IROP::STORE || definition.isterminator())
+                fail(value_name(v) + " uses " + value_name(operand) + " which has no result");
+
+            bool available = instruction.op == IROP::PHI ? dominates(definition.block, block.preds[i])
+                             : definition.block == instruction.block ? position[operand] < position[v]
+                             : dominates(definition.block, instruction.block);
+            if (!available)
+                fail(value_name(v) + " uses " + value_name(operand) + " where its definition doesn't dominate");
+        }
+    }
+}
+
+void IRFunction::dump(std::ostream& out) const
+{
+    out<<"function "<<name<<" params "<<params<<" slots "<<frame_size<<std::endl;
+    for (unsigned b = 0; b < blocks.size(); ++b)
+    {
+        out<<"b"<<b<<":";
+        for (auto pred = blocks[b].preds.begin(); pred != blocks[b].preds.end(); ++pred)
+            out<<(pred == blocks[b].preds.begin() ? "\t\t; preds " : ", ")<<"b"<<*pred;
+        out<<std::endl;
+
+        for (auto it = blocks[b].code.begin(); it != blocks[b].code.end(); ++it)
+        {
+            const IRInstruction& instruction = values[*it];
+            std::string name = getinfo(instruction.op).name;
+            std::transform(name.begin(), name.end(), name.begin(), [](char c) {return std::tolower(c);});
+
+            out<<"\t";
+            if (instruction.op != IROP::STORE && !instruction.isterminator())
+                out<<"v"<<*it<<" = ";
+            out<<name;
+            switch (instruction.op)
+            {
+                case IROP::CONST:
+                case IROP::PARAM:
+                case IROP::SLOT:
+                    out<<" "<<instruction.imm;
+                    break;
+                case IROP::STRING:
+                    out<<" \""<<strings[instruction.imm]<<"\"";
+                    break;
+                case IROP::CALL:
+                case IROP::CALLB:
+                    out<<" #"<<instruction.imm;
+                    break;
+                default:
+                    break;
+            }
+            for (std::size_t i = 0; i < instruction.operands.size(); ++i)
+            {
+                out<<(i ? ", " : " ");
+                if (instruction.op == IROP::PHI)
+                    out<<"[v"<<instruction.operands[i]<<", b"<<blocks[b].preds[i]<<"]";
+                else
+                    out<<"v"<<instruction.operands[i];
+            }
+            for (std::size_t i = 0; i < blocks[b].succs.size() && instruction.isterminator(); ++i)
+                out<<(i || !instruction.operands.empty() ? ", " : " ")<<"b"<<blocks[b].succs[i];
+            out<<std::endl;
+        }
+    }
+}
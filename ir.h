@@ -0,0 +1,124 @@
+#ifndef H_IR
+#define H_IR
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "identifier.h"
+#include "memory.h"
+
+/* Instructions of the SSA form, with the number of operands each takes
+ * (-1 for any number). Every instruction defines the value of the same
+ * number, instructions without a result define one nobody uses. */
+#define IR_OPCODES(X) \
+    X(CONST, 0)         /* imm; function values are function indices, builtins -(index + 1) */ \
+    X(STRING, 0)        /* address of the literal IRFunction::strings[imm] */ \
+    X(PARAM, 0)         /* parameter imm, entry block only */ \
+    X(SLOT, 0)          /* address of frame slot imm, for locals whose address is taken */ \
+    X(PHI, -1)          /* one operand per predecessor, in the order of IRBlock::preds */ \
+    X(ADD, 2) \
+    X(SUB, 2) \
+    X(EQ, 2) \
+    X(NE, 2) \
+    X(NEG, 1) \
+    X(NOT, 1) \
+    X(LOAD, 1)          /* word at address */ \
+    X(STORE, 2)         /* address, value */ \
+    X(CALL, -1)         /* function imm, the operands are the arguments */ \
+    X(CALLB, -1)        /* builtin imm */ \
+    X(CALLI, -1)        /* function value, then the arguments */ \
+    X(JMP, 0)           /* to succs[0] */ \
+    X(BRANCH, 1)        /* to succs[0] if the operand isn't zero, succs[1] if it is */ \
+    X(RET, 1)
+
+#define IR_ENUM(name, operands) name,
+enum class IROP {IR_OPCODES(IR_ENUM) IROP_COUNT};
+#undef IR_ENUM
+
+struct IROpcodeInfo
+{
+    const char* name;
+    int operands;
+};
+
+#define IR_INFO(name, operands) {#name, operands},
+const IROpcodeInfo irop_info[] = {IR_OPCODES(IR_INFO)};
+#undef IR_INFO
+
+inline const IROpcodeInfo& getinfo(IROP op)
+{
+    return irop_info[static_cast<int>(op)];
+}
+
+typedef unsigned IRValue;
+const unsigned NOBLOCK = static_cast<unsigned>(-1);
+
+struct IRInstruction
+{
+    IROP op;
+    Word imm;
+    std::vector<IRValue> operands;
+    unsigned block;     // NOBLOCK once the instruction is removed
+
+    bool isterminator() const {return op == IROP::JMP || op == IROP::BRANCH || op == IROP::RET;}
+    bool iscall() const {return op == IROP::CALL || op == IROP::CALLB || op == IROP::CALLI;}
+    // depends on nothing but its operands and has no effects, so it may be dropped when unused and moved
+    bool ispure() const
+    {
+        return op == IROP::CONST || op == IROP::STRING || op == IROP::SLOT || op == IROP::ADD || op == IROP::SUB ||
+               op == IROP::EQ || op == IROP::NE || op == IROP::NEG || op == IROP::NOT;
+    }
+};
+
+struct IRBlock
+{
+    std::vector<IRValue> code;      // phis first, then one terminator at the end
+    std::vector<unsigned> preds;
+    std::vector<unsigned> succs;
+};
+
+/* A function lowered to basic blocks in SSA form, see IRBuilder. Block 0
+ * is the entry. Locals are SSA values, except for those whose address is
+ * taken, which stay in their frame slots and are accessed through SLOT
+ * addresses; all other memory is accessed with explicit LOADs and STOREs
+ * of B addresses, and calls may read or write any of it. */
+struct IRFunction
+{
+    Identifier name;
+    unsigned params;
+    unsigned frame_size;    // slots of the analysed function
+    std::vector<IRInstruction> values;
+    std::vector<IRBlock> blocks;
+    std::vector<std::string> strings;
+
+    IRFunction(Identifier _name, unsigned _params, unsigned _frame_size) : name(_name), params(_params), frame_size(_frame_size) {}
+
+    unsigned newblock();
+    void link(unsigned from, unsigned to);
+    IRValue append(unsigned block, IROP op, std::vector<IRValue> operands = std::vector<IRValue>(), Word imm = 0);
+    IRValue insert(unsigned block, std::size_t position, IROP op, std::vector<IRValue> operands = std::vector<IRValue>(), Word imm = 0);
+    void remove(IRValue value) {values[value].block = NOBLOCK;}    // takes effect at the next sweep()
+    void move(IRValue value, unsigned block, std::size_t position);
+    void sweep();
+    // rewrites every operand v to replacement[v], following chains of replaced values
+    void replace_uses(std::vector<IRValue> replacement);
+
+    std::vector<unsigned> usecounts() const;
+    std::vector<unsigned> reverse_postorder() const;
+    // immediate dominator of every block reachable from the entry (which is its own), NOBLOCK for the rest
+    std::vector<unsigned> dominators() const;
+    static bool dominates(const std::vector<unsigned>& idom, unsigned a, unsigned b);
+
+    // drops blocks unreachable from the entry and the phi operands coming from them, removing phis that become trivial
+    void remove_unreachable();
+    // puts a block with nothing but a jump on every edge from a block with several successors to one with phis,
+    // so that copies for the phis can be placed on the edge
+    void split_critical_edges();
+
+    // throws std::logic_error describing the first broken invariant
+    void verify() const;
+    void dump(std::ostream& out) const;
+};
+
+#endif // H_IR
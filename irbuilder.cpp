@@ -0,0 +1,534 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "irbuilder.h"
+
+IRFunction IRBuilder::build(Function& function)
+{
+    unsigned frame = std::max<unsigned>(function.frame_size, function.params.size());
+    IRFunction ir(function.name, function.params.size(), frame);
+    IRBuilder builder(ir);
+    builder.in_memory.assign(frame, false);
+    builder.find_address_taken(function.getbody());
+
+    builder.current = builder.newblock();
+    builder.seal(builder.current);
+    builder.zero = builder.constant(0);
+    for (unsigned param = 0; param < ir.params; ++param)
+        if (!builder.in_memory[param])
+            builder.write_local(param, builder.current, builder.emit(IROP::PARAM, {}, param));
+
+    builder.lower_statement(function.getbody());
+    builder.emit(IROP::RET, {builder.zero});
+    builder.finish();
+    return ir;
+}
+
+std::vector<IRFunction> IRBuilder::build(Library& library, ThreadPool& pool)
+{
+    std::vector<IRFunction> functions(library.functions.size(), IRFunction(Identifier(), 0, 0));
+    pool.parallel_for(library.functions.size(), [&](std::size_t i)
+    {
+        functions[i] = build(library.functions[i]);
+    });
+    return functions;
+}
+
+unsigned IRBuilder::newblock()
+{
+    sealed.push_back(false);
+    phis.emplace_back();
+    incomplete.emplace_back();
+    return ir.newblock();
+}
+
+// all predecessors of block are known, its incomplete phis can be filled in
+void IRBuilder::seal(unsigned block)
+{
+    for (std::size_t i = 0; i < incomplete[block].size(); ++i)
+        add_phi_operands(incomplete[block][i].first, incomplete[block][i].second);
+    incomplete[block].clear();
+    sealed[block] = true;
+}
+
+IRValue IRBuilder::emit(IROP op, std::vector<IRValue> operands, Word imm)
+{
+    IRValue value = ir.append(current, op, operands, imm);
+    replaced.push_back(value);
+    phi_users.emplace_back();
+    return value;
+}
+
+void IRBuilder::jump(unsigned target)
+{
+    emit(IROP::JMP);
+    ir.link(current, target);
+}
+
+void IRBuilder::branch(IRValue cond, unsigned if_true, unsigned if_false)
+{
+    if (if_true == if_false)
+    {
+        jump(if_true);
+        return;
+    }
+    emit(IROP::BRANCH, {cond});
+    ir.link(current, if_true);
+    ir.link(current, if_false);
+}
+
+void IRBuilder::write_local(unsigned local, unsigned block, IRValue value)
+{
+    definitions[static_cast<std::uint64_t>(block) << 32 | local] = value;
+}
+
+IRValue IRBuilder::read_local(unsigned local, unsigned block)
+{
+    auto found = definitions.find(static_cast<std::uint64_t>(block) << 32 | local);
+    if (found != definitions.end())
+        return resolve(found->second);
+    return read_local_recursive(local, block);
+}
+
+IRValue IRBuilder::read_local_recursive(unsigned local, unsigned block)
+{
+    IRValue value;
+    const std::vector<unsigned>& preds = ir.blocks[block].preds;
+    if (!sealed[block])
+    {
+        value = newphi(block);
+        incomplete[block].push_back(std::make_pair(local, value));
+    }
+    else if (preds.size() == 1)
+        value = read_local(local, preds.front());
+    else if (preds.empty())
+        value = zero;
+    else
+    {
+        // the phi breaks cycles through loops before its operands are read
+        IRValue phi = newphi(block);
+        write_local(local, block, phi);
+        value = add_phi_operands(local, phi);
+    }
+    write_local(local, block, value);
+    return value;
+}
+
+IRValue IRBuilder::newphi(unsigned block)
+{
+    ir.values.push_back(IRInstruction{IROP::PHI, 0, std::vector<IRValue>(), block});
+    IRValue phi = ir.values.size() - 1;
+    replaced.push_back(phi);
+    phi_users.emplace_back();
+    phis[block].push_back(phi);
+    return phi;
+}
+
+IRValue IRBuilder::add_phi_operands(unsigned local, IRValue phi)
+{
+    unsigned block = ir.values[phi].block;
+    for (std::size_t i = 0; i < ir.blocks[block].preds.size(); ++i)
+    {
+        IRValue operand = read_local(local, ir.blocks[block].preds[i]);
+        ir.values[phi].operands.push_back(operand);
+        phi_users[operand].push_back(phi);
+    }
+    return remove_trivial_phi(phi);
+}
+
+// a phi merging only itself and one other value is replaced by that value, which may make phis using it trivial too
+IRValue IRBuilder::remove_trivial_phi(IRValue phi)
+{
+    IRValue same = phi;
+    for (auto it = ir.values[phi].operands.begin(); it != ir.values[phi].operands.end(); ++it)
+    {
+        IRValue operand = resolve(*it);
+        if (operand == same || operand == phi)
+            continue;
+        if (same != phi)
+            return phi;
+        same = operand;
+    }
+    if (same == phi)
+        same = zero;    // only reachable through itself
+
+    replaced[phi] = same;
+    ir.values[phi].block = NOBLOCK;
+    std::vector<IRValue> users = phi_users[phi];
+    phi_users[same].insert(phi_users[same].end(), users.begin(), users.end());
+    for (auto user = users.begin(); user != users.end(); ++user)
+    {
+        const IRInstruction& instruction = ir.values[*user];
+        if (*user != phi && instruction.block != NOBLOCK &&
+            instruction.operands.size() == ir.blocks[instruction.block].preds.size())
+            remove_trivial_phi(*user);
+    }
+    return same;
+}
+
+IRValue IRBuilder::resolve(IRValue value)
+{
+    IRValue root = value;
+    while (replaced[root] != root)
+        root = replaced[root];
+    while (replaced[value] != root)
+    {
+        IRValue next = replaced[value];
+        replaced[value] = root;
+        value = next;
+    }
+    return root;
+}
+
+void IRBuilder::finish()
+{
+    for (unsigned b = 0; b < ir.blocks.size(); ++b)
+    {
+        if (!sealed[b])
+            throw std::logic_error("Block " + std::to_string(b) + " of " + ir.name + " was never sealed");
+        std::vector<IRValue> code;
+        for (auto phi = phis[b].begin(); phi != phis[b].end(); ++phi)
+            if (ir.values[*phi].block != NOBLOCK)
+                code.push_back(*phi);
+        code.insert(code.end(), ir.blocks[b].code.begin(), ir.blocks[b].code.end());
+        ir.blocks[b].code.swap(code);
+    }
+    for (auto it = ir.values.begin(); it != ir.values.end(); ++it)
+        if (it->block != NOBLOCK)
+            for (auto operand = it->operands.begin(); operand != it->operands.end(); ++operand)
+                *operand = resolve(*operand);
+
+    ir.remove_unreachable();
+    ir.verify();
+}
+
+bool IRBuilder::islocal(const Expression& expr)
+{
+    return expr.type == EXPR_TYPE::IDENTIFIER &&
+           (expr.binding.type == IDTYPE::VARIABLE || expr.binding.type == IDTYPE::PARAMETER);
+}
+
+void IRBuilder::find_address_taken(const Statement& stmt)
+{
+    if (stmt.expr)
+        find_address_taken(*stmt.expr);
+    if (stmt.vars)
+    {
+        for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            if (it->is_initialized)
+                find_address_taken(*it->expr);
+    }
+    if (stmt.body)
+    {
+        for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+            find_address_taken(*it);
+    }
+}
+
+void IRBuilder::find_address_taken(const Expression& expr)
+{
+    if (expr.type == EXPR_TYPE::UNARY_AMP)
+    {
+        const Expression* operand = &expr.expressions->front();
+        while (operand->type == EXPR_TYPE::PARENTHESIS)
+            operand = &operand->expressions->front();
+        if (islocal(*operand))
+            in_memory[operand->binding.index] = true;
+    }
+    if (expr.expressions)
+    {
+        for (auto it = expr.expressions->begin(); it != expr.expressions->end(); ++it)
+            find_address_taken(*it);
+    }
+}
+
+void IRBuilder::lower_statement(const Statement& stmt)
+{
+    switch (stmt.type)
+    {
+        case STATEMENT_TYPE::COMPOUND:
+            for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+                lower_statement(*it);
+            break;
+        case STATEMENT_TYPE::CONDITIONAL:
+        {
+            unsigned then = newblock(), join = newblock();
+            lower_branch(*stmt.expr, then, join);
+            seal(then);
+            current = then;
+            lower_statement(stmt.body->back());
+            jump(join);
+            seal(join);
+            current = join;
+            break;
+        }
+        case STATEMENT_TYPE::LOOP:
+        {
+            unsigned preheader = newblock(), exit = newblock();
+            lower_branch(*stmt.expr, preheader, exit);
+            seal(preheader);
+            current = preheader;
+            unsigned body = newblock();
+            jump(body);
+            current = body;
+            lower_statement(stmt.body->back());
+            lower_branch(*stmt.expr, body, exit);
+            seal(body);
+            seal(exit);
+            current = exit;
+            break;
+        }
+        case STATEMENT_TYPE::RETURN:
+            emit(IROP::RET, {lower_expr(*stmt.expr)});
+            current = newblock();   // anything after the return is unreachable and dropped at the end
+            seal(current);
+            break;
+        case STATEMENT_TYPE::VAR_DEF:
+            // a variable without an initializer keeps its value, like in the other engines
+            for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            {
+                if (!it->is_initialized)
+                    continue;
+                IRValue value = lower_expr(*it->expr);
+                if (in_memory[it->binding.index])
+                    emit(IROP::STORE, {emit(IROP::SLOT, {}, it->binding.index), value});
+                else
+                    write_local(it->binding.index, current, value);
+            }
+            break;
+        case STATEMENT_TYPE::EXPRESSION:
+            lower_expr(*stmt.expr);
+            break;
+        case STATEMENT_TYPE::NOP:
+            break;
+    }
+}
+
+IRValue IRBuilder::lower_expr(const Expression& expr)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::INT_LITERAL:
+            return constant(*expr.int_val);
+        case EXPR_TYPE::STR_LITERAL:
+        {
+            auto found = strings.find(*expr.str_val);
+            if (found == strings.end())
+            {
+                found = strings.insert(std::make_pair(*expr.str_val, static_cast<Word>(ir.strings.size()))).first;
+                ir.strings.push_back(*expr.str_val);
+            }
+            return emit(IROP::STRING, {}, found->second);
+        }
+        case EXPR_TYPE::IDENTIFIER:
+            switch (expr.binding.type)
+            {
+                case IDTYPE::VARIABLE:
+                case IDTYPE::PARAMETER:
+                    return read(expr);
+                case IDTYPE::FUNCTION:
+                    return constant(expr.binding.index);
+                case IDTYPE::BUILTIN:
+                    return constant(-(expr.binding.index + 1));
+            }
+            break;
+        case EXPR_TYPE::PARENTHESIS:
+            return lower_expr(expr.expressions->front());
+        case EXPR_TYPE::INDEXING:
+        case EXPR_TYPE::UNARY_STAR:
+            return emit(IROP::LOAD, {lower_address(expr)});
+        case EXPR_TYPE::UNARY_AMP:
+            return lower_address(expr.expressions->front());
+        case EXPR_TYPE::FUNC_CALL:
+            return lower_call(expr);
+        case EXPR_TYPE::BIN_EQUALS:
+        {
+            const Expression& lhs = expr.expressions->front();
+            if (islocal(lhs) && !in_memory[lhs.binding.index])
+            {
+                IRValue value = lower_expr(expr.expressions->back());
+                write_local(lhs.binding.index, current, value);
+                return value;
+            }
+            IRValue address = lower_address(lhs);
+            IRValue value = lower_expr(expr.expressions->back());
+            emit(IROP::STORE, {address, value});
+            return value;
+        }
+        case EXPR_TYPE::BIN_PLUSEQUALS:
+            return lower_update(expr.expressions->front(), IROP::ADD, &expr.expressions->back(), 0, false);
+        case EXPR_TYPE::BIN_MINUSEQUALS:
+            return lower_update(expr.expressions->front(), IROP::SUB, &expr.expressions->back(), 0, false);
+        case EXPR_TYPE::BIN_PLUS:
+        case EXPR_TYPE::BIN_MINUS:
+        case EXPR_TYPE::BIN_COMPARE:
+        case EXPR_TYPE::BIN_NEGATEEQUALS:
+        {
+            static const std::map<EXPR_TYPE, IROP> binary_ops = {{EXPR_TYPE::BIN_PLUS, IROP::ADD}, {EXPR_TYPE::BIN_MINUS, IROP::SUB},
+                                                                 {EXPR_TYPE::BIN_COMPARE, IROP::EQ}, {EXPR_TYPE::BIN_NEGATEEQUALS, IROP::NE}};
+            IRValue left = lower_expr(expr.expressions->front());
+            IRValue right = lower_expr(expr.expressions->back());
+            return emit(binary_ops.at(expr.type), {left, right});
+        }
+        case EXPR_TYPE::BIN_AND:
+        case EXPR_TYPE::BIN_OR:
+        {
+            unsigned if_true = newblock(), if_false = newblock();
+            lower_branch(expr, if_true, if_false);
+            return lower_merge(if_true, if_false, nullptr, nullptr);
+        }
+        case EXPR_TYPE::BIN_COMMA:
+            lower_expr(expr.expressions->front());
+            return lower_expr(expr.expressions->back());
+        case EXPR_TYPE::UNARY_MINUS:
+            return emit(IROP::NEG, {lower_expr(expr.expressions->front())});
+        case EXPR_TYPE::UNARY_NEGATE:
+            return emit(IROP::NOT, {lower_expr(expr.expressions->front())});
+        case EXPR_TYPE::UNARY_PREINCR:
+            return lower_update(expr.expressions->front(), IROP::ADD, nullptr, 1, false);
+        case EXPR_TYPE::UNARY_PREDECR:
+            return lower_update(expr.expressions->front(), IROP::ADD, nullptr, -1, false);
+        case EXPR_TYPE::UNARY_POSTINCR:
+            return lower_update(expr.expressions->front(), IROP::ADD, nullptr, 1, true);
+        case EXPR_TYPE::UNARY_POSTDECR:
+            return lower_update(expr.expressions->front(), IROP::ADD, nullptr, -1, true);
+        case EXPR_TYPE::TERNARY:
+        {
+            unsigned if_true = newblock(), if_false = newblock();
+            lower_branch(expr.expressions->at(0), if_true, if_false);
+            return lower_merge(if_true, if_false, &expr.expressions->at(1), &expr.expressions->at(2));
+        }
+        case EXPR_TYPE::NONE:
+            return zero;
+    }
+    throw std::logic_error("Unknown expression type");
+}
+
+// B address of an lvalue; locals only have one if their address is taken somewhere
+IRValue IRBuilder::lower_address(const Expression& expr)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::IDENTIFIER:
+            if (!islocal(expr))
+                throw std::logic_error("Address of '" + *expr.str_val + "' which isn't a variable");
+            if (!in_memory[expr.binding.index])
+                throw std::logic_error("Address of '" + *expr.str_val + "' which is kept in a register");
+            return emit(IROP::SLOT, {}, expr.binding.index);
+        case EXPR_TYPE::UNARY_STAR:
+            return lower_expr(expr.expressions->front());
+        case EXPR_TYPE::INDEXING:
+        {
+            IRValue base = lower_expr(expr.expressions->front());
+            IRValue index = lower_expr(expr.expressions->back());
+            return emit(IROP::ADD, {base, index});
+        }
+        case EXPR_TYPE::PARENTHESIS:
+            return lower_address(expr.expressions->front());
+        default:
+            throw std::logic_error("Expression is not an lvalue");
+    }
+}
+
+IRValue IRBuilder::lower_call(const Expression& expr)
+{
+    const Expression& callee = expr.expressions->front();
+    std::vector<IRValue> args;
+    for (auto it = expr.expressions->begin() + 1; it != expr.expressions->end(); ++it)
+        args.push_back(lower_expr(*it));
+
+    if (callee.type == EXPR_TYPE::IDENTIFIER && callee.binding.type == IDTYPE::FUNCTION)
+        return emit(IROP::CALL, args, callee.binding.index);
+    if (callee.type == EXPR_TYPE::IDENTIFIER && callee.binding.type == IDTYPE::BUILTIN)
+        return emit(IROP::CALLB, args, callee.binding.index);
+    // the function value is evaluated after the arguments, like on the stack machine
+    args.insert(args.begin(), lower_expr(callee));
+    return emit(IROP::CALLI, args);
+}
+
+/* target op= operand, or target += delta for increments and decrements.
+ * The old value is read before operand is evaluated, like on the stack
+ * machine. Returns the old value if postfix is set, the new one otherwise. */
+IRValue IRBuilder::lower_update(const Expression& target, IROP op, const Expression* operand, Word delta, bool postfix)
+{
+    if (islocal(target) && !in_memory[target.binding.index])
+    {
+        IRValue old = read_local(target.binding.index, current);
+        IRValue change = operand ? lower_expr(*operand) : constant(delta);
+        IRValue updated = emit(op, {old, change});
+        write_local(target.binding.index, current, updated);
+        return postfix ? old : updated;
+    }
+
+    IRValue address = lower_address(target);
+    IRValue old = emit(IROP::LOAD, {address});
+    IRValue change = operand ? lower_expr(*operand) : constant(delta);
+    IRValue updated = emit(op, {old, change});
+    emit(IROP::STORE, {address, updated});
+    return postfix ? old : updated;
+}
+
+// ends the current block with a jump to if_true or if_false, short circuiting && and ||
+void IRBuilder::lower_branch(const Expression& cond, unsigned if_true, unsigned if_false)
+{
+    switch (cond.type)
+    {
+        case EXPR_TYPE::PARENTHESIS:
+            lower_branch(cond.expressions->front(), if_true, if_false);
+            return;
+        case EXPR_TYPE::UNARY_NEGATE:
+            lower_branch(cond.expressions->front(), if_false, if_true);
+            return;
+        case EXPR_TYPE::INT_LITERAL:
+            jump(*cond.int_val != 0 ? if_true : if_false);
+            return;
+        case EXPR_TYPE::BIN_AND:
+        case EXPR_TYPE::BIN_OR:
+        {
+            unsigned second = newblock();
+            if (cond.type == EXPR_TYPE::BIN_AND)
+                lower_branch(cond.expressions->front(), second, if_false);
+            else
+                lower_branch(cond.expressions->front(), if_true, second);
+            seal(second);
+            current = second;
+            lower_branch(cond.expressions->back(), if_true, if_false);
+            return;
+        }
+        default:
+            branch(lower_expr(cond), if_true, if_false);
+            return;
+    }
+}
+
+/* Lowers true_expr in if_true and false_expr in if_false (1 and 0 when
+ * they're null) and joins them, returning the phi of the two values. */
+IRValue IRBuilder::lower_merge(unsigned if_true, unsigned if_false, const Expression* true_expr, const Expression* false_expr)
+{
+    unsigned join = newblock();
+    seal(if_true);
+    current = if_true;
+    IRValue true_value = true_expr ? lower_expr(*true_expr) : constant(1);
+    jump(join);
+    seal(if_false);
+    current = if_false;
+    IRValue false_value = false_expr ? lower_expr(*false_expr) : zero;
+    jump(join);
+    seal(join);
+    current = join;
+    if (true_value == false_value)
+        return true_value;
+
+    IRValue phi = newphi(join);
+    ir.values[phi].operands = {true_value, false_value};
+    phi_users[true_value].push_back(phi);
+    phi_users[false_value].push_back(phi);
+    return phi;
+}
+
+IRValue IRBuilder::read(const Expression& local)
+{
+    if (in_memory[local.binding.index])
+        return emit(IROP::LOAD, {emit(IROP::SLOT, {}, local.binding.index)});
+    return read_local(local.binding.index, current);
+}
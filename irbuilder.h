@@ -0,0 +1,80 @@
+#ifndef H_IRBUILDER
+#define H_IRBUILDER
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "ir.h"
+#include "expression.h"
+#include "statement.h"
+#include "function.h"
+#include "library.h"
+#include "threadpool.h"
+
+/* Lowers analysed functions to SSA form in a single walk over the tree,
+ * with the algorithm of Braun et al., "Simple and Efficient Construction of
+ * Static Single Assignment Form" (CC 2013): the current value of a local
+ * is looked up in the block being lowered and, failing that, recursively in
+ * its predecessors, placing phis only where several definitions meet. A
+ * block's phis are completed once all its predecessors are known (the block
+ * is sealed), and phis that turn out to merge a single value are removed on
+ * the spot. Reads of locals that were never assigned give 0, as frames are
+ * zeroed on entry.
+ *
+ * Loops are lowered with the condition tested before the first iteration
+ * and again at the end of the body, which branches back to the start of
+ * the body; the block between the first test and the body is the loop's
+ * preheader. */
+class IRBuilder
+{
+    IRFunction& ir;
+    unsigned current;
+    IRValue zero;
+    std::vector<bool> in_memory;        // locals whose address is taken stay in their frame slots
+    std::vector<bool> sealed;
+    std::vector<std::vector<IRValue>> phis;                         // of each block, prepended to its code at the end
+    std::vector<std::vector<std::pair<unsigned, IRValue>>> incomplete; // local and phi waiting for a block to be sealed
+    std::unordered_map<std::uint64_t, IRValue> definitions;         // current value of a local in a block
+    std::vector<IRValue> replaced;      // trivial phis point to the value they were replaced with
+    std::vector<std::vector<IRValue>> phi_users;
+    std::map<std::string, Word> strings;
+
+    unsigned newblock();
+    void seal(unsigned block);
+    IRValue emit(IROP op, std::vector<IRValue> operands = std::vector<IRValue>(), Word imm = 0);
+    IRValue constant(Word value) {return emit(IROP::CONST, {}, value);}
+    void jump(unsigned target);
+    void branch(IRValue cond, unsigned if_true, unsigned if_false);
+
+    void write_local(unsigned local, unsigned block, IRValue value);
+    IRValue read_local(unsigned local, unsigned block);
+    IRValue read_local_recursive(unsigned local, unsigned block);
+    IRValue newphi(unsigned block);
+    IRValue add_phi_operands(unsigned local, IRValue phi);
+    IRValue remove_trivial_phi(IRValue phi);
+    IRValue resolve(IRValue value);
+
+    void lower_statement(const Statement& stmt);
+    IRValue lower_expr(const Expression& expr);
+    IRValue lower_address(const Expression& expr);
+    IRValue lower_call(const Expression& expr);
+    IRValue lower_update(const Expression& target, IROP op, const Expression* operand, Word delta, bool postfix);
+    void lower_branch(const Expression& cond, unsigned if_true, unsigned if_false);
+    IRValue lower_merge(unsigned if_true, unsigned if_false, const Expression* true_expr, const Expression* false_expr);
+    IRValue read(const Expression& local);
+
+    static bool islocal(const Expression& expr);
+    void find_address_taken(const Statement& stmt);
+    void find_address_taken(const Expression& expr);
+    void finish();
+
+    IRBuilder(IRFunction& _ir) : ir(_ir), current(0), zero(0) {}
+
+public:
+    static IRFunction build(Function& function);
+    static std::vector<IRFunction> build(Library& library, ThreadPool& pool);
+};
+
+#endif // H_IRBUILDER
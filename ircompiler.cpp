@@ -0,0 +1,710 @@
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <stdexcept>
+
+#include "ircompiler.h"
+#include "linearscan.h"
+
+Program IRCompiler::compile(std::vector<IRFunction>& functions)
+{
+    Program program;
+    for (auto it = functions.begin(); it != functions.end(); ++it)
+        program.functions.push_back(CompiledFunction{it->name, it->params, 0, 0, 0});
+
+    IRCompiler compiler(program);
+    for (std::size_t i = 0; i < functions.size(); ++i)
+    {
+        compiler.compile_function(functions[i]);
+        compiler.allocate_and_emit(program.functions[i]);
+    }
+    return program;
+}
+
+template<typename Fn> void IRCompiler::for_each_register(RegInstruction& instruction, Fn fn)
+{
+    const char* kinds = getinfo(instruction.op).operands;
+    std::size_t definition = std::numeric_limits<std::size_t>::max();
+    for (std::size_t i = 0; kinds[i]; ++i)
+    {
+        if (kinds[i] == 'd')
+            definition = i;
+        else if (kinds[i] == 'r')
+            fn(instruction.operands[i], false);
+        else if (kinds[i] == 'c')
+        {
+            for (Word arg = 0; arg < instruction.operands[i]; ++arg)
+                fn(instruction.operands[i + 1 + arg], false);
+        }
+    }
+    if (definition != std::numeric_limits<std::size_t>::max())
+        fn(instruction.operands[definition], true);
+}
+
+void IRCompiler::emit(REGOP op, std::vector<Word> operands)
+{
+    code.push_back(RegInstruction{op, operands});
+}
+
+// parameters live in the registers the arguments arrive in, other values get one of their own after the locals
+IRCompiler::Reg IRCompiler::vreg(IRValue value) const
+{
+    value = coalesced[value];
+    if (ir->values[value].op == IROP::PARAM)
+        return immediate(value);
+    return ir->frame_size + value;
+}
+
+template<typename Fn> void IRCompiler::for_each_use(IRValue value, Fn fn) const
+{
+    const std::vector<IRValue>& operands = ir->values[value].operands;
+    for (std::size_t i = 0; i < operands.size(); ++i)
+    {
+        OPERAND kind = encoding(value, i);
+        if (kind == OPERAND::REGISTER)
+            fn(operands[i]);
+        else if (kind == OPERAND::FUSED)
+            for_each_use(operands[i], fn);
+    }
+}
+
+// how the instruction user takes its operand-th operand
+IRCompiler::OPERAND IRCompiler::encoding(IRValue user, std::size_t operand) const
+{
+    const IRInstruction& instruction = ir->values[user];
+    IRValue value = instruction.operands[operand];
+    IROP op = ir->values[value].op;
+    if (fused[value])
+        return OPERAND::FUSED;
+
+    switch (instruction.op)
+    {
+        case IROP::ADD:
+        case IROP::EQ:
+        case IROP::NE:
+            // one of the operands can be an immediate, the second one if both are constants
+            if (op == IROP::CONST && (operand == 1 || ir->values[instruction.operands[1]].op != IROP::CONST))
+                return OPERAND::IMMEDIATE;
+            break;
+        case IROP::SUB:
+            if (op == IROP::CONST && operand == 1)
+                return OPERAND::IMMEDIATE;
+            break;
+        case IROP::LOAD:
+            if (op == IROP::SLOT)
+                return OPERAND::LOCAL;
+            break;
+        case IROP::STORE:
+            if (operand == 0 && op == IROP::SLOT)
+                return OPERAND::LOCAL;
+            if (operand == 1 && op == IROP::CONST && ir->values[instruction.operands[0]].op == IROP::SLOT)
+                return OPERAND::IMMEDIATE;
+            break;
+        case IROP::PHI:
+        case IROP::BRANCH:
+        case IROP::RET:
+            if (op == IROP::CONST)
+                return OPERAND::IMMEDIATE;
+            break;
+        default:
+            break;
+    }
+    return OPERAND::REGISTER;
+}
+
+void IRCompiler::mark_needed(IRValue value)
+{
+    std::vector<IRValue> pending(1, value);
+    needed[value] = true;
+    while (!pending.empty())
+    {
+        IRValue user = pending.back();
+        pending.pop_back();
+        for (std::size_t i = 0; i < ir->values[user].operands.size(); ++i)
+        {
+            IRValue operand = ir->values[user].operands[i];
+            OPERAND kind = encoding(user, i);
+            if ((kind == OPERAND::REGISTER || kind == OPERAND::FUSED) && !needed[operand])
+            {
+                // a fused operand isn't computed itself, but its operands are
+                needed[operand] = true;
+                pending.push_back(operand);
+            }
+        }
+    }
+}
+
+IRValue IRCompiler::representative(IRValue value)
+{
+    while (coalesced[value] != value)
+        value = coalesced[value] = coalesced[coalesced[value]];
+    return value;
+}
+
+/* Gives phis and their operands the same register where that's safe, after
+ * Budimlić et al., "Fast Copy Coalescing and Live-Range Identification"
+ * (PLDI 2002): two values can share a register unless one of them is live
+ * where the other is defined, and only the one defined first (whose
+ * definition dominates) can be, since the form is strict. Phis are defined
+ * at the start of their block and their operands used at the end of the
+ * predecessors they come from. */
+void IRCompiler::coalesce_phis()
+{
+    std::size_t count = ir->values.size();
+    std::vector<unsigned> position(count, 0);     // in its block
+    std::vector<std::vector<IRValue>> users(count);
+    for (auto block = layout.begin(); block != layout.end(); ++block)
+    {
+        const std::vector<IRValue>& values = ir->blocks[*block].code;
+        for (unsigned i = 0; i < values.size(); ++i)
+        {
+            position[values[i]] = i;
+            if (needed[values[i]] && !fused[values[i]] && ir->values[values[i]].op != IROP::PHI)
+                for_each_use(values[i], [&](IRValue operand) {users[operand].push_back(values[i]);});
+        }
+    }
+
+    std::vector<std::vector<bool>> live_in(ir->blocks.size(), std::vector<bool>(count, false));
+    std::vector<std::vector<bool>> live_out(live_in);
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+        for (auto block = layout.rbegin(); block != layout.rend(); ++block)
+        {
+            std::vector<bool> live(count, false);
+            for (auto succ = ir->blocks[*block].succs.begin(); succ != ir->blocks[*block].succs.end(); ++succ)
+            {
+                const IRBlock& successor = ir->blocks[*succ];
+                std::size_t pred = std::find(successor.preds.begin(), successor.preds.end(), *block) - successor.preds.begin();
+                for (IRValue v = 0; v < count; ++v)
+                    if (live_in[*succ][v])
+                        live[v] = true;
+                for (auto phi = successor.code.begin(); phi != successor.code.end() && ir->values[*phi].op == IROP::PHI; ++phi)
+                    if (needed[*phi] && encoding(*phi, pred) == OPERAND::REGISTER)
+                        live[ir->values[*phi].operands[pred]] = true;
+            }
+            live_out[*block] = live;
+
+            const std::vector<IRValue>& values = ir->blocks[*block].code;
+            for (auto it = values.rbegin(); it != values.rend(); ++it)
+            {
+                live[*it] = false;
+                if (needed[*it] && !fused[*it] && ir->values[*it].op != IROP::PHI)
+                    for_each_use(*it, [&](IRValue operand) {live[operand] = true;});
+            }
+            if (live != live_in[*block])
+            {
+                live_in[*block] = live;
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<unsigned> idom = ir->dominators();
+    auto defined_before = [&](IRValue a, IRValue b)
+    {
+        unsigned block_a = ir->values[a].block, block_b = ir->values[b].block;
+        return block_a == block_b ? position[a] < position[b] : IRFunction::dominates(idom, block_a, block_b);
+    };
+    auto interfere = [&](IRValue a, IRValue b)
+    {
+        if (!defined_before(a, b))
+        {
+            if (!defined_before(b, a))
+                return false;
+            std::swap(a, b);
+        }
+        unsigned block = ir->values[b].block;
+        if (live_out[block][a])
+            return true;
+        return std::any_of(users[a].begin(), users[a].end(), [&](IRValue user)
+        {
+            return ir->values[user].block == block && position[user] > position[b];
+        });
+    };
+
+    std::vector<std::vector<IRValue>> members(count);
+    for (IRValue v = 0; v < count; ++v)
+        members[v].assign(1, v);
+    for (auto block = layout.begin(); block != layout.end(); ++block)
+    {
+        const std::vector<IRValue>& values = ir->blocks[*block].code;
+        for (auto phi = values.begin(); phi != values.end() && ir->values[*phi].op == IROP::PHI; ++phi)
+        {
+            if (!needed[*phi])
+                continue;
+            for (std::size_t i = 0; i < ir->values[*phi].operands.size(); ++i)
+            {
+                IRValue a = representative(*phi), b = representative(ir->values[*phi].operands[i]);
+                if (a == b || encoding(*phi, i) != OPERAND::REGISTER)
+                    continue;
+                if (ir->values[a].op == IROP::PARAM && ir->values[b].op == IROP::PARAM)
+                    continue;
+                bool overlap = std::any_of(members[a].begin(), members[a].end(), [&](IRValue x)
+                {
+                    return std::any_of(members[b].begin(), members[b].end(), [&](IRValue y) {return interfere(x, y);});
+                });
+                if (overlap)
+                    continue;
+                if (ir->values[b].op == IROP::PARAM)
+                    std::swap(a, b);
+                coalesced[b] = a;
+                members[a].insert(members[a].end(), members[b].begin(), members[b].end());
+                members[b].clear();
+            }
+        }
+    }
+    for (IRValue v = 0; v < count; ++v)
+        representative(v);
+}
+
+// whether going from from to to needs copies into to's phis
+bool IRCompiler::hascopies(unsigned from, unsigned to) const
+{
+    const IRBlock& block = ir->blocks[to];
+    std::size_t pred = std::find(block.preds.begin(), block.preds.end(), from) - block.preds.begin();
+    for (auto phi = block.code.begin(); phi != block.code.end() && ir->values[*phi].op == IROP::PHI; ++phi)
+    {
+        if (!needed[*phi])
+            continue;
+        if (encoding(*phi, pred) == OPERAND::IMMEDIATE || vreg(*phi) != vreg(ir->values[*phi].operands[pred]))
+            return true;
+    }
+    return false;
+}
+
+// the block control ends up in when entering block, past blocks that would only jump further
+unsigned IRCompiler::forward(unsigned block) const
+{
+    std::vector<bool> visited(ir->blocks.size(), false);
+    unsigned target = block;
+    while (!visited[target])
+    {
+        visited[target] = true;
+        const std::vector<IRValue>& values = ir->blocks[target].code;
+        bool empty = std::all_of(values.begin(), values.end() - 1, [&](IRValue value)
+        {
+            IROP op = ir->values[value].op;
+            return !needed[value] || fused[value] || op == IROP::PHI || op == IROP::PARAM;
+        });
+        unsigned next = ir->blocks[target].succs.empty() ? NOBLOCK : ir->blocks[target].succs[0];
+        if (!empty || ir->values[values.back()].op != IROP::JMP || hascopies(target, next))
+            return target;
+        target = next;
+    }
+    return block;   // a loop doing nothing
+}
+
+void IRCompiler::compile_function(IRFunction& function)
+{
+    ir = &function;
+    code.clear();
+    function.split_critical_edges();
+    layout = function.reverse_postorder();
+    block_start.assign(function.blocks.size(), 0);
+    block_end.assign(function.blocks.size(), 0);
+    next_vreg = function.frame_size + function.values.size();
+
+    std::vector<unsigned> uses = function.usecounts();
+    std::vector<IRValue> user(function.values.size(), 0);
+    in_memory.assign(function.frame_size, false);
+    for (IRValue v = 0; v < function.values.size(); ++v)
+    {
+        if (function.values[v].block == NOBLOCK)
+            continue;
+        for (auto operand = function.values[v].operands.begin(); operand != function.values[v].operands.end(); ++operand)
+            user[*operand] = v;
+        if (function.values[v].op == IROP::SLOT)
+            in_memory[function.values[v].imm] = true;
+    }
+
+    // additions used once as an address and comparisons used once as a condition are computed by their user
+    fused.assign(function.values.size(), false);
+    for (IRValue v = 0; v < function.values.size(); ++v)
+    {
+        const IRInstruction& instruction = function.values[v];
+        if (instruction.block == NOBLOCK || uses[v] != 1 || function.values[user[v]].block != instruction.block)
+            continue;
+        const IRInstruction& consumer = function.values[user[v]];
+        if (instruction.op == IROP::ADD)
+            fused[v] = (consumer.op == IROP::LOAD || (consumer.op == IROP::STORE && consumer.operands[0] == v)) &&
+                       function.values[instruction.operands[0]].op != IROP::CONST &&
+                       function.values[instruction.operands[1]].op != IROP::CONST;
+        else if (instruction.op == IROP::EQ || instruction.op == IROP::NE || instruction.op == IROP::NOT)
+            fused[v] = consumer.op == IROP::BRANCH;
+    }
+
+    // a frame with locals in memory must stay, their addresses may have been passed on
+    tail.assign(function.values.size(), false);
+    if (std::find(in_memory.begin(), in_memory.end(), true) == in_memory.end())
+    {
+        for (auto block = function.blocks.begin(); block != function.blocks.end(); ++block)
+        {
+            std::size_t size = block->code.size();
+            if (size < 2 || function.values[block->code[size - 1]].op != IROP::RET)
+                continue;
+            IRValue call = block->code[size - 2];
+            tail[call] = (function.values[call].op == IROP::CALL || function.values[call].op == IROP::CALLI) && uses[call] == 1 &&
+                         function.values[block->code[size - 1]].operands[0] == call;
+        }
+    }
+
+    needed.assign(function.values.size(), false);
+    for (IRValue v = 0; v < function.values.size(); ++v)
+    {
+        const IRInstruction& instruction = function.values[v];
+        if (instruction.block != NOBLOCK && !needed[v] &&
+            (instruction.op == IROP::STORE || instruction.iscall() || instruction.isterminator()))
+            mark_needed(v);
+    }
+
+    coalesced.resize(function.values.size());
+    for (IRValue v = 0; v < function.values.size(); ++v)
+        coalesced[v] = v;
+    coalesce_phis();
+
+    // the entry block stays first even if it only jumps, the rest of those are bypassed
+    std::vector<unsigned> emitted(1, layout.front());
+    for (auto it = layout.begin() + 1; it != layout.end(); ++it)
+        if (forward(*it) == *it)
+            emitted.push_back(*it);
+    for (std::size_t i = 0; i < emitted.size(); ++i)
+    {
+        unsigned block = emitted[i];
+        next_block = i + 1 < emitted.size() ? emitted[i + 1] : NOBLOCK;
+        block_start[block] = code.size();
+        const std::vector<IRValue>& values = function.blocks[block].code;
+        for (auto it = values.begin(); it != values.end(); ++it)
+            if (needed[*it] && !fused[*it])
+                compile_instruction(*it);
+        block_end[block] = code.size();
+    }
+}
+
+void IRCompiler::compile_instruction(IRValue value)
+{
+    const IRInstruction& instruction = ir->values[value];
+    const std::vector<IRValue>& operands = instruction.operands;
+    Reg dest = vreg(value);
+    switch (instruction.op)
+    {
+        case IROP::CONST:
+            emit(REGOP::LOADI, {dest, instruction.imm});
+            break;
+        case IROP::STRING:
+            emit(REGOP::LOADS, {dest, program.intern(ir->strings[instruction.imm])});
+            break;
+        case IROP::SLOT:
+            emit(REGOP::ADDR, {dest, instruction.imm});
+            break;
+        case IROP::PARAM:
+        case IROP::PHI:
+            break;
+        case IROP::ADD:
+        case IROP::EQ:
+        case IROP::NE:
+        {
+            static const REGOP register_ops[] = {REGOP::ADD, REGOP::EQ, REGOP::NE};
+            static const REGOP immediate_ops[] = {REGOP::ADDI, REGOP::EQI, REGOP::NEI};
+            int kind = instruction.op == IROP::ADD ? 0 : instruction.op == IROP::EQ ? 1 : 2;
+            if (encoding(value, 1) == OPERAND::IMMEDIATE)
+                emit(immediate_ops[kind], {dest, vreg(operands[0]), immediate(operands[1])});
+            else if (encoding(value, 0) == OPERAND::IMMEDIATE)
+                emit(immediate_ops[kind], {dest, vreg(operands[1]), immediate(operands[0])});
+            else
+                emit(register_ops[kind], {dest, vreg(operands[0]), vreg(operands[1])});
+            break;
+        }
+        case IROP::SUB:
+            if (encoding(value, 1) == OPERAND::IMMEDIATE)
+                emit(REGOP::ADDI, {dest, vreg(operands[0]), static_cast<Word>(0 - static_cast<std::uint64_t>(immediate(operands[1])))});
+            else
+                emit(REGOP::SUB, {dest, vreg(operands[0]), vreg(operands[1])});
+            break;
+        case IROP::NEG:
+            emit(REGOP::NEG, {dest, vreg(operands[0])});
+            break;
+        case IROP::NOT:
+            emit(REGOP::NOT, {dest, vreg(operands[0])});
+            break;
+        case IROP::LOAD:
+            switch (encoding(value, 0))
+            {
+                case OPERAND::LOCAL:
+                    emit(REGOP::MOV, {dest, immediate(operands[0])});
+                    break;
+                case OPERAND::FUSED:
+                {
+                    const std::vector<IRValue>& sum = ir->values[operands[0]].operands;
+                    emit(REGOP::LOADX, {dest, vreg(sum[0]), vreg(sum[1])});
+                    break;
+                }
+                default:
+                    emit(REGOP::LOAD, {dest, vreg(operands[0])});
+                    break;
+            }
+            break;
+        case IROP::STORE:
+            switch (encoding(value, 0))
+            {
+                case OPERAND::LOCAL:
+                    if (encoding(value, 1) == OPERAND::IMMEDIATE)
+                        emit(REGOP::LOADI, {immediate(operands[0]), immediate(operands[1])});
+                    else
+                        emit(REGOP::MOV, {immediate(operands[0]), vreg(operands[1])});
+                    break;
+                case OPERAND::FUSED:
+                {
+                    const std::vector<IRValue>& sum = ir->values[operands[0]].operands;
+                    emit(REGOP::STOREX, {vreg(sum[0]), vreg(sum[1]), vreg(operands[1])});
+                    break;
+                }
+                default:
+                    emit(REGOP::STORE, {vreg(operands[0]), vreg(operands[1])});
+                    break;
+            }
+            break;
+        case IROP::CALL:
+        case IROP::CALLB:
+        case IROP::CALLI:
+        {
+            std::vector<Word> call_operands = {dest, 0, 0};
+            auto arg = operands.begin();
+            if (instruction.op == IROP::CALLI)
+                call_operands[1] = vreg(*arg++);
+            else
+                call_operands[1] = instruction.imm;
+            call_operands[2] = operands.end() - arg;
+            for (; arg != operands.end(); ++arg)
+                call_operands.push_back(vreg(*arg));
+            if (tail[value])
+                emit(instruction.op == IROP::CALL ? REGOP::TAILCALL : REGOP::TAILCALLI,
+                     std::vector<Word>(call_operands.begin() + 1, call_operands.end()));
+            else
+                emit(instruction.op == IROP::CALL ? REGOP::CALL : instruction.op == IROP::CALLB ? REGOP::CALLB : REGOP::CALLI,
+                     call_operands);
+            break;
+        }
+        case IROP::JMP:
+        {
+            unsigned target = ir->blocks[instruction.block].succs[0];
+            compile_copies(instruction.block, target);
+            target = forward(target);
+            if (target != next_block)
+                emit(REGOP::JMP, {target});
+            break;
+        }
+        case IROP::BRANCH:
+            compile_branch(value);
+            break;
+        case IROP::RET:
+            if (tail[operands[0]])
+                break;
+            if (encoding(value, 0) == OPERAND::IMMEDIATE)
+                emit(REGOP::RETI, {immediate(operands[0])});
+            else
+                emit(REGOP::RET, {vreg(operands[0])});
+            break;
+        default:
+            throw std::logic_error("Unknown IR instruction");
+    }
+}
+
+// successors of a branch have a single predecessor once critical edges are split, so there are no copies to make
+void IRCompiler::compile_branch(IRValue value)
+{
+    const IRBlock& block = ir->blocks[ir->values[value].block];
+    unsigned if_true = forward(block.succs[0]), if_false = forward(block.succs[1]);
+    IRValue cond = ir->values[value].operands[0];
+    if (encoding(value, 0) == OPERAND::IMMEDIATE)
+    {
+        unsigned target = immediate(cond) != 0 ? if_true : if_false;
+        if (target != next_block)
+            emit(REGOP::JMP, {target});
+    }
+    else if (if_false == next_block)
+        compile_jump_if(cond, true, if_true);
+    else if (if_true == next_block)
+        compile_jump_if(cond, false, if_false);
+    else
+    {
+        compile_jump_if(cond, true, if_true);
+        emit(REGOP::JMP, {if_false});
+    }
+}
+
+// jumps to target if cond isn't zero (when is set) or is zero, comparisons fused into the branch compare directly
+void IRCompiler::compile_jump_if(IRValue cond, bool when, unsigned target)
+{
+    const IRInstruction& instruction = ir->values[cond];
+    if (!fused[cond])
+        emit(when ? REGOP::JNZ : REGOP::JZ, {vreg(cond), target});
+    else if (instruction.op == IROP::NOT)
+        emit(when ? REGOP::JZ : REGOP::JNZ, {vreg(instruction.operands[0]), target});
+    else
+    {
+        bool jump_if_equal = (instruction.op == IROP::EQ) == when;
+        const std::vector<IRValue>& operands = instruction.operands;
+        if (encoding(cond, 1) == OPERAND::IMMEDIATE)
+            emit(jump_if_equal ? REGOP::JEQI : REGOP::JNEI, {vreg(operands[0]), immediate(operands[1]), target});
+        else if (encoding(cond, 0) == OPERAND::IMMEDIATE)
+            emit(jump_if_equal ? REGOP::JEQI : REGOP::JNEI, {vreg(operands[1]), immediate(operands[0]), target});
+        else
+            emit(jump_if_equal ? REGOP::JEQ : REGOP::JNE, {vreg(operands[0]), vreg(operands[1]), target});
+    }
+}
+
+/* Copies the operands of to's phis coming from from into the phis'
+ * registers. The copies happen at once, so a register that's read by one
+ * copy is only overwritten after it's read; cycles are broken with a
+ * temporary. Constants are loaded last as they don't read anything. */
+void IRCompiler::compile_copies(unsigned from, unsigned to)
+{
+    const IRBlock& block = ir->blocks[to];
+    std::size_t pred = std::find(block.preds.begin(), block.preds.end(), from) - block.preds.begin();
+
+    std::vector<std::pair<Reg, Reg>> moves;
+    std::vector<std::pair<Reg, Word>> loads;
+    for (auto it = block.code.begin(); it != block.code.end() && ir->values[*it].op == IROP::PHI; ++it)
+    {
+        if (!needed[*it])
+            continue;
+        IRValue operand = ir->values[*it].operands[pred];
+        if (encoding(*it, pred) == OPERAND::IMMEDIATE)
+            loads.push_back(std::make_pair(vreg(*it), immediate(operand)));
+        else if (vreg(*it) != vreg(operand))
+            moves.push_back(std::make_pair(vreg(*it), vreg(operand)));
+    }
+
+    while (!moves.empty())
+    {
+        auto ready = std::find_if(moves.begin(), moves.end(), [&](const std::pair<Reg, Reg>& move)
+        {
+            return std::none_of(moves.begin(), moves.end(), [&](const std::pair<Reg, Reg>& other) {return other.second == move.first;});
+        });
+        if (ready == moves.end())
+        {
+            // every destination is still to be read: save one and read the copy instead
+            Reg saved = next_vreg++;
+            emit(REGOP::MOV, {saved, moves.front().first});
+            for (auto it = moves.begin(); it != moves.end(); ++it)
+                if (it->second == moves.front().first)
+                    it->second = saved;
+            continue;
+        }
+        emit(REGOP::MOV, {ready->first, ready->second});
+        moves.erase(ready);
+    }
+    for (auto it = loads.begin(); it != loads.end(); ++it)
+        emit(REGOP::LOADI, {it->first, it->second});
+}
+
+void IRCompiler::allocate_and_emit(CompiledFunction& compiled)
+{
+    const std::size_t none = std::numeric_limits<std::size_t>::max();
+    std::vector<LiveInterval> ranges(next_vreg, LiveInterval{0, none, 0});
+    for (unsigned vreg = 0; vreg < next_vreg; ++vreg)
+        ranges[vreg].vreg = vreg;
+    auto extend = [&](Word vreg, std::size_t position)
+    {
+        LiveInterval& range = ranges[vreg];
+        range.start = range.start == none ? position : std::min(range.start, position);
+        range.end = std::max(range.end, position);
+    };
+
+    std::vector<std::vector<unsigned>> definitions(next_vreg);     // blocks writing each vreg
+    for (auto block = layout.begin(); block != layout.end(); ++block)
+        for (std::size_t i = block_start[*block]; i < block_end[*block]; ++i)
+            for_each_register(code[i], [&](Word reg, bool definition)
+            {
+                if (definition && (definitions[reg].empty() || definitions[reg].back() != *block))
+                    definitions[reg].push_back(*block);
+            });
+
+    /* Liveness one variable at a time: from every use not preceded by a
+     * definition in its block, walk the predecessors backwards until the
+     * blocks defining it, extending its interval over the blocks passed. */
+    std::vector<std::size_t> live_out(ir->blocks.size(), none);    // last vreg found live out of the block
+    std::vector<std::size_t> defined(next_vreg, none);             // block a vreg was last defined in during the scan
+    std::vector<unsigned> pending;
+    for (auto block = layout.begin(); block != layout.end(); ++block)
+    {
+        for (std::size_t i = block_start[*block]; i < block_end[*block]; ++i)
+        {
+            for_each_register(code[i], [&](Word reg, bool definition)
+            {
+                extend(reg, i);
+                if (definition)
+                {
+                    defined[reg] = *block;
+                    return;
+                }
+                if (defined[reg] == *block || (reg < ir->frame_size && in_memory[reg]))
+                    return;
+
+                pending.assign(1, *block);
+                while (!pending.empty())
+                {
+                    unsigned live_in = pending.back();
+                    pending.pop_back();
+                    if (block_start[live_in] != block_end[live_in])
+                        extend(reg, block_start[live_in]);
+                    for (auto pred = ir->blocks[live_in].preds.begin(); pred != ir->blocks[live_in].preds.end(); ++pred)
+                    {
+                        if (live_out[*pred] == static_cast<std::size_t>(reg))
+                            continue;
+                        live_out[*pred] = reg;
+                        if (block_start[*pred] != block_end[*pred])
+                            extend(reg, block_end[*pred] - 1);
+                        if (std::find(definitions[reg].begin(), definitions[reg].end(), *pred) == definitions[reg].end())
+                            pending.push_back(*pred);
+                    }
+                }
+            });
+        }
+    }
+
+    // parameters are live from the start, locals whose address is taken throughout
+    for (unsigned param = 0; param < ir->params; ++param)
+        extend(param, 0);
+    for (unsigned local = 0; local < ir->frame_size; ++local)
+    {
+        if (in_memory[local] && !code.empty())
+        {
+            extend(local, 0);
+            extend(local, code.size() - 1);
+        }
+    }
+
+    std::vector<LiveInterval> intervals;
+    for (auto range = ranges.begin(); range != ranges.end(); ++range)
+        if (range->start != none)
+            intervals.push_back(*range);
+    std::vector<int> slot = LinearScan::allocate(intervals, next_vreg, compiled.frame_size);
+
+    for (auto it = code.begin(); it != code.end(); ++it)
+        for_each_register(*it, [&](Word& reg, bool) {reg = slot[reg];});
+    std::vector<std::size_t> position(code.size() + 1);
+    position[0] = program.code.size();
+    for (std::size_t i = 0; i < code.size(); ++i)
+    {
+        bool removed = code[i].op == REGOP::MOV && code[i].operands[0] == code[i].operands[1];
+        position[i + 1] = position[i] + (removed ? 0 : 1 + code[i].operands.size());
+    }
+
+    compiled.entry = position[0];
+    for (std::size_t i = 0; i < code.size(); ++i)
+    {
+        if (position[i + 1] == position[i])
+            continue;
+        const char* kinds = getinfo(code[i].op).operands;
+        program.code.push_back(static_cast<Word>(code[i].op));
+        for (std::size_t operand = 0; operand < code[i].operands.size(); ++operand)
+        {
+            if (operand < std::strlen(kinds) && kinds[operand] == 't')
+                program.code.push_back(position[block_start[code[i].operands[operand]]]);
+            else
+                program.code.push_back(code[i].operands[operand]);
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef H_IRCOMPILER
+#define H_IRCOMPILER
+
+#include <vector>
+
+#include "ir.h"
+#include "regbytecode.h"
+
+/* Translates functions in SSA form to register machine code, so that they
+ * run on RegisterVM. Every value gets its own virtual register (parameters
+ * the ones the arguments arrive in) and phis become copies at the end of
+ * the predecessors, after critical edges are split. Constants, frame slot
+ * addresses and single use additions and comparisons are folded into the
+ * instructions using them where the instruction set allows, and pure
+ * values nobody uses aren't computed. A phi shares its register with
+ * those of its operands whose live ranges don't overlap with it or each
+ * other, which removes most of the copies, and blocks left with nothing
+ * but a jump are bypassed. Blocks are laid out in reverse postorder; live
+ * ranges come from liveness over the blocks and slots are shared by
+ * LinearScan as for RegisterCompiler. A call of a function or function
+ * value whose result is returned right after it is a tail call unless the
+ * function has locals in memory (see TailCalls). */
+class IRCompiler
+{
+    typedef Word Reg;
+
+    enum class OPERAND {REGISTER, IMMEDIATE, LOCAL, FUSED};
+
+    struct RegInstruction
+    {
+        REGOP op;
+        std::vector<Word> operands;
+    };
+
+    Program& program;
+    IRFunction* ir;
+    std::vector<bool> fused;        // computed by the instruction using it
+    std::vector<bool> needed;
+    std::vector<bool> tail;         // calls whose value the next instruction returns, made in the caller's frame
+    std::vector<bool> in_memory;    // locals accessed through SLOTs
+    std::vector<IRValue> coalesced; // value whose register each value shares, a parameter if there's one
+    std::vector<unsigned> layout;
+    std::vector<RegInstruction> code;
+    std::vector<std::size_t> block_start;   // first instruction of every block, in code
+    std::vector<std::size_t> block_end;
+    unsigned next_block;    // laid out after the one being compiled
+    unsigned next_vreg;
+
+    void emit(REGOP op, std::vector<Word> operands);
+    Reg vreg(IRValue value) const;
+    Word immediate(IRValue value) const {return ir->values[value].imm;}
+    OPERAND encoding(IRValue user, std::size_t operand) const;
+    void mark_needed(IRValue value);
+    IRValue representative(IRValue value);
+    void coalesce_phis();
+    bool hascopies(unsigned from, unsigned to) const;
+    unsigned forward(unsigned block) const;
+    // calls fn(operand) for every operand value reads from a register, including those of values fused into it
+    template<typename Fn> void for_each_use(IRValue value, Fn fn) const;
+
+    void compile_function(IRFunction& function);
+    void compile_instruction(IRValue value);
+    void compile_branch(IRValue value);
+    void compile_jump_if(IRValue cond, bool when, unsigned target);
+    void compile_copies(unsigned from, unsigned to);
+    void allocate_and_emit(CompiledFunction& compiled);
+
+    // calls fn(reg, is_definition) for every register operand, uses before the definition
+    template<typename Fn> static void for_each_register(RegInstruction& instruction, Fn fn);
+
+    IRCompiler(Program& _program) : program(_program), ir(nullptr), next_block(NOBLOCK), next_vreg(0) {}
+
+public:
+    static Program compile(std::vector<IRFunction>& functions);
+};
+
+#endif // H_IRCOMPILER
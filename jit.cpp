@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "jit.h"
+#include "x64codegen.h"
+#include "builtins.h"
+
+const std::vector<Word>& Jit::generate(Library& library, JitEmitter& emitter)
+{
+    X64Codegen::generate(library, emitter);
+    return emitter.getstatics();
+}
+
+Jit::Jit(Library& library, std::size_t heap_words)
+    : table(builtins.size() + library.functions.size()), emitter(table.data() + builtins.size()),
+      memory(generate(library, emitter), heap_words, 0), runtime(memory), natives(runtime),
+      code(emitter, Memory::pointer(memory.statics()))
+{
+    for (unsigned i = 0; i < builtins.size(); ++i)
+        table[builtins.size() - 1 - i] = JitRuntime::builtin(i);
+    for (unsigned i = 0; i < library.functions.size(); ++i)
+    {
+        table[builtins.size() + i] = code.at(emitter.getfunction(i));
+        names.push_back(library.functions[i].name);
+    }
+}
+
+Word Jit::run(const Identifier& entry)
+{
+    auto function = std::find(names.begin(), names.end(), entry);
+    if (function == names.end())
+        throw std::runtime_error("No function named '" + entry + "'");
+    X64Function compiled = reinterpret_cast<X64Function>(table[builtins.size() + (function - names.begin())]);
+
+    JitRuntime* outer = natives.activate();
+    runtime.exited = false;
+    natives.error = nullptr;
+    Word result = 0;
+    MemoryTrap trap(memory, [this](const void* instruction) {return code.contains(instruction);});
+    if (MEMORY_TRAPPED(trap))
+        natives.error = std::make_exception_ptr(std::runtime_error(memory.fault(trap, function_at(trap.instruction))));
+    else if (!setjmp(natives.exit_point))
+        result = compiled(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    JitRuntime::restore(outer);
+    runtime.flush();
+
+    if (natives.error)
+        std::rethrow_exception(natives.error);
+    return result;
+}
+
+std::string Jit::function_at(const void* instruction) const
+{
+    if (!instruction || !code.contains(instruction))
+        return std::string();
+    std::size_t offset = static_cast<const std::uint8_t*>(instruction) - static_cast<const std::uint8_t*>(code.at(0));
+    int found = -1;
+    for (unsigned i = 0; i < names.size(); ++i)
+        if (emitter.getfunction(i) <= offset && (found < 0 || emitter.getfunction(i) > emitter.getfunction(found)))
+            found = i;
+    return found < 0 ? std::string() : names[found];
+}
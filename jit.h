@@ -0,0 +1,42 @@
+#ifndef H_JIT
+#define H_JIT
+
+#include <vector>
+
+#include "jitemitter.h"
+#include "jitruntime.h"
+#include "executablememory.h"
+#include "function.h"
+#include "library.h"
+#include "memory.h"
+#include "runtime.h"
+
+/* Compiles a library to machine code in memory and runs it in process.
+ * The code is generated by X64Codegen into a JitEmitter and copied into
+ * executable pages. Calls between functions go through the call table, see
+ * JitEmitter; builtins are the functions of a JitRuntime. Faults in the
+ * guard pages of B memory end the run with an error, see MemoryTrap. */
+class Jit
+{
+    std::vector<const void*> table;     // builtins in reverse order, then the functions
+    std::vector<Identifier> names;
+    JitEmitter emitter;
+    Memory memory;
+    Runtime runtime;
+    JitRuntime natives;
+    ExecutableMemory code;
+
+    static const std::vector<Word>& generate(Library& library, JitEmitter& emitter);
+    // name of the function whose code contains instruction, empty if none does
+    std::string function_at(const void* instruction) const;
+
+public:
+    Jit(Library& library, std::size_t heap_words = 1 << 20);
+
+    // runs entry to completion (or until exit() is called) and returns its result
+    Word run(const Identifier& entry = "main");
+
+    std::size_t size() const {return emitter.getcode().size();}     // bytes of machine code
+};
+
+#endif // H_JIT
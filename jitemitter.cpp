@@ -0,0 +1,396 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "jitemitter.h"
+
+static const std::size_t UNBOUND = static_cast<std::size_t>(-1);
+
+// opcodes of add/sub/cmp/mov as "op r/m64, r64", "op r64, r/m64" and the /digit of "op r/m64, imm32"
+static const std::uint8_t op_to_rm[] = {0x01, 0x29, 0x39, 0x89};
+static const std::uint8_t op_from_rm[] = {0x03, 0x2B, 0x3B, 0x8B};
+static const unsigned op_digit[] = {0, 5, 7, 0};
+
+static unsigned number(X64REG reg)
+{
+    return static_cast<unsigned>(reg);
+}
+
+static bool isbyte(std::int32_t value)
+{
+    return value >= -128 && value <= 127;
+}
+
+void JitEmitter::int32(std::int32_t value)
+{
+    std::uint8_t bytes[4];
+    std::memcpy(bytes, &value, 4);
+    code.insert(code.end(), bytes, bytes + 4);
+}
+
+void JitEmitter::int64(Word value)
+{
+    std::uint8_t bytes[8];
+    std::memcpy(bytes, &value, 8);
+    code.insert(code.end(), bytes, bytes + 8);
+}
+
+void JitEmitter::rex(unsigned reg, unsigned base, bool wide)
+{
+    std::uint8_t prefix = 0x40 | (wide ? 8 : 0) | (reg >> 3) << 2 | base >> 3;
+    if (prefix != 0x40)
+        byte(prefix);
+}
+
+void JitEmitter::modrm(unsigned reg, X64REG rm)
+{
+    byte(0xC0 | (reg & 7) << 3 | (number(rm) & 7));
+}
+
+// [base + displacement]; rbp and r13 always need a displacement, rsp and r12 a SIB byte
+void JitEmitter::memory(unsigned reg, X64REG base, std::int32_t displacement)
+{
+    unsigned rm = number(base) & 7;
+    unsigned mod = displacement == 0 && rm != 5 ? 0 : isbyte(displacement) ? 1 : 2;
+    byte(mod << 6 | (reg & 7) << 3 | rm);
+    if (rm == 4)
+        byte(0x24);
+    if (mod == 1)
+        byte(static_cast<std::uint8_t>(displacement));
+    else if (mod == 2)
+        int32(displacement);
+}
+
+// mov r11, &table[index]; call [r11]
+void JitEmitter::call_table(Word index, bool jump)
+{
+    mov_imm(X64REG::R11, static_cast<Word>(reinterpret_cast<std::uintptr_t>(table + index)));
+    byte(0x41);
+    byte(0xFF);
+    byte(jump ? 0x23 : 0x13);
+}
+
+// mov r10, table; call or jmp [r10 + reg * 8]
+void JitEmitter::call_table_at(X64REG reg, bool jump)
+{
+    mov_imm(X64REG::R10, static_cast<Word>(reinterpret_cast<std::uintptr_t>(table)));
+    byte(0x41 | (number(reg) >> 3) << 1);
+    byte(0xFF);
+    byte(jump ? 0x24 : 0x14);
+    byte(0xC0 | (number(reg) & 7) << 3 | (number(X64REG::R10) & 7));
+}
+
+void JitEmitter::patch_strings(std::uint8_t* destination, Word* statics_begin) const
+{
+    for (auto it = strings.begin(); it != strings.end(); ++it)
+    {
+        Word address = static_cast<Word>(reinterpret_cast<std::uintptr_t>(statics_begin + it->second));
+        std::memcpy(destination + it->first, &address, 8);
+    }
+}
+
+std::size_t JitEmitter::forwarder(Word argument, const void* target)
+{
+    while (code.size() % 16)
+        byte(0xCC);
+    std::size_t offset = code.size();
+
+    push(X64REG::RBP);
+    alu(X64OP::MOV, X64REG::RBP, X64REG::RSP);
+    for (int arg = 5; arg >= 0; --arg)
+        push(x64_argument_registers[arg]);
+    mov_imm(X64REG::RDI, argument);
+    alu(X64OP::MOV, X64REG::RSI, X64REG::RSP);
+    rex(number(X64REG::RDX), number(X64REG::RBP));         // lea rdx, [rbp + 16]
+    byte(0x8D);
+    memory(number(X64REG::RDX), X64REG::RBP, 16);
+    mov_imm(X64REG::RAX, static_cast<Word>(reinterpret_cast<std::uintptr_t>(target)));
+    byte(0xFF);                                             // call rax
+    modrm(2, X64REG::RAX);
+    leave();
+    ret();
+    return offset;
+}
+
+void JitEmitter::bind(unsigned label)
+{
+    if (label >= labels.size())
+        labels.resize(label + 1, UNBOUND);
+    labels[label] = code.size();
+}
+
+void JitEmitter::begin_function(unsigned index)
+{
+    while (code.size() % 16)
+        byte(0xCC);
+    if (index >= functions.size())
+        functions.resize(index + 1);
+    functions[index] = code.size();
+}
+
+void JitEmitter::end_function(unsigned)
+{
+}
+
+void JitEmitter::finish(const std::vector<Word>& _statics)
+{
+    for (auto it = jumps.begin(); it != jumps.end(); ++it)
+    {
+        if (it->second >= labels.size() || labels[it->second] == UNBOUND)
+            throw std::logic_error("Jump to unbound label " + std::to_string(it->second));
+        std::int32_t relative = static_cast<std::int32_t>(labels[it->second] - (it->first + 4));
+        std::memcpy(code.data() + it->first, &relative, 4);
+    }
+    statics = _statics;
+}
+
+void JitEmitter::push(X64REG reg)
+{
+    rex(0, number(reg), false);
+    byte(0x50 + (number(reg) & 7));
+}
+
+void JitEmitter::pop(X64REG reg)
+{
+    rex(0, number(reg), false);
+    byte(0x58 + (number(reg) & 7));
+}
+
+void JitEmitter::mov_imm(X64REG reg, Word value)
+{
+    if (value == 0)
+        alu(X64OP::SUB, reg, reg);
+    else if (value >= INT32_MIN && value <= INT32_MAX)
+        alu_imm(X64OP::MOV, reg, static_cast<std::int32_t>(value));
+    else
+    {
+        rex(0, number(reg));
+        byte(0xB8 + (number(reg) & 7));
+        int64(value);
+    }
+}
+
+void JitEmitter::alu(X64OP op, X64REG dst, X64REG src)
+{
+    rex(number(src), number(dst));
+    byte(op_to_rm[static_cast<int>(op)]);
+    modrm(number(src), dst);
+}
+
+void JitEmitter::alu_imm(X64OP op, X64REG dst, std::int32_t value)
+{
+    rex(0, number(dst));
+    if (op == X64OP::MOV)
+    {
+        byte(0xC7);
+        modrm(0, dst);
+        int32(value);
+    }
+    else if (isbyte(value))
+    {
+        byte(0x83);
+        modrm(op_digit[static_cast<int>(op)], dst);
+        byte(static_cast<std::uint8_t>(value));
+    }
+    else
+    {
+        byte(0x81);
+        modrm(op_digit[static_cast<int>(op)], dst);
+        int32(value);
+    }
+}
+
+void JitEmitter::alu_local(X64OP op, X64REG dst, unsigned slot)
+{
+    rex(number(dst), number(X64REG::RBP));
+    byte(op_from_rm[static_cast<int>(op)]);
+    memory(number(dst), X64REG::RBP, -8 * static_cast<std::int32_t>(slot + 1));
+}
+
+void JitEmitter::alu_to_local(X64OP op, unsigned slot, X64REG src)
+{
+    rex(number(src), number(X64REG::RBP));
+    byte(op_to_rm[static_cast<int>(op)]);
+    memory(number(src), X64REG::RBP, -8 * static_cast<std::int32_t>(slot + 1));
+}
+
+void JitEmitter::alu_local_imm(X64OP op, unsigned slot, std::int32_t value)
+{
+    std::int32_t displacement = -8 * static_cast<std::int32_t>(slot + 1);
+    rex(0, number(X64REG::RBP));
+    if (op == X64OP::MOV)
+    {
+        byte(0xC7);
+        memory(0, X64REG::RBP, displacement);
+        int32(value);
+    }
+    else if (isbyte(value))
+    {
+        byte(0x83);
+        memory(op_digit[static_cast<int>(op)], X64REG::RBP, displacement);
+        byte(static_cast<std::uint8_t>(value));
+    }
+    else
+    {
+        byte(0x81);
+        memory(op_digit[static_cast<int>(op)], X64REG::RBP, displacement);
+        int32(value);
+    }
+}
+
+void JitEmitter::lea_local(X64REG dst, unsigned slot)
+{
+    rex(number(dst), number(X64REG::RBP));
+    byte(0x8D);
+    memory(number(dst), X64REG::RBP, -8 * static_cast<std::int32_t>(slot + 1));
+}
+
+void JitEmitter::load_param(X64REG dst, unsigned index)
+{
+    rex(number(dst), number(X64REG::RBP));
+    byte(0x8B);
+    memory(number(dst), X64REG::RBP, 16 + 8 * static_cast<std::int32_t>(index));
+}
+
+void JitEmitter::store_param(unsigned index, X64REG src)
+{
+    rex(number(src), number(X64REG::RBP));
+    byte(0x89);
+    memory(number(src), X64REG::RBP, 16 + 8 * static_cast<std::int32_t>(index));
+}
+
+void JitEmitter::load(X64REG dst, X64REG base)
+{
+    rex(number(dst), number(base));
+    byte(0x8B);
+    memory(number(dst), base, 0);
+}
+
+void JitEmitter::store(X64REG base, X64REG src)
+{
+    rex(number(src), number(base));
+    byte(0x89);
+    memory(number(src), base, 0);
+}
+
+void JitEmitter::load_stack(X64REG dst, std::int32_t offset)
+{
+    rex(number(dst), number(X64REG::RSP));
+    byte(0x8B);
+    memory(number(dst), X64REG::RSP, offset);
+}
+
+void JitEmitter::push_stack(std::int32_t offset)
+{
+    byte(0xFF);
+    memory(6, X64REG::RSP, offset);
+}
+
+void JitEmitter::shl(X64REG reg, unsigned bits)
+{
+    rex(0, number(reg));
+    byte(0xC1);
+    modrm(4, reg);
+    byte(bits);
+}
+
+void JitEmitter::shr(X64REG reg, unsigned bits)
+{
+    rex(0, number(reg));
+    byte(0xC1);
+    modrm(5, reg);
+    byte(bits);
+}
+
+void JitEmitter::neg(X64REG reg)
+{
+    rex(0, number(reg));
+    byte(0xF7);
+    modrm(3, reg);
+}
+
+void JitEmitter::test(X64REG reg)
+{
+    rex(number(reg), number(reg));
+    byte(0x85);
+    modrm(number(reg), reg);
+}
+
+// setcc of the low byte, then movzx reg, low byte
+void JitEmitter::setcc(X64COND cond, X64REG reg)
+{
+    byte(0x0F);
+    byte(cond == X64COND::E ? 0x94 : 0x95);
+    modrm(0, reg);
+    rex(number(reg), number(reg));
+    byte(0x0F);
+    byte(0xB6);
+    modrm(number(reg), reg);
+}
+
+void JitEmitter::jmp(unsigned label)
+{
+    byte(0xE9);
+    jumps.emplace_back(code.size(), label);
+    int32(0);
+}
+
+void JitEmitter::jcc(X64COND cond, unsigned label)
+{
+    byte(0x0F);
+    byte(cond == X64COND::E ? 0x84 : 0x85);
+    jumps.emplace_back(code.size(), label);
+    int32(0);
+}
+
+void JitEmitter::call_function(unsigned index)
+{
+    call_table(index);
+}
+
+void JitEmitter::call_builtin(unsigned index)
+{
+    call_table(-static_cast<Word>(index) - 1);
+}
+
+void JitEmitter::jump_function(unsigned index)
+{
+    call_table(index, true);
+}
+
+void JitEmitter::function_value(X64REG dst, unsigned index)
+{
+    mov_imm(dst, index);
+}
+
+void JitEmitter::builtin_value(X64REG dst, unsigned index)
+{
+    mov_imm(dst, -static_cast<Word>(index) - 1);
+}
+
+void JitEmitter::call_value(X64REG reg)
+{
+    call_table_at(reg, false);
+}
+
+void JitEmitter::jump_value(X64REG reg)
+{
+    call_table_at(reg, true);
+}
+
+void JitEmitter::lea_string(X64REG dst, Word offset)
+{
+    rex(0, number(dst));
+    byte(0xB8 + (number(dst) & 7));
+    strings.emplace_back(code.size(), offset);
+    int64(0);
+}
+
+void JitEmitter::leave()
+{
+    byte(0xC9);
+}
+
+void JitEmitter::ret()
+{
+    byte(0xC3);
+}
@@ -0,0 +1,87 @@
+#ifndef H_JITEMITTER
+#define H_JITEMITTER
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "x64emitter.h"
+
+/* Encodes x86-64 machine code into a buffer for Jit. The value of a function
+ * or builtin is the same as in the VMs (its index, builtins -(index + 1)),
+ * and every call goes through the call table: entry n for function n,
+ * entry -(n + 1) for builtin n, so calls can be redirected by patching the
+ * table. The code is position independent except for string literals,
+ * which are absolute addresses filled in by patch_strings(). */
+class JitEmitter : public X64Emitter
+{
+    const void* const* table;
+    std::vector<std::uint8_t> code;
+    std::vector<std::size_t> labels;
+    std::vector<std::pair<std::size_t, unsigned>> jumps;    // rel32 at offset to label
+    std::vector<std::pair<std::size_t, Word>> strings;      // imm64 at offset to statics word
+    std::vector<std::size_t> functions;
+    std::vector<Word> statics;
+
+    void byte(std::uint8_t value) {code.push_back(value);}
+    void int32(std::int32_t value);
+    void int64(Word value);
+    void rex(unsigned reg, unsigned base, bool wide = true);
+    void modrm(unsigned reg, X64REG rm);
+    void memory(unsigned reg, X64REG base, std::int32_t displacement);
+    void call_table(Word index, bool jump = false);    // call or jmp through the table entry
+    void call_table_at(X64REG reg, bool jump);          // the same through the entry reg holds the index of
+
+public:
+    JitEmitter(const void* const* _table) : table(_table) {}
+
+    const std::vector<std::uint8_t>& getcode() const {return code;}
+    const std::vector<Word>& getstatics() const {return statics;}
+    std::size_t getfunction(unsigned index) const {return functions[index];}
+    // writes the address of string literals into code copied to destination
+    void patch_strings(std::uint8_t* destination, Word* statics_begin) const;
+    /* Function forwarding its arguments to target(argument, register_args,
+     * stack_args), where register_args points to the six passed in
+     * registers and stack_args to the rest. Returns its offset. */
+    std::size_t forwarder(Word argument, const void* target);
+
+    void bind(unsigned label) override;
+    void begin_function(unsigned index) override;
+    void end_function(unsigned index) override;
+    void finish(const std::vector<Word>& statics) override;
+
+    void push(X64REG reg) override;
+    void pop(X64REG reg) override;
+    void mov_imm(X64REG reg, Word value) override;
+    void alu(X64OP op, X64REG dst, X64REG src) override;
+    void alu_imm(X64OP op, X64REG dst, std::int32_t value) override;
+    void alu_local(X64OP op, X64REG dst, unsigned slot) override;
+    void alu_to_local(X64OP op, unsigned slot, X64REG src) override;
+    void alu_local_imm(X64OP op, unsigned slot, std::int32_t value) override;
+    void lea_local(X64REG dst, unsigned slot) override;
+    void load_param(X64REG dst, unsigned index) override;
+    void store_param(unsigned index, X64REG src) override;
+    void load(X64REG dst, X64REG base) override;
+    void store(X64REG base, X64REG src) override;
+    void load_stack(X64REG dst, std::int32_t offset) override;
+    void push_stack(std::int32_t offset) override;
+    void shl(X64REG reg, unsigned bits) override;
+    void shr(X64REG reg, unsigned bits) override;
+    void neg(X64REG reg) override;
+    void test(X64REG reg) override;
+    void setcc(X64COND cond, X64REG reg) override;
+    void jmp(unsigned label) override;
+    void jcc(X64COND cond, unsigned label) override;
+    void call_function(unsigned index) override;
+    void call_builtin(unsigned index) override;
+    void jump_function(unsigned index) override;
+    void function_value(X64REG dst, unsigned index) override;
+    void builtin_value(X64REG dst, unsigned index) override;
+    void call_value(X64REG reg) override;
+    void jump_value(X64REG reg) override;
+    void lea_string(X64REG dst, Word offset) override;
+    void leave() override;
+    void ret() override;
+};
+
+#endif // H_JITEMITTER
@@ -0,0 +1,114 @@
+#include <cstdarg>
+#include <vector>
+
+#include "jitruntime.h"
+
+thread_local JitRuntime* JitRuntime::active = nullptr;
+
+const void* JitRuntime::builtin(unsigned index)
+{
+    static const void* const functions[] = {reinterpret_cast<const void*>(&builtin_putchar),
+                                            reinterpret_cast<const void*>(&builtin_getchar),
+                                            reinterpret_cast<const void*>(&builtin_printf),
+                                            reinterpret_cast<const void*>(&builtin_char),
+                                            reinterpret_cast<const void*>(&builtin_lchar),
+                                            reinterpret_cast<const void*>(&builtin_exit),
+                                            reinterpret_cast<const void*>(&builtin_getvec),
+                                            reinterpret_cast<const void*>(&builtin_flush)};
+    return functions[index];
+}
+
+void JitRuntime::unwind()
+{
+    std::longjmp(exit_point, 1);
+}
+
+// runs builtin, false when generated code has to be left as the program exited or error is set
+bool JitRuntime::attempt(unsigned builtin, const Word* args, unsigned argc, Word& result)
+{
+    try
+    {
+        result = runtime.call(builtin, args, argc);
+        return !runtime.exited;
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    return false;
+}
+
+Word JitRuntime::call(unsigned builtin, const Word* args, unsigned argc)
+{
+    Word result;
+    if (!attempt(builtin, args, argc, result))
+        unwind();
+    return result;
+}
+
+Word JitRuntime::builtin_putchar(Word c)
+{
+    return active->call(0, &c, 1);
+}
+
+Word JitRuntime::builtin_getchar()
+{
+    return active->call(1, nullptr, 0);
+}
+
+// variadic, the format decides how many arguments were passed
+Word JitRuntime::builtin_printf(Word format, ...)
+{
+    Word result;
+    bool returned;
+    {
+        // without allocating for the usual few arguments, it's called for every line of output
+        Word few[8];
+        std::vector<Word> many;
+        unsigned count = Runtime::format_arguments(format);
+        Word* args = few;
+        if (count >= 8)
+        {
+            many.resize(count + 1);
+            args = many.data();
+        }
+        args[0] = format;
+        std::va_list list;
+        va_start(list, format);
+        for (unsigned i = 1; i <= count; ++i)
+            args[i] = va_arg(list, Word);
+        va_end(list);
+        returned = active->attempt(2, args, count + 1, result);
+    }
+    // many is gone by now
+    if (!returned)
+        active->unwind();
+    return result;
+}
+
+Word JitRuntime::builtin_char(Word string, Word index)
+{
+    Word args[] = {string, index};
+    return active->call(3, args, 2);
+}
+
+Word JitRuntime::builtin_lchar(Word string, Word index, Word c)
+{
+    Word args[] = {string, index, c};
+    return active->call(4, args, 3);
+}
+
+Word JitRuntime::builtin_exit()
+{
+    return active->call(5, nullptr, 0);
+}
+
+Word JitRuntime::builtin_getvec(Word size)
+{
+    return active->call(6, &size, 1);
+}
+
+Word JitRuntime::builtin_flush()
+{
+    return active->call(7, nullptr, 0);
+}
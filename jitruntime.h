@@ -0,0 +1,50 @@
+#ifndef H_JITRUNTIME
+#define H_JITRUNTIME
+
+#include <csetjmp>
+#include <exception>
+
+#include "runtime.h"
+
+/* The builtins of a Runtime as called from generated code: System V
+ * functions taking one Word per argument, printf variadic. Generated code
+ * has no unwind information, so exit() and exceptions thrown by builtins
+ * longjmp to exit_point instead, which whoever calls into generated code
+ * sets up with setjmp; the exception is kept in error. Nothing with a
+ * destructor may be alive in a frame that longjmp skips. */
+class JitRuntime
+{
+    Runtime& runtime;
+
+    static thread_local JitRuntime* active;
+
+    bool attempt(unsigned builtin, const Word* args, unsigned argc, Word& result);
+    Word call(unsigned builtin, const Word* args, unsigned argc);
+
+    static Word builtin_putchar(Word c);
+    static Word builtin_getchar();
+    static Word builtin_printf(Word format, ...);
+    static Word builtin_char(Word string, Word index);
+    static Word builtin_lchar(Word string, Word index, Word c);
+    static Word builtin_exit();
+    static Word builtin_getvec(Word size);
+    static Word builtin_flush();
+
+public:
+    std::jmp_buf exit_point;
+    std::exception_ptr error;
+
+    JitRuntime(Runtime& _runtime) : runtime(_runtime) {}
+
+    // address of the function implementing builtin index
+    static const void* builtin(unsigned index);
+
+    // makes this the runtime builtins called on this thread use, returns the previous one
+    JitRuntime* activate() {JitRuntime* previous = active; active = this; return previous;}
+    static void restore(JitRuntime* previous) {active = previous;}
+
+    // leaves generated code for exit_point, error (if set) is rethrown from there
+    [[noreturn]] void unwind();
+};
+
+#endif // H_JITRUNTIME
@@ -41,8 +41,7 @@ struct Action
     int return_state;
     Goal next_goal;
 
-    //Action() : next_action(ACTION::JUMP), next_state(-1), return_state(-1), next_goal(Goal()), load_next_token(false) {}
-    Action() {}
+    Action() : next_action(ACTION::CALL_NONTERM), next_state(-1), return_state(-1) {}
 
     Action(ACTION _next_action, int _next_state, int _return_state = -1)
         : next_action(_next_action), next_state(_next_state), return_state(_return_state) {}
@@ -464,7 +463,7 @@ const std::unordered_map<Current, Action, CurrentHasher> grammar =
     },
     {
         Current(49),
-        Action(ACTION::CALL_NONTERM, 11, 48)
+        Action(ACTION::CALL_NONTERM, 97, 48)
     },
     {
         Current(50),
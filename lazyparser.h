@@ -0,0 +1,128 @@
+#ifndef H_LAZYPARSER
+#define H_LAZYPARSER
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lexer.h"
+#include "token.h"
+#include "function.h"
+#include "library.h"
+#include "identifier.h"
+
+/* Lazy parsing mode:
+ * Instead of running the whole token stream through the parser state
+ * machine, the pre-scan only recognizes function headers (name and
+ * parameters) and skips over the body by matching braces, parentheses
+ * and semicolons. Each function gets a LazyBody holding its byte range
+ * in the source, which is parsed by a regular parser the first time
+ * Function::getbody() is called. */
+class LazyParser
+{
+    Lexer lexer;
+    std::shared_ptr<std::string> source;
+    Token current;
+
+    void advance()
+    {
+        current = lexer.next();
+        if (current.type == TOKEN_EOF)
+            throw std::logic_error("Unexpected end of file in function body");
+    }
+
+    void skip_balanced(TOKEN open, TOKEN close)
+    {
+        int depth = 1;
+        while (depth)
+        {
+            advance();
+            if (current.type == open)
+                depth++;
+            else if (current.type == close)
+                depth--;
+        }
+    }
+
+    // skips a statement starting with the current token, leaves current at its last token
+    void skip_statement()
+    {
+        switch (current.type)
+        {
+            case TOKEN_CURLYBRACE_OPEN:
+                skip_balanced(TOKEN_CURLYBRACE_OPEN, TOKEN_CURLYBRACE_CLOSE);
+                break;
+            case TOKEN_IF:
+            case TOKEN_WHILE:
+                advance();
+                if (current.type != TOKEN_PARENTHESIS_OPEN)
+                    throw std::logic_error("Expected ( after if or while");
+                skip_balanced(TOKEN_PARENTHESIS_OPEN, TOKEN_PARENTHESIS_CLOSE);
+                advance();
+                skip_statement();
+                break;
+            case TOKEN_SEMICOLON:
+                break;
+            default:    // return, variable definitions and expressions end with a semicolon
+            {
+                int depth = 0;
+                while (current.type != TOKEN_SEMICOLON || depth)
+                {
+                    if (current.type == TOKEN_PARENTHESIS_OPEN || current.type == TOKEN_SQBRACKET_OPEN)
+                        depth++;
+                    if (current.type == TOKEN_PARENTHESIS_CLOSE || current.type == TOKEN_SQBRACKET_CLOSE)
+                        depth--;
+                    advance();
+                }
+                break;
+            }
+        }
+    }
+
+    LazyParser(std::shared_ptr<std::string> _source) : lexer(_source.get()), source(_source) {}
+
+    Library prescan()
+    {
+        std::vector<Function> functions;
+        std::size_t func_begin = 0;
+
+        current = lexer.next();
+        while (current.type != TOKEN_EOF)
+        {
+            if (current.type != TOKEN_IDENTIFIER)
+                throw std::logic_error("Expected function name");
+            Identifier name = *current.str_val;
+
+            std::vector<Identifier> params;
+            advance();
+            while (current.type == TOKEN_IDENTIFIER)
+            {
+                params.push_back(*current.str_val);
+                advance();
+                if (current.type == TOKEN_COMMA)
+                    advance();
+            }
+            if (current.type != TOKEN_COLON)
+                throw std::logic_error("Expected : after function parameters");
+
+            advance();
+            skip_statement();
+
+            std::size_t func_end = lexer.position();
+            functions.push_back(Function(name, params, std::make_shared<LazyBody>(source, func_begin, func_end)));
+            func_begin = func_end;
+
+            current = lexer.next();
+        }
+        return Library(functions);
+    }
+
+public:
+    static Library parse(std::shared_ptr<std::string> _source)
+    {
+        LazyParser lazy_parser(_source);
+        return lazy_parser.prescan();
+    }
+};
+
+#endif // H_LAZYPARSER
@@ -0,0 +1,14 @@
+#include "lexer.h"
+
+const std::map<std::string,TOKEN> Lexer::tokens = {{"if", TOKEN_IF}, {"while", TOKEN_WHILE}, {"return", TOKEN_RETURN}, {"var", TOKEN_VAR},
+                                                  {"(", TOKEN_PARENTHESIS_OPEN}, {")", TOKEN_PARENTHESIS_CLOSE},
+                                                  {"[", TOKEN_SQBRACKET_OPEN}, {"]", TOKEN_SQBRACKET_CLOSE},
+                                                  {"{", TOKEN_CURLYBRACE_OPEN}, {"}", TOKEN_CURLYBRACE_CLOSE},
+                                                  {",", TOKEN_COMMA}, {";", TOKEN_SEMICOLON}, {":", TOKEN_COLON},
+                                                  {"?", TOKEN_QUESTIONMARK}, {"+", TOKEN_PLUS}, {"-", TOKEN_MINUS},
+                                                  {"=", TOKEN_EQUALS}, {"+=", TOKEN_PLUSEQUALS}, {"-=", TOKEN_MINUSEQUALS},
+                                                  {"!", TOKEN_NEGATE}, {"!=", TOKEN_NEGATEEQUALS},
+                                                  {"++", TOKEN_INCREMENT}, {"--", TOKEN_DECREMENT}, {"==", TOKEN_COMPARE},
+                                                  {"*", TOKEN_STAR}, {"&", TOKEN_AMP}, {"&&", TOKEN_AND}, {"||", TOKEN_OR}};
+
+const std::vector<std::string> Lexer::reserved_words = {"if", "while", "return", "var"};
@@ -5,26 +5,24 @@
 #include <string>
 #include <map>
 #include <iostream>
+#include <sstream>
 #include <memory>
 #include <vector>
 #include <algorithm>
 
 #include "token.h"
 
+struct LexerPosition
+{
+    std::size_t offset;
+    unsigned line;
+};
+
 class Lexer
 {
-    const std::map<std::string,TOKEN> tokens = {{"if", TOKEN_IF}, {"while", TOKEN_WHILE}, {"return", TOKEN_RETURN}, {"var", TOKEN_VAR},
-                                                {"(", TOKEN_PARENTHESIS_OPEN}, {")", TOKEN_PARENTHESIS_CLOSE},
-                                                {"[", TOKEN_SQBRACKET_OPEN}, {"]", TOKEN_SQBRACKET_CLOSE},
-                                                {"{", TOKEN_CURLYBRACE_OPEN}, {"}", TOKEN_CURLYBRACE_CLOSE},
-                                                {",", TOKEN_COMMA}, {";", TOKEN_SEMICOLON}, {":", TOKEN_COLON},
-                                                {"?", TOKEN_QUESTIONMARK}, {"+", TOKEN_PLUS}, {"-", TOKEN_MINUS},
-                                                {"=", TOKEN_EQUALS}, {"+=", TOKEN_PLUSEQUALS}, {"-=", TOKEN_MINUSEQUALS},
-                                                {"!", TOKEN_NEGATE}, {"!=", TOKEN_NEGATEEQUALS},
-                                                {"++", TOKEN_INCREMENT}, {"--", TOKEN_DECREMENT}, {"==", TOKEN_COMPARE},
-                                                {"*", TOKEN_STAR}, {"&", TOKEN_AMP}, {"&&", TOKEN_AND}, {"||", TOKEN_OR}};
-
-    const std::vector<std::string> reserved_words = {"if", "while", "return", "var"};
+    // shared by every lexer, built once
+    static const std::map<std::string,TOKEN> tokens;
+    static const std::vector<std::string> reserved_words;
 
     std::string* const stream;
     std::string::iterator stream_it;
@@ -90,6 +88,28 @@ public:
                                         stream_it(stream->begin()),
                                         curr_line(1) {}
 
+    // byte offset of the first character past the last returned token
+    std::size_t position() const
+    {
+        return std::distance(static_cast<std::string::const_iterator>(stream->begin()),
+                             static_cast<std::string::const_iterator>(stream_it));
+    }
+
+    LexerPosition tell() const
+    {
+        return LexerPosition{position(), curr_line};
+    }
+
+    // iterators into the stream are recomputed, so seeking is also how to
+    // continue after text has been appended to the stream
+    void seek(LexerPosition pos)
+    {
+        if (pos.offset > stream->size())
+            throw std::logic_error("Lexer position past the end of stream");
+        stream_it = stream->begin() + pos.offset;
+        curr_line = pos.line;
+    }
+
     Token next()
     {
         std::string symbol("");
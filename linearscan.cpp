@@ -0,0 +1,41 @@
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+#include "linearscan.h"
+
+std::vector<int> LinearScan::allocate(std::vector<LiveInterval> intervals, unsigned vregs, unsigned& slots)
+{
+    std::sort(intervals.begin(), intervals.end(), [](const LiveInterval& a, const LiveInterval& b)
+    {
+        return a.start != b.start ? a.start < b.start : a.vreg < b.vreg;
+    });
+
+    typedef std::pair<std::size_t, unsigned> Active;     // end of the interval and its slot
+    std::priority_queue<Active, std::vector<Active>, std::greater<Active>> active;
+    std::priority_queue<unsigned, std::vector<unsigned>, std::greater<unsigned>> free_slots;
+    std::vector<int> assignment(vregs, -1);
+    slots = 0;
+
+    for (auto it = intervals.begin(); it != intervals.end(); ++it)
+    {
+        // intervals that ended before this one starts give their slots back
+        while (!active.empty() && active.top().first < it->start)
+        {
+            free_slots.push(active.top().second);
+            active.pop();
+        }
+
+        unsigned slot;
+        if (free_slots.empty())
+            slot = slots++;
+        else
+        {
+            slot = free_slots.top();
+            free_slots.pop();
+        }
+        assignment[it->vreg] = slot;
+        active.push(Active(it->end, slot));
+    }
+    return assignment;
+}
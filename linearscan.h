@@ -0,0 +1,28 @@
+#ifndef H_LINEARSCAN
+#define H_LINEARSCAN
+
+#include <cstddef>
+#include <vector>
+
+struct LiveInterval
+{
+    unsigned vreg;
+    std::size_t start;      // first instruction reading or writing vreg
+    std::size_t end;        // last one, extended to the end of any loop the value is live across
+};
+
+/* Linear scan register allocation (Poletto & Sarkar). Registers are frame
+ * slots, of which there are as many as needed, so nothing is ever spilled;
+ * the point is to give temporaries and variables with disjoint lifetimes
+ * the same slot and keep frames small. Intervals starting at the same
+ * instruction are assigned in vreg order and a fresh slot is always the
+ * lowest free one, so vregs 0..n-1 that are all live at instruction 0 get
+ * slots 0..n-1, which is what the calling convention needs for parameters. */
+class LinearScan
+{
+public:
+    // slot of every vreg, -1 for vregs without an interval; slots is set to the number of slots used
+    static std::vector<int> allocate(std::vector<LiveInterval> intervals, unsigned vregs, unsigned& slots);
+};
+
+#endif // H_LINEARSCAN
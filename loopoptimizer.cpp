@@ -0,0 +1,336 @@
+#include <algorithm>
+
+#include "loopoptimizer.h"
+
+LoopOptimizer::Counts LoopOptimizer::optimize(std::vector<IRFunction>& functions, ThreadPool& pool)
+{
+    std::vector<Counts> counts(functions.size(), Counts{0, 0});
+    pool.parallel_for(functions.size(), [&](std::size_t i)
+    {
+        counts[i] = optimize(functions[i]);
+    });
+    Counts total{0, 0};
+    for (auto it = counts.begin(); it != counts.end(); ++it)
+    {
+        total.hoisted += it->hoisted;
+        total.reduced += it->reduced;
+    }
+    return total;
+}
+
+LoopOptimizer::Counts LoopOptimizer::optimize(IRFunction& function)
+{
+    LoopOptimizer optimizer(function);
+    while (!optimizer.find_loops())
+        ;   // a new preheader belongs to the loops around its own, so they're found again
+
+    Counts counts{0, 0};
+    for (auto loop = optimizer.loops.begin(); loop != optimizer.loops.end(); ++loop)
+    {
+        counts.hoisted += optimizer.hoist_invariants(*loop);
+        counts.reduced += optimizer.reduce_induction_variables(*loop);
+        function.sweep();   // the loops around this one look at the instructions left
+    }
+    function.verify();
+    return counts;
+}
+
+// finds the natural loops, returns false after giving one of them a preheader, which invalidates them
+bool LoopOptimizer::find_loops()
+{
+    idom = ir.dominators();
+    std::vector<unsigned> order = ir.reverse_postorder();
+    loops.clear();
+    for (auto header = order.begin(); header != order.end(); ++header)
+    {
+        Loop loop{*header, NOBLOCK, std::vector<unsigned>(), std::vector<bool>(ir.blocks.size(), false)};
+        loop.contains[*header] = true;
+        // the blocks the back edges come from and everything reaching them without going through the header
+        std::vector<unsigned> pending;
+        const std::vector<unsigned>& preds = ir.blocks[*header].preds;
+        for (auto pred = preds.begin(); pred != preds.end(); ++pred)
+            if (idom[*pred] != NOBLOCK && IRFunction::dominates(idom, *header, *pred))
+                pending.push_back(*pred);
+        if (pending.empty())
+            continue;
+        while (!pending.empty())
+        {
+            unsigned block = pending.back();
+            pending.pop_back();
+            if (loop.contains[block])
+                continue;
+            loop.contains[block] = true;
+            for (auto pred = ir.blocks[block].preds.begin(); pred != ir.blocks[block].preds.end(); ++pred)
+                if (idom[*pred] != NOBLOCK)
+                    pending.push_back(*pred);
+        }
+        for (auto block = order.begin(); block != order.end(); ++block)
+            if (loop.contains[*block])
+                loop.blocks.push_back(*block);
+        loops.push_back(loop);
+    }
+    // a loop nested in another has fewer blocks
+    std::stable_sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) {return a.blocks.size() < b.blocks.size();});
+
+    for (auto loop = loops.begin(); loop != loops.end(); ++loop)
+    {
+        std::vector<unsigned> outside;
+        const std::vector<unsigned>& preds = ir.blocks[loop->header].preds;
+        for (auto pred = preds.begin(); pred != preds.end(); ++pred)
+            if (!loop->contains[*pred])
+                outside.push_back(*pred);
+        if (outside.size() == 1 && ir.blocks[outside[0]].succs.size() == 1)
+            loop->preheader = outside[0];
+        else
+        {
+            add_preheader(*loop);
+            return false;
+        }
+    }
+    return true;
+}
+
+// routes all edges entering the loop from outside through a new block, moving the header's phis for them there
+void LoopOptimizer::add_preheader(Loop& loop)
+{
+    unsigned preheader = ir.newblock();
+    std::vector<unsigned> preds = ir.blocks[loop.header].preds;
+    std::vector<unsigned> inside;
+    for (auto pred = preds.begin(); pred != preds.end(); ++pred)
+    {
+        if (loop.contains[*pred])
+            inside.push_back(*pred);
+        else
+        {
+            ir.blocks[preheader].preds.push_back(*pred);
+            std::vector<unsigned>& succs = ir.blocks[*pred].succs;
+            std::replace(succs.begin(), succs.end(), loop.header, preheader);
+        }
+    }
+
+    std::vector<IRValue> code = ir.blocks[loop.header].code;
+    for (auto phi = code.begin(); phi != code.end() && ir.values[*phi].op == IROP::PHI; ++phi)
+    {
+        std::vector<IRValue> entering, staying;
+        for (std::size_t i = 0; i < preds.size(); ++i)
+            (loop.contains[preds[i]] ? staying : entering).push_back(ir.values[*phi].operands[i]);
+        IRValue merged = entering.front();
+        if (std::any_of(entering.begin(), entering.end(), [&](IRValue value) {return value != merged;}))
+            merged = ir.append(preheader, IROP::PHI, entering);
+        staying.push_back(merged);
+        ir.values[*phi].operands = staying;
+    }
+    inside.push_back(preheader);
+    ir.blocks[loop.header].preds = inside;
+    ir.append(preheader, IROP::JMP);
+    ir.blocks[preheader].succs.push_back(loop.header);
+}
+
+bool LoopOptimizer::isinvariant(const Loop& loop, IRValue value) const
+{
+    return !loop.contains[ir.values[value].block];
+}
+
+// a op b, computed at the end of the preheader
+IRValue LoopOptimizer::compute(const Loop& loop, IROP op, IRValue a, IRValue b)
+{
+    return ir.insert(loop.preheader, ir.blocks[loop.preheader].code.size() - 1, op, {a, b});
+}
+
+unsigned LoopOptimizer::hoist_invariants(const Loop& loop)
+{
+    bool writes = false;
+    std::vector<unsigned> exiting;
+    for (auto block = loop.blocks.begin(); block != loop.blocks.end(); ++block)
+    {
+        const std::vector<IRValue>& code = ir.blocks[*block].code;
+        writes |= std::any_of(code.begin(), code.end(), [&](IRValue value)
+        {
+            return ir.values[value].op == IROP::STORE || ir.values[value].iscall();
+        });
+        const std::vector<unsigned>& succs = ir.blocks[*block].succs;
+        if (std::any_of(succs.begin(), succs.end(), [&](unsigned succ) {return !loop.contains[succ];}))
+            exiting.push_back(*block);
+    }
+
+    unsigned hoisted = 0;
+    std::vector<unsigned> uses = ir.usecounts();
+    for (auto block = loop.blocks.begin(); block != loop.blocks.end(); ++block)
+    {
+        bool always_runs = !exiting.empty() && std::all_of(exiting.begin(), exiting.end(), [&](unsigned exit)
+        {
+            return IRFunction::dominates(idom, *block, exit);
+        });
+        std::vector<IRValue> code = ir.blocks[*block].code;
+        for (auto it = code.begin(); it != code.end(); ++it)
+        {
+            const IRInstruction& instruction = ir.values[*it];
+            if (instruction.op == IROP::PHI || instruction.isterminator())
+                continue;
+            bool invariant = std::all_of(instruction.operands.begin(), instruction.operands.end(), [&](IRValue operand)
+            {
+                return isinvariant(loop, operand);
+            });
+            if (invariant && (instruction.ispure() || (instruction.op == IROP::LOAD && !writes && always_runs)))
+            {
+                // constants aren't counted, they cost nothing where they're used as immediates
+                hoisted += !instruction.operands.empty();
+                ir.move(*it, loop.preheader, ir.blocks[loop.preheader].code.size() - 1);
+            }
+            else if (instruction.op == IROP::ADD && reassociate(loop, *it, uses))
+                ++hoisted;
+        }
+    }
+    return hoisted;
+}
+
+// turns a + (x + c) into (a + c) + x and a + (x - c) into (a - c) + x when a and c are invariant
+bool LoopOptimizer::reassociate(const Loop& loop, IRValue value, const std::vector<unsigned>& uses)
+{
+    for (std::size_t side = 0; side < 2; ++side)
+    {
+        IRValue a = ir.values[value].operands[side], inner = ir.values[value].operands[1 - side];
+        if (!isinvariant(loop, a) || isinvariant(loop, inner) || uses[inner] != 1)
+            continue;
+        IROP op = ir.values[inner].op;
+        if (op != IROP::ADD && op != IROP::SUB)
+            continue;
+        for (std::size_t i = 0; i < (op == IROP::ADD ? 2 : 1); ++i)
+        {
+            // for a subtraction only the subtrahend can move
+            IRValue c = ir.values[inner].operands[op == IROP::ADD ? i : 1];
+            IRValue x = ir.values[inner].operands[op == IROP::ADD ? 1 - i : 0];
+            if (!isinvariant(loop, c) || isinvariant(loop, x))
+                continue;
+            IRValue moved = compute(loop, op, a, c);
+            ir.values[value].operands = {moved, x};
+            ir.remove(inner);
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned LoopOptimizer::reduce_induction_variables(const Loop& loop)
+{
+    const std::vector<unsigned> preds = ir.blocks[loop.header].preds;
+    std::size_t entry = std::find(preds.begin(), preds.end(), loop.preheader) - preds.begin();
+    std::vector<IRValue> phis;
+    for (auto it = ir.blocks[loop.header].code.begin(); it != ir.blocks[loop.header].code.end(); ++it)
+        if (ir.values[*it].op == IROP::PHI)
+            phis.push_back(*it);
+
+    unsigned reduced = 0;
+    std::vector<std::vector<IRValue>> users;
+    auto find_users = [&]()
+    {
+        users.assign(ir.values.size(), std::vector<IRValue>());
+        for (IRValue v = 0; v < ir.values.size(); ++v)
+            if (ir.values[v].block != NOBLOCK)
+                for (auto operand = ir.values[v].operands.begin(); operand != ir.values[v].operands.end(); ++operand)
+                    users[*operand].push_back(v);
+    };
+    auto other = [&](IRValue user, IRValue operand)
+    {
+        const std::vector<IRValue>& operands = ir.values[user].operands;
+        return operands[0] == operand ? operands[1] : operands[0];
+    };
+    find_users();
+
+    for (auto phi = phis.begin(); phi != phis.end(); ++phi)
+    {
+        // i = phi(init, next, ..., next) with next = i + step
+        std::vector<IRValue> operands = ir.values[*phi].operands;
+        IRValue init = operands[entry], next = operands[entry == 0 ? 1 : 0];
+        bool stepped = true;
+        for (std::size_t i = 0; i < operands.size(); ++i)
+            stepped &= i == entry || operands[i] == next;
+        if (!stepped || next == *phi || ir.values[next].op != IROP::ADD || isinvariant(loop, next))
+            continue;
+        IRValue step = other(next, *phi);
+        if (step == *phi || (ir.values[next].operands[0] != *phi && ir.values[next].operands[1] != *phi) || !isinvariant(loop, step))
+            continue;
+
+        // every other use of i and next must be a sum with or comparison to an invariant, in the loop
+        std::vector<IRValue> sums[2], comparisons[2];
+        auto classify = [&](int which, IRValue value, IRValue ignored)
+        {
+            for (auto user = users[value].begin(); user != users[value].end(); ++user)
+            {
+                if (*user == ignored)
+                    continue;
+                const IRInstruction& instruction = ir.values[*user];
+                if (!loop.contains[instruction.block] || instruction.operands.size() != 2 ||
+                    other(*user, value) == value || !isinvariant(loop, other(*user, value)))
+                    return false;
+                if (instruction.op == IROP::ADD)
+                    sums[which].push_back(*user);
+                else if (instruction.op == IROP::EQ || instruction.op == IROP::NE)
+                    comparisons[which].push_back(*user);
+                else
+                    return false;
+            }
+            return true;
+        };
+        if (!classify(0, *phi, next) || !classify(1, next, *phi) || (sums[0].empty() && sums[1].empty()))
+            continue;
+
+        // the pointer follows the sum used the most, which then needs no addition at all
+        IRValue chosen = sums[0].empty() ? sums[1].front() : sums[0].front();
+        for (int which = 0; which < 2; ++which)
+            for (auto sum = sums[which].begin(); sum != sums[which].end(); ++sum)
+                if (users[*sum].size() > users[chosen].size())
+                    chosen = *sum;
+        bool of_next = std::find(sums[1].begin(), sums[1].end(), chosen) != sums[1].end();
+        IRValue base = other(chosen, of_next ? next : *phi);
+
+        IRValue start = compute(loop, IROP::ADD, init, base);
+        IRValue pointer = ir.insert(loop.header, 0, IROP::PHI, std::vector<IRValue>(preds.size(), start));
+        const std::vector<IRValue>& next_block = ir.blocks[ir.values[next].block].code;
+        std::size_t position = std::find(next_block.begin(), next_block.end(), next) - next_block.begin();
+        IRValue advanced = ir.insert(ir.values[next].block, position + 1, IROP::ADD, {pointer, step});
+        for (std::size_t i = 0; i < preds.size(); ++i)
+            if (i != entry)
+                ir.values[pointer].operands[i] = advanced;
+
+        std::vector<IRValue> replacement(ir.values.size());
+        for (IRValue v = 0; v < replacement.size(); ++v)
+            replacement[v] = v;
+        for (int which = 0; which < 2; ++which)
+        {
+            IRValue variable = which ? next : *phi, reduction = which ? advanced : pointer;
+            for (auto sum = sums[which].begin(); sum != sums[which].end(); ++sum)
+            {
+                IRValue offset = other(*sum, variable);
+                if (offset == base)
+                {
+                    replacement[*sum] = reduction;
+                    ir.remove(*sum);
+                }
+                else
+                    ir.values[*sum].operands = {reduction, compute(loop, IROP::SUB, offset, base)};
+            }
+            for (auto comparison = comparisons[which].begin(); comparison != comparisons[which].end(); ++comparison)
+                ir.values[*comparison].operands = {reduction, compute(loop, IROP::ADD, other(*comparison, variable), base)};
+        }
+        ir.remove(*phi);
+        ir.remove(next);
+        for (IRValue v = replacement.size(); v < ir.values.size(); ++v)
+            replacement.push_back(v);   // the differences computed above
+        ir.replace_uses(replacement);
+
+        // the step goes just before its first use, so that the pointer and the stepped one are rarely live at once
+        std::vector<IRValue>& code = ir.blocks[ir.values[advanced].block].code;
+        code.erase(code.begin() + position + 1);
+        auto first_use = std::find_if(code.begin() + position + 1, code.end(), [&](IRValue value)
+        {
+            const std::vector<IRValue>& operands = ir.values[value].operands;
+            return ir.values[value].isterminator() || std::find(operands.begin(), operands.end(), advanced) != operands.end();
+        });
+        code.insert(first_use, advanced);
+
+        find_users();
+        ++reduced;
+    }
+    return reduced;
+}
@@ -0,0 +1,66 @@
+#ifndef H_LOOPOPTIMIZER
+#define H_LOOPOPTIMIZER
+
+#include <vector>
+
+#include "ir.h"
+#include "threadpool.h"
+
+/* Loop optimizations over functions in SSA form. Natural loops are found
+ * from the back edges of the control flow graph (edges to a block that
+ * dominates their source) and each is given a preheader, a block outside
+ * the loop that is the only way into its header from outside; IRBuilder
+ * already makes one for every loop it lowers. Loops are then optimized
+ * innermost first, so that what's hoisted out of an inner loop can be
+ * hoisted out of the enclosing one as well:
+ *
+ * - pure instructions whose operands are all computed outside the loop are
+ *   moved to the preheader, as are loads of such addresses in loops that
+ *   neither store nor call, provided the load is on the way to every exit
+ *   and so would have run in the first iteration anyway;
+ * - a + (x + c) and a + (x - c) with a and c invariant are turned into
+ *   (a + c) + x and (a - c) + x, so an index like v[i + 1] costs a hoisted
+ *   addition instead of one every iteration;
+ * - a basic induction variable i, a phi of the header stepped by the same
+ *   invariant amount on every back edge, that is only used to form sums
+ *   base + i of invariants and in comparisons with invariants, is replaced
+ *   by a pointer p = base + i stepped by the same amount: other sums become
+ *   p plus an invariant difference and comparisons i == n become p == n +
+ *   base (linear function test replacement), so i and its increment go
+ *   away. Indexing through i thus becomes pointer increments. */
+class LoopOptimizer
+{
+    struct Loop
+    {
+        unsigned header;
+        unsigned preheader;
+        std::vector<unsigned> blocks;   // in reverse postorder, header first
+        std::vector<bool> contains;     // by block
+    };
+
+    IRFunction& ir;
+    std::vector<Loop> loops;            // innermost first
+    std::vector<unsigned> idom;
+
+    bool find_loops();
+    void add_preheader(Loop& loop);
+    bool isinvariant(const Loop& loop, IRValue value) const;
+    IRValue compute(const Loop& loop, IROP op, IRValue a, IRValue b);
+    unsigned hoist_invariants(const Loop& loop);
+    bool reassociate(const Loop& loop, IRValue value, const std::vector<unsigned>& uses);
+    unsigned reduce_induction_variables(const Loop& loop);
+
+    LoopOptimizer(IRFunction& _ir) : ir(_ir) {}
+
+public:
+    struct Counts
+    {
+        unsigned hoisted;       // instructions moved or reassociated out of loops
+        unsigned reduced;       // induction variables replaced by pointers
+    };
+
+    static Counts optimize(IRFunction& function);
+    static Counts optimize(std::vector<IRFunction>& functions, ThreadPool& pool);
+};
+
+#endif // H_LOOPOPTIMIZER
@@ -1,37 +1,534 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <windows.h>
+#include <chrono>
+#include <cstdio>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
 #include "lexer.h"
 #include "token.h"
 #include "parser.h"
+#include "lazyparser.h"
+#include "context.h"
+#include "callgraph.h"
+#include "bytecodecompiler.h"
+#include "vm.h"
+#include "regcompiler.h"
+#include "regvm.h"
+#include "asmemitter.h"
+#include "x64codegen.h"
+#include "ccodegen.h"
+#include "jit.h"
+#include "tieredvm.h"
+#include "instancepool.h"
+#include "astcache.h"
+#include "astimage.h"
+#include "programimage.h"
+#include "compileserver.h"
+#include "constantfolder.h"
+#include "irbuilder.h"
+#include "ircompiler.h"
+#include "valuenumbering.h"
+#include "loopoptimizer.h"
+#include "inliner.h"
 #include "debugprinter.h"
 
 using namespace std;
 
-int main(int argc, char* argv[])
+// bytes of the process in physical memory, 0 where it isn't known
+static std::size_t resident_bytes()
+{
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    std::size_t size = 0, resident = 0;
+    if (statm>>size>>resident)
+        return resident * sysconf(_SC_PAGESIZE);
+#endif
+    return 0;
+}
+
+// nodes of the tree under a view of an AST image, read in place
+static std::size_t count_nodes(const AstImage::ExpressionView& expr)
+{
+    std::size_t nodes = 1;
+    for (std::size_t i = 0; i < expr.size(); ++i)
+        nodes += count_nodes(expr[i]);
+    return nodes;
+}
+
+static std::size_t count_nodes(const AstImage::StatementView& stmt)
+{
+    std::size_t nodes = 1;
+    for (std::size_t i = 0; i < stmt.size(); ++i)
+        nodes += count_nodes(stmt[i]);
+    if (stmt.has_expr())
+        nodes += count_nodes(stmt.expr());
+    for (std::size_t i = 0; i < stmt.var_count(); ++i)
+        nodes += 1 + (stmt.var(i).is_initialized() ? count_nodes(stmt.var(i).expr()) : 0);
+    return nodes;
+}
+
+static int compiler_main(int argc, char* argv[])
 {
+    auto launch = std::chrono::steady_clock::now();
     bool testcase = false;
+    bool signatures = false;
+    bool lazy = false;
+    bool check = false;
+    bool callgraph = false;
+    bool prune = false;
+    bool run = false;
+    bool stats = false;
+    bool dump_bytecode = false;
+    bool dump_ir = false;
+    bool fold = true;
+    bool gvn = true;
+    bool loop_opt = true;
+    bool inline_calls = true;
+    InlineOptions inline_options;
+    std::string profile_filename;
+    std::string write_profile_filename;
+    bool superinstructions = true;
+    std::string opcode_profile_filename;
+    std::string engine = "stack";
+    bool checked_memory = false;
+    std::size_t instance_count = 0;
+    InstanceOptions instance_options;
+    std::string cache_directory;
+    std::uintmax_t cache_bytes = std::uintmax_t(1) << 28;
+    std::string ast_image_filename;
+    bool read_ast_image = false;
+    std::string program_image_filename;
+    bool run_program_image = false;
+    std::string socket_path;
+    std::string asm_filename;
+    std::string c_filename;
+    TierThresholds thresholds;
+    std::vector<Identifier> entry_points;
+    unsigned jobs = std::thread::hardware_concurrency();
     std::string src_filename = "first_test.txt";
-    if (argc > 1)
+    for (int i = 1; i < argc; ++i)
     {
-        if (std::string(argv[1]) == "--testcase")
+        std::string arg(argv[i]);
+        if (arg == "--testcase" && i + 1 < argc)
         {
             testcase = true;
-            src_filename = std::string(argv[2]);
+            src_filename = std::string(argv[++i]);
+        }
+        else if (arg == "--signatures")     // list functions without parsing their bodies
+            signatures = true;
+        else if (arg == "--lazy")           // parse function bodies on demand
+            lazy = true;
+        else if (arg == "--check")          // resolve names and report errors
+            check = true;
+        else if (arg == "--jobs" && i + 1 < argc)
+            jobs = std::stoi(argv[++i]);
+        else if (arg == "--callgraph")      // print reachability and recursion of every function
+            callgraph = true;
+        else if (arg == "--prune")          // drop functions unreachable from the entry points
+            prune = true;
+        else if (arg == "--run")            // compile to bytecode and execute the entry point
+            run = true;
+        else if (arg == "--stats")          // report executed instructions, run time and time from startup to the result
+            stats = true;
+        else if (arg == "--dump-bytecode")
+            dump_bytecode = true;
+        else if (arg == "--dump-ir")        // print every function in SSA form
+            dump_ir = true;
+        else if (arg == "--no-gvn")         // keep redundant computations in the SSA form
+            gvn = false;
+        else if (arg == "--no-loop-opt")    // keep invariant code and induction variables in loops
+            loop_opt = false;
+        else if (arg == "--no-inline")      // keep every call
+            inline_calls = false;
+        else if (arg == "--inline-size" && i + 1 < argc)    // largest function inlined, in expression nodes
+            inline_options.size = std::stoi(argv[++i]);
+        else if (arg == "--profile" && i + 1 < argc)        // call counts from --write-profile, to inline hot functions only
+            profile_filename = argv[++i];
+        else if (arg == "--write-profile" && i + 1 < argc)  // write call counts of a stack engine run, without inlining
+            write_profile_filename = argv[++i];
+        else if (arg == "--no-superinstructions")   // one dispatch per instruction in the stack engine
+            superinstructions = false;
+        else if (arg == "--profile-opcodes" && i + 1 < argc)    // write sequences of instructions run by the stack engine, for superinstgen
+            opcode_profile_filename = argv[++i];
+        else if (arg == "--no-fold")        // keep constant expressions and dead branches as written
+            fold = false;
+        else if (arg == "--engine" && i + 1 < argc)     // stack, register, ssa, jit or tiered
+            engine = argv[++i];
+        else if (arg == "--checked-memory")     // test every pointer dereference in the stack, register and ssa engines
+            checked_memory = true;
+        else if (arg == "--instances" && i + 1 < argc)  // run the entry in as many isolated instances of the stack engine, on --jobs workers
+            instance_count = std::stoul(argv[++i]);
+        else if (arg == "--slice" && i + 1 < argc)      // instructions an instance runs before the next one gets a turn
+            instance_options.slice = std::stoull(argv[++i]);
+        else if (arg == "--budget" && i + 1 < argc)     // instructions after which an instance is stopped, 0 for no limit
+            instance_options.budget = std::stoull(argv[++i]);
+        else if (arg == "--cache" && i + 1 < argc)      // keep parsed sources in a directory, keyed by their contents
+            cache_directory = argv[++i];
+        else if (arg == "--cache-size" && i + 1 < argc) // bytes the cache directory may take before the least recently used entries are removed
+            cache_bytes = std::stoull(argv[++i]);
+        else if (arg == "--write-ast" && i + 1 < argc)  // write the parsed source as an AST image
+            ast_image_filename = argv[++i];
+        else if (arg == "--read-ast")       // the source is an AST image, list its functions without loading it
+            read_ast_image = true;
+        else if (arg == "--write-image" && i + 1 < argc)    // write the program compiled for the stack engine as an image
+            program_image_filename = argv[++i];
+        else if (arg == "--image")          // the source is a program image, run it on the stack engine
+            run_program_image = true;
+        else if (arg == "--serve" && i + 1 < argc)      // compile sources sent by bclient over a Unix socket, on --jobs handlers
+            socket_path = argv[++i];
+        else if (arg == "--tier-calls" && i + 1 < argc) // calls before the tiered engine compiles a function, 0 never
+            thresholds.calls = std::stoull(argv[++i]);
+        else if (arg == "--tier-loops" && i + 1 < argc) // loop iterations in a function before it's compiled, 0 never
+            thresholds.loops = std::stoull(argv[++i]);
+        else if (arg == "--emit-asm" && i + 1 < argc)   // write x86-64 assembly, link with the bruntime library
+            asm_filename = argv[++i];
+        else if (arg == "--emit-c" && i + 1 < argc)     // write C, compile with bruntime.h and link with the bruntime library
+            c_filename = argv[++i];
+        else if (arg == "--entry" && i + 1 < argc)
+            entry_points.push_back(argv[++i]);
+        else src_filename = arg;
+    }
+
+    if (read_ast_image)
+    {
+        auto start = std::chrono::steady_clock::now();
+        AstImage image(src_filename);
+        auto mapped = std::chrono::steady_clock::now();
+        std::size_t nodes = 0;
+        for (std::size_t i = 0; i < image.functions(); ++i)
+        {
+            AstImage::FunctionView function = image.function(i);
+            cout<<function.name()<<"(";
+            for (std::size_t param = 0; param < function.param_count(); ++param)
+                cout<<(param ? ", " : "")<<function.param(param);
+            cout<<")"<<endl;
+            if (stats)
+                nodes += count_nodes(function.body());
+        }
+        if (stats)
+        {
+            std::chrono::duration<double> mapping = mapped - start, walking = std::chrono::steady_clock::now() - mapped;
+            cerr<<image.bytes()<<" bytes mapped in "<<mapping.count()<<" s, "<<nodes<<" nodes of "<<image.functions()
+                <<" functions walked in "<<walking.count()<<" s"<<endl;
         }
+        return 0;
+    }
+
+    if (!socket_path.empty())
+    {
+        CompileServer server(socket_path, jobs, std::size_t(1) << 26, cache_directory, cache_bytes);
+        server.serve();
+        return 0;
+    }
+    if (run_program_image)
+    {
+        auto start = std::chrono::steady_clock::now();
+        ProgramImage image(src_filename);
+        VM vm(image.program(), image.code());
+        auto loaded = std::chrono::steady_clock::now();
+        Word result = vm.run(entry_points.empty() ? "main" : entry_points.front());
+        std::chrono::duration<double> loading = loaded - start, running = std::chrono::steady_clock::now() - loaded,
+                                      started = loaded - launch;
+        std::fflush(stdout);
+        std::chrono::duration<double> latency = std::chrono::steady_clock::now() - launch;
+        if (stats)
+            cerr<<image.bytes()<<" bytes mapped in "<<loading.count()<<" s, "<<vm.instructions()<<" instructions in "
+                <<running.count()<<" s, started "<<started.count()<<" s and finished "<<latency.count()<<" s from startup"<<endl;
+        return static_cast<int>(result);
     }
 
     ifstream src(src_filename);
 
     if (src.good())
     {
-        std::string cont;
         std::stringstream buffer;
         buffer<<src.rdbuf();
-        cont = buffer.str()+"\n";
+        std::shared_ptr<std::string> cont = std::make_shared<std::string>(buffer.str()+"\n");
         src.close();
-        Lexer lexer(&cont);
+
+        if (!ast_image_filename.empty())
+        {
+            Library lib = cache_directory.empty() ? LazyParser::parse(cont) : AstCache(cache_directory, cache_bytes).parse(cont);
+            AstImage::write(lib, ast_image_filename);
+            return 0;
+        }
+        if (signatures)
+        {
+            Library lib = LazyParser::parse(cont);
+            for (auto it = lib.functions.begin(); it != lib.functions.end(); ++it)
+            {
+                cout<<it->name<<"(";
+                for (auto param = it->params.begin(); param != it->params.end(); ++param)
+                    cout<<(param != it->params.begin() ? ", " : "")<<*param;
+                cout<<")"<<endl;
+            }
+            return 0;
+        }
+        if (check || callgraph || run || dump_bytecode || dump_ir || !asm_filename.empty() || !c_filename.empty() ||
+            !program_image_filename.empty())
+        {
+            Library lib;
+            if (cache_directory.empty())
+                lib = LazyParser::parse(cont);
+            else
+            {
+                auto start = std::chrono::steady_clock::now();
+                AstCache cache(cache_directory, cache_bytes);
+                lib = cache.parse(cont);
+                std::chrono::duration<double> loading = std::chrono::steady_clock::now() - start;
+                if (stats)
+                    cerr<<"AST cache "<<(cache.hits ? "hit" : "miss")<<" in "<<loading.count()<<" s"<<endl;
+            }
+            ThreadPool pool(jobs);
+            std::vector<Diagnostic> diagnostics = Context::analyse(lib, pool);
+            for (auto it = diagnostics.begin(); it != diagnostics.end(); ++it)
+                cout<<it->function<<": "<<it->message<<endl;
+            if (!diagnostics.empty())
+                return 1;
+
+            if (entry_points.empty())
+                entry_points.push_back("main");
+            // the later stages only see the functions that can run
+            if (prune)
+                CallGraph::prune(lib, entry_points);
+
+            if (fold)
+                ConstantFolder::fold(lib, pool);
+            if (inline_calls && write_profile_filename.empty())
+            {
+                if (!profile_filename.empty())
+                {
+                    std::map<Identifier, unsigned long long> counts;
+                    ifstream profile(profile_filename);
+                    Identifier name;
+                    unsigned long long count;
+                    while (profile>>name>>count)
+                        counts[name] = count;
+                    for (auto it = lib.functions.begin(); it != lib.functions.end(); ++it)
+                        inline_options.profile.push_back(counts[it->name]);
+                }
+                unsigned inlined = Inliner::inline_calls(lib, inline_options);
+                if (stats)
+                    cerr<<inlined<<" calls inlined"<<endl;
+                // arguments that were literals are now operands of the callee's expression
+                if (fold && inlined)
+                    ConstantFolder::fold(lib, pool);
+            }
+            if (callgraph)
+            {
+                CallGraph graph(lib);
+                std::vector<bool> reachable = graph.reachable(lib, entry_points);
+                for (unsigned i = 0; i < graph.size(); ++i)
+                {
+                    cout<<lib.functions[i].name<<": "<<(reachable[i] ? "reachable" : "unreachable")
+                        <<", component "<<graph.getcomponent(i)<<(graph.isrecursive(i) ? ", recursive" : "")<<endl;
+                    for (const unsigned* callee = graph.callees_begin(i); callee != graph.callees_end(i); ++callee)
+                        cout<<"    -> "<<lib.functions[*callee].name<<endl;
+                }
+            }
+            auto lower = [&]()
+            {
+                std::vector<IRFunction> functions = IRBuilder::build(lib, pool);
+                unsigned eliminated = gvn ? ValueNumbering::eliminate(functions, pool) : 0;
+                if (loop_opt)
+                {
+                    LoopOptimizer::Counts counts = LoopOptimizer::optimize(functions, pool);
+                    if (stats)
+                        cerr<<counts.hoisted<<" instructions hoisted out of loops, "<<counts.reduced
+                            <<" induction variables strength reduced"<<endl;
+                    // what was hoisted may duplicate what the preheader already had
+                    if (gvn)
+                        eliminated += ValueNumbering::eliminate(functions, pool);
+                }
+                if (stats && gvn)
+                    cerr<<eliminated<<" instructions eliminated by value numbering"<<endl;
+                return functions;
+            };
+            if (dump_ir)
+            {
+                std::vector<IRFunction> functions = lower();
+                for (auto it = functions.begin(); it != functions.end(); ++it)
+                    it->dump(cout);
+            }
+            if (!asm_filename.empty())
+            {
+                ofstream asm_file;
+                if (asm_filename != "-")
+                    asm_file.open(asm_filename);
+                AsmEmitter emitter(asm_filename == "-" ? cout : asm_file, lib);
+                X64Codegen::generate(lib, emitter);
+            }
+            if (!c_filename.empty())
+            {
+                ofstream c_file;
+                if (c_filename != "-")
+                    c_file.open(c_filename);
+                CCodegen::generate(lib, c_filename == "-" ? cout : c_file);
+            }
+            if (run && checked_memory && engine != "stack" && engine != "register" && engine != "ssa")
+            {
+                cerr<<"--checked-memory needs the stack, register or ssa engine, native code relies on guard pages"<<endl;
+                return 1;
+            }
+            if (run && instance_count && engine != "stack")
+            {
+                cerr<<"--instances needs the stack engine"<<endl;
+                return 1;
+            }
+            if (!program_image_filename.empty() && engine != "stack")
+            {
+                cerr<<"--write-image needs the stack engine"<<endl;
+                return 1;
+            }
+            if (run && engine == "jit")
+            {
+                auto start = std::chrono::steady_clock::now();
+                Jit jit(lib);
+                auto compiled = std::chrono::steady_clock::now();
+                Word result = jit.run(entry_points.front());
+                auto finished = std::chrono::steady_clock::now();
+                std::fflush(stdout);
+                if (stats)
+                {
+                    std::chrono::duration<double> compiling = compiled - start, running = finished - compiled,
+                                                  latency = finished - launch;
+                    cerr<<jit.size()<<" bytes compiled in "<<compiling.count()<<" s, run in "<<running.count()<<" s, "
+                        <<latency.count()<<" s from startup"<<endl;
+                }
+                return static_cast<int>(result);
+            }
+            if (run || dump_bytecode || !program_image_filename.empty())
+            {
+                bool registers = engine == "register" || engine == "ssa";
+                Program program;
+                if (engine == "ssa")
+                {
+                    std::vector<IRFunction> functions = lower();
+                    program = IRCompiler::compile(functions);
+                }
+                else
+                    program = registers ? RegisterCompiler::compile(lib) : BytecodeCompiler::compile(lib);
+                if (engine == "stack" && superinstructions && opcode_profile_filename.empty())
+                {
+                    std::size_t fused = BytecodeCompiler::fuse(program);
+                    if (stats)
+                        cerr<<fused<<" instructions fused into superinstructions"<<endl;
+                }
+                if (!program_image_filename.empty())
+                    ProgramImage::write(program, program_image_filename);
+                if (dump_bytecode)
+                {
+                    if (registers)
+                        DebugPrinter::print_debug_register_program(program);
+                    else
+                        DebugPrinter::print_debug_program(program);
+                }
+                if (run && instance_count)
+                {
+                    InstancePool pool(program, jobs, instance_options);
+                    std::size_t resident = resident_bytes();
+                    auto start = std::chrono::steady_clock::now();
+                    for (std::size_t i = 0; i < instance_count; ++i)
+                        pool.spawn(entry_points.front());
+                    auto spawned = std::chrono::steady_clock::now();
+                    std::size_t idle = resident_bytes() - resident;
+                    pool.run();
+                    std::chrono::duration<double> spawning = spawned - start, running = std::chrono::steady_clock::now() - spawned;
+
+                    int failed = 0;
+                    unsigned long long instructions = 0;
+                    for (std::size_t i = 0; i < pool.size(); ++i)
+                    {
+                        const InstancePool::Outcome& outcome = pool.outcome(i);
+                        cout<<outcome.output;
+                        if (!outcome.error.empty())
+                        {
+                            cerr<<"instance "<<i<<": "<<outcome.error<<endl;
+                            failed++;
+                        }
+                        instructions += outcome.instructions;
+                    }
+                    cout.flush();
+                    if (stats)
+                    {
+                        cerr<<instance_count<<" instances spawned in "<<spawning.count()<<" s, "
+                            <<spawning.count() / instance_count * 1e6<<" us and "<<idle / instance_count<<" resident bytes each"<<endl;
+                        cerr<<instructions<<" instructions in "<<running.count()<<" s on "<<jobs<<" workers"<<endl;
+                    }
+                    return failed ? 1 : 0;
+                }
+                if (run)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    Word result;
+                    unsigned long long instructions;
+                    std::vector<TieredVM::TierUp> tierups;
+                    if (registers)
+                    {
+                        RegisterVM vm(program);
+                        vm.check_memory(checked_memory);
+                        result = vm.run(entry_points.front());
+                        instructions = vm.instructions();
+                    }
+                    else if (engine == "tiered")
+                    {
+                        TieredVM vm(lib, program, thresholds);
+                        result = vm.run(entry_points.front());
+                        instructions = vm.instructions();
+                        tierups = vm.gettierups();
+                    }
+                    else
+                    {
+                        VM vm(program);
+                        vm.check_memory(checked_memory);
+                        if (opcode_profile_filename.empty())
+                            result = vm.run(entry_points.front());
+                        else
+                        {
+                            OpcodeProfile profile;
+                            result = vm.trace(entry_points.front(), profile);
+                            ofstream profile_file(opcode_profile_filename);
+                            profile.write(profile_file);
+                        }
+                        instructions = vm.instructions();
+                        if (!write_profile_filename.empty())
+                        {
+                            ofstream profile(write_profile_filename);
+                            for (std::size_t i = 0; i < lib.functions.size(); ++i)
+                                profile<<lib.functions[i].name<<" "<<vm.callcounts()[i]<<endl;
+                        }
+                    }
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                    std::fflush(stdout);
+                    std::chrono::duration<double> latency = std::chrono::steady_clock::now() - launch, started = start - launch;
+                    if (stats)
+                    {
+                        cerr<<instructions<<" instructions in "<<elapsed.count()<<" s, started "<<started.count()<<" s and finished "
+                            <<latency.count()<<" s from startup"<<endl;
+                        for (auto it = tierups.begin(); it != tierups.end(); ++it)
+                        {
+                            cerr<<"tier up "<<lib.functions[it->function].name<<" after "<<it->calls<<" calls, "
+                                <<it->loops<<" loop iterations at "<<it->requested<<" s: ";
+                            if (it->installed < 0)
+                                cerr<<"not installed"<<endl;
+                            else
+                                cerr<<it->bytes<<" bytes installed at "<<it->installed<<" s"<<endl;
+                        }
+                    }
+                    return static_cast<int>(result);
+                }
+            }
+            return 0;
+        }
+        if (lazy)
+        {
+            DebugPrinter::print_debug_library(LazyParser::parse(cont), testcase, 0);
+            return 0;
+        }
+
+        Lexer lexer(cont.get());
         Parser parser;
 
         std::stringstream output;
@@ -60,3 +557,18 @@ int main(int argc, char* argv[])
     }
     return 0;
 }
+
+// errors of the program being run, like a memory fault or a stack overflow, end it with their message
+int main(int argc, char* argv[])
+{
+    try
+    {
+        return compiler_main(argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        std::fflush(stdout);
+        cerr<<e.what()<<endl;
+        return 1;
+    }
+}
@@ -0,0 +1,260 @@
+#include <cstring>
+#include <utility>
+
+#include "memory.h"
+
+#ifdef MEMORY_GUARD_PAGES
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__) && defined(__x86_64__)
+#include <ucontext.h>
+#endif
+#endif
+
+thread_local MemoryTrap* MemoryTrap::active = nullptr;
+
+#ifdef MEMORY_GUARD_PAGES
+// the machine stack of the thread, faults from its lowest guard_bytes below it up are overflows
+static thread_local std::uintptr_t stack_low = 0;
+static thread_local std::uintptr_t stack_high = 0;
+static const std::size_t guard_bytes = 1 << 16;
+
+/* A stack for the handler to run on while the thread's own one is full,
+ * installed for each thread that sets up a trap unless it has one already. */
+class SignalStack
+{
+    std::vector<char> stack;
+    bool installed;
+
+public:
+    SignalStack() : stack(std::max<std::size_t>(SIGSTKSZ, 1 << 16)), installed(false)
+    {
+        stack_t current;
+        if (sigaltstack(nullptr, &current) == 0 && (current.ss_flags & SS_DISABLE))
+        {
+            stack_t alternate;
+            alternate.ss_sp = stack.data();
+            alternate.ss_size = stack.size();
+            alternate.ss_flags = 0;
+            installed = sigaltstack(&alternate, nullptr) == 0;
+        }
+#ifdef __linux__
+        pthread_attr_t attributes;
+        if (pthread_getattr_np(pthread_self(), &attributes) == 0)
+        {
+            void* low;
+            std::size_t size;
+            if (pthread_attr_getstack(&attributes, &low, &size) == 0)
+            {
+                stack_low = reinterpret_cast<std::uintptr_t>(low);
+                stack_high = stack_low + size;
+            }
+            pthread_attr_destroy(&attributes);
+        }
+#endif
+    }
+    ~SignalStack()
+    {
+        if (installed)
+        {
+            stack_t disabled;
+            std::memset(&disabled, 0, sizeof(disabled));
+            disabled.ss_flags = SS_DISABLE;
+            sigaltstack(&disabled, nullptr);
+        }
+    }
+    SignalStack(const SignalStack&) = delete;
+    SignalStack& operator=(const SignalStack&) = delete;
+};
+#endif
+
+// words rounded up to whole pages
+static std::size_t page_multiple(std::size_t words, std::size_t page_words)
+{
+    return page_words ? (words + page_words - 1) / page_words * page_words : words;
+}
+
+Memory::Memory(const std::vector<Word>& statics, std::size_t heap_words, std::size_t stack_words)
+    : region(nullptr), region_words(0), guard_words(0), checked(false)
+{
+#ifdef MEMORY_GUARD_PAGES
+    guard_words = sysconf(_SC_PAGESIZE) / sizeof(Word);
+#endif
+    const std::size_t sizes[] = {page_multiple(statics.size(), guard_words), page_multiple(heap_words, guard_words),
+                                 page_multiple(stack_words, guard_words)};
+    region_words = guard_words;
+    for (std::size_t size : sizes)
+        region_words += size + guard_words;
+
+#ifdef MEMORY_GUARD_PAGES
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    void* mapping = mmap(nullptr, region_words * sizeof(Word), PROT_NONE, flags, -1, 0);
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error("Cannot allocate B memory");
+    region = static_cast<Word*>(mapping);
+#else
+    region = new Word[region_words]();
+#endif
+
+    // segments end where their pages do, so that the guard page follows the last word
+    Word* ends[3];
+    Word* segment = region + guard_words;
+    for (int i = 0; i < 3; ++i)
+    {
+#ifdef MEMORY_GUARD_PAGES
+        if (sizes[i] && mprotect(segment, sizes[i] * sizeof(Word), PROT_READ | PROT_WRITE) != 0)
+        {
+            munmap(region, region_words * sizeof(Word));
+            throw std::runtime_error("Cannot allocate B memory");
+        }
+#endif
+        segment += sizes[i];
+        ends[i] = segment;
+        segment += guard_words;
+    }
+    statics_end = ends[0];
+    statics_begin = statics_end - statics.size();
+    heap_limit = ends[1];
+    heap_begin = heap_top = heap_limit - heap_words;
+    stack_limit = ends[2];
+    stack_base = stack_limit - stack_words;
+    std::copy(statics.begin(), statics.end(), statics_begin);
+}
+
+Memory::~Memory()
+{
+#ifdef MEMORY_GUARD_PAGES
+    munmap(region, region_words * sizeof(Word));
+#else
+    delete[] region;
+#endif
+}
+
+bool Memory::valid(Word address) const
+{
+    return (address >= Memory::address(statics_begin) && address < Memory::address(statics_end)) ||
+           (address >= Memory::address(heap_begin) && address < Memory::address(heap_top)) ||
+           (address >= Memory::address(stack_base) && address < Memory::address(stack_limit));
+}
+
+static std::string words(Word count)
+{
+    return std::to_string(count) + (count == 1 ? " word" : " words");
+}
+
+std::string Memory::fault(Word address, const std::string& function) const
+{
+    struct Segment
+    {
+        const char* name;
+        Word begin;
+        Word end;
+    };
+    const Segment segments[] = {{"the statics", Memory::address(statics_begin), Memory::address(statics_end)},
+                                {"the heap", Memory::address(heap_begin), Memory::address(heap_limit)},
+                                {"the frames", Memory::address(stack_base), Memory::address(stack_limit)}};
+
+    std::string message = "Memory fault in " + (function.empty() ? "an unknown function" : "'" + function + "'") +
+                          ": address " + std::to_string(address);
+    for (const Segment& segment : segments)
+    {
+        if (address >= segment.begin && address < segment.end)
+        {
+            if (segment.begin == Memory::address(heap_begin) && address >= Memory::address(heap_top))
+                return message + " is in the heap but not in any vector";
+            return message + " is in " + segment.name;
+        }
+        if (address >= segment.end && address - segment.end < static_cast<Word>(guard_words))
+            return message + " is " + words(address - segment.end + 1) + " past the end of " + segment.name;
+    }
+    // the nearest segment above, if the address is in the pages before it
+    if (address >= Memory::address(region) && address < Memory::address(region + region_words))
+        for (const Segment& segment : segments)
+            if (address < segment.begin)
+                return message + " is " + words(segment.begin - address) + " before the start of " + segment.name;
+    return message + " is outside B memory";
+}
+
+std::string Memory::fault(const MemoryTrap& trap, const std::string& function) const
+{
+    if (trap.overflow)
+        return overflow(function);
+    return fault(trap.address(), function);
+}
+
+std::string Memory::overflow(const std::string& function)
+{
+    return "Stack overflow in " + (function.empty() ? "an unknown function" : "'" + function + "'");
+}
+
+MemoryTrap::MemoryTrap(const Memory& _memory, std::function<bool(const void* instruction)> _in_code)
+    : outer(active), memory(_memory), in_code(std::move(_in_code)), location(nullptr), instruction(nullptr), overflow(false)
+{
+#ifdef MEMORY_GUARD_PAGES
+    static thread_local SignalStack signal_stack;
+    static const bool installed = []()
+    {
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_sigaction = &MemoryTrap::handler;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+        return sigaction(SIGSEGV, &action, nullptr) == 0 && sigaction(SIGBUS, &action, nullptr) == 0;
+    }();
+    static_cast<void>(installed);
+#endif
+    active = this;
+}
+
+MemoryTrap::~MemoryTrap()
+{
+    active = outer;
+}
+
+// the linker marks the bounds of the section, they're null if nothing is in it
+#ifdef MEMORY_INTERPRETER_SECTION
+extern "C" const char __start_b_interpreters[] __attribute__((weak));
+extern "C" const char __stop_b_interpreters[] __attribute__((weak));
+#endif
+
+bool MemoryTrap::interpreter(const void* instruction)
+{
+#ifdef MEMORY_INTERPRETER_SECTION
+    const char* at = static_cast<const char*>(instruction);
+    return __start_b_interpreters && at >= __start_b_interpreters && at < __stop_b_interpreters;
+#else
+    static_cast<void>(instruction);
+    return true;
+#endif
+}
+
+#ifdef MEMORY_GUARD_PAGES
+void MemoryTrap::handler(int signal, siginfo_t* info, void* context)
+{
+    MemoryTrap* trap = active;
+    std::uintptr_t location = reinterpret_cast<std::uintptr_t>(info->si_addr);
+    bool overflow = stack_low && location + guard_bytes >= stack_low && location < stack_high;
+    const void* instruction = nullptr;
+#if defined(__linux__) && defined(__x86_64__)
+    instruction = reinterpret_cast<const void*>(static_cast<ucontext_t*>(context)->uc_mcontext.gregs[REG_RIP]);
+#else
+    static_cast<void>(context);
+#endif
+    if (!trap || !(overflow || trap->memory.guards(info->si_addr)) || (instruction && !trap->in_code(instruction)))
+    {
+        // not a fault of B code, it happens again with the default action
+        ::signal(signal, SIG_DFL);
+        return;
+    }
+    // a fault while the error is being reported goes to the outer trap
+    active = trap->outer;
+    trap->location = info->si_addr;
+    trap->overflow = overflow;
+    trap->instruction = instruction;
+    siglongjmp(trap->point, 1);
+}
+#endif
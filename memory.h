@@ -0,0 +1,178 @@
+#ifndef H_MEMORY
+#define H_MEMORY
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MEMORY_GUARD_PAGES
+#include <setjmp.h>
+#include <signal.h>
+#endif
+
+typedef std::int64_t Word;
+
+class MemoryTrap;
+
+/* B memory is word addressed. A B address is the machine address of a word
+ * divided by the word size, so that pointers can be dereferenced without
+ * any translation and stay valid when passed to compiled code or the
+ * runtime library. Everything a program can point at (string literals,
+ * vectors from getvec() and function frames) lives in one mapping, each
+ * segment ending at an inaccessible guard page:
+ *
+ *   | guard | statics | guard | heap -> ... | guard | frames -> ... | guard |
+ *
+ * so that running off the end of a segment faults instead of every access
+ * being checked. MemoryTrap turns the fault into an error; with checked set
+ * the interpreters and builtins also test every address with valid(). Without
+ * mmap there are no guard pages. */
+class Memory
+{
+    Word* region;
+    std::size_t region_words;
+    std::size_t guard_words;
+    Word* statics_begin;
+    Word* statics_end;
+    Word* heap_begin;
+    Word* heap_top;
+    Word* heap_limit;
+    Word* stack_base;
+    Word* stack_limit;
+
+public:
+    bool checked;
+
+    Memory(const std::vector<Word>& statics, std::size_t heap_words, std::size_t stack_words);
+    ~Memory();
+    Memory(const Memory&) = delete;
+    Memory& operator=(const Memory&) = delete;
+
+    static Word address(const Word* pointer)
+    {
+        return static_cast<Word>(reinterpret_cast<std::uintptr_t>(pointer) / sizeof(Word));
+    }
+    static Word* pointer(Word address)
+    {
+        return reinterpret_cast<Word*>(static_cast<std::uintptr_t>(address) * sizeof(Word));
+    }
+
+    Word statics() const {return address(statics_begin);}
+    Word* frames_begin() const {return stack_base;}
+    Word* frames_end() const {return stack_limit;}
+
+    // words 0..size of a new vector, as returned by B's getvec(size)
+    Word allocate(Word size)
+    {
+        if (size < 0 || heap_limit - heap_top < size + 1)
+            throw std::runtime_error("out of memory in getvec");
+        Word* vector = heap_top;
+        heap_top += size + 1;
+        return address(vector);
+    }
+
+    // whether address is in the statics, a vector allocated so far or the frame area
+    bool valid(Word address) const;
+    // whether location is in the mapping, where anything that faults is a guard page
+    bool guards(const void* location) const
+    {
+        return location >= region && location < region + region_words;
+    }
+    // error for an access of address by function, which may be empty if it isn't known
+    std::string fault(Word address, const std::string& function) const;
+    // error for the fault trap caught in function: such an access, or the machine stack overflowing
+    std::string fault(const MemoryTrap& trap, const std::string& function) const;
+    // error for the stack overflowing in function, which every engine reports the same way
+    static std::string overflow(const std::string& function);
+};
+
+/* Catches segmentation faults on the thread while it exists, of B code
+ * accessing memory: at one of its guard pages, or in the guard of the
+ * machine stack, by an instruction that in_code accepts. The handler
+ * records where the fault happened and siglongjmps to point, which must be
+ * set with MEMORY_TRAPPED in the function that owns the trap before any B
+ * code runs. Traps nest, the innermost one catches. Any other fault, such
+ * as one in a builtin given a bad pointer, is a bug of the host and kills
+ * the process as usual. The handler runs on an alternate signal stack, so
+ * native code recursing until the machine stack runs into its guard is
+ * caught as well, as an overflow. Where the faulting instruction isn't
+ * known, faults at a guard page are caught wherever they happen. */
+class MemoryTrap
+{
+    MemoryTrap* outer;
+    const Memory& memory;
+    std::function<bool(const void*)> in_code;
+
+    static thread_local MemoryTrap* active;
+
+#ifdef MEMORY_GUARD_PAGES
+    static void handler(int signal, siginfo_t* info, void* context);
+#endif
+
+public:
+#ifdef MEMORY_GUARD_PAGES
+    sigjmp_buf point;
+#endif
+    const void* location;       // address accessed
+    const void* instruction;    // address of the faulting instruction, null if it isn't known
+    bool overflow;              // the fault was in the machine stack or its guard, not at a B address
+
+    MemoryTrap(const Memory& _memory, std::function<bool(const void* instruction)> _in_code);
+    ~MemoryTrap();
+    MemoryTrap(const MemoryTrap&) = delete;
+    MemoryTrap& operator=(const MemoryTrap&) = delete;
+
+    // B address of the word accessed
+    Word address() const {return Memory::address(static_cast<const Word*>(location));}
+
+    // whether instruction is in an interpreter loop, one defined with MEMORY_INTERPRETER
+    static bool interpreter(const void* instruction);
+};
+
+// put on the definition of an interpreter loop, so that MemoryTrap::interpreter knows its code
+#if defined(MEMORY_GUARD_PAGES) && defined(__GNUC__) && defined(__ELF__)
+#define MEMORY_INTERPRETER_SECTION
+#define MEMORY_INTERPRETER __attribute__((section("b_interpreters")))
+#else
+#define MEMORY_INTERPRETER
+#endif
+
+// nonzero when the trap's point is reached by a fault
+#ifdef MEMORY_GUARD_PAGES
+#define MEMORY_TRAPPED(trap) sigsetjmp((trap).point, 1)
+#else
+#define MEMORY_TRAPPED(trap) 0
+#endif
+
+// String literal as stored in B memory: one character per word, zero
+// terminated, with B escapes (*n, *t, *0, *e, **, *', *", *( and *))
+inline std::vector<Word> string_literal_words(const std::string& literal)
+{
+    std::vector<Word> words;
+    for (std::size_t i = 0; i < literal.size(); ++i)
+    {
+        char c = literal[i];
+        if (c == '*' && i + 1 < literal.size())
+        {
+            switch (literal[++i])
+            {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case '0':
+                case 'e': c = 0; break;
+                case '(': c = '{'; break;
+                case ')': c = '}'; break;
+                default: c = literal[i]; break;
+            }
+        }
+        words.push_back(static_cast<unsigned char>(c));
+    }
+    words.push_back(0);
+    return words;
+}
+
+#endif // H_MEMORY
@@ -0,0 +1,126 @@
+/* Runtime library linked into B programs compiled to native code (see
+ * AsmEmitter): the builtins as brt_<name> functions following the System V
+ * calling convention, and a C main that runs the program's main and
+ * reports faults in the guard pages of the heap and overflows of the
+ * machine stack, with the function they happened in. Build it with runtime.cpp
+ * and memory.cpp, CMake does so as the bruntime library. */
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+#include "runtime.h"
+
+static Memory memory(std::vector<Word>(), 1 << 20, 0);
+static Runtime runtime(memory);
+
+extern "C"
+{
+
+// where the functions are, see AsmEmitter; weak as C from CCodegen has no such list
+struct FunctionCode
+{
+    const char* begin;
+    const char* end;
+    const char* name;
+};
+extern const FunctionCode b_functions[] __attribute__((weak));
+
+// entered like an X64Function, see x64emitter.h
+Word b_main(Word, Word, Word, Word, Word, Word, Word, Word,
+            Word, Word, Word, Word, Word, Word, Word, Word);
+
+Word brt_putchar(Word c)
+{
+    return runtime.call(0, &c, 1);
+}
+
+Word brt_getchar()
+{
+    return runtime.call(1, nullptr, 0);
+}
+
+// variadic, the format decides how many arguments were passed
+Word brt_printf(Word format, ...)
+{
+    Word few[8];
+    std::vector<Word> many;
+    unsigned count = Runtime::format_arguments(format);
+    Word* args = few;
+    if (count >= 8)
+    {
+        many.resize(count + 1);
+        args = many.data();
+    }
+    args[0] = format;
+    std::va_list list;
+    va_start(list, format);
+    for (unsigned i = 1; i <= count; ++i)
+        args[i] = va_arg(list, Word);
+    va_end(list);
+    return runtime.call(2, args, count + 1);
+}
+
+Word brt_char(Word string, Word index)
+{
+    Word args[] = {string, index};
+    return runtime.call(3, args, 2);
+}
+
+Word brt_lchar(Word string, Word index, Word c)
+{
+    Word args[] = {string, index, c};
+    return runtime.call(4, args, 3);
+}
+
+Word brt_exit()
+{
+    runtime.flush();
+    std::exit(0);
+}
+
+Word brt_getvec(Word size)
+{
+    return runtime.call(6, &size, 1);
+}
+
+Word brt_flush()
+{
+    return runtime.call(7, nullptr, 0);
+}
+
+}
+
+// name of the function whose code instruction is in, empty if it isn't known
+static std::string function_at(const void* instruction)
+{
+    const char* at = static_cast<const char*>(instruction);
+    for (const FunctionCode* function = b_functions; function && function->begin; ++function)
+        if (at >= function->begin && at < function->end)
+            return function->name;
+    return std::string();
+}
+
+// whether instruction is in a B function, which it can't tell without b_functions
+static bool in_functions(const void* instruction)
+{
+    const char* at = static_cast<const char*>(instruction);
+    for (const FunctionCode* function = b_functions; function && function->begin; ++function)
+        if (at >= function->begin && at < function->end)
+            return true;
+    return !b_functions;
+}
+
+int main()
+{
+    MemoryTrap trap(memory, in_functions);
+    if (MEMORY_TRAPPED(trap))
+    {
+        runtime.flush();
+        std::fprintf(stderr, "%s\n", memory.fault(trap, function_at(trap.instruction)).c_str());
+        return 1;
+    }
+    Word result = b_main(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    runtime.flush();
+    return static_cast<int>(result);
+}
@@ -0,0 +1,105 @@
+#ifndef H_OPCODEPROFILE
+#define H_OPCODEPROFILE
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+
+/* Executions of every pair and triple of consecutive stack machine
+ * instructions, recorded by VM::trace() and read by superinstgen to choose
+ * the superinstructions. Written one sequence per line, most frequent
+ * first, as the count followed by the opcode names. */
+class OpcodeProfile
+{
+    static const int opcodes = static_cast<int>(OPCODE::OPCODE_COUNT);
+
+    std::vector<unsigned long long> pairs;
+    std::vector<unsigned long long> triples;
+    int previous[2];    // opcodes of the last two instructions, -1 before the first ones
+
+    static int find(const std::string& name)
+    {
+        for (int op = 0; op < opcodes; ++op)
+            if (name == opcode_info[op].name)
+                return op;
+        throw std::runtime_error("Unknown opcode '" + name + "' in profile");
+    }
+
+public:
+    struct Sequence
+    {
+        unsigned long long count;
+        std::vector<OPCODE> ops;
+    };
+
+    OpcodeProfile() : pairs(opcodes * opcodes, 0), triples(opcodes * opcodes * opcodes, 0), previous{-1, -1} {}
+
+    void record(Word op)
+    {
+        if (previous[1] >= 0)
+        {
+            pairs[previous[1] * opcodes + op]++;
+            if (previous[0] >= 0)
+                triples[(previous[0] * opcodes + previous[1]) * opcodes + op]++;
+        }
+        previous[0] = previous[1];
+        previous[1] = static_cast<int>(op);
+    }
+
+    std::vector<Sequence> sequences() const
+    {
+        std::vector<Sequence> result;
+        for (int i = 0; i < opcodes * opcodes; ++i)
+            if (pairs[i])
+                result.push_back(Sequence{pairs[i], {static_cast<OPCODE>(i / opcodes), static_cast<OPCODE>(i % opcodes)}});
+        for (int i = 0; i < opcodes * opcodes * opcodes; ++i)
+            if (triples[i])
+                result.push_back(Sequence{triples[i], {static_cast<OPCODE>(i / opcodes / opcodes),
+                                                       static_cast<OPCODE>(i / opcodes % opcodes), static_cast<OPCODE>(i % opcodes)}});
+        std::stable_sort(result.begin(), result.end(), [](const Sequence& a, const Sequence& b) {return a.count > b.count;});
+        return result;
+    }
+
+    void write(std::ostream& out) const
+    {
+        std::vector<Sequence> all = sequences();
+        for (auto it = all.begin(); it != all.end(); ++it)
+        {
+            out<<it->count;
+            for (auto op = it->ops.begin(); op != it->ops.end(); ++op)
+                out<<" "<<getinfo(*op).name;
+            out<<"\n";
+        }
+    }
+
+    // adds the counts written to in
+    void read(std::istream& in)
+    {
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::istringstream fields(line);
+            unsigned long long count;
+            std::string name;
+            std::vector<int> ops;
+            if (!(fields>>count))
+                continue;
+            while (fields>>name)
+                ops.push_back(find(name));
+            if (ops.size() == 2)
+                pairs[ops[0] * opcodes + ops[1]] += count;
+            else if (ops.size() == 3)
+                triples[(ops[0] * opcodes + ops[1]) * opcodes + ops[2]] += count;
+            else
+                throw std::runtime_error("Malformed profile line '" + line + "'");
+        }
+    }
+};
+
+#endif // H_OPCODEPROFILE
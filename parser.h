@@ -16,61 +16,64 @@
 #include "library.h"
 #include "identifier.h"
 #include "parsertoken.h"
+#include "persistentstack.h"
 
 #include "debugprinter.h"
 
 class CurrentState
 {
     private:
-        std::stack<int> current_state;
+        // only the most recent state is ever read, so no history is kept
+        int current_state;
     public:
-        CurrentState()
-        {
-            current_state.push(0);
-        }
+        CurrentState() : current_state(0) {}
         CurrentState& operator=(const int other)
         {
-            current_state.push(other);
+            current_state = other;
+            return *this;
         }
-        int operator()()
+        int operator()() const
         {
-            return current_state.top();
+            return current_state;
         }
 };
 
+// Parser state at a token boundary together with the lexer position that
+// produces the next token. Taking one is O(1), snapshots share structure.
+struct ParserSnapshot
+{
+    PersistentStack<ParserToken> parser_stack;
+    PersistentStack<int> return_stack;
+    PersistentStack<int> reduce_stack;
+    CurrentState current_state;
+    LexerPosition lexer_position;
+};
+
 class Parser
 {
-    std::stack<ParserToken> parser_stack;
-    std::stack<int> return_stack;
-    std::stack<int> reduce_stack;
+    PersistentStack<ParserToken> parser_stack;
+    PersistentStack<int> return_stack;
+    PersistentStack<int> reduce_stack;
     CurrentState current_state;
 
-    Action choose_action(Token lookahead_token)
+    // what a syntax error at lookahead_token throws, for whoever parses to report
+    std::logic_error syntax_error(const Token& lookahead_token)
     {
-        return this->choose_action(current_state(), lookahead_token.type);
+        auto name = token_debug_names.find(lookahead_token.type);
+        return std::logic_error("Line " + std::to_string(lookahead_token.line_num) + ": unexpected " +
+                                (name == token_debug_names.end() ? "token" : name->second) +
+                                " in parser state " + std::to_string(current_state()));
     }
 
-    Action choose_action(int _current_state, TOKEN lookahead_token_type)
+    Action choose_action(Token lookahead_token)
     {
-        Action a;
-        try
-        {
-            a = grammar.at(Current(_current_state, lookahead_token_type));
-        }
-        catch (const std::exception& e)
-        {
-            try
-            {
-                a = grammar.at(Current(_current_state));
-            }
-            catch (const std::exception& e)
-            {
-                cout<<"STATE MACHINE ERROR"<<endl;
-                //cout<<_current_state<<" "<<token_debug_names.at(lookahead_token_type)<<endl;
-                throw e;
-            }
-        }
-        return a;
+        // a state without an entry for the lookahead has a default action, looked up without it
+        auto found = grammar.find(Current(current_state(), lookahead_token.type));
+        if (found == grammar.end())
+            found = grammar.find(Current(current_state()));
+        if (found == grammar.end())
+            throw syntax_error(lookahead_token);
+        return found->second;
     }
 
     Expression reduce_expression(EXPR_TYPE rule, std::vector<ParserToken>& ptokens)
@@ -206,15 +209,14 @@ class Parser
                     if (it->gettag() == PARSERTOKEN::TOKEN && it->token->type == TOKEN_IDENTIFIER)
                     {
                         Identifier ident = *it->token->str_val;
-                        std::advance(it, 2);
-                        if (it->gettag() == PARSERTOKEN::EXPRESSION)
+                        // the last variable may have no = and initializer after it
+                        if (std::distance(it, ptokens.rend()) > 2 && std::next(it, 2)->gettag() == PARSERTOKEN::EXPRESSION)
+                        {
+                            std::advance(it, 2);
                             vars.push_back(Variable(ident, *it->expression));
+                        }
                         else
-                        {
                             vars.push_back(Variable(ident));
-                            --it;
-                            continue;
-                        }
                     }
                 }
                 return Statement(rule, vars);
@@ -245,23 +247,46 @@ class Parser
         }
     }
 
+    static bool ispostfix(EXPR_TYPE type)
+    {
+        return type == EXPR_TYPE::UNARY_POSTINCR || type == EXPR_TYPE::UNARY_POSTDECR;
+    }
+
     std::vector<Expression> rpn_traverse_tree(Expression to_traverse)
     {
         std::vector<Expression> parents_vector;
 
-        // second operand of a ternary expression must be parenthesised before any further processing
+        // second operand of a ternary expression must be parenthesised before any further processing,
+        // operands are copied first since they may still be shared with a parser snapshot
         if (op_opcount[to_traverse.type] == EXPR_OPCOUNT::TERNARY)
+        {
+            to_traverse.expressions = std::make_shared<std::vector<Expression>>(*to_traverse.expressions);
             *++to_traverse.expressions->begin() = rpn_expr(Expression(EXPR_TYPE::PARENTHESIS, *++to_traverse.expressions->begin()));
+        }
 
-        if (op_opcount[to_traverse.type] != EXPR_OPCOUNT::SINGLETOKEN &&
-            op_opcount[to_traverse.type] != EXPR_OPCOUNT::GROUPING)
+        // postfix operators bind tighter than anything else and follow their operand,
+        // so they're kept whole and ordered like a single token
+        if (ispostfix(to_traverse.type))
+        {
+            to_traverse.expressions = std::make_shared<std::vector<Expression>>(1, rpn_expr(to_traverse.expressions->front()));
+            parents_vector.push_back(to_traverse);
+        }
+        else if (op_opcount[to_traverse.type] != EXPR_OPCOUNT::SINGLETOKEN &&
+                 op_opcount[to_traverse.type] != EXPR_OPCOUNT::GROUPING)
         {
             // Usually there is and operand before the operator, however in case of
             // unary operators, there is no operand before them so we don't want to
             // include their first child because it's another non-singletoken and
             // non-grouping expression
             if (op_opcount[to_traverse.type] != EXPR_OPCOUNT::UNARY)
-                parents_vector.push_back(to_traverse.expressions->front());
+            {
+                if (ispostfix(to_traverse.expressions->front().type))
+                {
+                    std::vector<Expression> traversed = rpn_traverse_tree(to_traverse.expressions->front());
+                    parents_vector.insert(parents_vector.end(), traversed.begin(), traversed.end());
+                }
+                else parents_vector.push_back(to_traverse.expressions->front());
+            }
             parents_vector.push_back(to_traverse);
             for (auto it = (op_opcount[to_traverse.type] != EXPR_OPCOUNT::UNARY ? ++to_traverse.expressions->begin() : to_traverse.expressions->begin()); it != to_traverse.expressions->end(); ++it)
             {
@@ -290,7 +315,8 @@ class Parser
         };
         for (auto it = exprs.begin(); it != exprs.end(); ++it)
         {
-            if (op_opcount[it->type] == EXPR_OPCOUNT::SINGLETOKEN || op_opcount[it->type] == EXPR_OPCOUNT::GROUPING)
+            if (op_opcount[it->type] == EXPR_OPCOUNT::SINGLETOKEN || op_opcount[it->type] == EXPR_OPCOUNT::GROUPING ||
+                ispostfix(it->type))
                 output_stack.push(*it);
             else
             {
@@ -320,8 +346,11 @@ class Parser
         // inside it are properly ordered by applying rpn_expr on them
         else if (op_opcount[to_transform.type] == EXPR_OPCOUNT::GROUPING)
         {
+            // nested grouping expressions were already ordered when they were reduced
+            to_transform.expressions = std::make_shared<std::vector<Expression>>(*to_transform.expressions);
             for (auto it = to_transform.expressions->begin(); it != to_transform.expressions->end(); ++it)
-                *it = rpn_expr(*it);
+                if (op_opcount[it->type] != EXPR_OPCOUNT::GROUPING)
+                    *it = rpn_expr(*it);
             return to_transform;    // after applying precedence rules to expressions inside return grouping expression
         }
 
@@ -345,9 +374,15 @@ public:
     bool feed(Token lookahead_token)
     {
         Action action;
+        // default actions can call nonterminals forever on some wrong tokens, a
+        // correct program never calls more of them than there are actions before shifting
+        std::size_t calls = 0;
         while (action.next_action != ACTION::SHIFT)
         {
             action = this->choose_action(lookahead_token);
+            if ((action.next_action == ACTION::CALL_NONTERM || action.next_action == ACTION::CALL_NONTERM_REC) &&
+                ++calls > grammar.size())
+                throw syntax_error(lookahead_token);
             switch (action.next_action)
             {
                 // shift is for situations where we want to return after shifting
@@ -413,6 +448,28 @@ public:
         return false;
     }
 
+    ParserSnapshot snapshot(const Lexer& lexer) const
+    {
+        ParserSnapshot snap;
+        snap.parser_stack = parser_stack;
+        snap.return_stack = return_stack;
+        snap.reduce_stack = reduce_stack;
+        snap.current_state = current_state;
+        snap.lexer_position = lexer.tell();
+        return snap;
+    }
+
+    // rewinds both the parser and the lexer, which may have been given a
+    // longer stream since the snapshot was taken
+    void restore(const ParserSnapshot& snap, Lexer& lexer)
+    {
+        parser_stack = snap.parser_stack;
+        return_stack = snap.return_stack;
+        reduce_stack = snap.reduce_stack;
+        current_state = snap.current_state;
+        lexer.seek(snap.lexer_position);
+    }
+
     Library finish()
     {
         if (!parser_stack.empty() &&
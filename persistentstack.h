@@ -0,0 +1,100 @@
+#ifndef H_PERSISTENTSTACK
+#define H_PERSISTENTSTACK
+
+#include <memory>
+#include <utility>
+#include <stdexcept>
+
+/* Stack with the same interface as std::stack, built as a singly linked
+ * list of shared nodes. Copying a stack is O(1) and copies share all of
+ * their nodes, so the parser can take a snapshot after every token.
+ * Nodes are never modified once another stack references them: top()
+ * copies the top node first if it's shared (copy-on-write). */
+template <typename T>
+class PersistentStack
+{
+    struct Node
+    {
+        T value;
+        std::shared_ptr<Node> next;
+
+        Node(const T& _value, std::shared_ptr<Node> _next) : value(_value), next(_next) {}
+    };
+
+    std::shared_ptr<Node> head;
+    std::size_t count;
+
+    // releases uniquely owned nodes iteratively, a long list would overflow
+    // the call stack if destroyed recursively through shared_ptr destructors
+    void release()
+    {
+        while (head && head.use_count() == 1)
+        {
+            std::shared_ptr<Node> next = std::move(head->next);
+            head = std::move(next);
+        }
+        head.reset();
+    }
+
+public:
+    PersistentStack() : count(0) {}
+    PersistentStack(const PersistentStack& other) = default;
+
+    PersistentStack& operator=(const PersistentStack& other)
+    {
+        // holding the other list first keeps nodes it shares with this one, and makes self-assignment safe
+        std::shared_ptr<Node> other_head = other.head;
+        release();
+        head = std::move(other_head);
+        count = other.count;
+        return *this;
+    }
+
+    ~PersistentStack()
+    {
+        release();
+    }
+
+    bool empty() const
+    {
+        return !head;
+    }
+
+    std::size_t size() const
+    {
+        return count;
+    }
+
+    const T& top() const
+    {
+        if (!head)
+            throw std::logic_error("top() called on an empty stack");
+        return head->value;
+    }
+
+    T& top()
+    {
+        if (!head)
+            throw std::logic_error("top() called on an empty stack");
+        if (head.use_count() > 1)
+            head = std::make_shared<Node>(head->value, head->next);
+        return head->value;
+    }
+
+    void push(const T& value)
+    {
+        head = std::make_shared<Node>(value, head);
+        count++;
+    }
+
+    void pop()
+    {
+        if (!head)
+            throw std::logic_error("pop() called on an empty stack");
+        std::shared_ptr<Node> next = head->next;
+        head = next;
+        count--;
+    }
+};
+
+#endif // H_PERSISTENTSTACK
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PROGRAM_IMAGE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "programimage.h"
+#include "astcache.h"
+#include "builtins.h"
+
+static const char magic[8] = {'B', 'B', 'C', 'I', 'M', 'G', '0', '1'};
+
+std::uint64_t ProgramImage::instruction_set_stamp()
+{
+    static const std::uint64_t stamp = []()
+    {
+        std::string table(magic, sizeof(magic));
+        for (const OpcodeInfo& info : opcode_info)
+            table += std::string(info.name) + " " + std::to_string(info.operands) + " " + std::to_string(info.stack_effect) + "\n";
+        for (const Builtin& builtin : builtins)
+            table += builtin.name + " " + std::to_string(builtin.arity) + "\n";
+        return AstCache::hash(table.data(), table.size());
+    }();
+    return stamp;
+}
+
+// sections follow the header in the order of its fields, each starting on a word boundary
+std::vector<char> ProgramImage::serialize(const Program& program)
+{
+    std::vector<char> image(sizeof(Header) + program.functions.size() * sizeof(FunctionRecord));
+    auto align = [&]() {image.resize((image.size() + sizeof(Word) - 1) / sizeof(Word) * sizeof(Word));};
+    auto append = [&](const void* bytes, std::size_t count)
+    {
+        const char* begin = static_cast<const char*>(bytes);
+        image.insert(image.end(), begin, begin + count);
+    };
+
+    Header header = {};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.stamp = instruction_set_stamp();
+    header.functions = program.functions.size();
+
+    align();
+    header.code = image.size();
+    header.code_words = program.code.size();
+    append(program.code.data(), program.code.size() * sizeof(Word));
+    header.statics = image.size();
+    header.statics_words = program.statics.size();
+    append(program.statics.data(), program.statics.size() * sizeof(Word));
+
+    header.names = image.size();
+    for (std::size_t i = 0; i < program.functions.size(); ++i)
+    {
+        const CompiledFunction& function = program.functions[i];
+        FunctionRecord record = {function.entry, static_cast<std::uint32_t>(image.size() - header.names), function.params,
+                                 function.frame_size, function.max_stack};
+        std::memcpy(image.data() + sizeof(Header) + i * sizeof(FunctionRecord), &record, sizeof(record));
+        append(function.name.c_str(), function.name.size() + 1);
+    }
+    header.size = image.size();
+    std::memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+void ProgramImage::write(const Program& program, const std::string& path)
+{
+    std::vector<char> image = serialize(program);
+    std::ofstream file(path, std::ios::binary);
+    if (!file.write(image.data(), image.size()))
+        throw std::runtime_error("Cannot write program image " + path);
+}
+
+ProgramImage::ProgramImage(const std::string& path) : data(nullptr), size(0), mapped(false)
+{
+#ifdef PROGRAM_IMAGE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open program image " + path);
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0)
+    {
+        size = status.st_size;
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            data = static_cast<const char*>(mapping);
+            mapped = true;
+        }
+    }
+    close(fd);
+    if (!mapped)
+        throw std::runtime_error("Cannot map program image " + path);
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        throw std::runtime_error("Cannot open program image " + path);
+    size = file.tellg();
+    // words, so that the code is aligned
+    Word* buffer = new Word[(size + sizeof(Word) - 1) / sizeof(Word)];
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer), size);
+    data = reinterpret_cast<const char*>(buffer);
+#endif
+
+    const Header* header = reinterpret_cast<const Header*>(data);
+    const char* problem = nullptr;
+    auto fits = [&](std::uint64_t offset, std::uint64_t bytes) {return offset <= size && bytes <= size - offset;};
+    if (size < sizeof(Header) || std::memcmp(header->magic, magic, sizeof(magic)))
+        problem = " isn't a program image";
+    else if (header->stamp != instruction_set_stamp())
+        problem = " was written for another instruction set";
+    else if (header->size != size || !fits(sizeof(Header), std::uint64_t(header->functions) * sizeof(FunctionRecord)) ||
+             header->code % sizeof(Word) || header->code_words > size / sizeof(Word) || !fits(header->code, header->code_words * sizeof(Word)) ||
+             header->statics_words > size / sizeof(Word) || !fits(header->statics, header->statics_words * sizeof(Word)) ||
+             !fits(header->names, 0))
+        problem = " is truncated or damaged";
+    else
+    {
+        const FunctionRecord* records = reinterpret_cast<const FunctionRecord*>(data + sizeof(Header));
+        functions.functions.reserve(header->functions);
+        for (std::uint32_t i = 0; i < header->functions && !problem; ++i)
+        {
+            const FunctionRecord& record = records[i];
+            const char* name = data + header->names + std::min<std::uint64_t>(record.name, size - header->names);
+            if (record.entry >= header->code_words || name == data + size || !std::memchr(name, 0, data + size - name))
+                problem = " is truncated or damaged";
+            else
+                functions.functions.push_back(CompiledFunction{name, record.params, record.frame_size, record.max_stack,
+                                                               static_cast<std::size_t>(record.entry)});
+        }
+        const Word* statics = reinterpret_cast<const Word*>(data + header->statics);
+        functions.statics.assign(statics, statics + header->statics_words);
+    }
+    if (problem)
+    {
+        unmap();
+        throw std::runtime_error("Program image " + path + problem);
+    }
+}
+
+void ProgramImage::unmap()
+{
+#ifdef PROGRAM_IMAGE_MMAP
+    if (mapped)
+        munmap(const_cast<char*>(data), size);
+#else
+    delete[] reinterpret_cast<const Word*>(data);
+#endif
+    data = nullptr;
+    mapped = false;
+}
@@ -0,0 +1,74 @@
+#ifndef H_PROGRAMIMAGE
+#define H_PROGRAMIMAGE
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+
+/* A Program compiled to the stack instruction set, in a file that's mapped
+ * and executed in place. The code needs no relocation: jumps are positions
+ * in the code, calls are function indices and string literals offsets in
+ * statics, so the VM runs the mapped words as they are and only the pages
+ * it reaches are read. Constants are immediates in the code; string
+ * literals make up statics, which the VM copies into B memory anyway. The
+ * function table is the one thing turned into a Program on loading.
+ *
+ * The header carries a stamp of the opcode table (superinstructions
+ * included) and the builtins, so an image is only run by a compiler with
+ * the same instruction set. Beyond that the code is trusted like the
+ * compiler's own output. */
+class ProgramImage
+{
+public:
+    struct Header
+    {
+        char magic[8];
+        std::uint64_t stamp;
+        std::uint64_t size;             // of the whole file
+        std::uint64_t code;             // offset of code_words words
+        std::uint64_t code_words;
+        std::uint64_t statics;          // offset of statics_words words
+        std::uint64_t statics_words;
+        std::uint64_t names;            // offset of the function names, each zero terminated
+        std::uint32_t functions;        // records right after the header
+        std::uint32_t reserved;
+    };
+    struct FunctionRecord
+    {
+        std::uint64_t entry;
+        std::uint32_t name;             // offset in names
+        std::uint32_t params;
+        std::uint32_t frame_size;
+        std::uint32_t max_stack;
+    };
+
+private:
+    const char* data;
+    std::size_t size;
+    bool mapped;
+    Program functions;      // function table and statics, the code stays in the mapping
+
+    void unmap();
+
+public:
+    // maps the image at path, throws if it isn't one for this instruction set
+    ProgramImage(const std::string& path);
+    ~ProgramImage() {unmap();}
+    ProgramImage(const ProgramImage&) = delete;
+    ProgramImage& operator=(const ProgramImage&) = delete;
+
+    // everything but the code, which is code()
+    const Program& program() const {return functions;}
+    const Word* code() const {return reinterpret_cast<const Word*>(data + reinterpret_cast<const Header*>(data)->code);}
+    std::size_t bytes() const {return size;}
+
+    // the image of program, which must be compiled to the stack instruction set
+    static std::vector<char> serialize(const Program& program);
+    static void write(const Program& program, const std::string& path);
+    // hash of the opcode and builtin tables, changes with the instruction set
+    static std::uint64_t instruction_set_stamp();
+};
+
+#endif // H_PROGRAMIMAGE
@@ -0,0 +1,82 @@
+#ifndef H_REGBYTECODE
+#define H_REGBYTECODE
+
+#include <cstring>
+
+#include "bytecode.h"
+
+/* Register machine instructions. Registers are frame slots, so a register
+ * can have its address taken like any other B variable. Each entry lists
+ * the opcode's operand words:
+ *
+ *   d  destination register     r  source register
+ *   i  immediate                s  string literal, offset into statics
+ *   t  jump target              f  function index     b  builtin index
+ *   c  argument count, followed by that many source registers
+ *
+ * Conditional jumps compare directly, so loop and if conditions don't
+ * need to materialize a truth value first. */
+#define REGISTER_OPCODES(X) \
+    X(HALT, "") \
+    X(LOADI, "di") \
+    X(LOADS, "ds") \
+    X(MOV, "dr") \
+    X(ADDR, "dr")       /* d = address of register r */ \
+    X(LOAD, "dr")       /* d = *r */ \
+    X(STORE, "rr")      /* *r0 = r1 */ \
+    X(LOADX, "drr")     /* d = r0[r1] */ \
+    X(STOREX, "rrr")    /* r0[r1] = r2 */ \
+    X(ADD, "drr") \
+    X(ADDI, "dri") \
+    X(SUB, "drr") \
+    X(EQ, "drr") \
+    X(EQI, "dri") \
+    X(NE, "drr") \
+    X(NEI, "dri") \
+    X(NEG, "dr") \
+    X(NOT, "dr") \
+    X(JMP, "t") \
+    X(JZ, "rt") \
+    X(JNZ, "rt") \
+    X(JEQ, "rrt") \
+    X(JNE, "rrt") \
+    X(JEQI, "rit") \
+    X(JNEI, "rit") \
+    X(CALL, "dfc") \
+    X(CALLB, "dbc") \
+    X(CALLI, "drc")     /* calls the function value in r */ \
+    X(TAILCALL, "fc")   /* calls the function in the caller's frame, returning to its caller */ \
+    X(TAILCALLI, "rc")  /* calls the function value in r in the caller's frame */ \
+    X(RET, "r") \
+    X(RETI, "i")
+
+#define REGISTER_ENUM(name, operands) name,
+enum class REGOP {REGISTER_OPCODES(REGISTER_ENUM) REGOP_COUNT};
+#undef REGISTER_ENUM
+
+struct RegOpcodeInfo
+{
+    const char* name;
+    const char* operands;
+};
+
+#define REGISTER_INFO(name, operands) {#name, operands},
+const RegOpcodeInfo regop_info[] = {REGISTER_OPCODES(REGISTER_INFO)};
+#undef REGISTER_INFO
+
+inline const RegOpcodeInfo& getinfo(REGOP op)
+{
+    return regop_info[static_cast<int>(op)];
+}
+
+// number of words taken by the instruction starting at code, including the opcode
+inline std::size_t instruction_length(REGOP op, const Word* code)
+{
+    const char* operands = getinfo(op).operands;
+    std::size_t fixed = std::strlen(operands);
+    if (fixed && operands[fixed - 1] == 'c')
+        return 1 + fixed + code[fixed];
+    return 1 + fixed;
+}
+
+#endif // H_REGBYTECODE
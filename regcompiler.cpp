@@ -0,0 +1,654 @@
+#include <algorithm>
+#include <limits>
+
+#include "regcompiler.h"
+#include "linearscan.h"
+
+Program RegisterCompiler::compile(Library& library)
+{
+    Program program;
+    for (auto it = library.functions.begin(); it != library.functions.end(); ++it)
+        program.functions.push_back(CompiledFunction{it->name, static_cast<unsigned>(it->params.size()), 0, 0, 0});
+
+    RegisterCompiler compiler(program);
+    for (std::size_t i = 0; i < library.functions.size(); ++i)
+    {
+        compiler.compile_function(library.functions[i]);
+        compiler.allocate_and_emit(program.functions[i]);
+    }
+    return program;
+}
+
+template<typename Fn> void RegisterCompiler::for_each_register(RegInstruction& instruction, Fn fn)
+{
+    const char* kinds = getinfo(instruction.op).operands;
+    for (std::size_t i = 0; kinds[i]; ++i)
+    {
+        if (kinds[i] == 'd' || kinds[i] == 'r')
+            fn(instruction.operands[i]);
+        else if (kinds[i] == 'c')
+        {
+            for (Word arg = 0; arg < instruction.operands[i]; ++arg)
+                fn(instruction.operands[i + 1 + arg]);
+        }
+    }
+}
+
+void RegisterCompiler::emit(REGOP op, std::vector<Word> operands)
+{
+    code.push_back(RegInstruction{op, operands});
+}
+
+unsigned RegisterCompiler::newlabel()
+{
+    labels.push_back(std::numeric_limits<std::size_t>::max());
+    return labels.size() - 1;
+}
+
+void RegisterCompiler::bind(unsigned label)
+{
+    labels[label] = code.size();
+}
+
+void RegisterCompiler::move(Reg dest, Reg source)
+{
+    if (dest != source)
+        emit(REGOP::MOV, {dest, source});
+}
+
+// a variable read now must be copied if evaluating later code could change it before the read is used
+RegisterCompiler::Reg RegisterCompiler::protect(Reg reg, const Expression& later)
+{
+    if (!isvariable(reg) || !later.haseffects())
+        return reg;
+    Reg copy = temp();
+    move(copy, reg);
+    return copy;
+}
+
+bool RegisterCompiler::islocal(const Expression& expr)
+{
+    return expr.type == EXPR_TYPE::IDENTIFIER &&
+           (expr.binding.type == IDTYPE::VARIABLE || expr.binding.type == IDTYPE::PARAMETER);
+}
+
+void RegisterCompiler::find_address_taken(const Statement& stmt)
+{
+    if (stmt.expr)
+        find_address_taken(*stmt.expr);
+    if (stmt.vars)
+    {
+        for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            if (it->is_initialized)
+                find_address_taken(*it->expr);
+    }
+    if (stmt.body)
+    {
+        for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+            find_address_taken(*it);
+    }
+}
+
+void RegisterCompiler::find_address_taken(const Expression& expr)
+{
+    if (expr.type == EXPR_TYPE::UNARY_AMP)
+    {
+        const Expression* operand = &expr.expressions->front();
+        while (operand->type == EXPR_TYPE::PARENTHESIS)
+            operand = &operand->expressions->front();
+        if (islocal(*operand))
+            address_taken[operand->binding.index] = true;
+    }
+    if (expr.expressions)
+    {
+        for (auto it = expr.expressions->begin(); it != expr.expressions->end(); ++it)
+            find_address_taken(*it);
+    }
+}
+
+void RegisterCompiler::compile_function(Function& function)
+{
+    code.clear();
+    labels.clear();
+    loops.clear();
+    locals = next_vreg = std::max<unsigned>(function.frame_size, function.params.size());
+    address_taken.assign(locals, false);
+
+    find_address_taken(function.getbody());
+    tail_calls = std::find(address_taken.begin(), address_taken.end(), true) == address_taken.end();
+    compile_statement(function.getbody());
+    emit(REGOP::RETI, {0});
+}
+
+void RegisterCompiler::compile_statement(const Statement& stmt)
+{
+    switch (stmt.type)
+    {
+        case STATEMENT_TYPE::COMPOUND:
+            for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+                compile_statement(*it);
+            break;
+        case STATEMENT_TYPE::CONDITIONAL:
+        {
+            unsigned end = newlabel();
+            compile_branch(*stmt.expr, false, end);
+            compile_statement(stmt.body->back());
+            bind(end);
+            break;
+        }
+        case STATEMENT_TYPE::LOOP:
+        {
+            // condition is placed after the body and jumps back to it
+            unsigned test = newlabel(), body = newlabel();
+            emit(REGOP::JMP, {test});
+            bind(body);
+            std::size_t first = code.size();
+            compile_statement(stmt.body->back());
+            bind(test);
+            compile_branch(*stmt.expr, true, body);
+            loops.push_back(std::make_pair(first, code.size() - 1));
+            break;
+        }
+        case STATEMENT_TYPE::RETURN:
+            if (tail_calls && TailCalls::call(stmt))
+                compile_call(*TailCalls::call(stmt), NOREG, true);
+            else if (isliteral(*stmt.expr))
+                emit(REGOP::RETI, {*stmt.expr->int_val});
+            else
+                emit(REGOP::RET, {compile_expr(*stmt.expr)});
+            break;
+        case STATEMENT_TYPE::VAR_DEF:
+            // frames are zeroed on entry, only initializers need code
+            for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            {
+                if (it->is_initialized)
+                    move(it->binding.index, compile_expr(*it->expr, it->binding.index));
+            }
+            break;
+        case STATEMENT_TYPE::EXPRESSION:
+            compile_effect(*stmt.expr);
+            break;
+        case STATEMENT_TYPE::NOP:
+            break;
+    }
+}
+
+// evaluates expr for its side effects only
+void RegisterCompiler::compile_effect(const Expression& expr)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::UNARY_PREINCR:
+        case EXPR_TYPE::UNARY_POSTINCR:
+        case EXPR_TYPE::UNARY_PREDECR:
+        case EXPR_TYPE::UNARY_POSTDECR:
+            if (islocal(expr.expressions->front()))
+            {
+                Reg var = expr.expressions->front().binding.index;
+                bool increment = expr.type == EXPR_TYPE::UNARY_PREINCR || expr.type == EXPR_TYPE::UNARY_POSTINCR;
+                emit(REGOP::ADDI, {var, var, increment ? 1 : -1});
+                return;
+            }
+            break;
+        case EXPR_TYPE::BIN_COMMA:
+            compile_effect(expr.expressions->front());
+            compile_effect(expr.expressions->back());
+            return;
+        case EXPR_TYPE::PARENTHESIS:
+            compile_effect(expr.expressions->front());
+            return;
+        default:
+            break;
+    }
+    compile_expr(expr);
+}
+
+/* Returns the register holding the value of expr. If dest is given the
+ * value is computed into it where that doesn't take extra instructions,
+ * but callers must still move the result if a different register comes
+ * back (a variable, for instance, is returned as is). */
+RegisterCompiler::Reg RegisterCompiler::compile_expr(const Expression& expr, Reg dest)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::INT_LITERAL:
+            dest = into(dest);
+            emit(REGOP::LOADI, {dest, *expr.int_val});
+            return dest;
+        case EXPR_TYPE::STR_LITERAL:
+            dest = into(dest);
+            emit(REGOP::LOADS, {dest, program.intern(*expr.str_val)});
+            return dest;
+        case EXPR_TYPE::IDENTIFIER:
+            switch (expr.binding.type)
+            {
+                case IDTYPE::VARIABLE:
+                case IDTYPE::PARAMETER:
+                    return expr.binding.index;
+                case IDTYPE::FUNCTION:
+                    dest = into(dest);
+                    emit(REGOP::LOADI, {dest, expr.binding.index});
+                    return dest;
+                case IDTYPE::BUILTIN:
+                    dest = into(dest);
+                    emit(REGOP::LOADI, {dest, -(expr.binding.index + 1)});
+                    return dest;
+            }
+            break;
+        case EXPR_TYPE::PARENTHESIS:
+            return compile_expr(expr.expressions->front(), dest);
+        case EXPR_TYPE::INDEXING:
+        {
+            Reg base = protect(compile_expr(expr.expressions->front()), expr.expressions->back());
+            Reg index = compile_expr(expr.expressions->back());
+            dest = into(dest);
+            emit(REGOP::LOADX, {dest, base, index});
+            return dest;
+        }
+        case EXPR_TYPE::UNARY_STAR:
+        {
+            Reg address = compile_expr(expr.expressions->front());
+            dest = into(dest);
+            emit(REGOP::LOAD, {dest, address});
+            return dest;
+        }
+        case EXPR_TYPE::UNARY_AMP:
+            return compile_address(expr.expressions->front(), dest);
+        case EXPR_TYPE::FUNC_CALL:
+            return compile_call(expr, dest);
+        case EXPR_TYPE::BIN_EQUALS:
+            return compile_assignment(expr);
+        case EXPR_TYPE::BIN_PLUSEQUALS:
+            return compile_compound_assignment(expr, 1);
+        case EXPR_TYPE::BIN_MINUSEQUALS:
+            return compile_compound_assignment(expr, -1);
+        case EXPR_TYPE::BIN_PLUS:
+        case EXPR_TYPE::BIN_MINUS:
+        case EXPR_TYPE::BIN_COMPARE:
+        case EXPR_TYPE::BIN_NEGATEEQUALS:
+        {
+            const Expression* lhs = &expr.expressions->front();
+            const Expression* rhs = &expr.expressions->back();
+            if (expr.type != EXPR_TYPE::BIN_MINUS && isliteral(*lhs) && !isliteral(*rhs))
+                std::swap(lhs, rhs);
+
+            Reg left = compile_expr(*lhs);
+            if (isliteral(*rhs))
+            {
+                static const std::map<EXPR_TYPE, REGOP> immediate_ops = {{EXPR_TYPE::BIN_PLUS, REGOP::ADDI}, {EXPR_TYPE::BIN_MINUS, REGOP::ADDI},
+                                                                         {EXPR_TYPE::BIN_COMPARE, REGOP::EQI}, {EXPR_TYPE::BIN_NEGATEEQUALS, REGOP::NEI}};
+                Word immediate = expr.type == EXPR_TYPE::BIN_MINUS ? -static_cast<Word>(*rhs->int_val) : *rhs->int_val;
+                dest = into(dest);
+                emit(immediate_ops.at(expr.type), {dest, left, immediate});
+                return dest;
+            }
+
+            static const std::map<EXPR_TYPE, REGOP> register_ops = {{EXPR_TYPE::BIN_PLUS, REGOP::ADD}, {EXPR_TYPE::BIN_MINUS, REGOP::SUB},
+                                                                    {EXPR_TYPE::BIN_COMPARE, REGOP::EQ}, {EXPR_TYPE::BIN_NEGATEEQUALS, REGOP::NE}};
+            left = protect(left, *rhs);
+            Reg right = compile_expr(*rhs);
+            dest = into(dest);
+            emit(register_ops.at(expr.type), {dest, left, right});
+            return dest;
+        }
+        case EXPR_TYPE::BIN_AND:
+        case EXPR_TYPE::BIN_OR:
+        {
+            // dest is only written after both operands are evaluated, it may be one of them
+            unsigned is_false = newlabel(), done = newlabel();
+            dest = into(dest);
+            compile_branch(expr, false, is_false);
+            emit(REGOP::LOADI, {dest, 1});
+            emit(REGOP::JMP, {done});
+            bind(is_false);
+            emit(REGOP::LOADI, {dest, 0});
+            bind(done);
+            return dest;
+        }
+        case EXPR_TYPE::BIN_COMMA:
+            compile_effect(expr.expressions->front());
+            return compile_expr(expr.expressions->back(), dest);
+        case EXPR_TYPE::UNARY_MINUS:
+        {
+            if (isliteral(expr.expressions->front()))
+            {
+                dest = into(dest);
+                emit(REGOP::LOADI, {dest, -static_cast<Word>(*expr.expressions->front().int_val)});
+                return dest;
+            }
+            Reg operand = compile_expr(expr.expressions->front());
+            dest = into(dest);
+            emit(REGOP::NEG, {dest, operand});
+            return dest;
+        }
+        case EXPR_TYPE::UNARY_NEGATE:
+        {
+            Reg operand = compile_expr(expr.expressions->front());
+            dest = into(dest);
+            emit(REGOP::NOT, {dest, operand});
+            return dest;
+        }
+        case EXPR_TYPE::UNARY_PREINCR:
+            return compile_increment(expr.expressions->front(), 1, false);
+        case EXPR_TYPE::UNARY_PREDECR:
+            return compile_increment(expr.expressions->front(), -1, false);
+        case EXPR_TYPE::UNARY_POSTINCR:
+            return compile_increment(expr.expressions->front(), 1, true);
+        case EXPR_TYPE::UNARY_POSTDECR:
+            return compile_increment(expr.expressions->front(), -1, true);
+        case EXPR_TYPE::TERNARY:
+        {
+            unsigned to_false = newlabel(), done = newlabel();
+            dest = into(dest);
+            compile_branch(expr.expressions->at(0), false, to_false);
+            move(dest, compile_expr(expr.expressions->at(1), dest));
+            emit(REGOP::JMP, {done});
+            bind(to_false);
+            move(dest, compile_expr(expr.expressions->at(2), dest));
+            bind(done);
+            return dest;
+        }
+        case EXPR_TYPE::NONE:
+            dest = into(dest);
+            emit(REGOP::LOADI, {dest, 0});
+            return dest;
+    }
+    throw std::logic_error("Unknown expression type");
+}
+
+RegisterCompiler::Reg RegisterCompiler::compile_address(const Expression& expr, Reg dest)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::IDENTIFIER:
+            if (!islocal(expr))
+                throw std::logic_error("Address of '" + *expr.str_val + "' which isn't a variable");
+            dest = into(dest);
+            emit(REGOP::ADDR, {dest, expr.binding.index});
+            return dest;
+        case EXPR_TYPE::UNARY_STAR:
+            return compile_expr(expr.expressions->front(), dest);
+        case EXPR_TYPE::INDEXING:
+        {
+            Reg base = protect(compile_expr(expr.expressions->front()), expr.expressions->back());
+            Reg index = compile_expr(expr.expressions->back());
+            dest = into(dest);
+            emit(REGOP::ADD, {dest, base, index});
+            return dest;
+        }
+        case EXPR_TYPE::PARENTHESIS:
+            return compile_address(expr.expressions->front(), dest);
+        default:
+            throw std::logic_error("Expression is not an lvalue");
+    }
+}
+
+RegisterCompiler::Reg RegisterCompiler::compile_call(const Expression& expr, Reg dest, bool tail)
+{
+    const Expression& callee = expr.expressions->front();
+    bool direct = callee.type == EXPR_TYPE::IDENTIFIER &&
+                  (callee.binding.type == IDTYPE::FUNCTION || callee.binding.type == IDTYPE::BUILTIN);
+
+    // arguments are read when the call is made, so a variable argument must be
+    // copied if any later argument or the callee expression can change it
+    std::vector<Reg> args;
+    for (auto it = expr.expressions->begin() + 1; it != expr.expressions->end(); ++it)
+    {
+        Reg arg = compile_expr(*it);
+        if (isvariable(arg))
+        {
+            bool changed_later = !direct && callee.haseffects();
+            for (auto later = it + 1; later != expr.expressions->end() && !changed_later; ++later)
+                changed_later = later->haseffects();
+            if (changed_later)
+            {
+                Reg copy = temp();
+                move(copy, arg);
+                arg = copy;
+            }
+        }
+        args.push_back(arg);
+    }
+
+    std::vector<Word> operands;
+    if (direct)
+        operands = {0, callee.binding.index, static_cast<Word>(args.size())};
+    else
+        operands = {0, compile_expr(callee), static_cast<Word>(args.size())};
+    operands.insert(operands.end(), args.begin(), args.end());
+    if (tail)
+    {
+        emit(direct ? REGOP::TAILCALL : REGOP::TAILCALLI, std::vector<Word>(operands.begin() + 1, operands.end()));
+        return NOREG;
+    }
+    operands[0] = dest = into(dest);
+
+    if (!direct)
+        emit(REGOP::CALLI, operands);
+    else if (callee.binding.type == IDTYPE::FUNCTION)
+        emit(REGOP::CALL, operands);
+    else
+        emit(REGOP::CALLB, operands);
+    return dest;
+}
+
+RegisterCompiler::Reg RegisterCompiler::compile_assignment(const Expression& expr)
+{
+    const Expression& lhs = expr.expressions->front();
+    const Expression& rhs = expr.expressions->back();
+    if (islocal(lhs))
+    {
+        Reg var = lhs.binding.index;
+        move(var, compile_expr(rhs, var));
+        return var;
+    }
+    if (lhs.type == EXPR_TYPE::INDEXING)
+    {
+        Reg base = protect(compile_expr(lhs.expressions->front()), lhs.expressions->back());
+        base = protect(base, rhs);
+        Reg index = protect(compile_expr(lhs.expressions->back()), rhs);
+        Reg value = compile_expr(rhs);
+        emit(REGOP::STOREX, {base, index, value});
+        return value;
+    }
+    Reg address = protect(compile_address(lhs), rhs);
+    Reg value = compile_expr(rhs);
+    emit(REGOP::STORE, {address, value});
+    return value;
+}
+
+RegisterCompiler::Reg RegisterCompiler::compile_compound_assignment(const Expression& expr, Word sign)
+{
+    const Expression& lhs = expr.expressions->front();
+    const Expression& rhs = expr.expressions->back();
+    if (islocal(lhs))
+    {
+        Reg var = lhs.binding.index;
+        if (isliteral(rhs))
+            emit(REGOP::ADDI, {var, var, sign * *rhs.int_val});
+        else
+        {
+            // the variable is read before the rhs, which may change it
+            Reg old = protect(var, rhs);
+            Reg delta = compile_expr(rhs);
+            emit(sign > 0 ? REGOP::ADD : REGOP::SUB, {var, old, delta});
+        }
+        return var;
+    }
+
+    Reg address = protect(compile_address(lhs), rhs);
+    Reg value = temp();
+    emit(REGOP::LOAD, {value, address});
+    if (isliteral(rhs))
+        emit(REGOP::ADDI, {value, value, sign * *rhs.int_val});
+    else
+        emit(sign > 0 ? REGOP::ADD : REGOP::SUB, {value, value, compile_expr(rhs)});
+    emit(REGOP::STORE, {address, value});
+    return value;
+}
+
+RegisterCompiler::Reg RegisterCompiler::compile_increment(const Expression& operand, Word delta, bool postfix)
+{
+    if (islocal(operand))
+    {
+        Reg var = operand.binding.index;
+        Reg old = NOREG;
+        if (postfix)
+        {
+            old = temp();
+            move(old, var);
+        }
+        emit(REGOP::ADDI, {var, var, delta});
+        return postfix ? old : var;
+    }
+
+    Reg address = compile_address(operand);
+    Reg value = temp();
+    emit(REGOP::LOAD, {value, address});
+    if (postfix)
+    {
+        Reg updated = temp();
+        emit(REGOP::ADDI, {updated, value, delta});
+        emit(REGOP::STORE, {address, updated});
+    }
+    else
+    {
+        emit(REGOP::ADDI, {value, value, delta});
+        emit(REGOP::STORE, {address, value});
+    }
+    return value;
+}
+
+// jumps to label if the truth value of cond is when, falls through otherwise
+void RegisterCompiler::compile_branch(const Expression& cond, bool when, unsigned label)
+{
+    switch (cond.type)
+    {
+        case EXPR_TYPE::PARENTHESIS:
+            compile_branch(cond.expressions->front(), when, label);
+            return;
+        case EXPR_TYPE::UNARY_NEGATE:
+            compile_branch(cond.expressions->front(), !when, label);
+            return;
+        case EXPR_TYPE::INT_LITERAL:
+            if ((*cond.int_val != 0) == when)
+                emit(REGOP::JMP, {label});
+            return;
+        case EXPR_TYPE::BIN_COMPARE:
+        case EXPR_TYPE::BIN_NEGATEEQUALS:
+        {
+            const Expression* lhs = &cond.expressions->front();
+            const Expression* rhs = &cond.expressions->back();
+            if (isliteral(*lhs) && !isliteral(*rhs))
+                std::swap(lhs, rhs);
+
+            bool jump_if_equal = (cond.type == EXPR_TYPE::BIN_COMPARE) == when;
+            Reg left = compile_expr(*lhs);
+            if (isliteral(*rhs))
+                emit(jump_if_equal ? REGOP::JEQI : REGOP::JNEI, {left, *rhs->int_val, label});
+            else
+            {
+                left = protect(left, *rhs);
+                Reg right = compile_expr(*rhs);
+                emit(jump_if_equal ? REGOP::JEQ : REGOP::JNE, {left, right, label});
+            }
+            return;
+        }
+        case EXPR_TYPE::BIN_AND:
+        case EXPR_TYPE::BIN_OR:
+        {
+            // a && b is false as soon as a is, a || b is true as soon as a is
+            bool shortcut = cond.type == EXPR_TYPE::BIN_OR;
+            if (when == shortcut)
+            {
+                compile_branch(cond.expressions->front(), when, label);
+                compile_branch(cond.expressions->back(), when, label);
+            }
+            else
+            {
+                unsigned skip = newlabel();
+                compile_branch(cond.expressions->front(), shortcut, skip);
+                compile_branch(cond.expressions->back(), when, label);
+                bind(skip);
+            }
+            return;
+        }
+        default:
+            emit(when ? REGOP::JNZ : REGOP::JZ, {compile_expr(cond), label});
+            return;
+    }
+}
+
+void RegisterCompiler::allocate_and_emit(CompiledFunction& function)
+{
+    // live intervals; locals are live from the start, so they read as zero until assigned
+    const std::size_t none = std::numeric_limits<std::size_t>::max();
+    std::vector<LiveInterval> ranges(next_vreg, LiveInterval{0, none, 0});
+    for (unsigned vreg = 0; vreg < next_vreg; ++vreg)
+        ranges[vreg].vreg = vreg;
+    for (unsigned param = 0; param < function.params; ++param)
+        ranges[param].start = 0;
+    for (std::size_t i = 0; i < code.size(); ++i)
+    {
+        for_each_register(code[i], [&](Word reg)
+        {
+            LiveInterval& range = ranges[reg];
+            range.start = reg < static_cast<Word>(locals) ? 0 : std::min(range.start, i);
+            range.end = std::max(range.end, i);
+        });
+    }
+    for (unsigned vreg = 0; vreg < locals; ++vreg)
+        if (address_taken[vreg] && ranges[vreg].start != none)
+            ranges[vreg].end = code.size() - 1;
+
+    // values live into a loop from before it must survive every iteration
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+        for (auto loop = loops.begin(); loop != loops.end(); ++loop)
+        {
+            for (auto range = ranges.begin(); range != ranges.end(); ++range)
+            {
+                if (range->start != none && range->start < loop->first &&
+                    range->end >= loop->first && range->end < loop->second)
+                {
+                    range->end = loop->second;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    std::vector<LiveInterval> intervals;
+    for (auto range = ranges.begin(); range != ranges.end(); ++range)
+        if (range->start != none)
+            intervals.push_back(*range);
+    std::vector<int> slot = LinearScan::allocate(intervals, next_vreg, function.frame_size);
+
+    // moves between registers that ended up in the same slot disappear
+    for (auto it = code.begin(); it != code.end(); ++it)
+        for_each_register(*it, [&](Word& reg) {reg = slot[reg];});
+    std::vector<std::size_t> position(code.size() + 1);
+    position[0] = program.code.size();
+    for (std::size_t i = 0; i < code.size(); ++i)
+    {
+        bool removed = code[i].op == REGOP::MOV && code[i].operands[0] == code[i].operands[1];
+        position[i + 1] = position[i] + (removed ? 0 : 1 + code[i].operands.size());
+    }
+
+    function.entry = position[0];
+    for (std::size_t i = 0; i < code.size(); ++i)
+    {
+        if (position[i + 1] == position[i])
+            continue;
+        const char* kinds = getinfo(code[i].op).operands;
+        program.code.push_back(static_cast<Word>(code[i].op));
+        for (std::size_t operand = 0; operand < code[i].operands.size(); ++operand)
+        {
+            if (operand < std::strlen(kinds) && kinds[operand] == 't')
+                program.code.push_back(position[labels[code[i].operands[operand]]]);
+            else
+                program.code.push_back(code[i].operands[operand]);
+        }
+    }
+}
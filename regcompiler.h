@@ -0,0 +1,74 @@
+#ifndef H_REGCOMPILER
+#define H_REGCOMPILER
+
+#include <vector>
+
+#include "regbytecode.h"
+#include "expression.h"
+#include "statement.h"
+#include "function.h"
+#include "library.h"
+#include "tailcalls.h"
+
+/* Lowers an analysed library to register machine code. Each function is
+ * first lowered to instructions over virtual registers: one per local
+ * (params and variables, numbered by their binding) and one per
+ * temporary. Variables are used in place, without loads or stores, and
+ * the result of an expression is computed straight into the variable it's
+ * assigned to where possible. LinearScan then maps virtual registers onto
+ * frame slots. */
+class RegisterCompiler
+{
+    typedef int Reg;
+    static const Reg NOREG = -1;
+
+    struct RegInstruction
+    {
+        REGOP op;
+        std::vector<Word> operands;
+    };
+
+    Program& program;
+    std::vector<RegInstruction> code;
+    std::vector<std::size_t> labels;                                // instruction each label is bound to
+    std::vector<std::pair<std::size_t, std::size_t>> loops;         // first and last instruction of every loop
+    unsigned locals;
+    unsigned next_vreg;
+    std::vector<bool> address_taken;                                // locals whose address escapes, live until the end
+    bool tail_calls;                                                // none did, see TailCalls
+
+    void emit(REGOP op, std::vector<Word> operands);
+    unsigned newlabel();
+    void bind(unsigned label);
+    Reg temp() {return next_vreg++;}
+    Reg into(Reg dest) {return dest != NOREG ? dest : temp();}
+    bool isvariable(Reg reg) const {return reg != NOREG && static_cast<unsigned>(reg) < locals;}
+    Reg protect(Reg reg, const Expression& later);
+    void move(Reg dest, Reg source);
+
+    void compile_function(Function& function);
+    void compile_statement(const Statement& stmt);
+    void compile_effect(const Expression& expr);
+    Reg compile_expr(const Expression& expr, Reg dest = NOREG);
+    Reg compile_address(const Expression& expr, Reg dest = NOREG);
+    Reg compile_call(const Expression& expr, Reg dest, bool tail = false);
+    Reg compile_assignment(const Expression& expr);
+    Reg compile_compound_assignment(const Expression& expr, Word sign);
+    Reg compile_increment(const Expression& operand, Word delta, bool postfix);
+    void compile_branch(const Expression& cond, bool when, unsigned label);
+    void allocate_and_emit(CompiledFunction& function);
+
+    static bool islocal(const Expression& expr);
+    static bool isliteral(const Expression& expr) {return expr.type == EXPR_TYPE::INT_LITERAL;}
+    void find_address_taken(const Statement& stmt);
+    void find_address_taken(const Expression& expr);
+
+    template<typename Fn> static void for_each_register(RegInstruction& instruction, Fn fn);
+
+    RegisterCompiler(Program& _program) : program(_program), locals(0), next_vreg(0), tail_calls(false) {}
+
+public:
+    static Program compile(Library& library);
+};
+
+#endif // H_REGCOMPILER
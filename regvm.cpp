@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "regvm.h"
+#include "dispatch.h"
+
+#define VM_OPCODE_ENUM REGOP
+
+// target of a pointer, tested first in checked mode
+#define VM_POINTER(address) (checked && !memory.valid(address) ? fault(address) : Memory::pointer(address))
+
+Word RegisterVM::run(const Identifier& entry)
+{
+    MemoryTrap trap(memory, MemoryTrap::interpreter);
+    try
+    {
+        if (MEMORY_TRAPPED(trap))
+            fault(trap.address());
+        Word result = memory.checked ? execute<true>(entry) : execute<false>(entry);
+        runtime.flush();
+        return result;
+    }
+    catch (...)
+    {
+        runtime.flush();
+        throw;
+    }
+}
+
+Word* RegisterVM::fault(Word address) const
+{
+    throw std::runtime_error(memory.fault(address, calls.empty() ? std::string() : program.functions[calls.back().function].name));
+}
+
+template <bool checked>
+Word RegisterVM::execute(const Identifier& entry)
+{
+#ifdef VM_COMPUTED_GOTO
+    static void* const dispatch_table[] = {REGISTER_OPCODES(VM_LABEL_ADDRESS)};
+#endif
+
+    int entry_index = program.find(entry);
+    if (entry_index < 0)
+        throw std::runtime_error("No function named '" + entry + "'");
+
+    const Word* const code = program.code.data();
+    const Word statics = memory.statics();
+    Word* const frames_end = memory.frames_end();
+
+    const Word* pc = nullptr;
+    Word* fp = nullptr;                 // frame of the running function, its slots are the registers
+    Word* frame_top = memory.frames_begin();
+    Word result = 0;
+
+    // operands of the call being made, shared by CALL, CALLB and CALLI
+    Word callee = entry_index;
+    Word result_register = 0;
+    Word argc = 0;
+    const Word* args = nullptr;
+
+    calls.clear();
+    executed = 0;
+    runtime.exited = false;
+    goto invoke;
+
+#ifndef VM_COMPUTED_GOTO
+dispatch:
+    ++executed;
+    switch (static_cast<REGOP>(*pc++))
+    {
+#endif
+    VM_TARGET(HALT)
+        return 0;
+    VM_TARGET(LOADI)
+        fp[pc[0]] = pc[1];
+        pc += 2;
+        VM_DISPATCH();
+    VM_TARGET(LOADS)
+        fp[pc[0]] = statics + pc[1];
+        pc += 2;
+        VM_DISPATCH();
+    VM_TARGET(MOV)
+        fp[pc[0]] = fp[pc[1]];
+        pc += 2;
+        VM_DISPATCH();
+    VM_TARGET(ADDR)
+        fp[pc[0]] = Memory::address(fp + pc[1]);
+        pc += 2;
+        VM_DISPATCH();
+    VM_TARGET(LOAD)
+        fp[pc[0]] = *VM_POINTER(fp[pc[1]]);
+        pc += 2;
+        VM_DISPATCH();
+    VM_TARGET(STORE)
+        *VM_POINTER(fp[pc[0]]) = fp[pc[1]];
+        pc += 2;
+        VM_DISPATCH();
+    VM_TARGET(LOADX)
+        fp[pc[0]] = *VM_POINTER(fp[pc[1]] + fp[pc[2]]);
+        pc += 3;
+        VM_DISPATCH();
+    VM_TARGET(STOREX)
+        *VM_POINTER(fp[pc[0]] + fp[pc[1]]) = fp[pc[2]];
+        pc += 3;
+        VM_DISPATCH();
+    VM_TARGET(ADD)
+        fp[pc[0]] = static_cast<Word>(static_cast<std::uint64_t>(fp[pc[1]]) + static_cast<std::uint64_t>(fp[pc[2]]));
+        pc += 3;
+        VM_DISPATCH();
+    VM_TARGET(ADDI)
+        fp[pc[0]] = static_cast<Word>(static_cast<std::uint64_t>(fp[pc[1]]) + static_cast<std::uint64_t>(pc[2]));
+        pc += 3;
+        VM_DISPATCH();
+    VM_TARGET(SUB)
+        fp[pc[0]] = static_cast<Word>(static_cast<std::uint64_t>(fp[pc[1]]) - static_cast<std::uint64_t>(fp[pc[2]]));
+        pc += 3;
+        VM_DISPATCH();
+    VM_TARGET(EQ)
+        fp[pc[0]] = fp[pc[1]] == fp[pc[2]];
+        pc += 3;
+        VM_DISPATCH();
+    VM_TARGET(EQI)
+        fp[pc[0]] = fp[pc[1]] == pc[2];
+        pc += 3;
+        VM_DISPATCH();
+    VM_TARGET(NE)
+        fp[pc[0]] = fp[pc[1]] != fp[pc[2]];
+        pc += 3;
+        VM_DISPATCH();
+    VM_TARGET(NEI)
+        fp[pc[0]] = fp[pc[1]] != pc[2];
+        pc += 3;
+        VM_DISPATCH();
+    VM_TARGET(NEG)
+        fp[pc[0]] = static_cast<Word>(0 - static_cast<std::uint64_t>(fp[pc[1]]));
+        pc += 2;
+        VM_DISPATCH();
+    VM_TARGET(NOT)
+        fp[pc[0]] = !fp[pc[1]];
+        pc += 2;
+        VM_DISPATCH();
+    VM_TARGET(JMP)
+        pc = code + pc[0];
+        VM_DISPATCH();
+    VM_TARGET(JZ)
+        pc = fp[pc[0]] ? pc + 2 : code + pc[1];
+        VM_DISPATCH();
+    VM_TARGET(JNZ)
+        pc = fp[pc[0]] ? code + pc[1] : pc + 2;
+        VM_DISPATCH();
+    VM_TARGET(JEQ)
+        pc = fp[pc[0]] == fp[pc[1]] ? code + pc[2] : pc + 3;
+        VM_DISPATCH();
+    VM_TARGET(JNE)
+        pc = fp[pc[0]] != fp[pc[1]] ? code + pc[2] : pc + 3;
+        VM_DISPATCH();
+    VM_TARGET(JEQI)
+        pc = fp[pc[0]] == pc[1] ? code + pc[2] : pc + 3;
+        VM_DISPATCH();
+    VM_TARGET(JNEI)
+        pc = fp[pc[0]] != pc[1] ? code + pc[2] : pc + 3;
+        VM_DISPATCH();
+    VM_TARGET(CALL)
+        result_register = pc[0];
+        callee = pc[1];
+        argc = pc[2];
+        args = pc + 3;
+        pc += 3 + argc;
+        goto invoke;
+    VM_TARGET(CALLB)
+        result_register = pc[0];
+        callee = pc[1];
+        argc = pc[2];
+        args = pc + 3;
+        pc += 3 + argc;
+        goto builtin;
+    VM_TARGET(CALLI)
+        result_register = pc[0];
+        callee = fp[pc[1]];
+        argc = pc[2];
+        args = pc + 3;
+        pc += 3 + argc;
+        if (callee < 0)
+        {
+            callee = -(callee + 1);
+            goto builtin;
+        }
+        if (callee >= static_cast<Word>(program.functions.size()))
+            throw std::runtime_error("Call of invalid function value " + std::to_string(callee));
+        goto invoke;
+    VM_TARGET(TAILCALL)
+        callee = pc[0];
+        argc = pc[1];
+        args = pc + 2;
+        goto tail_invoke;
+    VM_TARGET(TAILCALLI)
+        callee = fp[pc[0]];
+        argc = pc[1];
+        args = pc + 2;
+        if (callee < 0)
+        {
+            // a builtin doesn't take a frame, its result is returned right away
+            arguments.resize(std::max<std::size_t>(arguments.size(), argc));
+            for (Word i = 0; i < argc; ++i)
+                arguments[i] = fp[args[i]];
+            result = runtime.call(-(callee + 1), arguments.data(), argc);
+            if (runtime.exited)
+                return 0;
+            goto leave;
+        }
+        if (callee >= static_cast<Word>(program.functions.size()))
+            throw std::runtime_error("Call of invalid function value " + std::to_string(callee));
+        goto tail_invoke;
+    VM_TARGET(RET)
+        result = fp[pc[0]];
+        goto leave;
+    VM_TARGET(RETI)
+        result = pc[0];
+        goto leave;
+#ifndef VM_COMPUTED_GOTO
+    default:
+        throw std::logic_error("Invalid opcode " + std::to_string(pc[-1]));
+    }
+#endif
+
+invoke:
+    {
+        const CompiledFunction& function = program.functions[callee];
+        Word* frame = frame_top;
+        if (frames_end - frame < static_cast<std::ptrdiff_t>(function.frame_size) || calls.size() >= max_calls)
+            throw std::runtime_error(Memory::overflow(function.name));
+
+        // missing arguments read as zero, extra ones are dropped
+        Word passed = std::min<Word>(argc, function.params);
+        for (Word i = 0; i < passed; ++i)
+            frame[i] = fp[args[i]];
+        std::fill(frame + passed, frame + function.frame_size, 0);
+
+        calls.push_back(CallRecord{pc, fp, result_register, static_cast<unsigned>(callee)});
+        fp = frame;
+        frame_top = frame + function.frame_size;
+        pc = code + function.entry;
+        VM_DISPATCH();
+    }
+
+// the arguments are registers of the frame they replace, so they're gathered first
+tail_invoke:
+    {
+        const CompiledFunction& function = program.functions[callee];
+        if (frames_end - fp < static_cast<std::ptrdiff_t>(function.frame_size))
+            throw std::runtime_error(Memory::overflow(function.name));
+
+        Word passed = std::min<Word>(argc, function.params);
+        arguments.resize(std::max<std::size_t>(arguments.size(), passed));
+        for (Word i = 0; i < passed; ++i)
+            arguments[i] = fp[args[i]];
+        std::copy(arguments.begin(), arguments.begin() + passed, fp);
+        std::fill(fp + passed, fp + function.frame_size, 0);
+
+        calls.back().function = callee;
+        frame_top = fp + function.frame_size;
+        pc = code + function.entry;
+        VM_DISPATCH();
+    }
+
+leave:
+    if (calls.size() == 1)
+        return result;
+    frame_top = fp;
+    pc = calls.back().return_pc;
+    fp = calls.back().fp;
+    fp[calls.back().result] = result;
+    calls.pop_back();
+    VM_DISPATCH();
+
+builtin:
+    arguments.resize(std::max<std::size_t>(arguments.size(), argc));
+    for (Word i = 0; i < argc; ++i)
+        arguments[i] = fp[args[i]];
+    result = runtime.call(callee, arguments.data(), argc);
+    if (runtime.exited)
+        return 0;
+    fp[result_register] = result;
+    VM_DISPATCH();
+}
+
+// instantiated here for MEMORY_INTERPRETER, which GCC ignores on the template itself
+template MEMORY_INTERPRETER Word RegisterVM::execute<false>(const Identifier& entry);
+template MEMORY_INTERPRETER Word RegisterVM::execute<true>(const Identifier& entry);
@@ -0,0 +1,50 @@
+#ifndef H_REGVM
+#define H_REGVM
+
+#include <vector>
+
+#include "regbytecode.h"
+#include "memory.h"
+#include "runtime.h"
+
+/* Executes register machine code (see RegisterCompiler). Registers are the
+ * slots of the running function's frame in B memory; frames are zeroed on
+ * entry and arguments are copied into the first slots of the callee's.
+ * Pointers are checked like in VM. */
+class RegisterVM
+{
+    struct CallRecord
+    {
+        const Word* return_pc;
+        Word* fp;
+        Word result;        // caller's register receiving the return value
+        unsigned function;  // the one called
+    };
+
+    const Program& program;
+    Memory memory;
+    Runtime runtime;
+    std::vector<CallRecord> calls;
+    std::vector<Word> arguments;        // builtin arguments gathered from registers
+    std::size_t max_calls;
+    unsigned long long executed;
+
+    template <bool checked>
+    Word execute(const Identifier& entry);
+    [[noreturn]] Word* fault(Word address) const;
+
+public:
+    RegisterVM(const Program& _program, std::size_t heap_words = 1 << 20, std::size_t stack_words = 1 << 20)
+        : program(_program), memory(_program.statics, heap_words, stack_words), runtime(memory),
+          max_calls(stack_words), executed(0) {}
+
+    // runs entry to completion (or until exit() is called) and returns its result
+    Word run(const Identifier& entry = "main");
+
+    // test every address a program dereferences instead of relying on guard pages
+    void check_memory(bool enable = true) {memory.checked = enable;}
+
+    unsigned long long instructions() const {return executed;}
+};
+
+#endif // H_REGVM
@@ -0,0 +1,68 @@
+#!/bin/bash
+
+# Runs every program in benchmarks/ on every engine and compares its output with the .out file next to it.
+# The native engine assembles the --emit-asm output, the c engine compiles the --emit-c output with ${CC:-cc} -O2;
+# both are linked with the bruntime library built next to the compiler.
+# Programs with a .md5 file instead of a .out one have the md5 sum of their output compared, for output too large to keep.
+# Usage: [ENGINES="stack register ssa jit tiered native c"] run_benchmarks.sh [path to compiler executable] [extra compiler options...]
+
+EXEC_PATH="$(realpath "${1:-_gate_build/compiler}")"
+shift
+EXTRA_OPTIONS="$@"
+ENGINES="${ENGINES:-stack register ssa jit tiered}"
+
+SOURCE_DIR="$(realpath "$(dirname "$0")")"
+RUNTIME="$(dirname "$EXEC_PATH")/libbruntime.a"
+cd "$SOURCE_DIR/benchmarks"
+FAILED=0
+NATIVE_DIR="$(mktemp -d)"
+trap 'rm -rf "$NATIVE_DIR"' EXIT
+
+for filename in *.txt; do
+	BASENAME="$(basename $filename .txt)"
+
+	for engine in $ENGINES; do
+		echo "Running benchmark $BASENAME on $engine"
+
+		PROGRAM="$NATIVE_DIR/$BASENAME.$engine"
+		if [ "$engine" == "native" ]
+		then
+			"$EXEC_PATH" --emit-asm "$PROGRAM.s" $EXTRA_OPTIONS $filename &&
+				as "$PROGRAM.s" -o "$PROGRAM.o" &&
+				c++ "$PROGRAM.o" "$RUNTIME" -o "$PROGRAM"
+		elif [ "$engine" == "c" ]
+		then
+			"$EXEC_PATH" --emit-c "$PROGRAM.c" $EXTRA_OPTIONS $filename &&
+				${CC:-cc} -O2 -I"$SOURCE_DIR" -c "$PROGRAM.c" -o "$PROGRAM.o" &&
+				c++ "$PROGRAM.o" "$RUNTIME" -o "$PROGRAM"
+		fi
+
+		if [ "$engine" == "native" ] || [ "$engine" == "c" ]
+		then
+			(time "$PROGRAM") 2>&1 >"$PROGRAM.stdout" | grep real >&2
+		else
+			"$EXEC_PATH" --run --stats --engine $engine $EXTRA_OPTIONS $filename >"$PROGRAM.stdout"
+		fi
+		if [ -f "$BASENAME.md5" ]
+		then
+			EXPECTED="$(cat $BASENAME.md5)"
+			ACTUAL="$(md5sum <"$PROGRAM.stdout" | cut -d ' ' -f 1)"
+		else
+			EXPECTED="$(cat $BASENAME.out)"
+			ACTUAL="$(cat "$PROGRAM.stdout")"
+		fi
+		rm -f "$PROGRAM.stdout"
+		if [ "$ACTUAL" == "$EXPECTED" ]
+		then
+			echo "BENCHMARK PASSED"
+		else
+			echo "BENCHMARK FAILED, expected:"
+			echo "$EXPECTED"
+			echo "got:"
+			echo "$ACTUAL"
+			FAILED=1
+		fi
+	done
+done
+
+exit $FAILED
@@ -0,0 +1,185 @@
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include "runtime.h"
+#include "builtins.h"
+
+Word Runtime::call(unsigned builtin, const Word* args, unsigned argc)
+{
+    Word arg[3] = {0, 0, 0};
+    for (unsigned i = 0; i < argc && i < 3; ++i)
+        arg[i] = args[i];
+
+    switch (builtin)
+    {
+        case 0:     // putchar(c)
+            put(arg[0]);
+            return arg[0];
+        case 1:     // getchar(), zero at end of input
+        {
+            int c = get();
+            return c < 0 ? 0 : c;
+        }
+        case 2:     // printf(format, ...)
+            return printf(args, argc);
+        case 3:     // char(string, i)
+            return word(arg[0] + arg[1], "char");
+        case 4:     // lchar(string, i, c)
+            word(arg[0] + arg[1], "lchar") = arg[2];
+            return arg[2];
+        case 5:     // exit()
+            flush();
+            exited = true;
+            return 0;
+        case 6:     // getvec(size)
+            return memory.allocate(arg[0]);
+        case 7:     // flush()
+            flush();
+            return 0;
+        default:
+            throw std::logic_error("Unknown builtin " + std::to_string(builtin));
+    }
+}
+
+void Runtime::flush()
+{
+    if (redirected)
+        redirected_output.append(output.data(), output_used);
+    else
+    {
+        if (output_used)
+            std::fwrite(output.data(), 1, output_used, stdout);
+        std::fflush(stdout);
+    }
+    output_used = 0;
+}
+
+void Runtime::spill()
+{
+    if (output.empty())
+        output.resize(buffer_size);
+    else
+        flush();
+}
+
+int Runtime::get()
+{
+    if (input_next == input_end)
+    {
+        // a prompt must be visible before the program waits for the answer
+        flush();
+        input.resize(buffer_size);
+        input_next = 0;
+        if (redirected)
+        {
+            input_end = redirected_input.copy(input.data(), input.size(), redirected_read);
+            redirected_read += input_end;
+        }
+        else
+        {
+#if defined(__unix__) || defined(__APPLE__)
+            ssize_t got = read(STDIN_FILENO, input.data(), input.size());
+            input_end = got > 0 ? got : 0;
+#else
+            int c = std::getchar();
+            input[0] = static_cast<char>(c);
+            input_end = c == EOF ? 0 : 1;
+#endif
+        }
+        if (!input_end)
+            return -1;
+    }
+    return static_cast<unsigned char>(input[input_next++]);
+}
+
+Word& Runtime::word(Word address, const char* builtin)
+{
+    if (memory.checked && !memory.valid(address))
+        throw std::runtime_error(memory.fault(address, builtin));
+    return *Memory::pointer(address);
+}
+
+void Runtime::print_number(Word value, int base)
+{
+    char digits[24];
+    int n = 0;
+    std::uint64_t magnitude = value < 0 ? -static_cast<std::uint64_t>(value) : value;
+    if (value < 0)
+        put('-');
+    do
+    {
+        digits[n++] = '0' + magnitude % base;
+        magnitude /= base;
+    } while (magnitude);
+    while (n)
+        put(digits[--n]);
+}
+
+void Runtime::print_string(Word address)
+{
+    for (Word c; (c = word(address, "printf")); ++address)
+        put(c);
+}
+
+// %d, %o, %c and %s conversions as in B's printf
+Word Runtime::printf(const Word* args, unsigned argc)
+{
+    if (!argc)
+        return 0;
+
+    unsigned next = 1;
+    Word format = args[0];
+    if (memory.checked)
+        for (Word c = format; word(c, "printf"); ++c);
+    for (const Word* c = Memory::pointer(format); *c; ++c)
+    {
+        if (*c != '%' || !c[1])
+        {
+            put(*c);
+            continue;
+        }
+
+        Word arg = next < argc ? args[next] : 0;
+        switch (*++c)
+        {
+            case 'd':
+                print_number(arg, 10);
+                next++;
+                break;
+            case 'o':
+                print_number(arg, 8);
+                next++;
+                break;
+            case 'c':
+                put(arg);
+                next++;
+                break;
+            case 's':
+                print_string(arg);
+                next++;
+                break;
+            default:
+                put(*c);
+                break;
+        }
+    }
+    return 0;
+}
+
+unsigned Runtime::format_arguments(Word format)
+{
+    unsigned count = 0;
+    for (const Word* c = Memory::pointer(format); *c; ++c)
+    {
+        if (*c == '%' && c[1])
+        {
+            ++c;
+            if (*c == 'd' || *c == 'o' || *c == 'c' || *c == 's')
+                count++;
+        }
+    }
+    return count;
+}
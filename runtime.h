@@ -0,0 +1,73 @@
+#ifndef H_RUNTIME
+#define H_RUNTIME
+
+#include <string>
+#include <vector>
+
+#include "memory.h"
+
+/* B runtime library, the builtins listed in builtins.h. Builtins are
+ * called by index with their arguments in a contiguous block of words,
+ * missing arguments read as zero. Strings are one character per word.
+ * Output is collected in a buffer written to stdout when it's full, by
+ * flush() and exit(), before input is read and when whoever runs the
+ * program calls flush(). Input is read a buffer at a time as well. The
+ * buffers are allocated on first use; after redirect() input comes from a
+ * string and output is appended to captured(). */
+class Runtime
+{
+    static const std::size_t buffer_size = 1 << 16;
+
+    Memory& memory;
+    std::vector<char> output;
+    std::size_t output_used;
+    std::vector<char> input;
+    std::size_t input_next;
+    std::size_t input_end;
+    bool redirected;
+    std::string redirected_input;
+    std::size_t redirected_read;
+    std::string redirected_output;
+
+    void put(Word c)
+    {
+        if (output_used == output.size())
+            spill();
+        output[output_used++] = static_cast<char>(c);
+    }
+    // makes room in a full or not yet allocated output buffer
+    void spill();
+    // next character of stdin, -1 at its end
+    int get();
+
+    // the word at address, tested first if memory is checked
+    Word& word(Word address, const char* builtin);
+    void print_number(Word value, int base);
+    void print_string(Word address);
+    Word printf(const Word* args, unsigned argc);
+
+public:
+    bool exited;
+
+    Runtime(Memory& _memory)
+        : memory(_memory), output_used(0), input_next(0), input_end(0), redirected(false), redirected_read(0), exited(false) {}
+    ~Runtime() {flush();}
+    Runtime(const Runtime&) = delete;
+    Runtime& operator=(const Runtime&) = delete;
+
+    Word call(unsigned builtin, const Word* args, unsigned argc);
+    // writes the buffered output
+    void flush();
+    void redirect(const std::string& _input)
+    {
+        redirected = true;
+        redirected_input = _input;
+        redirected_read = 0;
+    }
+    const std::string& captured() const {return redirected_output;}
+
+    // number of arguments printf(format, ...) reads after the format
+    static unsigned format_arguments(Word format);
+};
+
+#endif // H_RUNTIME
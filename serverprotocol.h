@@ -0,0 +1,87 @@
+#ifndef H_SERVERPROTOCOL
+#define H_SERVERPROTOCOL
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SERVER_PROTOCOL_SUPPORTED
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/* Frames exchanged with the compile server over a Unix domain socket, a
+ * 32-bit length in the byte order of the machine followed by that many
+ * bytes. A request is the command followed by the source, a response is a
+ * status byte followed by the text or image it produced. A connection
+ * carries any number of requests, answered in order. Shared by the server
+ * and the client, which doesn't link with the compiler. */
+enum class SERVER_COMMAND : std::uint8_t
+{
+    SIGNATURES,     // functions and their parameters, one per line
+    CHECK,          // diagnostics of name resolution, one per line
+    COMPILE         // program image for the stack engine, see programimage.h
+};
+
+enum class SERVER_STATUS : std::uint8_t {OK, FAILED};
+
+const std::uint32_t max_frame_bytes = 1u << 30;
+
+#ifdef SERVER_PROTOCOL_SUPPORTED
+
+// writes all of size bytes, false if the other end went away
+inline bool send_all(int socket, const char* data, std::size_t size)
+{
+    while (size)
+    {
+        ssize_t sent = send(socket, data, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+inline bool receive_all(int socket, char* data, std::size_t size)
+{
+    while (size)
+    {
+        ssize_t received = recv(socket, data, size, 0);
+        if (received <= 0)
+            return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+inline bool send_frame(int socket, std::uint8_t kind, const char* body, std::size_t size)
+{
+    std::uint32_t length = size + 1;
+    char header[sizeof(length) + 1];
+    std::memcpy(header, &length, sizeof(length));
+    header[sizeof(length)] = static_cast<char>(kind);
+    return send_all(socket, header, sizeof(header)) && send_all(socket, body, size);
+}
+
+// the kind byte and the rest of a frame, false at the end of the connection or on a malformed frame
+inline bool receive_frame(int socket, std::uint8_t& kind, std::string& body)
+{
+    std::uint32_t length;
+    if (!receive_all(socket, reinterpret_cast<char*>(&length), sizeof(length)) || !length || length > max_frame_bytes)
+        return false;
+    char first;
+    if (!receive_all(socket, &first, 1))
+        return false;
+    kind = static_cast<std::uint8_t>(first);
+    body.resize(length - 1);
+    return receive_all(socket, &body[0], body.size());
+}
+
+#endif
+
+#endif // H_SERVERPROTOCOL
@@ -16,6 +16,7 @@ struct Variable
     const bool is_initialized;
     Identifier name;
     std::shared_ptr<Expression> expr;
+    Binding binding;
 
     Variable(Identifier _name) : is_initialized(false), name(_name) {}
     Variable(Identifier _name, Expression _expr) : is_initialized(true), name(_name), expr(std::make_shared<Expression>(_expr)) {}
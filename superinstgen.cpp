@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "opcodeprofile.h"
+
+/* Writes superinstructions.h for the sequences of instructions that save
+ * the most dispatches in the given profiles (written by the compiler with
+ * --profile-opcodes): a sequence of n instructions executed c times saves
+ * c * (n - 1). Calls, returns and HALT leave the interpreter loop and
+ * can't be part of one, jumps only at its end. Superinstructions already
+ * in the header the generator was built with are ignored, so profiles must
+ * come from runs with --no-superinstructions.
+ * Usage: superinstgen [--count N] output profile... */
+static bool fusable(OPCODE op, bool last)
+{
+    if (static_cast<int>(op) >= base_opcode_count)
+        return false;
+    switch (op)
+    {
+        case OPCODE::HALT:
+        case OPCODE::CALL:
+        case OPCODE::CALLB:
+        case OPCODE::CALLI:
+        case OPCODE::TAILCALL:
+        case OPCODE::TAILCALLI:
+        case OPCODE::RET:
+            return false;
+        case OPCODE::JMP:
+        case OPCODE::JZ:
+        case OPCODE::JNZ:
+            return last;
+        default:
+            return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t count = 16;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if (arg == "--count" && i + 1 < argc)
+            count = std::stoul(argv[++i]);
+        else
+            files.push_back(arg);
+    }
+    if (files.empty())
+    {
+        std::cerr<<"Usage: superinstgen [--count N] output profile..."<<std::endl;
+        return 1;
+    }
+
+    OpcodeProfile profile;
+    for (auto it = files.begin() + 1; it != files.end(); ++it)
+    {
+        std::ifstream in(*it);
+        if (!in.good())
+        {
+            std::cerr<<"Can't read profile "<<*it<<std::endl;
+            return 1;
+        }
+        profile.read(in);
+    }
+
+    std::vector<OpcodeProfile::Sequence> all = profile.sequences(), chosen;
+    for (auto it = all.begin(); it != all.end(); ++it)
+    {
+        bool ok = true;
+        for (std::size_t i = 0; i < it->ops.size(); ++i)
+            ok = ok && fusable(it->ops[i], i + 1 == it->ops.size());
+        if (ok)
+        {
+            it->count *= it->ops.size() - 1;
+            chosen.push_back(*it);
+        }
+    }
+    std::stable_sort(chosen.begin(), chosen.end(), [](const OpcodeProfile::Sequence& a, const OpcodeProfile::Sequence& b)
+    {
+        return a.count > b.count;
+    });
+    if (chosen.size() > count)
+        chosen.resize(count);
+
+    std::ofstream out(files.front());
+    out<<"// Generated by superinstgen, do not edit.\n";
+    out<<"// name, operand words, stack effect, then the parts with the offset of their operands\n";
+    out<<"#define SUPERINSTRUCTIONS(X, STEP)";
+    for (auto it = chosen.begin(); it != chosen.end(); ++it)
+    {
+        std::string name, parts;
+        int operands = 0, effect = 0;
+        for (auto op = it->ops.begin(); op != it->ops.end(); ++op)
+        {
+            const OpcodeInfo& info = getinfo(*op);
+            name += (name.empty() ? "" : "_") + std::string(info.name);
+            parts += " STEP(" + std::string(info.name) + ", " + std::to_string(operands) + ")";
+            operands += info.operands;
+            effect += info.stack_effect;
+        }
+        out<<" \\\n    X("<<name<<", "<<operands<<", "<<effect<<","<<parts<<")";
+        out<<" /* "<<it->count<<" dispatches saved */";
+    }
+    out<<"\n";
+    return out.good() ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+// Generated by superinstgen, do not edit.
+// name, operand words, stack effect, then the parts with the offset of their operands
+#define SUPERINSTRUCTIONS(X, STEP) \
+    X(LOADL_LOADL, 2, 2, STEP(LOADL, 0) STEP(LOADL, 1)) /* 53995884 dispatches saved */ \
+    X(LOADL_LOADL_ADD, 2, 1, STEP(LOADL, 0) STEP(LOADL, 1) STEP(ADD, 2)) /* 51300634 dispatches saved */ \
+    X(LOADL_ADD_LOAD, 1, 0, STEP(LOADL, 0) STEP(ADD, 1) STEP(LOAD, 1)) /* 40760710 dispatches saved */ \
+    X(POP_LOADL_LOADL, 2, 1, STEP(POP, 0) STEP(LOADL, 0) STEP(LOADL, 1)) /* 33114344 dispatches saved */ \
+    X(ADD_LOAD, 0, -1, STEP(ADD, 0) STEP(LOAD, 0)) /* 31079770 dispatches saved */ \
+    X(LOADL_ADD, 1, 0, STEP(LOADL, 0) STEP(ADD, 1)) /* 29510317 dispatches saved */ \
+    X(LOADL_LOADL_LOADL, 3, 3, STEP(LOADL, 0) STEP(LOADL, 1) STEP(LOADL, 2)) /* 24200550 dispatches saved */ \
+    X(LOADL_PUSH_ADD, 2, 1, STEP(LOADL, 0) STEP(PUSH, 1) STEP(ADD, 2)) /* 22624838 dispatches saved */ \
+    X(POP_LOADL, 1, 0, STEP(POP, 0) STEP(LOADL, 0)) /* 21617219 dispatches saved */ \
+    X(LOADL_PUSH, 2, 2, STEP(LOADL, 0) STEP(PUSH, 1)) /* 19856871 dispatches saved */ \
+    X(STOREL_POP_LOADL, 2, 0, STEP(STOREL, 0) STEP(POP, 1) STEP(LOADL, 1)) /* 18739274 dispatches saved */ \
+    X(PUSH_ADD_ADD, 1, -1, STEP(PUSH, 0) STEP(ADD, 1) STEP(ADD, 1)) /* 17198000 dispatches saved */ \
+    X(ADD_LOAD_LOADL, 1, 0, STEP(ADD, 0) STEP(LOAD, 0) STEP(LOADL, 0)) /* 17119608 dispatches saved */ \
+    X(PUSH_ADD, 1, 0, STEP(PUSH, 0) STEP(ADD, 1)) /* 16612224 dispatches saved */ \
+    X(ADD_LOAD_PUSH, 1, 0, STEP(ADD, 0) STEP(LOAD, 0) STEP(PUSH, 0)) /* 16199080 dispatches saved */ \
+    X(ADD_ADD_LOAD, 0, -2, STEP(ADD, 0) STEP(ADD, 0) STEP(LOAD, 0)) /* 15398400 dispatches saved */ \
+    X(POSTINCL_POP_LOADL, 3, 1, STEP(POSTINCL, 0) STEP(POP, 2) STEP(LOADL, 2)) /* 14757516 dispatches saved */ \
+    X(LOADL_LOADL_PUSH, 3, 3, STEP(LOADL, 0) STEP(LOADL, 1) STEP(PUSH, 2)) /* 14618810 dispatches saved */ \
+    X(LOADL_LOADL_NE, 2, 1, STEP(LOADL, 0) STEP(LOADL, 1) STEP(NE, 2)) /* 13671280 dispatches saved */ \
+    X(STOREL_POP, 1, -1, STEP(STOREL, 0) STEP(POP, 1)) /* 13500216 dispatches saved */ \
+    X(LOAD_LOADL_LOADL, 2, 2, STEP(LOAD, 0) STEP(LOADL, 0) STEP(LOADL, 1)) /* 13399600 dispatches saved */ \
+    X(ADD_LOAD_ADD, 0, -2, STEP(ADD, 0) STEP(LOAD, 0) STEP(ADD, 0)) /* 12000800 dispatches saved */ \
+    X(LOADL_NE_JNZ, 2, -1, STEP(LOADL, 0) STEP(NE, 1) STEP(JNZ, 1)) /* 11751264 dispatches saved */ \
+    X(LOADL_PUSH_EQ, 2, 1, STEP(LOADL, 0) STEP(PUSH, 1) STEP(EQ, 2)) /* 11701758 dispatches saved */
@@ -0,0 +1,60 @@
+#include "tailcalls.h"
+
+bool TailCalls::allowed(Function& function)
+{
+    return !takes_address(function.getbody());
+}
+
+const Expression* TailCalls::call(const Statement& stmt)
+{
+    if (stmt.type != STATEMENT_TYPE::RETURN || !stmt.expr)
+        return nullptr;
+    const Expression* expr = stmt.expr.get();
+    while (expr->type == EXPR_TYPE::PARENTHESIS)
+        expr = &expr->expressions->front();
+    if (expr->type != EXPR_TYPE::FUNC_CALL)
+        return nullptr;
+    // builtins don't take a frame, so calling them as usual already keeps the stack flat
+    const Expression& callee = expr->expressions->front();
+    if (callee.type == EXPR_TYPE::IDENTIFIER && callee.binding.type == IDTYPE::BUILTIN)
+        return nullptr;
+    return expr;
+}
+
+bool TailCalls::takes_address(const Statement& stmt)
+{
+    if (stmt.expr && takes_address(*stmt.expr))
+        return true;
+    if (stmt.vars)
+    {
+        for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            if (it->is_initialized && takes_address(*it->expr))
+                return true;
+    }
+    if (stmt.body)
+    {
+        for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+            if (takes_address(*it))
+                return true;
+    }
+    return false;
+}
+
+bool TailCalls::takes_address(const Expression& expr)
+{
+    if (!expr.expressions)
+        return false;
+    if (expr.type == EXPR_TYPE::UNARY_AMP)
+    {
+        const Expression* operand = &expr.expressions->front();
+        while (operand->type == EXPR_TYPE::PARENTHESIS)
+            operand = &operand->expressions->front();
+        if (operand->type == EXPR_TYPE::IDENTIFIER &&
+            (operand->binding.type == IDTYPE::VARIABLE || operand->binding.type == IDTYPE::PARAMETER))
+            return true;
+    }
+    for (auto it = expr.expressions->begin(); it != expr.expressions->end(); ++it)
+        if (takes_address(*it))
+            return true;
+    return false;
+}
@@ -0,0 +1,28 @@
+#ifndef H_TAILCALLS
+#define H_TAILCALLS
+
+#include "expression.h"
+#include "statement.h"
+#include "function.h"
+
+/* Calls in tail position, return f(...) with f a function or any
+ * expression giving a function value, but not a builtin. The backends run
+ * them in the caller's frame instead of a new one, so recursion through them
+ * needs no stack at all. That's only done in functions that never take the
+ * address of a local, since such an address could be passed to the callee
+ * and its frame would overwrite the variable. Native code passes at most
+ * sixteen arguments that way (see X64Codegen::argument_area); a tail
+ * call with more is an ordinary call there. */
+class TailCalls
+{
+    static bool takes_address(const Statement& stmt);
+    static bool takes_address(const Expression& expr);
+
+public:
+    // whether calls in tail position of the function may reuse its frame
+    static bool allowed(Function& function);
+    // the call whose value stmt returns, if it's a return statement with a call of anything but a builtin
+    static const Expression* call(const Statement& stmt);
+};
+
+#endif // H_TAILCALLS
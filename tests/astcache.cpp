@@ -0,0 +1,61 @@
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include <stdlib.h>
+
+#include "check.h"
+#include "astcache.h"
+#include "lazyparser.h"
+#include "debugprinter.h"
+
+namespace fs = std::filesystem;
+
+static std::string dump(const Library& lib)
+{
+    std::stringstream output;
+    std::streambuf* original = std::cout.rdbuf(output.rdbuf());
+    DebugPrinter::print_debug_library(lib, true, 0);
+    std::cout.rdbuf(original);
+    return output.str();
+}
+
+static fs::path entry(const fs::path& directory, const std::string& source)
+{
+    std::uint64_t key = AstCache::hash(source.data(), source.size());
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.ast", static_cast<unsigned long long>(key));
+    return directory / name;
+}
+
+int main()
+{
+    char pattern[] = "/tmp/astcacheXXXXXX";
+    if (!mkdtemp(pattern))
+        return 1;
+    fs::path directory = pattern;
+
+    std::shared_ptr<std::string> first = std::make_shared<std::string>("main: return 1;\n");
+    std::shared_ptr<std::string> second = std::make_shared<std::string>("main: return 2;\n");
+    {
+        AstCache cache(directory.string());
+        CHECK(dump(cache.parse(first)) == dump(LazyParser::parse(first)));
+        CHECK(dump(cache.parse(first)) == dump(LazyParser::parse(first)));
+        CHECK(cache.misses == 1 && cache.hits == 1);
+    }
+
+    // an entry found under the hash of another source of the same size, as on a collision, isn't used for it
+    fs::rename(entry(directory, *first), entry(directory, *second));
+    {
+        AstCache cache(directory.string());
+        CHECK(dump(cache.parse(second)) == dump(LazyParser::parse(second)));
+        CHECK(cache.misses == 1 && cache.hits == 0);
+        CHECK(dump(cache.parse(second)) == dump(LazyParser::parse(second)));
+        CHECK(cache.hits == 1);
+    }
+
+    fs::remove_all(directory);
+    return failed_checks;
+}
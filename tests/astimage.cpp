@@ -0,0 +1,127 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "astimage.h"
+#include "lazyparser.h"
+
+// the nodes under a node and the characters of their strings, following every offset in them
+static std::size_t walk(const AstImage::ExpressionView& expr)
+{
+    std::size_t nodes = 1;
+    for (std::size_t i = 0; i < expr.size(); ++i)
+        nodes += walk(expr[i]);
+    if (expr.has_str())
+        nodes += expr.str_val().size();
+    return nodes;
+}
+
+static std::size_t walk(const AstImage::StatementView& stmt)
+{
+    std::size_t nodes = 1;
+    for (std::size_t i = 0; i < stmt.size(); ++i)
+        nodes += walk(stmt[i]);
+    if (stmt.has_expr())
+        nodes += walk(stmt.expr());
+    for (std::size_t i = 0; i < stmt.var_count(); ++i)
+        nodes += 1 + stmt.var(i).name().size() + (stmt.var(i).is_initialized() ? walk(stmt.var(i).expr()) : 0);
+    return nodes;
+}
+
+static std::size_t walk(const std::string& path)
+{
+    AstImage image(path);
+    std::size_t nodes = 0;
+    for (std::size_t i = 0; i < image.functions(); ++i)
+    {
+        AstImage::FunctionView function = image.function(i);
+        nodes += function.name().size();
+        for (std::size_t param = 0; param < function.param_count(); ++param)
+            nodes += function.param(param).size();
+        nodes += walk(function.body());
+    }
+    return nodes;
+}
+
+static std::vector<char> read(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void write(const std::string& path, const std::vector<char>& bytes)
+{
+    std::ofstream file(path, std::ios::binary);
+    file.write(bytes.data(), bytes.size());
+}
+
+// the image with the body offset of its first function replaced
+static std::vector<char> with_body(std::vector<char> bytes, std::int32_t body)
+{
+    std::memcpy(bytes.data() + sizeof(AstImage::Header) + offsetof(AstImage::FunctionRecord, body), &body, sizeof(body));
+    return bytes;
+}
+
+int main()
+{
+    char pattern[] = "/tmp/astimageXXXXXX";
+    int fd = mkstemp(pattern);
+    if (fd < 0)
+        return 1;
+    close(fd);
+    const std::string path = pattern;
+
+    Library lib = LazyParser::parse(std::make_shared<std::string>(
+        "count n, total: {\n"
+        "    if (n == 0)\n"
+        "        return total;\n"
+        "    return count(n - 1, total + n);\n"
+        "}\n"
+        "main: {\n"
+        "    var i = 0, a;\n"
+        "    while (i != 10)\n"
+        "        a += count(i++, 0);\n"
+        "    printf(\"%d*n\", a);\n"
+        "    return a;\n"
+        "}\n"));
+    AstImage::write(lib, path);
+    const std::vector<char> image = read(path);
+    const std::size_t nodes = walk(path);
+    CHECK(nodes > 0);
+
+    // a truncated image isn't opened
+    std::vector<char> truncated(image.begin(), image.end() - 12);
+    write(path, truncated);
+    CHECK_THROWS(AstImage opened(path), std::runtime_error);
+    write(path, std::vector<char>(image.begin(), image.begin() + sizeof(AstImage::Header) / 2));
+    CHECK_THROWS(AstImage opened(path), std::runtime_error);
+
+    // offsets past either end of the image, or not at a whole record, throw when they're followed
+    std::int32_t body;
+    std::memcpy(&body, image.data() + sizeof(AstImage::Header) + offsetof(AstImage::FunctionRecord, body), sizeof(body));
+    const std::int32_t damaged[] = {0x10000000, -0x10000000, static_cast<std::int32_t>(image.size()),
+                                    static_cast<std::int32_t>(image.size() - sizeof(AstImage::Header) - 4),
+                                    -static_cast<std::int32_t>(sizeof(AstImage::Header) + 4), body + 1, body + 2};
+    for (std::int32_t offset : damaged)
+    {
+        write(path, with_body(image, offset));
+        CHECK_THROWS(walk(path), std::runtime_error);
+    }
+
+    // and the image as written walks the same after all that
+    write(path, with_body(image, body));
+    CHECK(walk(path) == nodes);
+
+    std::remove(path.c_str());
+    return failed_checks;
+}
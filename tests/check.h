@@ -0,0 +1,40 @@
+#ifndef H_TESTS_CHECK
+#define H_TESTS_CHECK
+
+#include <iostream>
+
+// Each test program counts the checks that failed and returns how many
+// there were, so that ctest reports it as failed with the lines in its output.
+static int failed_checks = 0;
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::cerr<<__FILE__<<":"<<__LINE__<<": check failed: "<<#condition<<std::endl; \
+            failed_checks++; \
+        } \
+    } while (0)
+
+// runs a statement that should throw an exception of the given type
+#define CHECK_THROWS(statement, exception) \
+    do \
+    { \
+        bool thrown = false; \
+        try \
+        { \
+            statement; \
+        } \
+        catch (const exception&) \
+        { \
+            thrown = true; \
+        } \
+        if (!thrown) \
+        { \
+            std::cerr<<__FILE__<<":"<<__LINE__<<": no "<<#exception<<" thrown by "<<#statement<<std::endl; \
+            failed_checks++; \
+        } \
+    } while (0)
+
+#endif // H_TESTS_CHECK
@@ -0,0 +1,105 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "lazyparser.h"
+#include "context.h"
+#include "threadpool.h"
+#include "bytecodecompiler.h"
+#include "vm.h"
+#include "jit.h"
+#include "tieredvm.h"
+
+static Library analysed(const std::string& text)
+{
+    Library lib = LazyParser::parse(std::make_shared<std::string>(text + "\n"));
+    ThreadPool pool(1);
+    CHECK(Context::analyse(lib, pool).empty());
+    return lib;
+}
+
+// the lhs of a compound assignment is read before its rhs changes it
+static const std::string compound =
+    "bump p: {\n"
+    "    *p += 10;\n"
+    "    return 1;\n"
+    "}\n"
+    "plus: {\n"
+    "    var a = 1;\n"
+    "    a += ++a;\n"
+    "    return a;\n"
+    "}\n"
+    "minus: {\n"
+    "    var b = 1;\n"
+    "    b -= b++;\n"
+    "    return b;\n"
+    "}\n"
+    "indexed: {\n"
+    "    var v = getvec(1);\n"
+    "    v[0] = 1;\n"
+    "    v[0] += v[0]++;\n"
+    "    return v[0];\n"
+    "}\n"
+    "called: {\n"
+    "    var c = 1;\n"
+    "    c += bump(&c);\n"
+    "    return c;\n"
+    "}\n"
+    "main: return 0;\n";
+
+static const char* const entries[] = {"plus", "minus", "indexed", "called"};
+
+// step goes native while loop is running, each of its calls must add 1 to the total either way
+static const std::string tiering =
+    "step n, v: {\n"
+    "    var a = n;\n"
+    "    a += ++a;\n"
+    "    v[0] -= v[0]++;\n"
+    "    return a - n - n;\n"
+    "}\n"
+    "main: {\n"
+    "    var i = 0, total = 0, v = getvec(1);\n"
+    "    while (i != 200000) {\n"
+    "        total += step(i, v);\n"
+    "        total += v[0];\n"
+    "        i++;\n"
+    "    }\n"
+    "    return total;\n"
+    "}\n";
+
+int main()
+{
+    Library lib = analysed(compound);
+    Program program = BytecodeCompiler::compile(lib);
+    VM vm(program);
+    CHECK(vm.run("plus") == 3);
+    CHECK(vm.run("minus") == 0);
+    CHECK(vm.run("indexed") == 2);
+    CHECK(vm.run("called") == 2);
+
+    Jit jit(lib);
+    for (const char* entry : entries)
+    {
+        Word expected = vm.run(entry), actual = jit.run(entry);
+        if (actual != expected)
+            std::cerr<<entry<<" returned "<<actual<<" from the JIT, "<<expected<<" from the stack VM"<<std::endl;
+        CHECK(actual == expected);
+    }
+
+    Library tiered_lib = analysed(tiering);
+    Program tiered_program = BytecodeCompiler::compile(tiered_lib);
+    VM interpreter(tiered_program);
+    CHECK(interpreter.run("main") == 200000);
+    TierThresholds thresholds;
+    thresholds.calls = 100;
+    TieredVM tiered(tiered_lib, tiered_program, thresholds);
+    CHECK(tiered.run("main") == 200000);
+    // and step did run natively for some of the calls
+    bool installed = false;
+    std::vector<TieredVM::TierUp> tierups = tiered.gettierups();
+    for (auto it = tierups.begin(); it != tierups.end(); ++it)
+        installed = installed || (it->function == 0 && it->installed >= 0);
+    CHECK(installed);
+    return failed_checks;
+}
@@ -0,0 +1,120 @@
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "lazyparser.h"
+#include "context.h"
+#include "threadpool.h"
+#include "bytecodecompiler.h"
+#include "vm.h"
+#include "regcompiler.h"
+#include "regvm.h"
+#include "jit.h"
+#include "tieredvm.h"
+
+static Library analysed(const std::string& text)
+{
+    Library lib = LazyParser::parse(std::make_shared<std::string>(text + "\n"));
+    ThreadPool pool(1);
+    CHECK(Context::analyse(lib, pool).empty());
+    return lib;
+}
+
+// the message of the error running entry ends with, empty if it returned
+template <typename Engine>
+static std::string error_of(Engine& engine, const std::string& entry = "main")
+{
+    try
+    {
+        engine.run(entry);
+    }
+    catch (const std::runtime_error& e)
+    {
+        return e.what();
+    }
+    return std::string();
+}
+
+static bool starts_with(const std::string& text, const std::string& prefix)
+{
+    if (text.compare(0, prefix.size(), prefix) != 0)
+    {
+        std::cerr<<"'"<<text<<"' doesn't start with '"<<prefix<<"'"<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    // recursion deeper than the machine stack is an error in native code, as it is in the interpreters,
+    // with the same message from every engine
+    Library deep = analysed(
+        "down n: {\n"
+        "    if (n == 0)\n"
+        "        return 0;\n"
+        "    return 1 + down(n - 1);\n"
+        "}\n"
+        "main: return down(100000000);\n"
+        "shallow: return down(1000);\n");
+    Program program = BytecodeCompiler::compile(deep);
+    {
+        VM vm(program);
+        CHECK(starts_with(error_of(vm), "Stack overflow in 'down'"));
+    }
+    {
+        Jit jit(deep);
+        CHECK(starts_with(error_of(jit), "Stack overflow in 'down'"));
+        // and the machine stack is usable again afterwards
+        CHECK(error_of(jit).find("Stack overflow") == 0);
+        CHECK(jit.run("shallow") == 1000);
+    }
+    {
+        TierThresholds thresholds;
+        thresholds.calls = 1;
+        TieredVM vm(deep, program, thresholds);
+        CHECK(starts_with(error_of(vm), "Stack overflow in 'down'"));
+    }
+    {
+        Program registers = RegisterCompiler::compile(deep);
+        RegisterVM vm(registers);
+        CHECK(starts_with(error_of(vm), "Stack overflow in 'down'"));
+    }
+
+    // faults name the function they happened in, "x" is the last word of the statics before their guard page
+    Library faulty = analysed(
+        "peek p, n: {\n"
+        "    if (n)\n"
+        "        return peek(p, n - 1);\n"
+        "    return p[2];\n"
+        "}\n"
+        "main: return peek(\"x\", 3) + peek(\"x\", 3);\n"
+        "builtin: return char(\"x\", 2);\n");
+    Program faulty_program = BytecodeCompiler::compile(faulty);
+    {
+        Jit jit(faulty);
+        CHECK(starts_with(error_of(jit), "Memory fault in 'peek'"));
+    }
+    {
+        VM vm(faulty_program);
+        CHECK(starts_with(error_of(vm), "Memory fault in 'peek'"));
+    }
+
+    // the same fault in a builtin is a bug of the host, which isn't caught
+    pid_t child = fork();
+    if (child == 0)
+    {
+        VM vm(faulty_program);
+        error_of(vm, "builtin");
+        _exit(0);
+    }
+    int status = 0;
+    CHECK(child > 0 && waitpid(child, &status, 0) == child);
+    CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+    return failed_checks;
+}
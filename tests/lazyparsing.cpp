@@ -0,0 +1,110 @@
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "check.h"
+#include "lexer.h"
+#include "parser.h"
+#include "lazyparser.h"
+#include "debugprinter.h"
+
+// the --testcase form of a library, which parses lazy bodies as it goes
+static std::string dump(const Library& lib)
+{
+    std::stringstream output;
+    std::streambuf* original = std::cout.rdbuf(output.rdbuf());
+    DebugPrinter::print_debug_library(lib, true, 0);
+    std::cout.rdbuf(original);
+    return output.str();
+}
+
+static Library parse_eagerly(std::string source)
+{
+    Lexer lexer(&source);
+    Parser parser;
+    Token t;
+    do
+    {
+        t = lexer.next();
+        parser.feed(t);
+    } while (t.type != TOKEN_EOF);
+    return parser.finish();
+}
+
+// bodies are parsed only when asked for, and then into what the parser makes of the whole source
+static void check_same_as_eager(const std::string& text)
+{
+    std::shared_ptr<std::string> source = std::make_shared<std::string>(text + "\n");
+    Library lazy = LazyParser::parse(source);
+    Library eager = parse_eagerly(*source);
+
+    CHECK(lazy.functions.size() == eager.functions.size());
+    for (auto it = lazy.functions.begin(); it != lazy.functions.end(); ++it)
+        CHECK(!it->isparsed());
+    std::string expected = dump(eager), actual = dump(lazy);
+    if (actual != expected)
+        std::cerr<<"lazily parsed:\n"<<actual<<"parsed eagerly:\n"<<expected;
+    CHECK(actual == expected);
+    for (auto it = lazy.functions.begin(); it != lazy.functions.end(); ++it)
+        CHECK(it->isparsed());
+}
+
+int main()
+{
+    check_same_as_eager(
+        "count n, total: {\n"
+        "    if (n == 0)\n"
+        "        return total;\n"
+        "    return count(n - 1, total + n);\n"
+        "}\n"
+        "main: {\n"
+        "    var i = 0, a, b = i ? 1 : -1;\n"
+        "    a = &b;\n"
+        "    while (i != 10) {\n"
+        "        if (i == 2 || !(i - 3) && b) { *a = (i + 1) - 2; }\n"
+        "        a[0] += count(i++, 0);\n"
+        "    }\n"
+        "    ;\n"
+        "    return b;\n"
+        "}\n");
+
+    // functions whose body is a single statement
+    check_same_as_eager(
+        "twice x: x + x;\n"
+        "loop n: while (n) n--;\n"
+        "pick c, a, b: if (c) return a;\n"
+        "main: 0;\n");
+
+    // braces, brackets and semicolons that don't delimit anything
+    check_same_as_eager(
+        "braces: {\n"
+        "    printf(\"} { ; ] [ )*n\");\n"
+        "    // } a closing brace in a comment\n"
+        "    /* { an opening one, and a ; */\n"
+        "    return \"{\"[0];\n"
+        "}\n"
+        "/* } between functions { */\n"
+        "main: { braces(); return 0; } // {\n");
+
+    // the function ranges are cut at the end of each body, not at the next name
+    std::shared_ptr<std::string> source = std::make_shared<std::string>("f a: { return a; } g: f(1);\nmain: g();\n");
+    Library lib = LazyParser::parse(source);
+    CHECK(lib.functions.size() == 3);
+    CHECK(lib.functions[1].name == "g");
+    CHECK(lib.functions[1].getbody().type == STATEMENT_TYPE::EXPRESSION);
+    CHECK(!lib.functions[0].isparsed());
+    CHECK(!lib.functions[2].isparsed());
+
+    CHECK_THROWS(LazyParser::parse(std::make_shared<std::string>("main: { return 0;\n")), std::logic_error);
+    CHECK_THROWS(LazyParser::parse(std::make_shared<std::string>("main 0;\n")), std::logic_error);
+
+    // syntax errors in a body throw when it's parsed, also those the default actions of the grammar would loop on
+    const char* wrong[] = {"main: { return 1 + ; }\n", "main: { return ) ; }\n", "main: { var 1; }\n", "main: { f(1,); }\n"};
+    for (const char* text : wrong)
+    {
+        Library broken = LazyParser::parse(std::make_shared<std::string>(text));
+        CHECK_THROWS(broken.functions[0].getbody(), std::logic_error);
+        CHECK_THROWS(parse_eagerly(text), std::logic_error);
+    }
+    return failed_checks;
+}
@@ -0,0 +1,126 @@
+#include <sstream>
+#include <string>
+
+#include "check.h"
+#include "lexer.h"
+#include "parser.h"
+#include "persistentstack.h"
+#include "debugprinter.h"
+
+static std::string dump(const Library& lib)
+{
+    std::stringstream output;
+    std::streambuf* original = std::cout.rdbuf(output.rdbuf());
+    DebugPrinter::print_debug_library(lib, true, 0);
+    std::cout.rdbuf(original);
+    return output.str();
+}
+
+// feeds tokens until the end of the stream, or until count of them have been fed
+static std::size_t feed(Parser& parser, Lexer& lexer, std::size_t count = std::size_t(-1))
+{
+    std::size_t fed = 0;
+    for (; fed < count; ++fed)
+    {
+        Token t = lexer.next();
+        parser.feed(t);
+        if (t.type == TOKEN_EOF)
+            return fed + 1;
+    }
+    return fed;
+}
+
+static std::string parse(std::string source)
+{
+    Lexer lexer(&source);
+    Parser parser;
+    feed(parser, lexer);
+    return dump(parser.finish());
+}
+
+static const std::string source =
+    "count n, total: {\n"
+    "    if (n == 0)\n"
+    "        return total;\n"
+    "    return count(n - 1, total + n);\n"
+    "}\n"
+    "main: {\n"
+    "    var i = 0, a, b = i ? 1 : -1;\n"
+    "    while (i != 10)\n"
+    "        a += count(i++, b) - a[i];\n"
+    "    return a;\n"
+    "}\n";
+
+int main()
+{
+    const std::string expected = parse(source);
+
+    // a snapshot after any token rewinds to exactly that point, even after
+    // what was parsed since then has been finished, and can be restored twice
+    std::size_t tokens;
+    {
+        std::string text = source;
+        Lexer lexer(&text);
+        Parser parser;
+        tokens = feed(parser, lexer);
+    }
+    for (std::size_t i = 0; i < tokens; ++i)
+    {
+        std::string text = source;
+        Lexer lexer(&text);
+        Parser parser;
+        feed(parser, lexer, i);
+        ParserSnapshot snap = parser.snapshot(lexer);
+        feed(parser, lexer);
+        CHECK(dump(parser.finish()) == expected);
+
+        parser.restore(snap, lexer);
+        feed(parser, lexer);
+        std::string restored = dump(parser.finish());
+        if (restored != expected)
+            std::cerr<<"restored after "<<i<<" tokens:\n"<<restored;
+        CHECK(restored == expected);
+
+        parser.restore(snap, lexer);
+        feed(parser, lexer);
+        CHECK(dump(parser.finish()) == expected);
+    }
+
+    // restoring seeks the lexer into a stream that has grown since the snapshot
+    {
+        std::string text = "first a: a;\n";
+        Lexer lexer(&text);
+        Parser parser;
+        feed(parser, lexer, 4);
+        ParserSnapshot snap = parser.snapshot(lexer);
+        text += "second: first(1);\nmain: { return second(); }\n";
+        parser.restore(snap, lexer);
+        feed(parser, lexer);
+        CHECK(dump(parser.finish()) == parse(text));
+    }
+
+    {
+        std::string text = source;
+        Lexer lexer(&text);
+        LexerPosition past_end = {text.size() + 1, 1};
+        CHECK_THROWS(lexer.seek(past_end), std::logic_error);
+    }
+
+    // assigning over or destroying a long stack releases it without recursing through its nodes
+    {
+        PersistentStack<int> stack, shared;
+        for (int i = 0; i < (1 << 21); ++i)
+            stack.push(i);
+        shared = stack;
+        stack.top() = -1;
+        stack = stack;
+        CHECK(stack.size() == (1 << 21) && stack.top() == -1 && shared.top() == (1 << 21) - 1);
+        shared = PersistentStack<int>();
+        CHECK(shared.empty());
+        stack.pop();
+        CHECK(stack.top() == (1 << 21) - 2);
+        stack = PersistentStack<int>();
+        CHECK(stack.empty() && stack.size() == 0);
+    }
+    return failed_checks;
+}
@@ -0,0 +1,126 @@
+#ifndef H_THREADPOOL
+#define H_THREADPOOL
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_ready;
+    std::condition_variable all_done;
+    std::size_t pending;
+    bool stopping;
+    std::exception_ptr failure;
+
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                task_ready.wait(lock, [this]() {return stopping || !tasks.empty();});
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!failure)
+                    failure = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0)
+                all_done.notify_all();
+        }
+    }
+
+public:
+    ThreadPool(unsigned threads = std::thread::hardware_concurrency()) : pending(0), stopping(false)
+    {
+        if (!threads)
+            threads = 1;
+        for (unsigned i = 0; i < threads; ++i)
+            workers.push_back(std::thread(&ThreadPool::work, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        task_ready.notify_all();
+        for (auto it = workers.begin(); it != workers.end(); ++it)
+            it->join();
+    }
+
+    unsigned size() const
+    {
+        return workers.size();
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+            pending++;
+        }
+        task_ready.notify_one();
+    }
+
+    // blocks until every submitted task has finished, rethrows the first exception thrown by a task
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        all_done.wait(lock, [this]() {return pending == 0;});
+        if (failure)
+        {
+            std::exception_ptr e = failure;
+            failure = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    // calls body(i) for every i in [0, count), workers take indices in batches of grain
+    void parallel_for(std::size_t count, std::function<void(std::size_t)> body, std::size_t grain = 16)
+    {
+        std::shared_ptr<std::atomic<std::size_t>> next = std::make_shared<std::atomic<std::size_t>>(0);
+        for (unsigned t = 0; t < size(); ++t)
+        {
+            submit([next, count, grain, &body]()
+            {
+                std::size_t begin;
+                while ((begin = next->fetch_add(grain)) < count)
+                {
+                    std::size_t end = std::min(begin + grain, count);
+                    for (std::size_t i = begin; i < end; ++i)
+                        body(i);
+                }
+            });
+        }
+        wait();
+    }
+};
+
+#endif // H_THREADPOOL
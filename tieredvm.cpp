@@ -0,0 +1,448 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "tieredvm.h"
+#include "jitemitter.h"
+#include "x64codegen.h"
+#include "builtins.h"
+#include "dispatch.h"
+
+#define VM_OPCODE_ENUM OPCODE
+
+// jumps to destination, counting it against the running function if it's a loop back edge
+#define TIERED_JUMP(destination) \
+    do { \
+        const Word* target = (destination); \
+        if (target < pc && ++loops_taken[current] == thresholds.loops) \
+            request(current); \
+        pc = target; \
+    } while (0)
+
+static_assert(sizeof(std::atomic<const void*>) == sizeof(const void*), "generated code reads the call table directly");
+
+thread_local TieredVM* TieredVM::active = nullptr;
+
+TieredVM::TieredVM(Library& _library, const Program& _program, TierThresholds _thresholds,
+                   std::size_t heap_words, std::size_t stack_words)
+    : library(_library), program(_program), thresholds(_thresholds),
+      argument_area(X64Codegen::argument_area(_library)), memory(_program.statics, heap_words, stack_words), runtime(memory), natives(runtime),
+      table(builtins.size() + _program.functions.size()), native_code(_program.functions.size()), calls_made(_program.functions.size()),
+      loops_taken(_program.functions.size()), requested(_program.functions.size()), stopping(false),
+      operands(stack_words), operand_top(nullptr), frame_top(nullptr), max_calls(stack_words), executed(0),
+      compiler(1)
+{
+    JitEmitter emitter(nullptr);
+    std::vector<std::size_t> offsets;
+    for (unsigned i = 0; i < program.functions.size(); ++i)
+        offsets.push_back(emitter.forwarder(i, reinterpret_cast<const void*>(&forward)));
+    forwarder_code.reset(new ExecutableMemory(emitter, nullptr));
+
+    for (unsigned i = 0; i < builtins.size(); ++i)
+        table[builtins.size() - 1 - i].store(JitRuntime::builtin(i));
+    for (unsigned i = 0; i < program.functions.size(); ++i)
+    {
+        forwarders.push_back(forwarder_code->at(offsets[i]));
+        table[builtins.size() + i].store(forwarders[i]);
+    }
+}
+
+TieredVM::~TieredVM()
+{
+    stopping = true;
+}
+
+Word TieredVM::run(const Identifier& entry)
+{
+    int entry_index = program.find(entry);
+    if (entry_index < 0)
+        throw std::runtime_error("No function named '" + entry + "'");
+
+    JitRuntime* outer_natives = natives.activate();
+    TieredVM* outer = active;
+    active = this;
+    runtime.exited = false;
+    natives.error = nullptr;
+    calls.clear();
+    executed = 0;
+    operand_top = operands.data();
+    frame_top = memory.frames_begin();
+    started = std::chrono::steady_clock::now();
+
+    Word result = 0;
+    MemoryTrap trap(memory, [this](const void* instruction) {return MemoryTrap::interpreter(instruction) || native(instruction);});
+    if (MEMORY_TRAPPED(trap))
+        natives.error = std::make_exception_ptr(std::runtime_error(memory.fault(trap, function_at(trap.instruction))));
+    else if (!setjmp(natives.exit_point))
+    {
+        try
+        {
+            result = execute(entry_index, nullptr, 0);
+        }
+        catch (...)
+        {
+            natives.error = std::current_exception();
+        }
+    }
+    active = outer;
+    JitRuntime::restore(outer_natives);
+    runtime.flush();
+
+    if (natives.error)
+        std::rethrow_exception(natives.error);
+    return result;
+}
+
+std::string TieredVM::function_at(const void* instruction)
+{
+    {
+        std::lock_guard<std::mutex> lock(compiled_mutex);
+        for (std::size_t i = 0; i < compiled_code.size(); ++i)
+            if (instruction && compiled_code[i]->contains(instruction))
+                return program.functions[compiled_functions[i]].name;
+    }
+    return calls.empty() ? std::string() : program.functions[calls.back().function].name;
+}
+
+// without taking compiled_mutex, it's called by the handler of a fault
+bool TieredVM::native(const void* instruction) const
+{
+    for (auto it = native_code.begin(); it != native_code.end(); ++it)
+    {
+        const ExecutableMemory* code = it->load(std::memory_order_acquire);
+        if (code && code->contains(instruction))
+            return true;
+    }
+    return false;
+}
+
+std::vector<TieredVM::TierUp> TieredVM::gettierups()
+{
+    std::lock_guard<std::mutex> lock(compiled_mutex);
+    return tierups;
+}
+
+void TieredVM::request(unsigned function)
+{
+    if (requested[function])
+        return;
+    requested[function] = true;
+    if (program.functions[function].params > max_native_params)
+        return;
+
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+        std::lock_guard<std::mutex> lock(compiled_mutex);
+        tierups.push_back(TierUp{function, calls_made[function], loops_taken[function], elapsed.count(), -1, 0});
+    }
+    compiler.submit([this, function]() {compile(function);});
+}
+
+// runs on the compiler thread
+void TieredVM::compile(unsigned function)
+{
+    if (stopping)
+        return;
+
+    JitEmitter emitter(reinterpret_cast<const void* const*>(table.data() + builtins.size()));
+    X64Codegen::generate(library, emitter, function, program, argument_area);
+    std::unique_ptr<ExecutableMemory> code(new ExecutableMemory(emitter, Memory::pointer(memory.statics())));
+    const void* entry = code->at(emitter.getfunction(function));
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+    std::lock_guard<std::mutex> lock(compiled_mutex);
+    native_code[function].store(code.get(), std::memory_order_release);
+    compiled_code.push_back(std::move(code));
+    compiled_functions.push_back(function);
+    for (auto it = tierups.begin(); it != tierups.end(); ++it)
+    {
+        if (it->function == function)
+        {
+            it->installed = elapsed.count();
+            it->bytes = emitter.getcode().size();
+        }
+    }
+    table[builtins.size() + function].store(entry, std::memory_order_release);
+}
+
+// missing arguments are passed as zero, native code ignores the extra ones
+Word TieredVM::call_native(const void* code, const Word* args, unsigned argc, unsigned params)
+{
+    Word a[max_native_params] = {};
+    std::copy(args, args + std::min(argc, params), a);
+    return reinterpret_cast<X64Function>(code)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7],
+                                               a[8], a[9], a[10], a[11], a[12], a[13], a[14], a[15]);
+}
+
+// called by the forwarders when native code calls a function that's still interpreted
+Word TieredVM::forward(Word function, const Word* register_args, const Word* stack_args)
+{
+    // no locals with destructors, exit() longjmps out of here from the interpreter
+    TieredVM* vm = active;
+    try
+    {
+        unsigned params = vm->program.functions[function].params;
+        vm->forwarded.resize(params);
+        for (unsigned i = 0; i < params; ++i)
+            vm->forwarded[i] = i < 6 ? register_args[i] : stack_args[i - 6];
+        return vm->execute(function, vm->forwarded.data(), params);
+    }
+    catch (...)
+    {
+        vm->natives.error = std::current_exception();
+    }
+    vm->natives.unwind();
+}
+
+/* The interpreter, VM::run with counters. It's reentered by forward(), a
+ * nested run starts at operand_top and frame_top, which are updated before
+ * every call into native code, and returns when its entry returns. */
+Word TieredVM::execute(unsigned entry, const Word* args, unsigned argc_passed)
+{
+#ifdef VM_COMPUTED_GOTO
+    static void* const dispatch_table[] = {BYTECODE_OPCODES(VM_LABEL_ADDRESS)};
+#endif
+
+    const Word* const code = program.code.data();
+    const Word statics = memory.statics();
+    Word* const frames_end = memory.frames_end();
+    Word* const operands_end = operands.data() + operands.size();
+    const std::size_t base = calls.size();
+
+    const Word* pc = nullptr;
+    Word* sp = operand_top;
+    Word* fp = nullptr;
+    Word* frames = frame_top;
+    unsigned current = entry;
+    Word result = 0;
+
+    // the entry is called like any other function, with its arguments on the operand stack
+    Word callee = entry;
+    Word argc = argc_passed;
+    if (operands_end - sp < argc)
+        throw std::runtime_error(Memory::overflow(program.functions[entry].name));
+    sp = std::copy(args, args + argc, sp);
+    goto invoke;
+
+#ifndef VM_COMPUTED_GOTO
+dispatch:
+    ++executed;
+    switch (static_cast<OPCODE>(*pc++))
+    {
+#endif
+    VM_TARGET(HALT)
+        return sp[-1];
+    VM_TARGET(PUSH)
+        *sp++ = *pc++;
+        VM_DISPATCH();
+    VM_TARGET(PUSHSTR)
+        *sp++ = statics + *pc++;
+        VM_DISPATCH();
+    VM_TARGET(POP)
+        --sp;
+        VM_DISPATCH();
+    VM_TARGET(DUP)
+        *sp = sp[-1];
+        ++sp;
+        VM_DISPATCH();
+    VM_TARGET(LOADL)
+        *sp++ = fp[*pc++];
+        VM_DISPATCH();
+    VM_TARGET(STOREL)
+        fp[*pc++] = sp[-1];
+        VM_DISPATCH();
+    VM_TARGET(ADDRL)
+        *sp++ = Memory::address(fp + *pc++);
+        VM_DISPATCH();
+    VM_TARGET(LOAD)
+        sp[-1] = *Memory::pointer(sp[-1]);
+        VM_DISPATCH();
+    VM_TARGET(STORE)
+        --sp;
+        *Memory::pointer(sp[-1]) = *sp;
+        sp[-1] = *sp;
+        VM_DISPATCH();
+    VM_TARGET(INCL)
+        fp[pc[0]] += pc[1];
+        *sp++ = fp[pc[0]];
+        pc += 2;
+        VM_DISPATCH();
+    VM_TARGET(POSTINCL)
+        *sp++ = fp[pc[0]];
+        fp[pc[0]] += pc[1];
+        pc += 2;
+        VM_DISPATCH();
+    VM_TARGET(INC)
+    {
+        Word* target = Memory::pointer(sp[-1]);
+        *target += *pc++;
+        sp[-1] = *target;
+        VM_DISPATCH();
+    }
+    VM_TARGET(POSTINC)
+    {
+        Word* target = Memory::pointer(sp[-1]);
+        sp[-1] = *target;
+        *target += *pc++;
+        VM_DISPATCH();
+    }
+    VM_TARGET(ADD)
+        --sp;
+        sp[-1] = static_cast<Word>(static_cast<std::uint64_t>(sp[-1]) + static_cast<std::uint64_t>(*sp));
+        VM_DISPATCH();
+    VM_TARGET(SUB)
+        --sp;
+        sp[-1] = static_cast<Word>(static_cast<std::uint64_t>(sp[-1]) - static_cast<std::uint64_t>(*sp));
+        VM_DISPATCH();
+    VM_TARGET(EQ)
+        --sp;
+        sp[-1] = sp[-1] == *sp;
+        VM_DISPATCH();
+    VM_TARGET(NE)
+        --sp;
+        sp[-1] = sp[-1] != *sp;
+        VM_DISPATCH();
+    VM_TARGET(NEG)
+        sp[-1] = static_cast<Word>(0 - static_cast<std::uint64_t>(sp[-1]));
+        VM_DISPATCH();
+    VM_TARGET(NOT)
+        sp[-1] = !sp[-1];
+        VM_DISPATCH();
+    VM_TARGET(JMP)
+        TIERED_JUMP(code + *pc);
+        VM_DISPATCH();
+    VM_TARGET(JZ)
+        if (*--sp)
+            pc++;
+        else
+            TIERED_JUMP(code + *pc);
+        VM_DISPATCH();
+    VM_TARGET(JNZ)
+        if (*--sp)
+            TIERED_JUMP(code + *pc);
+        else
+            pc++;
+        VM_DISPATCH();
+    VM_TARGET(CALL)
+        callee = pc[0];
+        argc = pc[1];
+        pc += 2;
+        goto invoke;
+    VM_TARGET(CALLB)
+        callee = pc[0];
+        argc = pc[1];
+        pc += 2;
+        goto builtin;
+    VM_TARGET(CALLI)
+        argc = *pc++;
+        callee = *--sp;
+        if (callee < 0)
+        {
+            callee = -(callee + 1);
+            goto builtin;
+        }
+        if (callee >= static_cast<Word>(program.functions.size()))
+            throw std::runtime_error("Call of invalid function value " + std::to_string(callee));
+        goto invoke;
+    VM_TARGET(TAILCALL)
+        callee = pc[0];
+        argc = pc[1];
+        pc += 2;
+        goto tail_invoke;
+    VM_TARGET(TAILCALLI)
+        argc = *pc++;
+        callee = *--sp;
+        // a builtin pushes its result for the RET that follows
+        if (callee < 0)
+        {
+            callee = -(callee + 1);
+            goto builtin;
+        }
+        if (callee >= static_cast<Word>(program.functions.size()))
+            throw std::runtime_error("Call of invalid function value " + std::to_string(callee));
+        goto tail_invoke;
+    VM_TARGET(RET)
+        result = *--sp;
+        frames = fp;
+        pc = calls.back().return_pc;
+        fp = calls.back().fp;
+        calls.pop_back();
+        if (calls.size() == base)
+            return result;
+        current = calls.back().function;
+        *sp++ = result;
+        VM_DISPATCH();
+#ifndef VM_COMPUTED_GOTO
+    default:
+        throw std::logic_error("Invalid opcode " + std::to_string(pc[-1]));
+    }
+#endif
+
+invoke:
+    {
+        const CompiledFunction& function = program.functions[callee];
+        if (++calls_made[callee] == thresholds.calls)
+            request(callee);
+        sp -= argc;
+
+        const void* native = table[builtins.size() + callee].load(std::memory_order_acquire);
+        if (native != forwarders[callee])
+        {
+            operand_top = sp;
+            frame_top = frames;
+            result = call_native(native, sp, argc, function.params);
+            if (calls.size() == base)
+                return result;
+            *sp++ = result;
+            VM_DISPATCH();
+        }
+
+        Word* frame = frames;
+        if (frames_end - frame < static_cast<std::ptrdiff_t>(function.frame_size) ||
+            operands_end - sp < static_cast<std::ptrdiff_t>(function.max_stack) || calls.size() >= max_calls)
+            throw std::runtime_error(Memory::overflow(function.name));
+
+        // missing arguments read as zero, extra ones are dropped
+        Word passed = std::min<Word>(argc, function.params);
+        std::copy(sp, sp + passed, frame);
+        std::fill(frame + passed, frame + function.frame_size, 0);
+
+        current = callee;
+        calls.push_back(CallRecord{pc, fp, current});
+        fp = frame;
+        frames = frame + function.frame_size;
+        pc = code + function.entry;
+        VM_DISPATCH();
+    }
+
+tail_invoke:
+    // native code is called as usual and the RET that follows returns its result
+    if (table[builtins.size() + callee].load(std::memory_order_acquire) != forwarders[callee])
+        goto invoke;
+    {
+        const CompiledFunction& function = program.functions[callee];
+        if (++calls_made[callee] == thresholds.calls)
+            request(callee);
+        sp -= argc;
+        if (frames_end - fp < static_cast<std::ptrdiff_t>(function.frame_size) ||
+            operands_end - sp < static_cast<std::ptrdiff_t>(function.max_stack))
+            throw std::runtime_error(Memory::overflow(function.name));
+
+        Word passed = std::min<Word>(argc, function.params);
+        std::copy(sp, sp + passed, fp);
+        std::fill(fp + passed, fp + function.frame_size, 0);
+
+        frames = fp + function.frame_size;
+        pc = code + function.entry;
+        current = callee;
+        calls.back().function = current;
+        VM_DISPATCH();
+    }
+
+builtin:
+    result = runtime.call(callee, sp - argc, argc);
+    sp -= argc;
+    if (runtime.exited)
+        natives.unwind();
+    *sp++ = result;
+    VM_DISPATCH();
+}
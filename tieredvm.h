@@ -0,0 +1,118 @@
+#ifndef H_TIEREDVM
+#define H_TIEREDVM
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "bytecode.h"
+#include "memory.h"
+#include "runtime.h"
+#include "jitruntime.h"
+#include "executablememory.h"
+#include "function.h"
+#include "library.h"
+#include "threadpool.h"
+#include "x64emitter.h"
+
+struct TierThresholds
+{
+    unsigned long long calls = 1000;    // calls of a function before it's compiled
+    unsigned long long loops = 10000;   // loop iterations (back edges taken) in a function before it's compiled
+};
+
+/* Runs a library compiled by BytecodeCompiler in an interpreter like VM's,
+ * counting calls and loop back edges of every function. A function crossing
+ * one of the thresholds is compiled to machine code on a background thread
+ * (X64Codegen into a JitEmitter) and from then on is called natively. Tiers
+ * switch only at function entry, a hot loop runs natively from the next
+ * call of its function. Native code calls functions that are still
+ * interpreted through forwarders in the call table, which are replaced by
+ * the compiled code once it's installed. Both tiers share B memory;
+ * interpreted frames live in its frame area, native ones on the machine
+ * stack. Functions with more than max_native_params parameters stay
+ * interpreted. Faults in the guard pages of B memory end the run with an
+ * error in either tier, see MemoryTrap. */
+class TieredVM
+{
+public:
+    struct TierUp
+    {
+        unsigned function;
+        unsigned long long calls;
+        unsigned long long loops;
+        double requested;       // seconds since run() started
+        double installed;       // negative while it's being compiled
+        std::size_t bytes;
+    };
+
+    static const unsigned max_native_params = x64_entry_params;
+
+private:
+    struct CallRecord
+    {
+        const Word* return_pc;
+        Word* fp;
+        unsigned function;      // the one called
+    };
+
+    Library& library;
+    const Program& program;
+    TierThresholds thresholds;
+    unsigned argument_area;     // of the whole library, see X64Codegen::argument_area
+    Memory memory;
+    Runtime runtime;
+    JitRuntime natives;
+
+    std::vector<std::atomic<const void*>> table;    // builtins in reverse order, then the functions, see JitEmitter
+    std::vector<const void*> forwarders;
+    std::unique_ptr<ExecutableMemory> forwarder_code;
+    std::vector<std::unique_ptr<ExecutableMemory>> compiled_code;
+    std::vector<unsigned> compiled_functions;       // the function in each of compiled_code
+    std::vector<std::atomic<const ExecutableMemory*>> native_code;     // of each function, once it's compiled
+
+    std::vector<unsigned long long> calls_made;
+    std::vector<unsigned long long> loops_taken;
+    std::vector<bool> requested;
+    std::vector<TierUp> tierups;
+    std::mutex compiled_mutex;      // guards compiled_code, compiled_functions and tierups
+    std::atomic<bool> stopping;
+    std::chrono::steady_clock::time_point started;
+
+    std::vector<Word> operands;
+    std::vector<CallRecord> calls;
+    std::vector<Word> forwarded;    // arguments of forward(), which execute() copies before anything else
+    Word* operand_top;      // where a nested interpreter starts, set before calling native code
+    Word* frame_top;
+    std::size_t max_calls;
+    unsigned long long executed;
+
+    static thread_local TieredVM* active;
+
+    ThreadPool compiler;    // last, so that it's joined before anything it uses goes away
+
+    MEMORY_INTERPRETER Word execute(unsigned function, const Word* args, unsigned argc);
+    Word call_native(const void* code, const Word* args, unsigned argc, unsigned params);
+    void request(unsigned function);
+    void compile(unsigned function);
+    static Word forward(Word function, const Word* register_args, const Word* stack_args);
+    // whether instruction is in the code of a compiled function
+    bool native(const void* instruction) const;
+    // name of the compiled function containing instruction, else of the innermost interpreted one
+    std::string function_at(const void* instruction);
+
+public:
+    TieredVM(Library& _library, const Program& _program, TierThresholds _thresholds = TierThresholds(),
+             std::size_t heap_words = 1 << 20, std::size_t stack_words = 1 << 20);
+    ~TieredVM();
+
+    // runs entry to completion (or until exit() is called) and returns its result
+    Word run(const Identifier& entry = "main");
+
+    unsigned long long instructions() const {return executed;}     // interpreted ones
+    std::vector<TierUp> gettierups();
+};
+
+#endif // H_TIEREDVM
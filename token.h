@@ -3,6 +3,8 @@
 
 #include <map>
 #include <memory>
+#include <string>
+#include <stdexcept>
 
 enum TOKEN {TOKEN_RESERVED = -1, TOKEN_IDENTIFIER = 0, TOKEN_INT_LITERAL, TOKEN_STR_LITERAL, TOKEN_EOF, TOKEN_IF, TOKEN_WHILE,
                TOKEN_RETURN, TOKEN_VAR, TOKEN_PARENTHESIS_OPEN, TOKEN_PARENTHESIS_CLOSE, TOKEN_SQBRACKET_OPEN, TOKEN_SQBRACKET_CLOSE,
@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+#include "valuenumbering.h"
+
+unsigned ValueNumbering::eliminate(std::vector<IRFunction>& functions, ThreadPool& pool)
+{
+    std::vector<unsigned> eliminated(functions.size(), 0);
+    pool.parallel_for(functions.size(), [&](std::size_t i)
+    {
+        eliminated[i] = eliminate(functions[i]);
+    });
+    return std::accumulate(eliminated.begin(), eliminated.end(), 0u);
+}
+
+unsigned ValueNumbering::eliminate(IRFunction& function)
+{
+    auto count = [&]()
+    {
+        return std::count_if(function.values.begin(), function.values.end(), [](const IRInstruction& instruction)
+        {
+            return instruction.block != NOBLOCK;
+        });
+    };
+    std::size_t before = count();
+
+    ValueNumbering numbering(function);
+    numbering.replacement.resize(function.values.size());
+    std::iota(numbering.replacement.begin(), numbering.replacement.end(), 0);
+
+    // children in the dominator tree, in reverse postorder so definitions are seen before uses outside loops
+    std::vector<unsigned> idom = function.dominators();
+    std::vector<std::vector<unsigned>> children(function.blocks.size());
+    std::vector<unsigned> order = function.reverse_postorder();
+    for (auto it = order.begin() + 1; it != order.end(); ++it)
+        children[idom[*it]].push_back(*it);
+
+    std::vector<Word> exit_state(function.blocks.size(), 0);
+    std::vector<std::size_t> mark(function.blocks.size(), 0);
+    std::vector<std::pair<unsigned, bool>> pending(1, std::make_pair(0u, false));   // block and whether it's being left
+    while (!pending.empty())
+    {
+        unsigned block = pending.back().first;
+        bool leaving = pending.back().second;
+        pending.pop_back();
+        if (leaving)
+        {
+            for (std::size_t i = mark[block]; i < numbering.added.size(); ++i)
+                numbering.available.erase(numbering.added[i]);
+            numbering.added.resize(mark[block]);
+            continue;
+        }
+
+        mark[block] = numbering.added.size();
+        const std::vector<unsigned>& preds = function.blocks[block].preds;
+        numbering.memory = preds.size() == 1 ? exit_state[preds[0]] : ++numbering.states;
+        std::vector<IRValue> code = function.blocks[block].code;
+        for (auto it = code.begin(); it != code.end(); ++it)
+            numbering.number(*it);
+        exit_state[block] = numbering.memory;
+
+        pending.push_back(std::make_pair(block, true));
+        for (auto child = children[block].rbegin(); child != children[block].rend(); ++child)
+            pending.push_back(std::make_pair(*child, false));
+    }
+
+    function.replace_uses(numbering.replacement);
+    numbering.remove_dead();
+    function.sweep();
+    function.verify();
+    return before - count();
+}
+
+IRValue ValueNumbering::resolve(IRValue value)
+{
+    while (replacement[value] != value)
+        value = replacement[value] = replacement[replacement[value]];
+    return value;
+}
+
+bool ValueNumbering::isconstant(IRValue value, Word& constant) const
+{
+    if (ir.values[value].op != IROP::CONST)
+        return false;
+    constant = ir.values[value].imm;
+    return true;
+}
+
+void ValueNumbering::replace(IRValue value, IRValue with)
+{
+    replacement[value] = with;
+    ir.remove(value);
+}
+
+void ValueNumbering::number(IRValue value)
+{
+    IRInstruction& instruction = ir.values[value];
+    for (auto it = instruction.operands.begin(); it != instruction.operands.end(); ++it)
+        *it = resolve(*it);
+
+    Key key(instruction.op, instruction.imm, instruction.operands);
+    switch (instruction.op)
+    {
+        case IROP::STORE:
+            memory = ++states;
+            available.insert(std::make_pair(Key(IROP::LOAD, memory, {instruction.operands[0]}), instruction.operands[1]));
+            added.push_back(Key(IROP::LOAD, memory, {instruction.operands[0]}));
+            return;
+        case IROP::CALL:
+        case IROP::CALLB:
+        case IROP::CALLI:
+            memory = ++states;
+            return;
+        case IROP::LOAD:
+            std::get<1>(key) = memory;
+            break;
+        case IROP::PHI:
+        {
+            // a phi of one value besides itself is that value (operands from loops not numbered yet are taken as they are)
+            IRValue only = value;
+            bool trivial = true;
+            for (auto it = instruction.operands.begin(); it != instruction.operands.end() && trivial; ++it)
+            {
+                if (*it == value || *it == only)
+                    continue;
+                trivial = only == value;
+                only = *it;
+            }
+            if (trivial && only != value)
+            {
+                replace(value, only);
+                return;
+            }
+            std::get<1>(key) = instruction.block;
+            break;
+        }
+        default:
+            if (!instruction.ispure())
+                return;
+            if (simplify(value))
+                return;
+            key = Key(instruction.op, instruction.imm, instruction.operands);
+            break;
+    }
+
+    auto found = available.find(key);
+    if (found != available.end())
+        replace(value, found->second);
+    else
+    {
+        available.insert(std::make_pair(key, value));
+        added.push_back(key);
+    }
+}
+
+/* Folds the instruction in place or replaces it with one of its operands,
+ * returning true in the latter case. Arithmetic wraps around as at run
+ * time. */
+bool ValueNumbering::simplify(IRValue value)
+{
+    IRInstruction& instruction = ir.values[value];
+    Word a = 0, b = 0;
+    bool constant_a = !instruction.operands.empty() && isconstant(instruction.operands[0], a);
+    bool constant_b = instruction.operands.size() > 1 && isconstant(instruction.operands[1], b);
+    bool same = instruction.operands.size() > 1 && instruction.operands[0] == instruction.operands[1];
+    auto fold = [&](Word result)
+    {
+        instruction.op = IROP::CONST;
+        instruction.imm = result;
+        instruction.operands.clear();
+        return false;
+    };
+
+    switch (instruction.op)
+    {
+        case IROP::ADD:
+            if (constant_a && constant_b)
+                return fold(static_cast<Word>(static_cast<std::uint64_t>(a) + static_cast<std::uint64_t>(b)));
+            if (constant_b && b == 0)
+            {
+                replace(value, instruction.operands[0]);
+                return true;
+            }
+            if (constant_a && a == 0)
+            {
+                replace(value, instruction.operands[1]);
+                return true;
+            }
+            break;
+        case IROP::SUB:
+            if (constant_a && constant_b)
+                return fold(static_cast<Word>(static_cast<std::uint64_t>(a) - static_cast<std::uint64_t>(b)));
+            if (same)
+                return fold(0);
+            if (constant_b && b == 0)
+            {
+                replace(value, instruction.operands[0]);
+                return true;
+            }
+            break;
+        case IROP::EQ:
+            if ((constant_a && constant_b) || same)
+                return fold(a == b);
+            break;
+        case IROP::NE:
+            if ((constant_a && constant_b) || same)
+                return fold(a != b);
+            break;
+        case IROP::NEG:
+            if (constant_a)
+                return fold(static_cast<Word>(0 - static_cast<std::uint64_t>(a)));
+            if (ir.values[instruction.operands[0]].op == IROP::NEG)
+            {
+                replace(value, ir.values[instruction.operands[0]].operands[0]);
+                return true;
+            }
+            break;
+        case IROP::NOT:
+            if (constant_a)
+                return fold(!a);
+            break;
+        default:
+            break;
+    }
+    if ((instruction.op == IROP::ADD || instruction.op == IROP::EQ || instruction.op == IROP::NE) &&
+        instruction.operands[0] > instruction.operands[1])
+        std::swap(instruction.operands[0], instruction.operands[1]);
+    return false;
+}
+
+// removes pure instructions, loads and phis whose values aren't used, and then those only they used
+void ValueNumbering::remove_dead()
+{
+    std::vector<unsigned> uses = ir.usecounts();
+    std::vector<IRValue> dead;
+    auto removable = [&](IRValue value)
+    {
+        const IRInstruction& instruction = ir.values[value];
+        return instruction.block != NOBLOCK && uses[value] == 0 &&
+               (instruction.ispure() || instruction.op == IROP::LOAD || instruction.op == IROP::PHI);
+    };
+    for (IRValue v = 0; v < ir.values.size(); ++v)
+        if (removable(v))
+            dead.push_back(v);
+    while (!dead.empty())
+    {
+        IRValue value = dead.back();
+        dead.pop_back();
+        ir.remove(value);
+        for (auto it = ir.values[value].operands.begin(); it != ir.values[value].operands.end(); ++it)
+            if (--uses[*it] == 0 && removable(*it))
+                dead.push_back(*it);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef H_VALUENUMBERING
+#define H_VALUENUMBERING
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "ir.h"
+#include "threadpool.h"
+
+/* Global value numbering over functions in SSA form, walking the dominator
+ * tree with a scoped table of the expressions available so far (the
+ * dominator-based scheme of Briggs, Cooper and Simpson, "Value Numbering",
+ * 1997): a pure instruction computing the same operation of the same
+ * operands as one whose definition dominates it is replaced by that one,
+ * as are phis merging the same values in the same block. On the way,
+ * operations of constants are folded and x+0, x-0, x-x, x==x and x!=x are
+ * simplified, and operands of commutative operations are ordered so a+b
+ * and b+a meet.
+ *
+ * Loads are numbered together with the state of memory they read: any
+ * store or call starts a new one, as does any block that can be entered
+ * from somewhere other than its immediate dominator, so a load is only
+ * reused where nothing can have written memory in between. The value a
+ * store writes is what a load of the same address gives until the next
+ * change. Instructions left unused by all that are removed. */
+class ValueNumbering
+{
+    typedef std::tuple<IROP, Word, std::vector<IRValue>> Key;  // for loads and phis, imm is the memory state and block
+
+    IRFunction& ir;
+    std::vector<IRValue> replacement;
+    std::map<Key, IRValue> available;
+    std::vector<Key> added;             // to available, undone when leaving a subtree of the dominator tree
+    Word memory;        // state of memory at the instruction being numbered
+    Word states;        // created so far
+
+    IRValue resolve(IRValue value);
+    bool isconstant(IRValue value, Word& constant) const;
+    void replace(IRValue value, IRValue with);
+    void number(IRValue value);
+    bool simplify(IRValue value);
+    void remove_dead();
+
+    ValueNumbering(IRFunction& _ir) : ir(_ir), memory(0), states(0) {}
+
+public:
+    // returns the number of instructions removed
+    static unsigned eliminate(IRFunction& function);
+    static unsigned eliminate(std::vector<IRFunction>& functions, ThreadPool& pool);
+};
+
+#endif // H_VALUENUMBERING
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "vm.h"
+
+// records every instruction in the profile while tracing
+#define VM_TRACE(opcode) if (tracing) profile->record(opcode)
+#include "dispatch.h"
+
+#define VM_OPCODE_ENUM OPCODE
+
+/* Effect of each instruction that falls through to the next one or jumps,
+ * given its operands, after pc has been moved past them. Both the handlers
+ * of single instructions and those of superinstructions are made of them. */
+// every loop and recursion passes through a taken jump or a call, where the run is suspended once its budget is used
+#define VM_YIELD() if (executed >= budget_end) goto suspend
+
+// target of a pointer, tested first in checked mode
+#define VM_POINTER(address) (checked && !memory.valid(address) ? fault(address) : Memory::pointer(address))
+
+#define VM_STEP(op, offset) VM_STEP_##op(ops + offset)
+#define VM_STEP_PUSH(ops) *sp++ = *(ops);
+#define VM_STEP_PUSHSTR(ops) *sp++ = statics + *(ops);
+#define VM_STEP_POP(ops) --sp;
+#define VM_STEP_DUP(ops) *sp = sp[-1]; ++sp;
+#define VM_STEP_LOADL(ops) *sp++ = fp[*(ops)];
+#define VM_STEP_STOREL(ops) fp[*(ops)] = sp[-1];
+#define VM_STEP_ADDRL(ops) *sp++ = Memory::address(fp + *(ops));
+#define VM_STEP_LOAD(ops) sp[-1] = *VM_POINTER(sp[-1]);
+#define VM_STEP_STORE(ops) --sp; *VM_POINTER(sp[-1]) = *sp; sp[-1] = *sp;
+#define VM_STEP_INCL(ops) fp[(ops)[0]] += (ops)[1]; *sp++ = fp[(ops)[0]];
+#define VM_STEP_POSTINCL(ops) *sp++ = fp[(ops)[0]]; fp[(ops)[0]] += (ops)[1];
+#define VM_STEP_INC(ops) {Word* target = VM_POINTER(sp[-1]); *target += *(ops); sp[-1] = *target;}
+#define VM_STEP_POSTINC(ops) {Word* target = VM_POINTER(sp[-1]); sp[-1] = *target; *target += *(ops);}
+#define VM_STEP_ADD(ops) --sp; sp[-1] = static_cast<Word>(static_cast<std::uint64_t>(sp[-1]) + static_cast<std::uint64_t>(*sp));
+#define VM_STEP_SUB(ops) --sp; sp[-1] = static_cast<Word>(static_cast<std::uint64_t>(sp[-1]) - static_cast<std::uint64_t>(*sp));
+#define VM_STEP_EQ(ops) --sp; sp[-1] = sp[-1] == *sp;
+#define VM_STEP_NE(ops) --sp; sp[-1] = sp[-1] != *sp;
+#define VM_STEP_NEG(ops) sp[-1] = static_cast<Word>(0 - static_cast<std::uint64_t>(sp[-1]));
+#define VM_STEP_NOT(ops) sp[-1] = !sp[-1];
+#define VM_STEP_JMP(ops) pc = code + *(ops); VM_YIELD();
+#define VM_STEP_JZ(ops) if (!*--sp) {pc = code + *(ops); VM_YIELD();}
+#define VM_STEP_JNZ(ops) if (*--sp) {pc = code + *(ops); VM_YIELD();}
+
+#define VM_HANDLER(name, operands, effect, ...) \
+    VM_TARGET(name) \
+    { \
+        const Word* ops = pc; \
+        (void)ops;  /* not read by steps without operands */ \
+        pc += operands; \
+        __VA_ARGS__ \
+    } \
+    VM_DISPATCH();
+#define VM_SIMPLE(name) VM_HANDLER(name, getinfo(OPCODE::name).operands, 0, VM_STEP(name, 0))
+
+Word VM::run(const Identifier& entry)
+{
+    start(entry);
+    resume(~0ULL);
+    return returned;
+}
+
+Word VM::trace(const Identifier& entry, OpcodeProfile& _profile)
+{
+    profile = &_profile;
+    start(entry);
+    budget_end = ~0ULL;
+    execute_trapped<true>();
+    return returned;
+}
+
+void VM::start(const Identifier& entry_name)
+{
+    int index = program.find(entry_name);
+    if (index < 0)
+        throw std::runtime_error("No function named '" + entry_name + "'");
+    entry = index;
+    state = State{nullptr, operands.get(), nullptr, memory.frames_begin()};
+    calls.clear();
+    executed = 0;
+    std::fill(called.begin(), called.end(), 0);
+    runtime.exited = false;
+    finished = false;
+    returned = 0;
+}
+
+bool VM::resume(unsigned long long budget)
+{
+    if (finished)
+        return true;
+    budget_end = executed + std::min(budget, ~0ULL - executed);
+    return execute_trapped<false>();
+}
+
+// a fault in a guard page ends the run like a failed check, the output so far is written either way
+template <bool tracing>
+bool VM::execute_trapped()
+{
+    MemoryTrap trap(memory, MemoryTrap::interpreter);
+    try
+    {
+        if (MEMORY_TRAPPED(trap))
+            fault(trap.address());
+        finished = memory.checked ? execute<tracing, true>() : execute<tracing, false>();
+        runtime.flush();
+        return finished;
+    }
+    catch (...)
+    {
+        finished = true;
+        runtime.flush();
+        throw;
+    }
+}
+
+Word* VM::fault(Word address) const
+{
+    throw std::runtime_error(memory.fault(address, calls.empty() ? std::string() : program.functions[calls.back().function].name));
+}
+
+template <bool tracing, bool checked>
+bool VM::execute()
+{
+#ifdef VM_COMPUTED_GOTO
+    static void* const dispatch_table[] = {BYTECODE_OPCODES(VM_LABEL_ADDRESS) SUPERINSTRUCTIONS(VM_LABEL_ADDRESS, )};
+#endif
+
+    const Word* const code = this->code;
+    const Word statics = memory.statics();
+    Word* const frames_end = memory.frames_end();
+    Word* const operands_end = operands.get() + operand_words;
+
+    const Word* pc = state.pc;
+    Word* sp = state.sp;                // next free operand slot
+    Word* fp = state.fp;                // frame of the running function
+    Word* frame_top = state.frame_top;
+    Word result = 0;
+
+    // operands of the call being made, shared by CALL, CALLB and CALLI
+    Word callee = entry;
+    Word argc = 0;
+
+    if (!pc)
+        goto invoke;
+    VM_DISPATCH();
+
+#ifndef VM_COMPUTED_GOTO
+dispatch:
+    ++executed;
+    VM_TRACE(*pc);
+    switch (static_cast<OPCODE>(*pc++))
+    {
+#endif
+    VM_TARGET(HALT)
+        returned = sp[-1];
+        return true;
+    VM_SIMPLE(PUSH)
+    VM_SIMPLE(PUSHSTR)
+    VM_SIMPLE(POP)
+    VM_SIMPLE(DUP)
+    VM_SIMPLE(LOADL)
+    VM_SIMPLE(STOREL)
+    VM_SIMPLE(ADDRL)
+    VM_SIMPLE(LOAD)
+    VM_SIMPLE(STORE)
+    VM_SIMPLE(INCL)
+    VM_SIMPLE(POSTINCL)
+    VM_SIMPLE(INC)
+    VM_SIMPLE(POSTINC)
+    VM_SIMPLE(ADD)
+    VM_SIMPLE(SUB)
+    VM_SIMPLE(EQ)
+    VM_SIMPLE(NE)
+    VM_SIMPLE(NEG)
+    VM_SIMPLE(NOT)
+    VM_SIMPLE(JMP)
+    VM_SIMPLE(JZ)
+    VM_SIMPLE(JNZ)
+    SUPERINSTRUCTIONS(VM_HANDLER, VM_STEP)
+    VM_TARGET(CALL)
+        callee = pc[0];
+        argc = pc[1];
+        pc += 2;
+        goto invoke;
+    VM_TARGET(CALLB)
+        callee = pc[0];
+        argc = pc[1];
+        pc += 2;
+        goto builtin;
+    VM_TARGET(CALLI)
+        argc = *pc++;
+        callee = *--sp;
+        if (callee < 0)
+        {
+            callee = -(callee + 1);
+            goto builtin;
+        }
+        if (callee >= static_cast<Word>(program.functions.size()))
+            throw std::runtime_error("Call of invalid function value " + std::to_string(callee));
+        goto invoke;
+    VM_TARGET(TAILCALL)
+        callee = pc[0];
+        argc = pc[1];
+        goto tail_invoke;
+    VM_TARGET(TAILCALLI)
+        argc = *pc++;
+        callee = *--sp;
+        // a builtin pushes its result for the RET that follows
+        if (callee < 0)
+        {
+            callee = -(callee + 1);
+            goto builtin;
+        }
+        if (callee >= static_cast<Word>(program.functions.size()))
+            throw std::runtime_error("Call of invalid function value " + std::to_string(callee));
+        goto tail_invoke;
+    VM_TARGET(RET)
+        result = *--sp;
+        if (calls.size() == 1)
+        {
+            returned = result;
+            return true;
+        }
+        frame_top = fp;
+        pc = calls.back().return_pc;
+        fp = calls.back().fp;
+        calls.pop_back();
+        *sp++ = result;
+        VM_DISPATCH();
+#ifndef VM_COMPUTED_GOTO
+    default:
+        throw std::logic_error("Invalid opcode " + std::to_string(pc[-1]));
+    }
+#endif
+
+invoke:
+    {
+        const CompiledFunction& function = program.functions[callee];
+        Word* frame = frame_top;
+        sp -= argc;
+        if (frames_end - frame < static_cast<std::ptrdiff_t>(function.frame_size) ||
+            operands_end - sp < static_cast<std::ptrdiff_t>(function.max_stack) || calls.size() >= max_calls)
+            throw std::runtime_error(Memory::overflow(function.name));
+
+        // missing arguments read as zero, extra ones are dropped
+        Word passed = std::min<Word>(argc, function.params);
+        std::copy(sp, sp + passed, frame);
+        std::fill(frame + passed, frame + function.frame_size, 0);
+
+        called[callee]++;
+        calls.push_back(CallRecord{pc, fp, static_cast<unsigned>(callee)});
+        fp = frame;
+        frame_top = frame + function.frame_size;
+        pc = code + function.entry;
+        VM_YIELD();
+        VM_DISPATCH();
+    }
+
+// the arguments replace the caller's frame, which the callee's return then leaves
+tail_invoke:
+    {
+        const CompiledFunction& function = program.functions[callee];
+        sp -= argc;
+        if (frames_end - fp < static_cast<std::ptrdiff_t>(function.frame_size) ||
+            operands_end - sp < static_cast<std::ptrdiff_t>(function.max_stack))
+            throw std::runtime_error(Memory::overflow(function.name));
+
+        Word passed = std::min<Word>(argc, function.params);
+        std::copy(sp, sp + passed, fp);
+        std::fill(fp + passed, fp + function.frame_size, 0);
+
+        called[callee]++;
+        calls.back().function = callee;
+        frame_top = fp + function.frame_size;
+        pc = code + function.entry;
+        VM_YIELD();
+        VM_DISPATCH();
+    }
+
+builtin:
+    result = runtime.call(callee, sp - argc, argc);
+    sp -= argc;
+    if (runtime.exited)
+    {
+        returned = 0;
+        return true;
+    }
+    *sp++ = result;
+    VM_DISPATCH();
+
+suspend:
+    state = State{pc, sp, fp, frame_top};
+    return false;
+}
+
+// instantiated here for MEMORY_INTERPRETER, which GCC ignores on the template itself
+template MEMORY_INTERPRETER bool VM::execute<false, false>();
+template MEMORY_INTERPRETER bool VM::execute<false, true>();
+template MEMORY_INTERPRETER bool VM::execute<true, false>();
+template MEMORY_INTERPRETER bool VM::execute<true, true>();
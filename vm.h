@@ -0,0 +1,95 @@
+#ifndef H_VM
+#define H_VM
+
+#include <memory>
+#include <vector>
+
+#include "bytecode.h"
+#include "memory.h"
+#include "runtime.h"
+#include "opcodeprofile.h"
+
+/* Executes a Program. The operand stack is private to the VM, function
+ * frames (locals and parameters) live in B memory so that & of a local
+ * yields an ordinary B address. Frames are zeroed on entry. Accesses
+ * through pointers are checked by the guard pages of Memory, or one by one
+ * after check_memory(). A run can be split in slices of a number of
+ * instructions with start() and resume(), it's suspended at the first
+ * call or taken jump after its budget runs out. */
+class VM
+{
+    struct CallRecord
+    {
+        const Word* return_pc;
+        Word* fp;
+        unsigned function;      // the one called, running until the record is popped
+    };
+
+    // registers of a suspended run, pc is null before its entry is called
+    struct State
+    {
+        const Word* pc;
+        Word* sp;
+        Word* fp;
+        Word* frame_top;
+    };
+
+    const Program& program;
+    const Word* code;       // program.code, or the same words elsewhere
+    Memory memory;
+    Runtime runtime;
+    std::unique_ptr<Word[]> operands;   // uninitialised, a large stack's pages are touched only when used
+    std::size_t operand_words;
+    std::vector<CallRecord> calls;
+    std::size_t max_calls;
+    unsigned long long executed;
+    unsigned long long budget_end;      // executed when the run is suspended
+    std::vector<unsigned long long> called;     // by function
+    OpcodeProfile* profile;
+    unsigned entry;
+    State state;
+    bool finished;
+    Word returned;
+
+    // continues the run from state, true once it has finished
+    template <bool tracing, bool checked>
+    bool execute();
+    template <bool tracing>
+    bool execute_trapped();
+    [[noreturn]] Word* fault(Word address) const;
+
+public:
+    VM(const Program& _program, std::size_t heap_words = 1 << 20, std::size_t stack_words = 1 << 20)
+        : VM(_program, _program.code.data(), heap_words, stack_words) {}
+    // runs code instead of program.code, such as the code of a ProgramImage mapped in place
+    VM(const Program& _program, const Word* _code, std::size_t heap_words = 1 << 20, std::size_t stack_words = 1 << 20)
+        : program(_program), code(_code), memory(_program.statics, heap_words, stack_words), runtime(memory),
+          operands(new Word[stack_words]), operand_words(stack_words), max_calls(stack_words), executed(0), budget_end(0),
+          called(_program.functions.size(), 0), profile(nullptr), entry(0), state{nullptr, nullptr, nullptr, nullptr},
+          finished(true), returned(0) {}
+
+    // runs entry to completion (or until exit() is called) and returns its result
+    Word run(const Identifier& entry = "main");
+    // the same, recording the sequences of instructions executed in profile
+    Word trace(const Identifier& entry, OpcodeProfile& _profile);
+
+    // prepares a run of entry, which resume() makes progress on
+    void start(const Identifier& entry);
+    // runs the started program for about budget more instructions, true once it has finished
+    bool resume(unsigned long long budget);
+    bool done() const {return finished;}
+    Word result() const {return returned;}
+
+    // getchar() reads input and output is kept in output() instead of using stdin and stdout
+    void redirect(const std::string& input) {runtime.redirect(input);}
+    const std::string& output() const {return runtime.captured();}
+
+    // test every address a program dereferences instead of relying on guard pages
+    void check_memory(bool enable = true) {memory.checked = enable;}
+
+    unsigned long long instructions() const {return executed;}
+    // calls of every function in the last run, a profile for the inliner
+    const std::vector<unsigned long long>& callcounts() const {return called;}
+};
+
+#endif // H_VM
@@ -0,0 +1,545 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "x64codegen.h"
+
+unsigned X64Codegen::argument_area(Library& library)
+{
+    unsigned area = 0;
+    for (auto it = library.functions.begin(); it != library.functions.end(); ++it)
+        if (TailCalls::allowed(*it))
+            area = std::max(area, tail_call_stack_args(it->getbody()));
+    return std::min(area, x64_entry_params - 6);
+}
+
+unsigned X64Codegen::tail_call_stack_args(const Statement& stmt)
+{
+    unsigned args = 0;
+    if (const Expression* call = TailCalls::call(stmt))
+        args = call->expressions->size() > 7 ? call->expressions->size() - 7 : 0;
+    if (stmt.body)
+        for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+            args = std::max(args, tail_call_stack_args(*it));
+    return args;
+}
+
+void X64Codegen::generate(Library& library, X64Emitter& emitter)
+{
+    X64Codegen codegen(emitter, argument_area(library));
+    for (unsigned i = 0; i < library.functions.size(); ++i)
+        codegen.generate_function(library.functions[i], i);
+    emitter.finish(codegen.data.statics);
+}
+
+void X64Codegen::generate(Library& library, X64Emitter& emitter, unsigned function, const Program& program,
+                          unsigned argument_area)
+{
+    X64Codegen codegen(emitter, argument_area);
+    codegen.data.statics = program.statics;
+    codegen.data.strings = program.strings;
+    codegen.generate_function(library.functions[function], function);
+    if (codegen.data.statics.size() != program.statics.size())
+        throw std::logic_error("String literal of '" + library.functions[function].name + "' missing from the program");
+    emitter.finish(codegen.data.statics);
+}
+
+bool X64Codegen::islocal(const Expression& expr)
+{
+    return expr.type == EXPR_TYPE::IDENTIFIER &&
+           (expr.binding.type == IDTYPE::VARIABLE || expr.binding.type == IDTYPE::PARAMETER);
+}
+
+// operands that can be used directly as the source of an instruction, without touching any register
+bool X64Codegen::issimple(const Expression& expr)
+{
+    return expr.type == EXPR_TYPE::INT_LITERAL || islocal(expr);
+}
+
+void X64Codegen::apply(X64OP op, const Expression& simple)
+{
+    if (simple.type == EXPR_TYPE::INT_LITERAL)
+        emitter.alu_imm(op, X64REG::RAX, *simple.int_val);
+    else
+        emitter.alu_local(op, X64REG::RAX, simple.binding.index);
+}
+
+void X64Codegen::generate_function(Function& function, unsigned index)
+{
+    unsigned params = function.params.size();
+    unsigned frame = std::max(function.frame_size, params);
+    depth = 0;
+    return_label = emitter.newlabel();
+    tail_calls = TailCalls::allowed(function);
+
+    emitter.begin_function(index);
+    emitter.push(X64REG::RBP);
+    emitter.alu(X64OP::MOV, X64REG::RBP, X64REG::RSP);
+    if (frame)
+        emitter.alu_imm(X64OP::SUB, X64REG::RSP, 8 * ((frame + 1) & ~1u));     // keeps rsp 16 byte aligned
+
+    for (unsigned param = 0; param < params; ++param)
+    {
+        if (param < 6)
+            emitter.alu_to_local(X64OP::MOV, param, x64_argument_registers[param]);
+        else
+        {
+            emitter.load_param(X64REG::RAX, param - 6);
+            emitter.alu_to_local(X64OP::MOV, param, X64REG::RAX);
+        }
+    }
+    for (unsigned slot = params; slot < frame; ++slot)
+        emitter.alu_local_imm(X64OP::MOV, slot, 0);
+
+    generate_statement(function.getbody());
+    emitter.mov_imm(X64REG::RAX, 0);
+    emitter.bind(return_label);
+    emitter.leave();
+    emitter.ret();
+    emitter.end_function(index);
+}
+
+void X64Codegen::generate_statement(const Statement& stmt)
+{
+    switch (stmt.type)
+    {
+        case STATEMENT_TYPE::COMPOUND:
+            for (auto it = stmt.body->begin(); it != stmt.body->end(); ++it)
+                generate_statement(*it);
+            break;
+        case STATEMENT_TYPE::CONDITIONAL:
+        {
+            unsigned end = emitter.newlabel();
+            generate_branch(*stmt.expr, false, end);
+            generate_statement(stmt.body->back());
+            emitter.bind(end);
+            break;
+        }
+        case STATEMENT_TYPE::LOOP:
+        {
+            unsigned test = emitter.newlabel(), body = emitter.newlabel();
+            emitter.jmp(test);
+            emitter.bind(body);
+            generate_statement(stmt.body->back());
+            emitter.bind(test);
+            generate_branch(*stmt.expr, true, body);
+            break;
+        }
+        case STATEMENT_TYPE::RETURN:
+            if (tail_calls && TailCalls::call(stmt) && generate_tail_call(*TailCalls::call(stmt)))
+                break;
+            generate_expr(*stmt.expr);
+            emitter.jmp(return_label);
+            break;
+        case STATEMENT_TYPE::VAR_DEF:
+            for (auto it = stmt.vars->begin(); it != stmt.vars->end(); ++it)
+            {
+                if (it->is_initialized)
+                {
+                    generate_expr(*it->expr);
+                    emitter.alu_to_local(X64OP::MOV, it->binding.index, X64REG::RAX);
+                }
+            }
+            break;
+        case STATEMENT_TYPE::EXPRESSION:
+            generate_expr(*stmt.expr);
+            break;
+        case STATEMENT_TYPE::NOP:
+            break;
+    }
+}
+
+// rax = lhs op rhs, flags set by the operation
+void X64Codegen::generate_binary(X64OP op, const Expression& lhs, const Expression& rhs)
+{
+    generate_expr(lhs);
+    if (issimple(rhs))
+        apply(op, rhs);
+    else
+    {
+        push(X64REG::RAX);
+        generate_expr(rhs);
+        emitter.alu(X64OP::MOV, X64REG::RCX, X64REG::RAX);
+        pop(X64REG::RAX);
+        emitter.alu(op, X64REG::RAX, X64REG::RCX);
+    }
+}
+
+void X64Codegen::generate_expr(const Expression& expr)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::INT_LITERAL:
+            emitter.mov_imm(X64REG::RAX, *expr.int_val);
+            break;
+        case EXPR_TYPE::STR_LITERAL:
+            emitter.lea_string(X64REG::RAX, data.intern(*expr.str_val));
+            emitter.shr(X64REG::RAX, 3);
+            break;
+        case EXPR_TYPE::IDENTIFIER:
+            switch (expr.binding.type)
+            {
+                case IDTYPE::VARIABLE:
+                case IDTYPE::PARAMETER:
+                    emitter.alu_local(X64OP::MOV, X64REG::RAX, expr.binding.index);
+                    break;
+                case IDTYPE::FUNCTION:
+                    emitter.function_value(X64REG::RAX, expr.binding.index);
+                    break;
+                case IDTYPE::BUILTIN:
+                    emitter.builtin_value(X64REG::RAX, expr.binding.index);
+                    break;
+            }
+            break;
+        case EXPR_TYPE::PARENTHESIS:
+            generate_expr(expr.expressions->front());
+            break;
+        case EXPR_TYPE::INDEXING:
+        case EXPR_TYPE::UNARY_STAR:
+            generate_address(expr);
+            emitter.shl(X64REG::RAX, 3);
+            emitter.load(X64REG::RAX, X64REG::RAX);
+            break;
+        case EXPR_TYPE::UNARY_AMP:
+            generate_address(expr.expressions->front());
+            break;
+        case EXPR_TYPE::FUNC_CALL:
+            generate_call(expr);
+            break;
+        case EXPR_TYPE::BIN_EQUALS:
+        {
+            const Expression& lhs = expr.expressions->front();
+            if (islocal(lhs))
+            {
+                generate_expr(expr.expressions->back());
+                emitter.alu_to_local(X64OP::MOV, lhs.binding.index, X64REG::RAX);
+            }
+            else
+            {
+                generate_address(lhs);
+                push(X64REG::RAX);
+                generate_expr(expr.expressions->back());
+                pop(X64REG::RCX);
+                emitter.shl(X64REG::RCX, 3);
+                emitter.store(X64REG::RCX, X64REG::RAX);
+            }
+            break;
+        }
+        case EXPR_TYPE::BIN_PLUSEQUALS:
+        case EXPR_TYPE::BIN_MINUSEQUALS:
+        {
+            X64OP op = expr.type == EXPR_TYPE::BIN_PLUSEQUALS ? X64OP::ADD : X64OP::SUB;
+            const Expression& lhs = expr.expressions->front();
+            const Expression& rhs = expr.expressions->back();
+            // the lhs is read before the rhs is evaluated, which may change it
+            if (islocal(lhs))
+            {
+                if (rhs.type == EXPR_TYPE::INT_LITERAL)
+                    emitter.alu_local_imm(op, lhs.binding.index, *rhs.int_val);
+                else if (!rhs.haseffects())
+                {
+                    generate_expr(rhs);
+                    emitter.alu_to_local(op, lhs.binding.index, X64REG::RAX);
+                }
+                else
+                {
+                    emitter.alu_local(X64OP::MOV, X64REG::RAX, lhs.binding.index);
+                    push(X64REG::RAX);
+                    generate_expr(rhs);
+                    emitter.alu(X64OP::MOV, X64REG::RDX, X64REG::RAX);
+                    pop(X64REG::RAX);
+                    emitter.alu(op, X64REG::RAX, X64REG::RDX);
+                    emitter.alu_to_local(X64OP::MOV, lhs.binding.index, X64REG::RAX);
+                }
+                emitter.alu_local(X64OP::MOV, X64REG::RAX, lhs.binding.index);
+            }
+            else
+            {
+                generate_address(lhs);
+                push(X64REG::RAX);
+                emitter.shl(X64REG::RAX, 3);
+                emitter.load(X64REG::RAX, X64REG::RAX);
+                push(X64REG::RAX);
+                generate_expr(rhs);
+                emitter.alu(X64OP::MOV, X64REG::RDX, X64REG::RAX);
+                pop(X64REG::RAX);
+                pop(X64REG::RCX);
+                emitter.shl(X64REG::RCX, 3);
+                emitter.alu(op, X64REG::RAX, X64REG::RDX);
+                emitter.store(X64REG::RCX, X64REG::RAX);
+            }
+            break;
+        }
+        case EXPR_TYPE::BIN_PLUS:
+            generate_binary(X64OP::ADD, expr.expressions->front(), expr.expressions->back());
+            break;
+        case EXPR_TYPE::BIN_MINUS:
+            generate_binary(X64OP::SUB, expr.expressions->front(), expr.expressions->back());
+            break;
+        case EXPR_TYPE::BIN_COMPARE:
+        case EXPR_TYPE::BIN_NEGATEEQUALS:
+            generate_binary(X64OP::CMP, expr.expressions->front(), expr.expressions->back());
+            emitter.setcc(expr.type == EXPR_TYPE::BIN_COMPARE ? X64COND::E : X64COND::NE, X64REG::RAX);
+            break;
+        case EXPR_TYPE::BIN_AND:
+        case EXPR_TYPE::BIN_OR:
+        case EXPR_TYPE::TERNARY:
+        {
+            unsigned is_false = emitter.newlabel(), done = emitter.newlabel();
+            generate_branch(expr.type == EXPR_TYPE::TERNARY ? expr.expressions->at(0) : expr, false, is_false);
+            if (expr.type == EXPR_TYPE::TERNARY)
+                generate_expr(expr.expressions->at(1));
+            else
+                emitter.mov_imm(X64REG::RAX, 1);
+            emitter.jmp(done);
+            emitter.bind(is_false);
+            if (expr.type == EXPR_TYPE::TERNARY)
+                generate_expr(expr.expressions->at(2));
+            else
+                emitter.mov_imm(X64REG::RAX, 0);
+            emitter.bind(done);
+            break;
+        }
+        case EXPR_TYPE::BIN_COMMA:
+            generate_expr(expr.expressions->front());
+            generate_expr(expr.expressions->back());
+            break;
+        case EXPR_TYPE::UNARY_MINUS:
+            generate_expr(expr.expressions->front());
+            emitter.neg(X64REG::RAX);
+            break;
+        case EXPR_TYPE::UNARY_NEGATE:
+            generate_expr(expr.expressions->front());
+            emitter.test(X64REG::RAX);
+            emitter.setcc(X64COND::E, X64REG::RAX);
+            break;
+        case EXPR_TYPE::UNARY_PREINCR:
+        case EXPR_TYPE::UNARY_PREDECR:
+        case EXPR_TYPE::UNARY_POSTINCR:
+        case EXPR_TYPE::UNARY_POSTDECR:
+        {
+            bool postfix = expr.type == EXPR_TYPE::UNARY_POSTINCR || expr.type == EXPR_TYPE::UNARY_POSTDECR;
+            std::int32_t delta = expr.type == EXPR_TYPE::UNARY_PREINCR || expr.type == EXPR_TYPE::UNARY_POSTINCR ? 1 : -1;
+            const Expression& operand = expr.expressions->front();
+            if (islocal(operand))
+            {
+                if (postfix)
+                    emitter.alu_local(X64OP::MOV, X64REG::RAX, operand.binding.index);
+                emitter.alu_local_imm(X64OP::ADD, operand.binding.index, delta);
+                if (!postfix)
+                    emitter.alu_local(X64OP::MOV, X64REG::RAX, operand.binding.index);
+            }
+            else
+            {
+                generate_address(operand);
+                emitter.shl(X64REG::RAX, 3);
+                emitter.alu(X64OP::MOV, X64REG::RCX, X64REG::RAX);
+                emitter.load(X64REG::RAX, X64REG::RCX);
+                if (postfix)
+                {
+                    emitter.alu(X64OP::MOV, X64REG::RDX, X64REG::RAX);
+                    emitter.alu_imm(X64OP::ADD, X64REG::RDX, delta);
+                    emitter.store(X64REG::RCX, X64REG::RDX);
+                }
+                else
+                {
+                    emitter.alu_imm(X64OP::ADD, X64REG::RAX, delta);
+                    emitter.store(X64REG::RCX, X64REG::RAX);
+                }
+            }
+            break;
+        }
+        case EXPR_TYPE::NONE:
+            emitter.mov_imm(X64REG::RAX, 0);
+            break;
+    }
+}
+
+// rax = B address of the lvalue expr
+void X64Codegen::generate_address(const Expression& expr)
+{
+    switch (expr.type)
+    {
+        case EXPR_TYPE::IDENTIFIER:
+            if (!islocal(expr))
+                throw std::logic_error("Address of '" + *expr.str_val + "' which isn't a variable");
+            emitter.lea_local(X64REG::RAX, expr.binding.index);
+            emitter.shr(X64REG::RAX, 3);
+            break;
+        case EXPR_TYPE::UNARY_STAR:
+            generate_expr(expr.expressions->front());
+            break;
+        case EXPR_TYPE::INDEXING:
+            generate_binary(X64OP::ADD, expr.expressions->front(), expr.expressions->back());
+            break;
+        case EXPR_TYPE::PARENTHESIS:
+            generate_address(expr.expressions->front());
+            break;
+        default:
+            throw std::logic_error("Expression is not an lvalue");
+    }
+}
+
+/* Arguments are evaluated left to right and pushed, then the first six are
+ * loaded into registers and the rest pushed again in reverse, so that the
+ * seventh argument ends up on top. The last argument of a direct call with
+ * at most six goes straight to its register. Calls of anything but a
+ * builtin leave the argument area free above the stack arguments, the
+ * pushed arguments count towards it as the callee doesn't read them.
+ * Padding keeps rsp 16 byte aligned at the call. rax is zeroed for
+ * variadic callees (printf). */
+void X64Codegen::generate_call(const Expression& expr)
+{
+    const Expression& callee = expr.expressions->front();
+    unsigned argc = expr.expressions->size() - 1;
+    unsigned stack_args = argc > 6 ? argc - 6 : 0;
+    bool direct = callee.type == EXPR_TYPE::IDENTIFIER &&
+                  (callee.binding.type == IDTYPE::FUNCTION || callee.binding.type == IDTYPE::BUILTIN);
+    bool last_in_register = direct && argc > 0 && argc <= 6;
+    unsigned pushed_args = last_in_register ? argc - 1 : argc;
+    bool builtin = direct && callee.binding.type == IDTYPE::BUILTIN;
+    unsigned area = builtin || reserved <= pushed_args + stack_args ? 0 : reserved - pushed_args - stack_args;
+
+    unsigned padding = (depth + area + pushed_args + stack_args) % 2;
+    if (area + padding)
+    {
+        emitter.alu_imm(X64OP::SUB, X64REG::RSP, 8 * (area + padding));
+        depth += area + padding;
+    }
+    for (unsigned arg = 0; arg < argc; ++arg)
+    {
+        generate_expr(expr.expressions->at(arg + 1));
+        if (arg < pushed_args)
+            push(X64REG::RAX);
+        else
+            emitter.alu(X64OP::MOV, x64_argument_registers[arg], X64REG::RAX);
+    }
+    if (!direct)
+    {
+        generate_expr(callee);
+        emitter.alu(X64OP::MOV, X64REG::R11, X64REG::RAX);
+    }
+
+    for (unsigned pushed = 0; pushed < stack_args; ++pushed)
+    {
+        emitter.push_stack(16 * pushed);
+        depth++;
+    }
+    for (unsigned arg = 0; arg < pushed_args && arg < 6; ++arg)
+        emitter.load_stack(x64_argument_registers[arg], 8 * (stack_args + pushed_args - 1 - arg));
+
+    emitter.mov_imm(X64REG::RAX, 0);
+    if (!direct)
+        emitter.call_value(X64REG::R11);
+    else if (!builtin)
+        emitter.call_function(callee.binding.index);
+    else
+        emitter.call_builtin(callee.binding.index);
+
+    unsigned words = pushed_args + stack_args + area + padding;
+    if (words)
+        emitter.alu_imm(X64OP::ADD, X64REG::RSP, 8 * words);
+    depth -= words;
+}
+
+/* Passes the arguments in registers and over our own stack arguments, drops
+ * the frame and jumps to the callee, which returns straight to our caller.
+ * Our parameters were copied into the frame in the prologue, so the stack
+ * arguments are free to overwrite. False if there are more of them than
+ * the argument area has room for. */
+bool X64Codegen::generate_tail_call(const Expression& expr)
+{
+    const Expression& callee = expr.expressions->front();
+    unsigned argc = expr.expressions->size() - 1;
+    unsigned stack_args = argc > 6 ? argc - 6 : 0;
+    if (stack_args > reserved)
+        return false;
+    bool direct = callee.type == EXPR_TYPE::IDENTIFIER && callee.binding.type == IDTYPE::FUNCTION;
+    unsigned pushed_args = direct && argc > 0 && argc <= 6 ? argc - 1 : argc;
+
+    for (unsigned arg = 0; arg < argc; ++arg)
+    {
+        generate_expr(expr.expressions->at(arg + 1));
+        if (arg < pushed_args)
+            push(X64REG::RAX);
+        else
+            emitter.alu(X64OP::MOV, x64_argument_registers[arg], X64REG::RAX);
+    }
+    if (!direct)
+    {
+        generate_expr(callee);
+        emitter.alu(X64OP::MOV, X64REG::R11, X64REG::RAX);
+    }
+
+    for (unsigned arg = 6; arg < argc; ++arg)
+    {
+        emitter.load_stack(X64REG::RAX, 8 * (argc - 1 - arg));
+        emitter.store_param(arg - 6, X64REG::RAX);
+    }
+    if (stack_args)
+    {
+        emitter.alu_imm(X64OP::ADD, X64REG::RSP, 8 * stack_args);
+        depth -= stack_args;
+    }
+    for (unsigned arg = std::min(pushed_args, 6u); arg-- > 0; )
+        pop(x64_argument_registers[arg]);
+
+    emitter.mov_imm(X64REG::RAX, 0);
+    emitter.leave();
+    if (direct)
+        emitter.jump_function(callee.binding.index);
+    else
+        emitter.jump_value(X64REG::R11);
+    return true;
+}
+
+// jumps to label if the truth value of cond is when, falls through otherwise
+void X64Codegen::generate_branch(const Expression& cond, bool when, unsigned label)
+{
+    switch (cond.type)
+    {
+        case EXPR_TYPE::PARENTHESIS:
+            generate_branch(cond.expressions->front(), when, label);
+            return;
+        case EXPR_TYPE::UNARY_NEGATE:
+            generate_branch(cond.expressions->front(), !when, label);
+            return;
+        case EXPR_TYPE::INT_LITERAL:
+            if ((*cond.int_val != 0) == when)
+                emitter.jmp(label);
+            return;
+        case EXPR_TYPE::BIN_COMPARE:
+        case EXPR_TYPE::BIN_NEGATEEQUALS:
+        {
+            const Expression* lhs = &cond.expressions->front();
+            const Expression* rhs = &cond.expressions->back();
+            if (lhs->type == EXPR_TYPE::INT_LITERAL && rhs->type != EXPR_TYPE::INT_LITERAL)
+                std::swap(lhs, rhs);
+            generate_binary(X64OP::CMP, *lhs, *rhs);
+            emitter.jcc((cond.type == EXPR_TYPE::BIN_COMPARE) == when ? X64COND::E : X64COND::NE, label);
+            return;
+        }
+        case EXPR_TYPE::BIN_AND:
+        case EXPR_TYPE::BIN_OR:
+        {
+            bool shortcut = cond.type == EXPR_TYPE::BIN_OR;
+            if (when == shortcut)
+            {
+                generate_branch(cond.expressions->front(), when, label);
+                generate_branch(cond.expressions->back(), when, label);
+            }
+            else
+            {
+                unsigned skip = emitter.newlabel();
+                generate_branch(cond.expressions->front(), shortcut, skip);
+                generate_branch(cond.expressions->back(), when, label);
+                emitter.bind(skip);
+            }
+            return;
+        }
+        default:
+            generate_expr(cond);
+            emitter.test(X64REG::RAX);
+            emitter.jcc(when ? X64COND::NE : X64COND::E, label);
+            return;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef H_X64CODEGEN
+#define H_X64CODEGEN
+
+#include "x64emitter.h"
+#include "bytecode.h"
+#include "expression.h"
+#include "statement.h"
+#include "function.h"
+#include "library.h"
+#include "tailcalls.h"
+
+/* Generates x86-64 code for an analysed library, System V calling
+ * convention. Expressions are evaluated into rax, intermediate values are
+ * pushed on the machine stack. Every local lives in a frame slot so that
+ * its address can be taken; frames are zeroed in the prologue. B addresses
+ * are machine addresses shifted right by 3; the emitter decides how function
+ * values are represented. */
+class X64Codegen
+{
+    X64Emitter& emitter;
+    Program data;           // only its string literals are used
+    unsigned depth;         // words pushed since the prologue, for call alignment
+    unsigned return_label;
+    bool tail_calls;        // allowed in the function being generated, see TailCalls
+    unsigned reserved;      // stack arguments every call leaves room for, see argument_area()
+
+    void push(X64REG reg) {emitter.push(reg); depth++;}
+    void pop(X64REG reg) {emitter.pop(reg); depth--;}
+
+    void generate_function(Function& function, unsigned index);
+    void generate_statement(const Statement& stmt);
+    void generate_expr(const Expression& expr);
+    void generate_address(const Expression& expr);
+    void generate_call(const Expression& expr);
+    bool generate_tail_call(const Expression& expr);
+    void generate_binary(X64OP op, const Expression& lhs, const Expression& rhs);
+    void generate_branch(const Expression& cond, bool when, unsigned label);
+
+    static unsigned tail_call_stack_args(const Statement& stmt);
+    static bool islocal(const Expression& expr);
+    static bool issimple(const Expression& expr);
+    void apply(X64OP op, const Expression& simple);
+
+    X64Codegen(X64Emitter& _emitter, unsigned _reserved)
+        : emitter(_emitter), depth(0), return_label(0), tail_calls(false), reserved(_reserved) {}
+
+public:
+    /* The most arguments any tail call in library passes on the stack, at
+     * most as many as an X64Function takes. A tail call writes them over
+     * the stack arguments of its own caller, so every call reserves at
+     * least this many words for them; tail calls passing more are made as
+     * ordinary calls. */
+    static unsigned argument_area(Library& library);
+
+    static void generate(Library& library, X64Emitter& emitter);
+    // code for a single function, string literals at their offsets in the
+    // statics of program, which must already contain all of them; the
+    // argument area must be that of the whole library
+    static void generate(Library& library, X64Emitter& emitter, unsigned function, const Program& program,
+                         unsigned argument_area);
+};
+
+#endif // H_X64CODEGEN
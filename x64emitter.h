@@ -0,0 +1,82 @@
+#ifndef H_X64EMITTER
+#define H_X64EMITTER
+
+#include <cstdint>
+#include <vector>
+
+#include "memory.h"
+
+enum class X64REG {RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+                   R8 = 8, R9 = 9, R10 = 10, R11 = 11};
+
+enum class X64OP {ADD, SUB, CMP, MOV};
+
+enum class X64COND {E, NE};
+
+const X64REG x64_argument_registers[] = {X64REG::RDI, X64REG::RSI, X64REG::RDX, X64REG::RCX, X64REG::R8, X64REG::R9};
+
+/* How code outside X64Codegen enters generated functions, whatever their
+ * parameters: the unused arguments are zero, and the stack ones leave room
+ * for those of tail calls made further in (see X64Codegen::argument_area). */
+typedef Word (*X64Function)(Word, Word, Word, Word, Word, Word, Word, Word,
+                            Word, Word, Word, Word, Word, Word, Word, Word);
+const unsigned x64_entry_params = 16;
+
+/* The x86-64 instructions X64Codegen needs, so the same code generator can
+ * write assembler source or encode machine code directly. Frame slots are
+ * the words below rbp: slot n is at [rbp - 8 * (n + 1)]. Functions and
+ * builtins are referred to by their index in the library and in builtins.h,
+ * string literals by their offset into the statics. */
+class X64Emitter
+{
+    unsigned labels;
+
+public:
+    X64Emitter() : labels(0) {}
+    virtual ~X64Emitter() {}
+
+    unsigned newlabel() {return labels++;}
+    virtual void bind(unsigned label) = 0;
+
+    virtual void begin_function(unsigned index) = 0;
+    virtual void end_function(unsigned index) = 0;
+    // called once after the last function with the words string literals point into
+    virtual void finish(const std::vector<Word>& statics) = 0;
+
+    virtual void push(X64REG reg) = 0;
+    virtual void pop(X64REG reg) = 0;
+    virtual void mov_imm(X64REG reg, Word value) = 0;
+    virtual void alu(X64OP op, X64REG dst, X64REG src) = 0;                 // op dst, src
+    virtual void alu_imm(X64OP op, X64REG dst, std::int32_t value) = 0;     // op dst, value
+    virtual void alu_local(X64OP op, X64REG dst, unsigned slot) = 0;        // op dst, [slot]
+    virtual void alu_to_local(X64OP op, unsigned slot, X64REG src) = 0;     // op [slot], src
+    virtual void alu_local_imm(X64OP op, unsigned slot, std::int32_t value) = 0;
+    virtual void lea_local(X64REG dst, unsigned slot) = 0;
+    virtual void load_param(X64REG dst, unsigned index) = 0;    // index-th parameter passed on the stack
+    virtual void store_param(unsigned index, X64REG src) = 0;   // over it, for a tail call
+    virtual void load(X64REG dst, X64REG base) = 0;             // mov dst, [base]
+    virtual void store(X64REG base, X64REG src) = 0;            // mov [base], src
+    virtual void load_stack(X64REG dst, std::int32_t offset) = 0;   // mov dst, [rsp + offset]
+    virtual void push_stack(std::int32_t offset) = 0;               // push [rsp + offset]
+    virtual void shl(X64REG reg, unsigned bits) = 0;
+    virtual void shr(X64REG reg, unsigned bits) = 0;
+    virtual void neg(X64REG reg) = 0;
+    virtual void test(X64REG reg) = 0;
+    virtual void setcc(X64COND cond, X64REG reg) = 0;           // reg = cond ? 1 : 0, reg is RAX, RCX or RDX
+    virtual void jmp(unsigned label) = 0;
+    virtual void jcc(X64COND cond, unsigned label) = 0;
+    virtual void call_function(unsigned index) = 0;
+    virtual void call_builtin(unsigned index) = 0;
+    virtual void jump_function(unsigned index) = 0;     // tail call, the function returns to our caller
+    // B values of functions and builtins, and calls through such a value;
+    // how they are represented is up to the emitter
+    virtual void function_value(X64REG dst, unsigned index) = 0;
+    virtual void builtin_value(X64REG dst, unsigned index) = 0;
+    virtual void call_value(X64REG reg) = 0;
+    virtual void jump_value(X64REG reg) = 0;
+    virtual void lea_string(X64REG dst, Word offset) = 0;
+    virtual void leave() = 0;
+    virtual void ret() = 0;
+};
+
+#endif // H_X64EMITTER